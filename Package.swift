@@ -424,15 +424,24 @@ let package = Package(
         "connections/implementation/p2p_cluster_pcp_handler_test.cc",
         "connections/implementation/p2p_point_to_point_pcp_handler_test.cc",
         "connections/implementation/base_pcp_handler_test.cc",
+        "connections/implementation/discovered_endpoint_registry_test.cc",
         "connections/implementation/injected_bluetooth_device_store_test.cc",
         "connections/implementation/internal_payload_factory_test.cc",
         "connections/implementation/client_proxy_test.cc",
         "connections/implementation/payload_manager_test.cc",
         "connections/implementation/offline_frames_validator_test.cc",
         "connections/implementation/service_controller_router_test.cc",
+        "connections/implementation/session_resumption_test.cc",
+        "connections/implementation/stream_memory_budget_test.cc",
+        "connections/implementation/ukey2_handshake_pool_test.cc",
+        "connections/implementation/offline_simulation_benchmark.cc",
+        "connections/implementation/linux_wifi_lan_benchmark.cc",
         "connections/implementation/wifi_direct_bwu_test.cc",
         "connections/implementation/wifi_hotspot_test.cc",
         "connections/implementation/analytics/analytics_recorder_test.cc",
+        "connections/implementation/analytics/connection_setup_tracer_test.cc",
+        "connections/implementation/analytics/medium_performance_model_test.cc",
+        "connections/implementation/analytics/payload_pipeline_profiler_test.cc",
         "connections/implementation/analytics/throughput_recorder_test.cc",
         "connections/implementation/mediums/ble_v2_test.cc",
         "connections/implementation/mediums/ble_v2/bloom_filter_test.cc",
@@ -552,6 +561,7 @@ let package = Package(
         "internal/weave/message_write_request_test.cc",
         "internal/weave/packet_test.cc",
         "internal/weave/packet_sequence_number_generator_test.cc",
+        "internal/weave/packetizer_benchmark.cc",
         "internal/weave/packetizer_test.cc",
         "internal/weave/sockets/client_socket_test.cc",
         "internal/weave/sockets/server_socket_test.cc",
@@ -1740,6 +1740,7 @@ class ConnectionResponseFrame final :
     kMultiplexSocketBitmaskFieldNumber = 5,
     kNearbyConnectionsVersionFieldNumber = 6,
     kSafeToDisconnectVersionFieldNumber = 7,
+    kSupportsSessionResumptionFieldNumber = 8,
   };
   // optional bytes handshake_data = 2;
   bool has_handshake_data() const;
@@ -1842,6 +1843,19 @@ class ConnectionResponseFrame final :
   void _internal_set_safe_to_disconnect_version(int32_t value);
   public:
 
+  // optional bool supports_session_resumption = 8;
+  bool has_supports_session_resumption() const;
+  private:
+  bool _internal_has_supports_session_resumption() const;
+  public:
+  void clear_supports_session_resumption();
+  bool supports_session_resumption() const;
+  void set_supports_session_resumption(bool value);
+  private:
+  bool _internal_supports_session_resumption() const;
+  void _internal_set_supports_session_resumption(bool value);
+  public:
+
   // @@protoc_insertion_point(class_scope:location.nearby.connections.ConnectionResponseFrame)
  private:
   class _Internal;
@@ -1858,6 +1872,7 @@ class ConnectionResponseFrame final :
   int32_t multiplex_socket_bitmask_;
   int32_t nearby_connections_version_;
   int32_t safe_to_disconnect_version_;
+  bool supports_session_resumption_;
   friend struct ::TableStruct_connections_2fimplementation_2fproto_2foffline_5fwire_5fformats_2eproto;
 };
 // -------------------------------------------------------------------
@@ -10246,6 +10261,34 @@ inline void ConnectionResponseFrame::set_safe_to_disconnect_version(int32_t valu
   // @@protoc_insertion_point(field_set:location.nearby.connections.ConnectionResponseFrame.safe_to_disconnect_version)
 }
 
+// optional bool supports_session_resumption = 8;
+inline bool ConnectionResponseFrame::_internal_has_supports_session_resumption() const {
+  bool value = (_has_bits_[0] & 0x00000080u) != 0;
+  return value;
+}
+inline bool ConnectionResponseFrame::has_supports_session_resumption() const {
+  return _internal_has_supports_session_resumption();
+}
+inline void ConnectionResponseFrame::clear_supports_session_resumption() {
+  supports_session_resumption_ = false;
+  _has_bits_[0] &= ~0x00000080u;
+}
+inline bool ConnectionResponseFrame::_internal_supports_session_resumption() const {
+  return supports_session_resumption_;
+}
+inline bool ConnectionResponseFrame::supports_session_resumption() const {
+  // @@protoc_insertion_point(field_get:location.nearby.connections.ConnectionResponseFrame.supports_session_resumption)
+  return _internal_supports_session_resumption();
+}
+inline void ConnectionResponseFrame::_internal_set_supports_session_resumption(bool value) {
+  _has_bits_[0] |= 0x00000080u;
+  supports_session_resumption_ = value;
+}
+inline void ConnectionResponseFrame::set_supports_session_resumption(bool value) {
+  _internal_set_supports_session_resumption(value);
+  // @@protoc_insertion_point(field_set:location.nearby.connections.ConnectionResponseFrame.supports_session_resumption)
+}
+
 // -------------------------------------------------------------------
 
 // PayloadTransferFrame_PayloadHeader
@@ -52,6 +52,14 @@ struct ConnectionOptions : public OptionsBase {
   int keep_alive_interval_millis = 0;
   int keep_alive_timeout_millis = 0;
 
+  // When true, RequestConnection() races the remote endpoint's discovered
+  // mediums instead of trying them one at a time: the preferred medium is
+  // tried first, and every connection_race_stagger_millis (or as soon as the
+  // running attempts have all failed) the next medium joins in. The first
+  // medium to connect wins and the other attempts are cancelled.
+  bool race_connection_mediums = false;
+  int connection_race_stagger_millis = 300;
+
   std::vector<Medium> GetMediums() const;
   ConnectionInfo connection_info;
 };
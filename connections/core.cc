@@ -14,6 +14,7 @@
 
 #include "connections/core.h"
 
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
@@ -26,6 +27,7 @@
 #include "connections/discovery_options.h"
 #include "connections/implementation/service_controller_router.h"
 #include "connections/implementation/service_id_constants.h"
+#include "connections/implementation/stream_memory_budget.h"
 #include "connections/listeners.h"
 #include "connections/medium_selector.h"
 #include "connections/out_of_band_connection_metadata.h"
@@ -197,6 +199,29 @@ void Core::SetCustomSavePath(absl::string_view path, ResultCallback callback) {
 
 std::string Core::Dump() { return client_.Dump(); }
 
+std::vector<analytics::PayloadPipelineProfile>
+Core::GetPayloadPipelineProfiles() {
+  return analytics::PayloadPipelineProfiler::GetInstance().GetProfiles();
+}
+
+analytics::ConnectionSetupLatencies Core::GetConnectionSetupLatencies() {
+  return analytics::ConnectionSetupTracer::GetInstance().GetLatencies();
+}
+
+void Core::AddConnectionSetupTraceSink(
+    std::shared_ptr<analytics::ConnectionSetupTraceSink> sink) {
+  analytics::ConnectionSetupTracer::GetInstance().AddSink(std::move(sink));
+}
+
+void Core::RemoveConnectionSetupTraceSink(
+    const analytics::ConnectionSetupTraceSink* sink) {
+  analytics::ConnectionSetupTracer::GetInstance().RemoveSink(sink);
+}
+
+StreamMemoryBudget::Stats Core::GetIncomingStreamStats() {
+  return StreamMemoryBudget::GetInstance().GetStats();
+}
+
 // V3
 void Core::StartAdvertisingV3(absl::string_view service_id,
                               const v3::AdvertisingOptions& advertising_options,
@@ -18,13 +18,17 @@
 #include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "absl/strings/string_view.h"
 #include "absl/types/span.h"
 #include "connections/connection_options.h"
+#include "connections/implementation/analytics/connection_setup_tracer.h"
+#include "connections/implementation/analytics/payload_pipeline_profiler.h"
 #include "connections/implementation/client_proxy.h"
 #include "connections/implementation/service_controller.h"
 #include "connections/implementation/service_controller_router.h"
+#include "connections/implementation/stream_memory_budget.h"
 #include "connections/listeners.h"
 #include "connections/params.h"
 #include "connections/payload.h"
@@ -254,6 +258,25 @@ class Core {
 
   std::string Dump();
 
+  // Gets a snapshot of the payload pipeline profiler: per-endpoint, per-medium
+  // stage latencies, utilization and throughput of payload transfers.
+  std::vector<analytics::PayloadPipelineProfile> GetPayloadPipelineProfiles();
+
+  // Gets the latency histograms of every connection setup phase, including the
+  // bandwidth upgrade that follows it, across all traced connection attempts.
+  analytics::ConnectionSetupLatencies GetConnectionSetupLatencies();
+
+  // Registers a sink that receives the trace of every connection attempt once
+  // it completes. Sinks are called on internal threads and must not block.
+  void AddConnectionSetupTraceSink(
+      std::shared_ptr<analytics::ConnectionSetupTraceSink> sink);
+  void RemoveConnectionSetupTraceSink(
+      const analytics::ConnectionSetupTraceSink* sink);
+
+  // Gets how much of incoming stream payloads is buffered, waiting for the
+  // clients to read it, and how often receiving had to wait for them.
+  StreamMemoryBudget::Stats GetIncomingStreamStats();
+
   //******************************* V3 *******************************
   // NOTE: Do NOT mix with the V1 APIs above, this might result in undefined
   // behavior!
@@ -13,6 +13,7 @@
 // limitations under the License.
 #ifndef CORE_DISCOVERY_OPTIONS_H_
 #define CORE_DISCOVERY_OPTIONS_H_
+#include <functional>
 #include <string>
 
 #include "connections/medium_selector.h"
@@ -45,6 +46,16 @@ struct DiscoveryOptions : OptionsBase {
 
   // If true, only low power mediums (like BLE) will be used for discovery.
   bool low_power = false;
+
+  // If positive, found and lost endpoints are reported in batches, at most
+  // once per this many milliseconds; see
+  // DiscoveryListener::endpoints_changed_cb. An endpoint that is found and
+  // lost again within one batch is not reported at all.
+  int batch_interval_millis = 0;
+
+  // If set, only endpoints whose endpoint_info it returns true for are
+  // reported as found. It runs on an internal thread, and must be cheap.
+  std::function<bool(const ByteArray& endpoint_info)> endpoint_info_filter;
 };
 
 }  // namespace connections
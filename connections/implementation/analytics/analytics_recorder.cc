@@ -27,6 +27,8 @@
 #include "absl/container/btree_map.h"
 #include "absl/strings/string_view.h"
 #include "absl/time/time.h"
+#include "connections/implementation/analytics/connection_setup_tracer.h"
+#include "connections/implementation/analytics/medium_performance_model.h"
 #include "internal/analytics/event_logger.h"
 #include "internal/platform/count_down_latch.h"
 #include "internal/platform/error_code_params.h"
@@ -43,6 +45,28 @@ namespace analytics {
 namespace {
 const char kVersion[] = "v1.0.0";
 constexpr absl::string_view kOnStartClientSession = "OnStartClientSession";
+
+// Feeds connection attempt results to the model used for picking upgrade
+// mediums. Cancelled attempts say nothing about the medium and are skipped.
+void UpdateMediumPerformanceModel(
+    location::nearby::proto::connections::Medium medium,
+    location::nearby::proto::connections::ConnectionAttemptResult result,
+    absl::Duration duration,
+    const ConnectionAttemptMetadataParams *connection_attempt_metadata_params) {
+  if (result != location::nearby::proto::connections::RESULT_SUCCESS &&
+      result != location::nearby::proto::connections::RESULT_ERROR) {
+    return;
+  }
+  ConnectionAttemptMetadataParams default_params = {};
+  if (connection_attempt_metadata_params == nullptr) {
+    connection_attempt_metadata_params = &default_params;
+  }
+  MediumPerformanceModel::GetInstance().OnConnectionAttempt(
+      medium, connection_attempt_metadata_params->band,
+      connection_attempt_metadata_params->frequency,
+      result == location::nearby::proto::connections::RESULT_SUCCESS,
+      duration);
+}
 }  // namespace
 
 using ::location::nearby::analytics::proto::ConnectionsLog;
@@ -96,8 +120,9 @@ using ::location::nearby::proto::connections::UPGRADE_UNFINISHED;
 using ::location::nearby::proto::connections::UPGRADED;
 using ::nearby::analytics::EventLogger;
 
-AnalyticsRecorder::AnalyticsRecorder(EventLogger *event_logger)
-    : event_logger_(event_logger) {
+AnalyticsRecorder::AnalyticsRecorder(EventLogger *event_logger,
+                                     std::int64_t client_id)
+    : event_logger_(event_logger), client_id_(client_id) {
   NEARBY_LOGS(INFO) << "Start AnalyticsRecorder ctor event_logger_="
                     << event_logger_;
   LogStartSession();
@@ -335,6 +360,8 @@ void AnalyticsRecorder::OnIncomingConnectionAttempt(
     ConnectionAttemptType type, Medium medium, ConnectionAttemptResult result,
     absl::Duration duration, const std::string &connection_token,
     ConnectionAttemptMetadataParams *connection_attempt_metadata_params) {
+  UpdateMediumPerformanceModel(medium, result, duration,
+                               connection_attempt_metadata_params);
   MutexLock lock(&mutex_);
   if (!CanRecordAnalyticsLocked("OnIncomingConnectionAttempt")) {
     return;
@@ -390,6 +417,8 @@ void AnalyticsRecorder::OnOutgoingConnectionAttempt(
     Medium medium, ConnectionAttemptResult result, absl::Duration duration,
     const std::string &connection_token,
     ConnectionAttemptMetadataParams *connection_attempt_metadata_params) {
+  UpdateMediumPerformanceModel(medium, result, duration,
+                               connection_attempt_metadata_params);
   MutexLock lock(&mutex_);
   if (!CanRecordAnalyticsLocked("OnOutgoingConnectionAttempt")) {
     return;
@@ -610,6 +639,9 @@ void AnalyticsRecorder::OnOutgoingPayloadDone(const std::string &endpoint_id,
 void AnalyticsRecorder::OnBandwidthUpgradeStarted(
     const std::string &endpoint_id, Medium from_medium, Medium to_medium,
     ConnectionAttemptDirection direction, const std::string &connection_token) {
+  // Setup traces are kept even when analytics logging is off.
+  ConnectionSetupTracer::GetInstance().BeginConnectedPhase(
+      client_id_, endpoint_id, ConnectionSetupPhase::kBwuUpgrade, to_medium);
   MutexLock lock(&mutex_);
   if (!CanRecordAnalyticsLocked("OnBandwidthUpgradeStarted")) {
     return;
@@ -629,6 +661,9 @@ void AnalyticsRecorder::OnBandwidthUpgradeStarted(
 void AnalyticsRecorder::OnBandwidthUpgradeError(
     const std::string &endpoint_id, BandwidthUpgradeResult result,
     BandwidthUpgradeErrorStage error_stage) {
+  ConnectionSetupTracer::GetInstance().EndConnectedPhase(
+      client_id_, endpoint_id, ConnectionSetupPhase::kBwuUpgrade,
+      /*succeeded=*/false);
   MutexLock lock(&mutex_);
   if (!CanRecordAnalyticsLocked("OnBandwidthUpgradeError")) {
     return;
@@ -638,6 +673,12 @@ void AnalyticsRecorder::OnBandwidthUpgradeError(
 
 void AnalyticsRecorder::OnBandwidthUpgradeSuccess(
     const std::string &endpoint_id) {
+  // The upgrade is the last phase of connection setup.
+  ConnectionSetupTracer &tracer = ConnectionSetupTracer::GetInstance();
+  tracer.EndConnectedPhase(client_id_, endpoint_id,
+                           ConnectionSetupPhase::kBwuUpgrade,
+                           /*succeeded=*/true);
+  tracer.EndTraces(client_id_, endpoint_id);
   MutexLock lock(&mutex_);
   if (!CanRecordAnalyticsLocked("OnBandwidthUpgradeSuccess")) {
     return;
@@ -41,7 +41,10 @@ namespace analytics {
 
 class AnalyticsRecorder {
  public:
-  explicit AnalyticsRecorder(::nearby::analytics::EventLogger *event_logger);
+  // `client_id` ties the connection setup traces of bandwidth upgrades to the
+  // client that owns this recorder.
+  explicit AnalyticsRecorder(::nearby::analytics::EventLogger *event_logger,
+                             std::int64_t client_id = 0);
   virtual ~AnalyticsRecorder();
 
   // TODO(edwinwu): Implement to pass real values for AdvertisingMetadata and
@@ -353,6 +356,7 @@ class AnalyticsRecorder {
   // Not owned by AnalyticsRecorder. Pointer must refer to a valid object
   // that outlives the one constructed.
   ::nearby::analytics::EventLogger *event_logger_;
+  const std::int64_t client_id_;
 
   SingleThreadExecutor serial_executor_;
   // Protects all sub-protos reading and writing in ConnectionLog.
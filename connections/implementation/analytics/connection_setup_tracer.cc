@@ -0,0 +1,419 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "connections/implementation/analytics/connection_setup_tracer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "internal/platform/implementation/system_clock.h"
+
+namespace nearby {
+namespace analytics {
+
+namespace {
+
+using ::location::nearby::proto::connections::Medium;
+
+int PhaseIndex(ConnectionSetupPhase phase) { return static_cast<int>(phase); }
+
+absl::string_view ResultName(ConnectionSetupResult result) {
+  switch (result) {
+    case ConnectionSetupResult::kPending:
+      return "pending";
+    case ConnectionSetupResult::kConnected:
+      return "connected";
+    case ConnectionSetupResult::kFailed:
+      return "failed";
+    case ConnectionSetupResult::kRejected:
+      return "rejected";
+  }
+  return "unknown";
+}
+
+}  // namespace
+
+absl::string_view ConnectionSetupPhaseName(ConnectionSetupPhase phase) {
+  switch (phase) {
+    case ConnectionSetupPhase::kDiscovery:
+      return "discovery";
+    case ConnectionSetupPhase::kMediumConnect:
+      return "medium_connect";
+    case ConnectionSetupPhase::kConnectionRequest:
+      return "connection_request";
+    case ConnectionSetupPhase::kEncryption:
+      return "encryption";
+    case ConnectionSetupPhase::kRegisterEndpoint:
+      return "register_endpoint";
+    case ConnectionSetupPhase::kAcceptance:
+      return "acceptance";
+    case ConnectionSetupPhase::kBwuUpgrade:
+      return "bwu_upgrade";
+    case ConnectionSetupPhase::kBwuMediumConnect:
+      return "bwu_medium_connect";
+  }
+  return "unknown";
+}
+
+// ConnectionSetupTrace
+
+std::string ConnectionSetupTrace::ToString() const {
+  std::string out = absl::StrFormat(
+      "%s connection with endpoint %s: %s over %s",
+      is_incoming ? "Incoming" : "Outgoing", endpoint_id, ResultName(result),
+      location::nearby::proto::connections::Medium_Name(medium));
+  if (setup_end_time != absl::InfiniteFuture()) {
+    absl::StrAppendFormat(&out, " after %s",
+                          absl::FormatDuration(setup_end_time - start_time));
+  }
+  for (const ConnectionSetupSpan& span : spans) {
+    std::string outcome =
+        span.IsOpen()
+            ? "running"
+            : absl::StrFormat("%s in %s", span.succeeded ? "done" : "failed",
+                              absl::FormatDuration(span.GetDuration()));
+    absl::StrAppendFormat(
+        &out, "\n  +%s %s [%s] %s",
+        absl::FormatDuration(span.start - start_time),
+        ConnectionSetupPhaseName(span.phase),
+        location::nearby::proto::connections::Medium_Name(span.medium),
+        outcome);
+  }
+  return out;
+}
+
+// ConnectionSetupTracer
+
+ConnectionSetupTracer& ConnectionSetupTracer::GetInstance() {
+  static std::aligned_storage_t<sizeof(ConnectionSetupTracer),
+                                alignof(ConnectionSetupTracer)>
+      storage;
+  static ConnectionSetupTracer* instance =
+      new (&storage) ConnectionSetupTracer();
+  return *instance;
+}
+
+ConnectionSetupTracer::ConnectionSetupTracer()
+    : histograms_(std::make_unique<Histograms>()) {}
+
+void ConnectionSetupTracer::AddSink(
+    std::shared_ptr<ConnectionSetupTraceSink> sink) {
+  absl::MutexLock lock(&mutex_);
+  sinks_.push_back(std::move(sink));
+}
+
+void ConnectionSetupTracer::RemoveSink(const ConnectionSetupTraceSink* sink) {
+  absl::MutexLock lock(&mutex_);
+  sinks_.erase(std::remove_if(sinks_.begin(), sinks_.end(),
+                              [sink](const auto& item) {
+                                return item.get() == sink;
+                              }),
+               sinks_.end());
+}
+
+void ConnectionSetupTracer::OnDiscoveryStarted(int64_t client_id) {
+  absl::MutexLock lock(&mutex_);
+  discovery_start_times_[client_id] = SystemClock::ElapsedRealtime();
+  absl::erase_if(found_endpoints_, [client_id](const auto& item) {
+    return item.first.first == client_id;
+  });
+}
+
+void ConnectionSetupTracer::OnEndpointFound(int64_t client_id,
+                                            const std::string& endpoint_id,
+                                            Medium medium) {
+  absl::MutexLock lock(&mutex_);
+  if (!discovery_start_times_.contains(client_id)) return;
+  FoundEndpointKey key(client_id, endpoint_id);
+  if (!found_endpoints_.contains(key) &&
+      static_cast<int>(found_endpoints_.size()) >= kMaxFoundEndpoints) {
+    return;
+  }
+  auto& found = found_endpoints_[key];
+  for (const auto& [found_medium, unused_time] : found) {
+    if (found_medium == medium) return;
+  }
+  found.emplace_back(medium, SystemClock::ElapsedRealtime());
+}
+
+void ConnectionSetupTracer::StartTrace(const ConnectionSetupKey& key,
+                                       absl::Time start_time) {
+  std::vector<ConnectionSetupTrace> completed;
+  {
+    absl::MutexLock lock(&mutex_);
+    if (open_traces_.contains(key)) {
+      completed.push_back(TakeTraceLocked(key));
+    }
+    if (static_cast<int>(open_traces_.size()) >= kMaxOpenTraces) {
+      auto oldest = std::min_element(
+          open_traces_.begin(), open_traces_.end(),
+          [](const auto& a, const auto& b) {
+            return a.second.start_time < b.second.start_time;
+          });
+      ConnectionSetupKey oldest_key = oldest->first;
+      completed.push_back(TakeTraceLocked(oldest_key));
+    }
+
+    ConnectionSetupTrace& trace = open_traces_[key];
+    trace.client_id = key.client_id;
+    trace.endpoint_id = key.endpoint_id;
+    trace.is_incoming = key.is_incoming;
+    trace.start_time = start_time;
+
+    auto found =
+        found_endpoints_.find(FoundEndpointKey(key.client_id, key.endpoint_id));
+    if (!key.is_incoming && found != found_endpoints_.end()) {
+      absl::Time discovery_start_time = discovery_start_times_[key.client_id];
+      for (const auto& [medium, found_time] : found->second) {
+        ConnectionSetupSpan span{.phase = ConnectionSetupPhase::kDiscovery,
+                                 .medium = medium,
+                                 .start = discovery_start_time};
+        EndSpanLocked(span, found_time, /*succeeded=*/true);
+        trace.spans.push_back(span);
+      }
+    }
+  }
+  Export(completed);
+}
+
+void ConnectionSetupTracer::BeginPhase(const ConnectionSetupKey& key,
+                                       ConnectionSetupPhase phase,
+                                       Medium medium) {
+  absl::MutexLock lock(&mutex_);
+  auto it = open_traces_.find(key);
+  if (it == open_traces_.end()) return;
+  it->second.spans.push_back({.phase = phase,
+                              .medium = medium,
+                              .start = SystemClock::ElapsedRealtime()});
+}
+
+void ConnectionSetupTracer::EndPhase(const ConnectionSetupKey& key,
+                                     ConnectionSetupPhase phase,
+                                     bool succeeded, Medium medium) {
+  absl::MutexLock lock(&mutex_);
+  auto it = open_traces_.find(key);
+  if (it == open_traces_.end()) return;
+  EndPhaseLocked(it->second, phase, succeeded, medium);
+}
+
+void ConnectionSetupTracer::RecordPhase(const ConnectionSetupKey& key,
+                                        ConnectionSetupPhase phase,
+                                        Medium medium, absl::Time start,
+                                        bool succeeded) {
+  absl::MutexLock lock(&mutex_);
+  auto it = open_traces_.find(key);
+  if (it == open_traces_.end()) return;
+  ConnectionSetupSpan span{.phase = phase, .medium = medium, .start = start};
+  EndSpanLocked(span, SystemClock::ElapsedRealtime(), succeeded);
+  it->second.spans.push_back(span);
+}
+
+void ConnectionSetupTracer::OnSetupFinished(const ConnectionSetupKey& key,
+                                            ConnectionSetupResult result,
+                                            Medium medium) {
+  std::vector<ConnectionSetupTrace> completed;
+  {
+    absl::MutexLock lock(&mutex_);
+    auto it = open_traces_.find(key);
+    if (it == open_traces_.end() ||
+        it->second.result != ConnectionSetupResult::kPending) {
+      return;
+    }
+    ConnectionSetupTrace& trace = it->second;
+    trace.result = result;
+    trace.setup_end_time = SystemClock::ElapsedRealtime();
+    if (medium != Medium::UNKNOWN_MEDIUM) trace.medium = medium;
+
+    switch (result) {
+      case ConnectionSetupResult::kConnected:
+        histograms_->setup_latency.Record(trace.setup_end_time -
+                                          trace.start_time);
+        ++histograms_->connected;
+        return;
+      case ConnectionSetupResult::kRejected:
+        ++histograms_->rejected;
+        break;
+      case ConnectionSetupResult::kPending:
+      case ConnectionSetupResult::kFailed:
+        ++histograms_->failed;
+        break;
+    }
+    completed.push_back(TakeTraceLocked(key));
+  }
+  Export(completed);
+}
+
+void ConnectionSetupTracer::EndTrace(const ConnectionSetupKey& key) {
+  std::vector<ConnectionSetupTrace> completed;
+  {
+    absl::MutexLock lock(&mutex_);
+    if (!open_traces_.contains(key)) return;
+    completed.push_back(TakeTraceLocked(key));
+  }
+  Export(completed);
+}
+
+void ConnectionSetupTracer::BeginConnectedPhase(int64_t client_id,
+                                                const std::string& endpoint_id,
+                                                ConnectionSetupPhase phase,
+                                                Medium medium) {
+  absl::MutexLock lock(&mutex_);
+  ConnectionSetupTrace* trace = FindConnectedTraceLocked(client_id, endpoint_id);
+  if (trace == nullptr) return;
+  trace->spans.push_back({.phase = phase,
+                          .medium = medium,
+                          .start = SystemClock::ElapsedRealtime()});
+}
+
+void ConnectionSetupTracer::EndConnectedPhase(int64_t client_id,
+                                              const std::string& endpoint_id,
+                                              ConnectionSetupPhase phase,
+                                              bool succeeded, Medium medium) {
+  absl::MutexLock lock(&mutex_);
+  ConnectionSetupTrace* trace = FindConnectedTraceLocked(client_id, endpoint_id);
+  if (trace == nullptr) return;
+  EndPhaseLocked(*trace, phase, succeeded, medium);
+}
+
+void ConnectionSetupTracer::EndTraces(int64_t client_id,
+                                      const std::string& endpoint_id) {
+  std::vector<ConnectionSetupTrace> completed;
+  {
+    absl::MutexLock lock(&mutex_);
+    for (bool is_incoming : {false, true}) {
+      ConnectionSetupKey key{.client_id = client_id,
+                             .endpoint_id = endpoint_id,
+                             .is_incoming = is_incoming};
+      if (open_traces_.contains(key)) {
+        completed.push_back(TakeTraceLocked(key));
+      }
+    }
+  }
+  Export(completed);
+}
+
+ConnectionSetupLatencies ConnectionSetupTracer::GetLatencies() const {
+  absl::MutexLock lock(&mutex_);
+  ConnectionSetupLatencies latencies;
+  for (int i = 0; i < kNumConnectionSetupPhases; ++i) {
+    latencies.phase_latency[i] = histograms_->phase_latency[i].GetSnapshot();
+    latencies.failed_phase_latency[i] =
+        histograms_->failed_phase_latency[i].GetSnapshot();
+  }
+  latencies.setup_latency = histograms_->setup_latency.GetSnapshot();
+  latencies.connected = histograms_->connected;
+  latencies.failed = histograms_->failed;
+  latencies.rejected = histograms_->rejected;
+  return latencies;
+}
+
+std::optional<ConnectionSetupTrace> ConnectionSetupTracer::GetOpenTrace(
+    const ConnectionSetupKey& key) const {
+  absl::MutexLock lock(&mutex_);
+  auto it = open_traces_.find(key);
+  if (it == open_traces_.end()) return std::nullopt;
+  return it->second;
+}
+
+void ConnectionSetupTracer::Reset() {
+  absl::MutexLock lock(&mutex_);
+  open_traces_.clear();
+  found_endpoints_.clear();
+  discovery_start_times_.clear();
+  histograms_ = std::make_unique<Histograms>();
+}
+
+ConnectionSetupTrace* ConnectionSetupTracer::FindConnectedTraceLocked(
+    int64_t client_id, const std::string& endpoint_id) {
+  for (bool is_incoming : {false, true}) {
+    auto it = open_traces_.find(ConnectionSetupKey{.client_id = client_id,
+                                                   .endpoint_id = endpoint_id,
+                                                   .is_incoming = is_incoming});
+    if (it != open_traces_.end() &&
+        it->second.result == ConnectionSetupResult::kConnected) {
+      return &it->second;
+    }
+  }
+  return nullptr;
+}
+
+void ConnectionSetupTracer::EndSpanLocked(ConnectionSetupSpan& span,
+                                          absl::Time end, bool succeeded) {
+  span.end = std::max(end, span.start);
+  span.succeeded = succeeded;
+  int phase = PhaseIndex(span.phase);
+  (succeeded ? histograms_->phase_latency[phase]
+             : histograms_->failed_phase_latency[phase])
+      .Record(span.GetDuration());
+}
+
+void ConnectionSetupTracer::EndPhaseLocked(ConnectionSetupTrace& trace,
+                                           ConnectionSetupPhase phase,
+                                           bool succeeded, Medium medium) {
+  for (auto span = trace.spans.rbegin(); span != trace.spans.rend(); ++span) {
+    if (span->phase == phase && span->IsOpen() &&
+        (medium == Medium::UNKNOWN_MEDIUM || span->medium == medium)) {
+      EndSpanLocked(*span, SystemClock::ElapsedRealtime(), succeeded);
+      return;
+    }
+  }
+}
+
+ConnectionSetupTrace ConnectionSetupTracer::TakeTraceLocked(
+    const ConnectionSetupKey& key) {
+  auto node = open_traces_.extract(key);
+  ConnectionSetupTrace trace = std::move(node.mapped());
+  // Spans cut short by the end of the trace don't say how long the phase
+  // takes, so they stay out of the histograms.
+  absl::Time now = SystemClock::ElapsedRealtime();
+  for (ConnectionSetupSpan& span : trace.spans) {
+    if (span.IsOpen()) span.end = std::max(now, span.start);
+  }
+  if (trace.result == ConnectionSetupResult::kPending) {
+    trace.result = ConnectionSetupResult::kFailed;
+    trace.setup_end_time = now;
+    ++histograms_->failed;
+  }
+  return trace;
+}
+
+void ConnectionSetupTracer::Export(
+    const std::vector<ConnectionSetupTrace>& traces) {
+  if (traces.empty()) return;
+  std::vector<std::shared_ptr<ConnectionSetupTraceSink>> sinks;
+  {
+    absl::MutexLock lock(&mutex_);
+    sinks = sinks_;
+  }
+  for (const ConnectionSetupTrace& trace : traces) {
+    for (const auto& sink : sinks) {
+      sink->OnTraceCompleted(trace);
+    }
+  }
+}
+
+}  // namespace analytics
+}  // namespace nearby
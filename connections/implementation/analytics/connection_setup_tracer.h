@@ -0,0 +1,278 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NEARBY_CONNECTIONS_IMPLEMENTATION_ANALYTICS_CONNECTION_SETUP_TRACER_H_
+#define NEARBY_CONNECTIONS_IMPLEMENTATION_ANALYTICS_CONNECTION_SETUP_TRACER_H_
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "connections/implementation/analytics/payload_pipeline_profiler.h"
+#include "proto/connections_enums.pb.h"
+
+namespace nearby {
+namespace analytics {
+
+// The phases of setting up a connection, and of the bandwidth upgrade that
+// follows it.
+enum class ConnectionSetupPhase {
+  // From StartDiscovery() until the endpoint was found on one medium.
+  kDiscovery = 0,
+  // Connecting to the endpoint over one medium (ConnectImpl()).
+  kMediumConnect = 1,
+  // Writing (outgoing) or reading (incoming) the ConnectionRequestFrame.
+  kConnectionRequest = 2,
+  // Securing the channel with UKEY2, or by resuming an earlier session.
+  kEncryption = 3,
+  // EndpointManager::RegisterEndpoint().
+  kRegisterEndpoint = 4,
+  // Waiting for both sides to accept or reject the connection.
+  kAcceptance = 5,
+  // A bandwidth upgrade, from its start until the new medium took over.
+  kBwuUpgrade = 6,
+  // Connecting to the new medium during a bandwidth upgrade.
+  kBwuMediumConnect = 7,
+};
+constexpr int kNumConnectionSetupPhases = 8;
+
+absl::string_view ConnectionSetupPhaseName(ConnectionSetupPhase phase);
+
+// One phase of a connection attempt, on one medium where that applies.
+struct ConnectionSetupSpan {
+  ConnectionSetupPhase phase = ConnectionSetupPhase::kDiscovery;
+  location::nearby::proto::connections::Medium medium =
+      location::nearby::proto::connections::UNKNOWN_MEDIUM;
+  // Monotonic timestamps, from SystemClock::ElapsedRealtime(). `end` is
+  // infinite while the phase is still running.
+  absl::Time start = absl::InfinitePast();
+  absl::Time end = absl::InfiniteFuture();
+  bool succeeded = false;
+
+  bool IsOpen() const { return end == absl::InfiniteFuture(); }
+  absl::Duration GetDuration() const { return end - start; }
+};
+
+enum class ConnectionSetupResult {
+  kPending = 0,
+  kConnected = 1,
+  kFailed = 2,
+  kRejected = 3,
+};
+
+// Identifies one connection attempt. The same endpoint can be connecting to
+// several clients at once, and to one client in both directions.
+struct ConnectionSetupKey {
+  int64_t client_id = 0;
+  std::string endpoint_id;
+  bool is_incoming = false;
+
+  template <typename H>
+  friend H AbslHashValue(H h, const ConnectionSetupKey& key) {
+    return H::combine(std::move(h), key.client_id, key.endpoint_id,
+                      key.is_incoming);
+  }
+  friend bool operator==(const ConnectionSetupKey& a,
+                         const ConnectionSetupKey& b) {
+    return a.client_id == b.client_id && a.endpoint_id == b.endpoint_id &&
+           a.is_incoming == b.is_incoming;
+  }
+};
+
+// The phases one connection attempt went through, in the order they started.
+struct ConnectionSetupTrace {
+  int64_t client_id = 0;
+  std::string endpoint_id;
+  bool is_incoming = false;
+  absl::Time start_time = absl::InfinitePast();
+  // When the connection was accepted, rejected or failed.
+  absl::Time setup_end_time = absl::InfiniteFuture();
+  ConnectionSetupResult result = ConnectionSetupResult::kPending;
+  // The medium the connection was set up over.
+  location::nearby::proto::connections::Medium medium =
+      location::nearby::proto::connections::UNKNOWN_MEDIUM;
+  std::vector<ConnectionSetupSpan> spans;
+
+  // One line per span, with offsets from start_time; meant for logs.
+  std::string ToString() const;
+};
+
+// Receives every completed trace. Implementations must be thread-safe and
+// cheap; they run on whichever thread completed the trace.
+class ConnectionSetupTraceSink {
+ public:
+  virtual ~ConnectionSetupTraceSink() = default;
+
+  virtual void OnTraceCompleted(const ConnectionSetupTrace& trace) = 0;
+};
+
+// Aggregated latencies of every traced connection attempt.
+struct ConnectionSetupLatencies {
+  // Duration of the phases that succeeded and of those that failed, indexed
+  // by ConnectionSetupPhase.
+  std::array<LatencyHistogram::Snapshot, kNumConnectionSetupPhases>
+      phase_latency;
+  std::array<LatencyHistogram::Snapshot, kNumConnectionSetupPhases>
+      failed_phase_latency;
+  // From the start of a trace until the connection was accepted.
+  LatencyHistogram::Snapshot setup_latency;
+  int64_t connected = 0;
+  int64_t failed = 0;
+  int64_t rejected = 0;
+};
+
+// Always-on tracer for connection setup. BasePcpHandler and BwuManager mark
+// the start and end of each phase of a connection attempt, keyed by the
+// client, the remote endpoint id and the direction of the attempt.
+//
+// A trace starts when a connection is requested or an incoming request is
+// read. It is completed when the attempt fails, or, for a connection that was
+// set up, when a bandwidth upgrade finishes or the endpoint disconnects, so
+// the upgrade phases land in the same trace. Completed traces go to the
+// registered sinks; every phase also feeds the latency histograms, which can
+// be read at any time through Core::GetConnectionSetupLatencies().
+class ConnectionSetupTracer {
+ public:
+  using Medium = location::nearby::proto::connections::Medium;
+
+  // Open traces beyond this many are completed early, oldest first.
+  static constexpr int kMaxOpenTraces = 64;
+  // Discovery times are kept for at most this many endpoints.
+  static constexpr int kMaxFoundEndpoints = 256;
+
+  static ConnectionSetupTracer& GetInstance();
+
+  ConnectionSetupTracer();
+  ConnectionSetupTracer(const ConnectionSetupTracer&) = delete;
+  ConnectionSetupTracer& operator=(const ConnectionSetupTracer&) = delete;
+
+  void AddSink(std::shared_ptr<ConnectionSetupTraceSink> sink)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+  void RemoveSink(const ConnectionSetupTraceSink* sink)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Discovery is traced ahead of the attempt: the time each endpoint was first
+  // found on each medium becomes the discovery phase of the client's next
+  // outgoing trace to it. Starting discovery only forgets what that client
+  // found earlier.
+  void OnDiscoveryStarted(int64_t client_id) ABSL_LOCKS_EXCLUDED(mutex_);
+  void OnEndpointFound(int64_t client_id, const std::string& endpoint_id,
+                       Medium medium) ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Starts tracing an attempt that started at `start_time`. An open trace
+  // with the same key is completed first.
+  void StartTrace(const ConnectionSetupKey& key, absl::Time start_time)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+  void BeginPhase(const ConnectionSetupKey& key, ConnectionSetupPhase phase,
+                  Medium medium = Medium::UNKNOWN_MEDIUM)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+  // Ends the latest open span of `phase`; with a known `medium`, only a span
+  // on that medium. Does nothing if there is no such span.
+  void EndPhase(const ConnectionSetupKey& key, ConnectionSetupPhase phase,
+                bool succeeded, Medium medium = Medium::UNKNOWN_MEDIUM)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+  // Records a phase that started at `start` and has just ended.
+  void RecordPhase(const ConnectionSetupKey& key, ConnectionSetupPhase phase,
+                   Medium medium, absl::Time start, bool succeeded)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+  // The connection was accepted, rejected or failed. Anything but kConnected
+  // also completes the trace.
+  void OnSetupFinished(const ConnectionSetupKey& key,
+                       ConnectionSetupResult result,
+                       Medium medium = Medium::UNKNOWN_MEDIUM)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+  // Completes the trace, if one is open. Spans still open are ended as
+  // failed.
+  void EndTrace(const ConnectionSetupKey& key) ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Once connected, the client has at most one connection to the endpoint,
+  // whichever side started it. The bandwidth upgrade and the disconnect don't
+  // know that side, so these act on the client's connected trace to the
+  // endpoint.
+  void BeginConnectedPhase(int64_t client_id, const std::string& endpoint_id,
+                           ConnectionSetupPhase phase,
+                           Medium medium = Medium::UNKNOWN_MEDIUM)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+  void EndConnectedPhase(int64_t client_id, const std::string& endpoint_id,
+                         ConnectionSetupPhase phase, bool succeeded,
+                         Medium medium = Medium::UNKNOWN_MEDIUM)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+  // Completes the client's traces to the endpoint in both directions.
+  void EndTraces(int64_t client_id, const std::string& endpoint_id)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  ConnectionSetupLatencies GetLatencies() const ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Test only.
+  std::optional<ConnectionSetupTrace> GetOpenTrace(
+      const ConnectionSetupKey& key) const ABSL_LOCKS_EXCLUDED(mutex_);
+  void Reset() ABSL_LOCKS_EXCLUDED(mutex_);
+
+ private:
+  struct Histograms {
+    std::array<LatencyHistogram, kNumConnectionSetupPhases> phase_latency;
+    std::array<LatencyHistogram, kNumConnectionSetupPhases>
+        failed_phase_latency;
+    LatencyHistogram setup_latency;
+    int64_t connected = 0;
+    int64_t failed = 0;
+    int64_t rejected = 0;
+  };
+
+  using FoundEndpointKey = std::pair<int64_t, std::string>;
+
+  // Returns the client's connected trace to the endpoint, or nullptr.
+  ConnectionSetupTrace* FindConnectedTraceLocked(int64_t client_id,
+                                                 const std::string& endpoint_id)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void EndSpanLocked(ConnectionSetupSpan& span, absl::Time end, bool succeeded)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Ends the latest open span of `phase` in `trace`.
+  void EndPhaseLocked(ConnectionSetupTrace& trace, ConnectionSetupPhase phase,
+                      bool succeeded, Medium medium)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Removes the trace from the open ones and returns it, ready for the sinks.
+  ConnectionSetupTrace TakeTraceLocked(const ConnectionSetupKey& key)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Hands completed traces to the sinks. Called without the lock held.
+  void Export(const std::vector<ConnectionSetupTrace>& traces)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  mutable absl::Mutex mutex_;
+  std::vector<std::shared_ptr<ConnectionSetupTraceSink>> sinks_
+      ABSL_GUARDED_BY(mutex_);
+  absl::flat_hash_map<ConnectionSetupKey, ConnectionSetupTrace> open_traces_
+      ABSL_GUARDED_BY(mutex_);
+  // When each client last started discovery.
+  absl::flat_hash_map<int64_t, absl::Time> discovery_start_times_
+      ABSL_GUARDED_BY(mutex_);
+  absl::flat_hash_map<FoundEndpointKey,
+                      std::vector<std::pair<Medium, absl::Time>>>
+      found_endpoints_ ABSL_GUARDED_BY(mutex_);
+  std::unique_ptr<Histograms> histograms_ ABSL_GUARDED_BY(mutex_);
+};
+
+}  // namespace analytics
+}  // namespace nearby
+
+#endif  // NEARBY_CONNECTIONS_IMPLEMENTATION_ANALYTICS_CONNECTION_SETUP_TRACER_H_
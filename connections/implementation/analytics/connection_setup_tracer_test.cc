@@ -0,0 +1,392 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "connections/implementation/analytics/connection_setup_tracer.h"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "internal/platform/implementation/system_clock.h"
+#include "proto/connections_enums.pb.h"
+
+namespace nearby {
+namespace analytics {
+namespace {
+
+using ::location::nearby::proto::connections::BLUETOOTH;
+using ::location::nearby::proto::connections::BLE;
+using ::location::nearby::proto::connections::WIFI_LAN;
+
+constexpr char kEndpointId[] = "ABCD";
+constexpr int64_t kClientId = 1234;
+constexpr int64_t kOtherClientId = 5678;
+
+ConnectionSetupKey Outgoing(const std::string& endpoint_id,
+                            int64_t client_id = kClientId) {
+  return {.client_id = client_id,
+          .endpoint_id = endpoint_id,
+          .is_incoming = false};
+}
+
+ConnectionSetupKey Incoming(const std::string& endpoint_id,
+                            int64_t client_id = kClientId) {
+  return {.client_id = client_id,
+          .endpoint_id = endpoint_id,
+          .is_incoming = true};
+}
+
+int Index(ConnectionSetupPhase phase) { return static_cast<int>(phase); }
+
+class RecordingSink : public ConnectionSetupTraceSink {
+ public:
+  void OnTraceCompleted(const ConnectionSetupTrace& trace) override {
+    absl::MutexLock lock(&mutex_);
+    traces_.push_back(trace);
+  }
+
+  std::vector<ConnectionSetupTrace> GetTraces() {
+    absl::MutexLock lock(&mutex_);
+    return traces_;
+  }
+
+ private:
+  absl::Mutex mutex_;
+  std::vector<ConnectionSetupTrace> traces_;
+};
+
+class ConnectionSetupTracerTest : public ::testing::Test {
+ protected:
+  void SetUp() override { tracer_.AddSink(sink_); }
+
+  // Runs an outgoing attempt through every phase up to acceptance.
+  void ConnectOver(const std::string& endpoint_id,
+                   location::nearby::proto::connections::Medium medium) {
+    ConnectionSetupKey key = Outgoing(endpoint_id);
+    tracer_.StartTrace(key, SystemClock::ElapsedRealtime());
+    tracer_.BeginPhase(key, ConnectionSetupPhase::kMediumConnect, medium);
+    tracer_.EndPhase(key, ConnectionSetupPhase::kMediumConnect, true, medium);
+    for (ConnectionSetupPhase phase :
+         {ConnectionSetupPhase::kConnectionRequest,
+          ConnectionSetupPhase::kEncryption,
+          ConnectionSetupPhase::kRegisterEndpoint,
+          ConnectionSetupPhase::kAcceptance}) {
+      tracer_.BeginPhase(key, phase);
+      tracer_.EndPhase(key, phase, true);
+    }
+    tracer_.OnSetupFinished(key, ConnectionSetupResult::kConnected, medium);
+  }
+
+  ConnectionSetupTracer tracer_;
+  std::shared_ptr<RecordingSink> sink_ = std::make_shared<RecordingSink>();
+};
+
+TEST_F(ConnectionSetupTracerTest, ConnectedTraceStaysOpenUntilUpgradeEnds) {
+  ConnectOver(kEndpointId, BLUETOOTH);
+
+  std::optional<ConnectionSetupTrace> open =
+      tracer_.GetOpenTrace(Outgoing(kEndpointId));
+  ASSERT_TRUE(open.has_value());
+  EXPECT_EQ(open->result, ConnectionSetupResult::kConnected);
+  EXPECT_EQ(open->medium, BLUETOOTH);
+  EXPECT_TRUE(sink_->GetTraces().empty());
+
+  // The upgrade doesn't know which side started the connection.
+  tracer_.BeginConnectedPhase(kClientId, kEndpointId,
+                              ConnectionSetupPhase::kBwuUpgrade, WIFI_LAN);
+  tracer_.BeginConnectedPhase(kClientId, kEndpointId,
+                              ConnectionSetupPhase::kBwuMediumConnect,
+                              WIFI_LAN);
+  tracer_.EndConnectedPhase(kClientId, kEndpointId,
+                            ConnectionSetupPhase::kBwuMediumConnect, true);
+  tracer_.EndConnectedPhase(kClientId, kEndpointId,
+                            ConnectionSetupPhase::kBwuUpgrade, true);
+  tracer_.EndTraces(kClientId, kEndpointId);
+
+  std::vector<ConnectionSetupTrace> traces = sink_->GetTraces();
+  ASSERT_EQ(traces.size(), 1);
+  const ConnectionSetupTrace& trace = traces[0];
+  EXPECT_FALSE(trace.is_incoming);
+  EXPECT_EQ(trace.client_id, kClientId);
+  ASSERT_EQ(trace.spans.size(), 7);
+  EXPECT_EQ(trace.spans[0].phase, ConnectionSetupPhase::kMediumConnect);
+  EXPECT_EQ(trace.spans[5].phase, ConnectionSetupPhase::kBwuUpgrade);
+  EXPECT_EQ(trace.spans[5].medium, WIFI_LAN);
+  EXPECT_EQ(trace.spans[6].phase, ConnectionSetupPhase::kBwuMediumConnect);
+  for (const ConnectionSetupSpan& span : trace.spans) {
+    EXPECT_FALSE(span.IsOpen());
+    EXPECT_TRUE(span.succeeded);
+    EXPECT_GE(span.start, trace.start_time);
+  }
+  EXPECT_FALSE(tracer_.GetOpenTrace(Outgoing(kEndpointId)).has_value());
+}
+
+TEST_F(ConnectionSetupTracerTest, UpgradeIgnoresTracesStillBeingSetUp) {
+  tracer_.StartTrace(Incoming(kEndpointId), SystemClock::ElapsedRealtime());
+
+  tracer_.BeginConnectedPhase(kClientId, kEndpointId,
+                              ConnectionSetupPhase::kBwuUpgrade, WIFI_LAN);
+
+  std::optional<ConnectionSetupTrace> trace =
+      tracer_.GetOpenTrace(Incoming(kEndpointId));
+  ASSERT_TRUE(trace.has_value());
+  EXPECT_TRUE(trace->spans.empty());
+}
+
+TEST_F(ConnectionSetupTracerTest, RecordsEveryMediumTried) {
+  ConnectionSetupKey key = Outgoing(kEndpointId);
+  tracer_.StartTrace(key, SystemClock::ElapsedRealtime());
+  tracer_.BeginPhase(key, ConnectionSetupPhase::kMediumConnect, WIFI_LAN);
+  tracer_.BeginPhase(key, ConnectionSetupPhase::kMediumConnect, BLUETOOTH);
+  tracer_.EndPhase(key, ConnectionSetupPhase::kMediumConnect, false, WIFI_LAN);
+  tracer_.EndPhase(key, ConnectionSetupPhase::kMediumConnect, true, BLUETOOTH);
+
+  std::optional<ConnectionSetupTrace> trace = tracer_.GetOpenTrace(key);
+  ASSERT_TRUE(trace.has_value());
+  ASSERT_EQ(trace->spans.size(), 2);
+  EXPECT_EQ(trace->spans[0].medium, WIFI_LAN);
+  EXPECT_FALSE(trace->spans[0].succeeded);
+  EXPECT_EQ(trace->spans[1].medium, BLUETOOTH);
+  EXPECT_TRUE(trace->spans[1].succeeded);
+
+  ConnectionSetupLatencies latencies = tracer_.GetLatencies();
+  int connect = Index(ConnectionSetupPhase::kMediumConnect);
+  EXPECT_EQ(latencies.phase_latency[connect].count, 1);
+  EXPECT_EQ(latencies.failed_phase_latency[connect].count, 1);
+}
+
+TEST_F(ConnectionSetupTracerTest, DiscoveryBecomesPartOfOutgoingTrace) {
+  tracer_.OnDiscoveryStarted(kClientId);
+  tracer_.OnEndpointFound(kClientId, kEndpointId, BLE);
+  tracer_.OnEndpointFound(kClientId, kEndpointId, BLUETOOTH);
+
+  tracer_.StartTrace(Outgoing(kEndpointId), SystemClock::ElapsedRealtime());
+
+  std::optional<ConnectionSetupTrace> trace =
+      tracer_.GetOpenTrace(Outgoing(kEndpointId));
+  ASSERT_TRUE(trace.has_value());
+  ASSERT_EQ(trace->spans.size(), 2);
+  EXPECT_EQ(trace->spans[0].phase, ConnectionSetupPhase::kDiscovery);
+  EXPECT_EQ(trace->spans[0].medium, BLE);
+  EXPECT_EQ(trace->spans[1].medium, BLUETOOTH);
+  EXPECT_LE(trace->spans[0].end, trace->spans[1].end);
+  EXPECT_EQ(
+      tracer_.GetLatencies()
+          .phase_latency[Index(ConnectionSetupPhase::kDiscovery)]
+          .count,
+      2);
+}
+
+TEST_F(ConnectionSetupTracerTest, DiscoveryIsTrackedPerClient) {
+  tracer_.OnDiscoveryStarted(kClientId);
+  tracer_.OnEndpointFound(kClientId, kEndpointId, BLE);
+  // Another client starting discovery keeps what the first one found, and
+  // its own trace gets nothing the first client found.
+  tracer_.OnDiscoveryStarted(kOtherClientId);
+
+  tracer_.StartTrace(Outgoing(kEndpointId), SystemClock::ElapsedRealtime());
+  tracer_.StartTrace(Outgoing(kEndpointId, kOtherClientId),
+                     SystemClock::ElapsedRealtime());
+
+  std::optional<ConnectionSetupTrace> trace =
+      tracer_.GetOpenTrace(Outgoing(kEndpointId));
+  ASSERT_TRUE(trace.has_value());
+  ASSERT_EQ(trace->spans.size(), 1);
+  EXPECT_EQ(trace->spans[0].medium, BLE);
+  std::optional<ConnectionSetupTrace> other =
+      tracer_.GetOpenTrace(Outgoing(kEndpointId, kOtherClientId));
+  ASSERT_TRUE(other.has_value());
+  EXPECT_TRUE(other->spans.empty());
+}
+
+TEST_F(ConnectionSetupTracerTest, RestartingDiscoveryForgetsFoundEndpoints) {
+  tracer_.OnDiscoveryStarted(kClientId);
+  tracer_.OnEndpointFound(kClientId, kEndpointId, BLE);
+  tracer_.OnDiscoveryStarted(kClientId);
+
+  tracer_.StartTrace(Outgoing(kEndpointId), SystemClock::ElapsedRealtime());
+
+  std::optional<ConnectionSetupTrace> trace =
+      tracer_.GetOpenTrace(Outgoing(kEndpointId));
+  ASSERT_TRUE(trace.has_value());
+  EXPECT_TRUE(trace->spans.empty());
+}
+
+TEST_F(ConnectionSetupTracerTest, IncomingTraceSkipsDiscovery) {
+  tracer_.OnDiscoveryStarted(kClientId);
+  tracer_.OnEndpointFound(kClientId, kEndpointId, BLE);
+
+  tracer_.StartTrace(Incoming(kEndpointId), SystemClock::ElapsedRealtime());
+
+  std::optional<ConnectionSetupTrace> trace =
+      tracer_.GetOpenTrace(Incoming(kEndpointId));
+  ASSERT_TRUE(trace.has_value());
+  EXPECT_TRUE(trace->spans.empty());
+}
+
+TEST_F(ConnectionSetupTracerTest, SeparatesClientsAndDirections) {
+  tracer_.StartTrace(Outgoing(kEndpointId), SystemClock::ElapsedRealtime());
+  tracer_.StartTrace(Incoming(kEndpointId), SystemClock::ElapsedRealtime());
+  tracer_.StartTrace(Outgoing(kEndpointId, kOtherClientId),
+                     SystemClock::ElapsedRealtime());
+
+  tracer_.BeginPhase(Incoming(kEndpointId), ConnectionSetupPhase::kEncryption);
+  tracer_.OnSetupFinished(Outgoing(kEndpointId, kOtherClientId),
+                          ConnectionSetupResult::kRejected);
+
+  std::vector<ConnectionSetupTrace> traces = sink_->GetTraces();
+  ASSERT_EQ(traces.size(), 1);
+  EXPECT_EQ(traces[0].client_id, kOtherClientId);
+  EXPECT_EQ(traces[0].result, ConnectionSetupResult::kRejected);
+  std::optional<ConnectionSetupTrace> outgoing =
+      tracer_.GetOpenTrace(Outgoing(kEndpointId));
+  ASSERT_TRUE(outgoing.has_value());
+  EXPECT_TRUE(outgoing->spans.empty());
+  std::optional<ConnectionSetupTrace> incoming =
+      tracer_.GetOpenTrace(Incoming(kEndpointId));
+  ASSERT_TRUE(incoming.has_value());
+  ASSERT_EQ(incoming->spans.size(), 1);
+  EXPECT_EQ(incoming->spans[0].phase, ConnectionSetupPhase::kEncryption);
+
+  tracer_.EndTraces(kClientId, kEndpointId);
+
+  EXPECT_EQ(sink_->GetTraces().size(), 3);
+  EXPECT_FALSE(tracer_.GetOpenTrace(Outgoing(kEndpointId)).has_value());
+  EXPECT_FALSE(tracer_.GetOpenTrace(Incoming(kEndpointId)).has_value());
+}
+
+TEST_F(ConnectionSetupTracerTest, FailureCompletesTraceAndClosesSpans) {
+  ConnectionSetupKey key = Outgoing(kEndpointId);
+  tracer_.StartTrace(key, SystemClock::ElapsedRealtime());
+  tracer_.BeginPhase(key, ConnectionSetupPhase::kEncryption);
+
+  tracer_.OnSetupFinished(key, ConnectionSetupResult::kFailed);
+
+  std::vector<ConnectionSetupTrace> traces = sink_->GetTraces();
+  ASSERT_EQ(traces.size(), 1);
+  EXPECT_EQ(traces[0].result, ConnectionSetupResult::kFailed);
+  ASSERT_EQ(traces[0].spans.size(), 1);
+  EXPECT_FALSE(traces[0].spans[0].IsOpen());
+  EXPECT_FALSE(traces[0].spans[0].succeeded);
+
+  // A span cut short says nothing about how long the phase takes.
+  ConnectionSetupLatencies latencies = tracer_.GetLatencies();
+  int encryption = Index(ConnectionSetupPhase::kEncryption);
+  EXPECT_EQ(latencies.phase_latency[encryption].count, 0);
+  EXPECT_EQ(latencies.failed_phase_latency[encryption].count, 0);
+  EXPECT_EQ(latencies.failed, 1);
+  EXPECT_EQ(latencies.setup_latency.count, 0);
+}
+
+TEST_F(ConnectionSetupTracerTest, CountsOutcomes) {
+  ConnectOver("AAAA", BLUETOOTH);
+  ConnectOver("BBBB", WIFI_LAN);
+  tracer_.StartTrace(Incoming("CCCC"), SystemClock::ElapsedRealtime());
+  tracer_.OnSetupFinished(Incoming("CCCC"), ConnectionSetupResult::kRejected);
+
+  ConnectionSetupLatencies latencies = tracer_.GetLatencies();
+  EXPECT_EQ(latencies.connected, 2);
+  EXPECT_EQ(latencies.rejected, 1);
+  EXPECT_EQ(latencies.failed, 0);
+  EXPECT_EQ(latencies.setup_latency.count, 2);
+  EXPECT_EQ(
+      latencies.phase_latency[Index(ConnectionSetupPhase::kAcceptance)].count,
+      2);
+}
+
+TEST_F(ConnectionSetupTracerTest, RestartCompletesPreviousTrace) {
+  absl::Time start = SystemClock::ElapsedRealtime();
+  tracer_.StartTrace(Outgoing(kEndpointId), start);
+  tracer_.StartTrace(Outgoing(kEndpointId), start + absl::Milliseconds(1));
+
+  std::vector<ConnectionSetupTrace> traces = sink_->GetTraces();
+  ASSERT_EQ(traces.size(), 1);
+  EXPECT_EQ(traces[0].start_time, start);
+  EXPECT_EQ(traces[0].result, ConnectionSetupResult::kFailed);
+  std::optional<ConnectionSetupTrace> open =
+      tracer_.GetOpenTrace(Outgoing(kEndpointId));
+  ASSERT_TRUE(open.has_value());
+  EXPECT_EQ(open->start_time, start + absl::Milliseconds(1));
+}
+
+TEST_F(ConnectionSetupTracerTest, OpenTracesAreBounded) {
+  absl::Time start = SystemClock::ElapsedRealtime();
+  for (int i = 0; i <= ConnectionSetupTracer::kMaxOpenTraces; ++i) {
+    tracer_.StartTrace(Outgoing(absl::StrCat("E", i)),
+                       start + absl::Milliseconds(i));
+  }
+
+  std::vector<ConnectionSetupTrace> traces = sink_->GetTraces();
+  ASSERT_EQ(traces.size(), 1);
+  EXPECT_EQ(traces[0].endpoint_id, "E0");
+  EXPECT_FALSE(tracer_.GetOpenTrace(Outgoing("E0")).has_value());
+  EXPECT_TRUE(tracer_
+                  .GetOpenTrace(Outgoing(absl::StrCat(
+                      "E", ConnectionSetupTracer::kMaxOpenTraces)))
+                  .has_value());
+}
+
+TEST_F(ConnectionSetupTracerTest, IgnoresEventsWithoutTrace) {
+  ConnectionSetupKey key = Outgoing(kEndpointId);
+  tracer_.BeginPhase(key, ConnectionSetupPhase::kEncryption);
+  tracer_.EndPhase(key, ConnectionSetupPhase::kEncryption, true);
+  tracer_.OnSetupFinished(key, ConnectionSetupResult::kConnected);
+  tracer_.EndTrace(key);
+  tracer_.EndTraces(kClientId, kEndpointId);
+
+  EXPECT_TRUE(sink_->GetTraces().empty());
+  EXPECT_EQ(tracer_.GetLatencies().connected, 0);
+}
+
+TEST_F(ConnectionSetupTracerTest, RemovedSinkGetsNothing) {
+  tracer_.RemoveSink(sink_.get());
+
+  ConnectOver(kEndpointId, BLUETOOTH);
+  tracer_.EndTrace(Outgoing(kEndpointId));
+
+  EXPECT_TRUE(sink_->GetTraces().empty());
+}
+
+TEST_F(ConnectionSetupTracerTest, ToStringListsSpans) {
+  ConnectOver(kEndpointId, BLUETOOTH);
+  tracer_.EndTrace(Outgoing(kEndpointId));
+
+  std::string text = sink_->GetTraces().at(0).ToString();
+
+  EXPECT_NE(text.find("Outgoing connection with endpoint ABCD: connected"),
+            std::string::npos);
+  EXPECT_NE(text.find("medium_connect [BLUETOOTH] done"), std::string::npos);
+  EXPECT_NE(text.find("acceptance"), std::string::npos);
+}
+
+TEST_F(ConnectionSetupTracerTest, ResetClearsEverything) {
+  ConnectOver(kEndpointId, BLUETOOTH);
+
+  tracer_.Reset();
+
+  EXPECT_FALSE(tracer_.GetOpenTrace(Outgoing(kEndpointId)).has_value());
+  EXPECT_EQ(tracer_.GetLatencies().connected, 0);
+  EXPECT_EQ(tracer_.GetLatencies().setup_latency.count, 0);
+}
+
+}  // namespace
+}  // namespace analytics
+}  // namespace nearby
@@ -0,0 +1,361 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "connections/implementation/analytics/medium_performance_model.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "absl/time/time.h"
+#include "nlohmann/json.hpp"
+#include "internal/platform/implementation/system_clock.h"
+#include "internal/platform/logging.h"
+#include "internal/platform/mutex_lock.h"
+#include "proto/connections_enums.pb.h"
+
+namespace nearby {
+namespace analytics {
+
+namespace {
+
+using ::location::nearby::proto::connections::CONNECTION_BAND_UNKNOWN_BAND;
+using ::location::nearby::proto::connections::CONNECTION_BAND_WIFI_BAND_2GHZ;
+using ::location::nearby::proto::connections::CONNECTION_BAND_WIFI_BAND_5GHZ;
+using ::location::nearby::proto::connections::CONNECTION_BAND_WIFI_BAND_6GHZ;
+
+constexpr char kPreferencesKey[] = "nearby_connections_medium_performance";
+
+// Payloads smaller than this are dominated by per-payload overhead and don't
+// tell us much about the medium.
+constexpr int64_t kMinThroughputSampleBytes = 256 * 1024;
+// Weight of a new sample in the exponentially weighted moving averages.
+constexpr double kEwmaWeight = 0.3;
+// Success/failure counts are halved once they exceed this, so the success
+// probability follows recent behavior.
+constexpr double kMaxAttemptCount = 20;
+// The connection latency is amortized over a transfer of this duration when
+// computing a medium's score.
+constexpr absl::Duration kScoreHorizon = absl::Seconds(10);
+// Throughput penalty for WiFi mediums on a 2.4GHz link when we only have
+// band-agnostic history.
+constexpr double k2GhzThroughputFactor = 0.6;
+// Retry delay scaling bounds; see AdjustRetryDelay().
+constexpr double kMinRetryDelayFactor = 0.5;
+constexpr double kMaxRetryDelayFactor = 2.0;
+constexpr double kPriorSuccessProbability = 0.5;
+
+bool IsWifiMedium(MediumPerformanceModel::Medium medium) {
+  switch (medium) {
+    case location::nearby::proto::connections::WIFI_LAN:
+    case location::nearby::proto::connections::WIFI_HOTSPOT:
+    case location::nearby::proto::connections::WIFI_DIRECT:
+    case location::nearby::proto::connections::WIFI_AWARE:
+      return true;
+    default:
+      return false;
+  }
+}
+
+double Ewma(double average, int samples, double value) {
+  if (samples == 0) return value;
+  return average + kEwmaWeight * (value - average);
+}
+
+}  // namespace
+
+MediumPerformanceModel& MediumPerformanceModel::GetInstance() {
+  static std::aligned_storage_t<sizeof(MediumPerformanceModel),
+                                alignof(MediumPerformanceModel)>
+      storage;
+  static MediumPerformanceModel* instance =
+      new (&storage) MediumPerformanceModel();
+  return *instance;
+}
+
+MediumPerformanceModel::~MediumPerformanceModel() { Flush(); }
+
+void MediumPerformanceModel::SetPreferencesManager(
+    api::PreferencesManager* preferences_manager) {
+  MutexLock lock(&mutex_);
+  if (preferences_manager == preferences_manager_) return;
+  if (save_pending_ && preferences_manager_ != nullptr) {
+    WriteLocked();
+  }
+  preferences_manager_ = preferences_manager;
+  save_pending_ = false;
+  last_save_time_ = absl::InfinitePast();
+  if (preferences_manager_ != nullptr) {
+    LoadLocked();
+  }
+}
+
+void MediumPerformanceModel::Flush() {
+  MutexLock lock(&mutex_);
+  if (save_pending_ && preferences_manager_ != nullptr) {
+    WriteLocked();
+  }
+}
+
+void MediumPerformanceModel::OnThroughputMeasured(Medium medium,
+                                                  int throughput_kbps,
+                                                  int64_t total_bytes) {
+  if (throughput_kbps <= 0 || total_bytes < kMinThroughputSampleBytes) {
+    return;
+  }
+  MutexLock lock(&mutex_);
+  ConnectionBand band = CONNECTION_BAND_UNKNOWN_BAND;
+  auto it = last_band_.find(medium);
+  if (it != last_band_.end()) band = it->second;
+
+  for (ConnectionBand key_band : {CONNECTION_BAND_UNKNOWN_BAND, band}) {
+    Stats& stats = stats_[{medium, key_band}];
+    stats.throughput_kbps =
+        Ewma(stats.throughput_kbps, stats.throughput_samples, throughput_kbps);
+    stats.throughput_samples++;
+    if (key_band == band) break;
+  }
+  SaveLocked();
+}
+
+void MediumPerformanceModel::OnConnectionAttempt(Medium medium,
+                                                 ConnectionBand band,
+                                                 int frequency, bool success,
+                                                 absl::Duration duration) {
+  MutexLock lock(&mutex_);
+  band = ResolveBand(band, frequency);
+  if (success) last_band_[medium] = band;
+
+  for (ConnectionBand key_band : {CONNECTION_BAND_UNKNOWN_BAND, band}) {
+    Stats& stats = stats_[{medium, key_band}];
+    if (success) {
+      stats.connect_latency_millis =
+          Ewma(stats.connect_latency_millis, static_cast<int>(stats.successes),
+               absl::ToDoubleMilliseconds(duration));
+      stats.successes++;
+    } else {
+      stats.failures++;
+    }
+    if (stats.successes + stats.failures > kMaxAttemptCount) {
+      stats.successes /= 2;
+      stats.failures /= 2;
+    }
+    if (key_band == band) break;
+  }
+  SaveLocked();
+}
+
+MediumPerformanceModel::Estimate MediumPerformanceModel::GetEstimate(
+    Medium medium, ConnectionBand band, int frequency) const {
+  MutexLock lock(&mutex_);
+  return GetEstimateLocked(medium, ResolveBand(band, frequency));
+}
+
+MediumPerformanceModel::Estimate MediumPerformanceModel::GetEstimateLocked(
+    Medium medium, ConnectionBand band) const {
+  Estimate estimate;
+  estimate.throughput_kbps = NominalThroughputKbps(medium);
+
+  auto any_band = stats_.find({medium, CONNECTION_BAND_UNKNOWN_BAND});
+  if (any_band == stats_.end()) {
+    return estimate;
+  }
+  const Stats* stats = &any_band->second;
+  bool band_specific = false;
+  if (band != CONNECTION_BAND_UNKNOWN_BAND) {
+    auto it = stats_.find({medium, band});
+    if (it != stats_.end()) {
+      stats = &it->second;
+      band_specific = true;
+    }
+  }
+
+  estimate.has_history = true;
+  if (stats->throughput_samples > 0) {
+    estimate.throughput_kbps = stats->throughput_kbps;
+  } else if (any_band->second.throughput_samples > 0) {
+    estimate.throughput_kbps = any_band->second.throughput_kbps;
+    band_specific = false;
+  }
+  if (!band_specific && band == CONNECTION_BAND_WIFI_BAND_2GHZ &&
+      IsWifiMedium(medium)) {
+    estimate.throughput_kbps *= k2GhzThroughputFactor;
+  }
+  estimate.success_probability =
+      (stats->successes + 1) / (stats->successes + stats->failures + 2);
+  estimate.connect_latency = absl::Milliseconds(stats->connect_latency_millis);
+  estimate.score =
+      estimate.throughput_kbps * estimate.success_probability *
+      absl::FDivDuration(kScoreHorizon,
+                         kScoreHorizon + estimate.connect_latency);
+  return estimate;
+}
+
+std::vector<MediumPerformanceModel::Medium> MediumPerformanceModel::RankMediums(
+    const std::vector<Medium>& mediums, ConnectionBand band,
+    int frequency) const {
+  MutexLock lock(&mutex_);
+  band = ResolveBand(band, frequency);
+
+  // Only the slots held by mediums we know something about are reordered.
+  std::vector<size_t> slots;
+  std::vector<std::pair<double, Medium>> scored;
+  for (size_t i = 0; i < mediums.size(); ++i) {
+    Estimate estimate = GetEstimateLocked(mediums[i], band);
+    if (!estimate.has_history) continue;
+    slots.push_back(i);
+    scored.emplace_back(estimate.score, mediums[i]);
+  }
+  std::stable_sort(scored.begin(), scored.end(),
+                   [](const std::pair<double, Medium>& a,
+                      const std::pair<double, Medium>& b) {
+                     return a.first > b.first;
+                   });
+
+  std::vector<Medium> ranked(mediums);
+  for (size_t i = 0; i < slots.size(); ++i) {
+    ranked[slots[i]] = scored[i].second;
+  }
+  return ranked;
+}
+
+absl::Duration MediumPerformanceModel::AdjustRetryDelay(
+    Medium medium, absl::Duration delay) const {
+  MutexLock lock(&mutex_);
+  Estimate estimate = GetEstimateLocked(medium, CONNECTION_BAND_UNKNOWN_BAND);
+  if (!estimate.has_history) return delay;
+  double factor = std::clamp(
+      kPriorSuccessProbability / estimate.success_probability,
+      kMinRetryDelayFactor, kMaxRetryDelayFactor);
+  return delay * factor;
+}
+
+void MediumPerformanceModel::Reset() {
+  MutexLock lock(&mutex_);
+  stats_.clear();
+  last_band_.clear();
+  save_pending_ = false;
+  if (preferences_manager_ != nullptr) {
+    preferences_manager_->Remove(kPreferencesKey);
+  }
+}
+
+MediumPerformanceModel::ConnectionBand
+MediumPerformanceModel::BandFromFrequency(int frequency) {
+  if (frequency >= 2400 && frequency < 2500) {
+    return CONNECTION_BAND_WIFI_BAND_2GHZ;
+  }
+  if (frequency >= 4900 && frequency < 5925) {
+    return CONNECTION_BAND_WIFI_BAND_5GHZ;
+  }
+  if (frequency >= 5925 && frequency <= 7125) {
+    return CONNECTION_BAND_WIFI_BAND_6GHZ;
+  }
+  return CONNECTION_BAND_UNKNOWN_BAND;
+}
+
+MediumPerformanceModel::ConnectionBand MediumPerformanceModel::ResolveBand(
+    ConnectionBand band, int frequency) {
+  if (band != CONNECTION_BAND_UNKNOWN_BAND) return band;
+  return BandFromFrequency(frequency);
+}
+
+// Rough expectations used for mediums we have connected over but never
+// measured a sizable transfer on.
+double MediumPerformanceModel::NominalThroughputKbps(Medium medium) {
+  switch (medium) {
+    case location::nearby::proto::connections::WIFI_LAN:
+    case location::nearby::proto::connections::WIFI_HOTSPOT:
+    case location::nearby::proto::connections::WIFI_DIRECT:
+    case location::nearby::proto::connections::WIFI_AWARE:
+      return 10 * 1024;
+    case location::nearby::proto::connections::WEB_RTC:
+      return 2 * 1024;
+    case location::nearby::proto::connections::BLUETOOTH:
+      return 150;
+    case location::nearby::proto::connections::BLE:
+    case location::nearby::proto::connections::BLE_L2CAP:
+      return 20;
+    default:
+      return 0;
+  }
+}
+
+void MediumPerformanceModel::LoadLocked() {
+  nlohmann::json value =
+      preferences_manager_->Get(kPreferencesKey, nlohmann::json::array());
+  if (!value.is_array()) {
+    NEARBY_LOGS(WARNING) << "Ignoring malformed medium performance history.";
+    return;
+  }
+  stats_.clear();
+  last_band_.clear();
+  for (const auto& entry : value) {
+    if (!entry.is_object()) continue;
+    int medium = entry.value("medium", 0);
+    int band = entry.value("band", 0);
+    if (!location::nearby::proto::connections::Medium_IsValid(medium) ||
+        !location::nearby::proto::connections::ConnectionBand_IsValid(band)) {
+      continue;
+    }
+    Stats stats;
+    stats.throughput_kbps = entry.value("throughput_kbps", 0.0);
+    stats.throughput_samples = entry.value("throughput_samples", 0);
+    stats.connect_latency_millis = entry.value("connect_latency_millis", 0.0);
+    stats.successes = entry.value("successes", 0.0);
+    stats.failures = entry.value("failures", 0.0);
+    stats_[{static_cast<Medium>(medium), static_cast<ConnectionBand>(band)}] =
+        stats;
+    if (entry.value("last_band", false)) {
+      last_band_[static_cast<Medium>(medium)] =
+          static_cast<ConnectionBand>(band);
+    }
+  }
+}
+
+void MediumPerformanceModel::SaveLocked() {
+  if (preferences_manager_ == nullptr) return;
+  save_pending_ = true;
+  if (SystemClock::ElapsedRealtime() - last_save_time_ < kMinSaveInterval) {
+    return;
+  }
+  WriteLocked();
+}
+
+void MediumPerformanceModel::WriteLocked() {
+  save_pending_ = false;
+  last_save_time_ = SystemClock::ElapsedRealtime();
+  nlohmann::json value = nlohmann::json::array();
+  for (const auto& [key, stats] : stats_) {
+    auto last_band = last_band_.find(key.first);
+    value.push_back({
+        {"medium", static_cast<int>(key.first)},
+        {"band", static_cast<int>(key.second)},
+        {"throughput_kbps", stats.throughput_kbps},
+        {"throughput_samples", stats.throughput_samples},
+        {"connect_latency_millis", stats.connect_latency_millis},
+        {"successes", stats.successes},
+        {"failures", stats.failures},
+        {"last_band",
+         last_band != last_band_.end() && last_band->second == key.second},
+    });
+  }
+  preferences_manager_->Set(kPreferencesKey, value);
+}
+
+}  // namespace analytics
+}  // namespace nearby
@@ -0,0 +1,154 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NEARBY_CONNECTIONS_IMPLEMENTATION_ANALYTICS_MEDIUM_PERFORMANCE_MODEL_H_
+#define NEARBY_CONNECTIONS_IMPLEMENTATION_ANALYTICS_MEDIUM_PERFORMANCE_MODEL_H_
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/time/time.h"
+#include "internal/platform/implementation/preferences_manager.h"
+#include "internal/platform/mutex.h"
+#include "proto/connections_enums.pb.h"
+
+namespace nearby {
+namespace analytics {
+
+// Keeps a per-medium history of observed payload throughput and connection
+// attempt results/latencies, and uses it to estimate which medium is likely to
+// give the best transfer rate for the next connection.
+//
+// Throughput samples are reported by ThroughputRecorder, connection attempts
+// by AnalyticsRecorder. Samples are bucketed by medium and by the WiFi band the
+// connection ran on, so the current band of an endpoint can be taken into
+// account when ranking candidates.
+//
+// The process-wide instance keeps history across client sessions. If a
+// PreferencesManager is attached, the history is also restored from and saved
+// to it so that it survives process restarts. Saves are rate limited to one
+// per kMinSaveInterval; Flush() writes out whatever is left.
+class MediumPerformanceModel {
+ public:
+  using Medium = ::location::nearby::proto::connections::Medium;
+  using ConnectionBand = ::location::nearby::proto::connections::ConnectionBand;
+
+  // The model's view of one medium on one band.
+  struct Estimate {
+    // False if we have never observed the medium; the rest of the fields are
+    // priors in that case.
+    bool has_history = false;
+    double throughput_kbps = 0;
+    double success_probability = 0.5;
+    absl::Duration connect_latency = absl::ZeroDuration();
+    // Expected throughput discounted by the chance of failing to connect and
+    // by the connection latency. Higher is better.
+    double score = 0;
+  };
+
+  static constexpr absl::Duration kMinSaveInterval = absl::Seconds(30);
+
+  static MediumPerformanceModel& GetInstance();
+
+  MediumPerformanceModel() = default;
+  // Flushes unsaved history.
+  ~MediumPerformanceModel();
+  MediumPerformanceModel(const MediumPerformanceModel&) = delete;
+  MediumPerformanceModel& operator=(const MediumPerformanceModel&) = delete;
+
+  // Attaches (or detaches, if nullptr) the persistent store, which must
+  // outlive the model or be detached first. Any history found in
+  // |preferences_manager| replaces the in-memory history. Attaching the store
+  // that is already attached does nothing.
+  void SetPreferencesManager(api::PreferencesManager* preferences_manager)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Saves history not saved yet because of the rate limit.
+  void Flush() ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Records the measured throughput of a payload transfer over |medium|.
+  // Transfers that are too small to say anything about the medium are ignored.
+  void OnThroughputMeasured(Medium medium, int throughput_kbps,
+                            int64_t total_bytes) ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Records the outcome of a connection attempt over |medium|. |band| and
+  // |frequency| describe the link, when known.
+  void OnConnectionAttempt(Medium medium, ConnectionBand band, int frequency,
+                           bool success, absl::Duration duration)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  Estimate GetEstimate(Medium medium, ConnectionBand band, int frequency) const
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Reorders |mediums| by expected performance. Mediums without any history
+  // keep their position in |mediums|, so the caller's preference order is
+  // preserved until the model has something better to say.
+  std::vector<Medium> RankMediums(const std::vector<Medium>& mediums,
+                                  ConnectionBand band, int frequency) const
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Scales a retry |delay| for |medium| by how likely the medium is to
+  // connect: mediums that usually succeed are retried sooner, mediums that
+  // keep failing back off further. Returns |delay| unchanged without history.
+  absl::Duration AdjustRetryDelay(Medium medium, absl::Duration delay) const
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Drops all history, including the persisted copy.
+  void Reset() ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Derives the band from a WiFi |frequency| in MHz, or returns
+  // CONNECTION_BAND_UNKNOWN_BAND if the frequency isn't a WiFi frequency.
+  static ConnectionBand BandFromFrequency(int frequency);
+
+ private:
+  struct Stats {
+    double throughput_kbps = 0;
+    int throughput_samples = 0;
+    double connect_latency_millis = 0;
+    double successes = 0;
+    double failures = 0;
+  };
+
+  using Key = std::pair<Medium, ConnectionBand>;
+
+  static ConnectionBand ResolveBand(ConnectionBand band, int frequency);
+  static double NominalThroughputKbps(Medium medium);
+
+  Estimate GetEstimateLocked(Medium medium, ConnectionBand band) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void LoadLocked() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Saves the history now if the last save is at least kMinSaveInterval ago,
+  // otherwise leaves it to a later call or to Flush().
+  void SaveLocked() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void WriteLocked() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  mutable Mutex mutex_;
+  absl::flat_hash_map<Key, Stats> stats_ ABSL_GUARDED_BY(mutex_);
+  // The band of the last successful connection on each medium. Throughput
+  // samples don't carry a band, so they are attributed to this one.
+  absl::flat_hash_map<Medium, ConnectionBand> last_band_
+      ABSL_GUARDED_BY(mutex_);
+  api::PreferencesManager* preferences_manager_ ABSL_GUARDED_BY(mutex_) =
+      nullptr;
+  bool save_pending_ ABSL_GUARDED_BY(mutex_) = false;
+  absl::Time last_save_time_ ABSL_GUARDED_BY(mutex_) = absl::InfinitePast();
+};
+
+}  // namespace analytics
+}  // namespace nearby
+
+#endif  // NEARBY_CONNECTIONS_IMPLEMENTATION_ANALYTICS_MEDIUM_PERFORMANCE_MODEL_H_
@@ -0,0 +1,208 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "connections/implementation/analytics/medium_performance_model.h"
+
+#include <memory>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "absl/time/time.h"
+#include "internal/platform/implementation/platform.h"
+#include "internal/platform/implementation/preferences_manager.h"
+#include "proto/connections_enums.pb.h"
+
+namespace nearby {
+namespace analytics {
+namespace {
+
+using ::location::nearby::proto::connections::BLUETOOTH;
+using ::location::nearby::proto::connections::CONNECTION_BAND_UNKNOWN_BAND;
+using ::location::nearby::proto::connections::CONNECTION_BAND_WIFI_BAND_2GHZ;
+using ::location::nearby::proto::connections::CONNECTION_BAND_WIFI_BAND_5GHZ;
+using ::location::nearby::proto::connections::WEB_RTC;
+using ::location::nearby::proto::connections::WIFI_DIRECT;
+using ::location::nearby::proto::connections::WIFI_HOTSPOT;
+using ::location::nearby::proto::connections::WIFI_LAN;
+using Medium = MediumPerformanceModel::Medium;
+
+constexpr int64_t kLargePayloadBytes = 10 * 1024 * 1024;
+constexpr int kUnknownFrequency = -1;
+
+TEST(MediumPerformanceModelTest, RankWithoutHistoryKeepsPreferenceOrder) {
+  MediumPerformanceModel model;
+  std::vector<Medium> mediums = {WIFI_HOTSPOT, WIFI_LAN, WEB_RTC, BLUETOOTH};
+
+  EXPECT_EQ(model.RankMediums(mediums, CONNECTION_BAND_UNKNOWN_BAND,
+                              kUnknownFrequency),
+            mediums);
+}
+
+TEST(MediumPerformanceModelTest, RankPrefersFasterMedium) {
+  MediumPerformanceModel model;
+  model.OnConnectionAttempt(WIFI_HOTSPOT, CONNECTION_BAND_UNKNOWN_BAND,
+                            kUnknownFrequency, true, absl::Seconds(1));
+  model.OnThroughputMeasured(WIFI_HOTSPOT, 5 * 1024, kLargePayloadBytes);
+  model.OnConnectionAttempt(WIFI_LAN, CONNECTION_BAND_UNKNOWN_BAND,
+                            kUnknownFrequency, true, absl::Seconds(1));
+  model.OnThroughputMeasured(WIFI_LAN, 40 * 1024, kLargePayloadBytes);
+
+  EXPECT_EQ(model.RankMediums({WIFI_HOTSPOT, WIFI_LAN, BLUETOOTH},
+                              CONNECTION_BAND_UNKNOWN_BAND, kUnknownFrequency),
+            (std::vector<Medium>{WIFI_LAN, WIFI_HOTSPOT, BLUETOOTH}));
+}
+
+TEST(MediumPerformanceModelTest, RankKeepsSlotsOfUnknownMediums) {
+  MediumPerformanceModel model;
+  model.OnThroughputMeasured(WIFI_HOTSPOT, 5 * 1024, kLargePayloadBytes);
+  model.OnThroughputMeasured(WIFI_DIRECT, 30 * 1024, kLargePayloadBytes);
+
+  // WIFI_LAN has no history, so it stays in the middle.
+  EXPECT_EQ(model.RankMediums({WIFI_HOTSPOT, WIFI_LAN, WIFI_DIRECT},
+                              CONNECTION_BAND_UNKNOWN_BAND, kUnknownFrequency),
+            (std::vector<Medium>{WIFI_DIRECT, WIFI_LAN, WIFI_HOTSPOT}));
+}
+
+TEST(MediumPerformanceModelTest, FailuresLowerScore) {
+  MediumPerformanceModel model;
+  model.OnThroughputMeasured(WIFI_DIRECT, 30 * 1024, kLargePayloadBytes);
+  model.OnThroughputMeasured(WIFI_HOTSPOT, 20 * 1024, kLargePayloadBytes);
+  for (int i = 0; i < 10; ++i) {
+    model.OnConnectionAttempt(WIFI_DIRECT, CONNECTION_BAND_UNKNOWN_BAND,
+                              kUnknownFrequency, false, absl::Seconds(5));
+  }
+
+  EXPECT_EQ(model.RankMediums({WIFI_DIRECT, WIFI_HOTSPOT},
+                              CONNECTION_BAND_UNKNOWN_BAND, kUnknownFrequency),
+            (std::vector<Medium>{WIFI_HOTSPOT, WIFI_DIRECT}));
+}
+
+TEST(MediumPerformanceModelTest, SmallPayloadsAreIgnored) {
+  MediumPerformanceModel model;
+  model.OnThroughputMeasured(WIFI_LAN, 40 * 1024, 1024);
+
+  EXPECT_FALSE(model
+                   .GetEstimate(WIFI_LAN, CONNECTION_BAND_UNKNOWN_BAND,
+                                kUnknownFrequency)
+                   .has_history);
+}
+
+TEST(MediumPerformanceModelTest, BandSpecificHistoryIsUsed) {
+  MediumPerformanceModel model;
+  model.OnConnectionAttempt(WIFI_LAN, CONNECTION_BAND_WIFI_BAND_2GHZ,
+                            kUnknownFrequency, true, absl::Seconds(1));
+  model.OnThroughputMeasured(WIFI_LAN, 4 * 1024, kLargePayloadBytes);
+  model.OnConnectionAttempt(WIFI_LAN, CONNECTION_BAND_WIFI_BAND_5GHZ,
+                            kUnknownFrequency, true, absl::Seconds(1));
+  model.OnThroughputMeasured(WIFI_LAN, 40 * 1024, kLargePayloadBytes);
+
+  EXPECT_DOUBLE_EQ(model
+                       .GetEstimate(WIFI_LAN, CONNECTION_BAND_WIFI_BAND_2GHZ,
+                                    kUnknownFrequency)
+                       .throughput_kbps,
+                   4 * 1024);
+  // The band is derived from the frequency when it isn't given.
+  EXPECT_DOUBLE_EQ(
+      model.GetEstimate(WIFI_LAN, CONNECTION_BAND_UNKNOWN_BAND, 5180)
+          .throughput_kbps,
+      40 * 1024);
+}
+
+TEST(MediumPerformanceModelTest, BandFromFrequency) {
+  EXPECT_EQ(MediumPerformanceModel::BandFromFrequency(2437),
+            CONNECTION_BAND_WIFI_BAND_2GHZ);
+  EXPECT_EQ(MediumPerformanceModel::BandFromFrequency(5180),
+            CONNECTION_BAND_WIFI_BAND_5GHZ);
+  EXPECT_EQ(MediumPerformanceModel::BandFromFrequency(-1),
+            CONNECTION_BAND_UNKNOWN_BAND);
+}
+
+TEST(MediumPerformanceModelTest, AdjustRetryDelayFollowsSuccessRate) {
+  MediumPerformanceModel model;
+  absl::Duration delay = absl::Seconds(4);
+  EXPECT_EQ(model.AdjustRetryDelay(WIFI_LAN, delay), delay);
+
+  for (int i = 0; i < 10; ++i) {
+    model.OnConnectionAttempt(WIFI_LAN, CONNECTION_BAND_UNKNOWN_BAND,
+                              kUnknownFrequency, true, absl::Seconds(1));
+    model.OnConnectionAttempt(WIFI_HOTSPOT, CONNECTION_BAND_UNKNOWN_BAND,
+                              kUnknownFrequency, false, absl::Seconds(1));
+  }
+  EXPECT_LT(model.AdjustRetryDelay(WIFI_LAN, delay), delay);
+  EXPECT_GT(model.AdjustRetryDelay(WIFI_HOTSPOT, delay), delay);
+  EXPECT_LE(model.AdjustRetryDelay(WIFI_HOTSPOT, delay), delay * 2);
+}
+
+TEST(MediumPerformanceModelTest, HistoryIsPersisted) {
+  std::unique_ptr<api::PreferencesManager> preferences_manager =
+      api::ImplementationPlatform::CreatePreferencesManager(
+          "medium_performance_model_test");
+  {
+    MediumPerformanceModel model;
+    model.SetPreferencesManager(preferences_manager.get());
+    model.OnConnectionAttempt(WIFI_LAN, CONNECTION_BAND_WIFI_BAND_5GHZ,
+                              kUnknownFrequency, true, absl::Seconds(1));
+    model.OnThroughputMeasured(WIFI_LAN, 40 * 1024, kLargePayloadBytes);
+  }
+
+  MediumPerformanceModel model;
+  model.SetPreferencesManager(preferences_manager.get());
+  MediumPerformanceModel::Estimate estimate = model.GetEstimate(
+      WIFI_LAN, CONNECTION_BAND_WIFI_BAND_5GHZ, kUnknownFrequency);
+  EXPECT_TRUE(estimate.has_history);
+  EXPECT_DOUBLE_EQ(estimate.throughput_kbps, 40 * 1024);
+
+  model.Reset();
+  MediumPerformanceModel reloaded;
+  reloaded.SetPreferencesManager(preferences_manager.get());
+  EXPECT_FALSE(reloaded
+                   .GetEstimate(WIFI_LAN, CONNECTION_BAND_UNKNOWN_BAND,
+                                kUnknownFrequency)
+                   .has_history);
+}
+
+TEST(MediumPerformanceModelTest, SavesAreRateLimited) {
+  std::unique_ptr<api::PreferencesManager> preferences_manager =
+      api::ImplementationPlatform::CreatePreferencesManager(
+          "medium_performance_model_rate_limit_test");
+  MediumPerformanceModel model;
+  model.SetPreferencesManager(preferences_manager.get());
+  model.Reset();
+
+  // The first sample is saved right away, the next ones wait.
+  model.OnConnectionAttempt(WIFI_LAN, CONNECTION_BAND_UNKNOWN_BAND,
+                            kUnknownFrequency, true, absl::Seconds(1));
+  model.OnThroughputMeasured(WIFI_LAN, 40 * 1024, kLargePayloadBytes);
+  {
+    MediumPerformanceModel saved;
+    saved.SetPreferencesManager(preferences_manager.get());
+    MediumPerformanceModel::Estimate estimate = saved.GetEstimate(
+        WIFI_LAN, CONNECTION_BAND_UNKNOWN_BAND, kUnknownFrequency);
+    EXPECT_TRUE(estimate.has_history);
+    EXPECT_NE(estimate.throughput_kbps, 40 * 1024);
+  }
+
+  model.Flush();
+  MediumPerformanceModel saved;
+  saved.SetPreferencesManager(preferences_manager.get());
+  EXPECT_DOUBLE_EQ(saved
+                       .GetEstimate(WIFI_LAN, CONNECTION_BAND_UNKNOWN_BAND,
+                                    kUnknownFrequency)
+                       .throughput_kbps,
+                   40 * 1024);
+}
+
+}  // namespace
+}  // namespace analytics
+}  // namespace nearby
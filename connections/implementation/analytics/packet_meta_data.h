@@ -94,6 +94,27 @@ struct PacketMetaData {
     }
     return 0L;
   }
+
+  absl::Duration GetEncryptionDuration() const {
+    if (encryption_end_time > encryption_start_time) {
+      return encryption_end_time - encryption_start_time;
+    }
+    return absl::ZeroDuration();
+  }
+
+  absl::Duration GetFileIoDuration() const {
+    if (file_io_end_time > file_io_start_time) {
+      return file_io_end_time - file_io_start_time;
+    }
+    return absl::ZeroDuration();
+  }
+
+  absl::Duration GetSocketIoDuration() const {
+    if (socket_io_end_time > socket_io_start_time) {
+      return socket_io_end_time - socket_io_start_time;
+    }
+    return absl::ZeroDuration();
+  }
 };
 
 }  // namespace analytics
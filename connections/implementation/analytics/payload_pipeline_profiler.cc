@@ -0,0 +1,349 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "connections/implementation/analytics/payload_pipeline_profiler.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "internal/platform/implementation/system_clock.h"
+
+namespace nearby {
+namespace analytics {
+
+namespace {
+
+using ::nearby::connections::PayloadDirection;
+
+// Live throughput is computed over this many complete one-second windows.
+constexpr int kThroughputWindowSeconds = 4;
+constexpr int kThroughputSlots = kThroughputWindowSeconds + 1;
+constexpr double kKbInBytes = 1024;
+
+int BucketFor(absl::Duration latency) {
+  int64_t micros = absl::ToInt64Microseconds(latency);
+  if (micros <= 0) return 0;
+  int bucket = 1;
+  while (micros > 1 && bucket < LatencyHistogram::kNumBuckets - 1) {
+    micros >>= 1;
+    ++bucket;
+  }
+  return bucket;
+}
+
+int64_t NowMicros() {
+  return absl::ToUnixMicros(SystemClock::ElapsedRealtime());
+}
+
+}  // namespace
+
+// LatencyHistogram
+
+void LatencyHistogram::Record(absl::Duration latency) {
+  buckets_[BucketFor(latency)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_micros_.fetch_add(absl::ToInt64Microseconds(latency),
+                        std::memory_order_relaxed);
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::GetSnapshot() const {
+  Snapshot snapshot;
+  for (int i = 0; i < kNumBuckets; ++i) {
+    snapshot.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+    snapshot.count += snapshot.buckets[i];
+  }
+  snapshot.sum =
+      absl::Microseconds(sum_micros_.load(std::memory_order_relaxed));
+  return snapshot;
+}
+
+absl::Duration LatencyHistogram::BucketUpperBound(int bucket) {
+  if (bucket <= 0) return absl::Microseconds(1);
+  if (bucket >= kNumBuckets - 1) return absl::InfiniteDuration();
+  return absl::Microseconds(int64_t{1} << bucket);
+}
+
+absl::Duration LatencyHistogram::Snapshot::Mean() const {
+  if (count == 0) return absl::ZeroDuration();
+  return sum / count;
+}
+
+absl::Duration LatencyHistogram::Snapshot::Percentile(double percentile) const {
+  if (count == 0) return absl::ZeroDuration();
+  int64_t rank = static_cast<int64_t>(
+      std::max(1.0, std::min(100.0, percentile) / 100.0 * count));
+  int64_t seen = 0;
+  for (int i = 0; i < kNumBuckets; ++i) {
+    seen += buckets[i];
+    if (seen >= rank) return BucketUpperBound(i);
+  }
+  return BucketUpperBound(kNumBuckets - 1);
+}
+
+// PayloadPipelineProfile
+
+PipelineStage PayloadPipelineProfile::Bottleneck() const {
+  int bottleneck = 0;
+  for (int i = 1; i < kNumPipelineStages; ++i) {
+    if (stage_utilization[i] > stage_utilization[bottleneck]) bottleneck = i;
+  }
+  return static_cast<PipelineStage>(bottleneck);
+}
+
+// All counters are atomics so chunks can be recorded without holding the
+// profiler's lock.
+class PayloadPipelineProfiler::Pipeline {
+ public:
+  void RecordChunk(int64_t bytes,
+                   const std::array<absl::Duration, kNumPipelineStages>&
+                       stage_durations) {
+    int64_t now = NowMicros();
+    absl::Duration total = absl::ZeroDuration();
+    for (int i = 0; i < kNumPipelineStages; ++i) {
+      if (stage_durations[i] <= absl::ZeroDuration()) continue;
+      RecordStage(static_cast<PipelineStage>(i), stage_durations[i]);
+      total += stage_durations[i];
+    }
+    chunk_latency_.Record(total);
+    chunks_.fetch_add(1, std::memory_order_relaxed);
+    bytes_.fetch_add(bytes, std::memory_order_relaxed);
+
+    int64_t expected = 0;
+    first_chunk_start_micros_.compare_exchange_strong(
+        expected, now - absl::ToInt64Microseconds(total),
+        std::memory_order_relaxed);
+    last_active_micros_.store(now, std::memory_order_relaxed);
+    RecordLiveBytes(now, bytes);
+  }
+
+  void RecordStage(PipelineStage stage, absl::Duration duration) {
+    int index = static_cast<int>(stage);
+    stage_latency_[index].Record(duration);
+    stage_busy_micros_[index].fetch_add(absl::ToInt64Microseconds(duration),
+                                        std::memory_order_relaxed);
+    if (stage == PipelineStage::kAckWait) {
+      last_active_micros_.store(NowMicros(), std::memory_order_relaxed);
+    }
+  }
+
+  int64_t LastActiveMicros() const {
+    return last_active_micros_.load(std::memory_order_relaxed);
+  }
+
+  void FillProfile(PayloadPipelineProfile& profile) const {
+    int64_t now = NowMicros();
+    profile.chunks = chunks_.load(std::memory_order_relaxed);
+    profile.bytes = bytes_.load(std::memory_order_relaxed);
+    profile.chunk_latency = chunk_latency_.GetSnapshot();
+    for (int i = 0; i < kNumPipelineStages; ++i) {
+      profile.stage_latency[i] = stage_latency_[i].GetSnapshot();
+    }
+
+    int64_t first = first_chunk_start_micros_.load(std::memory_order_relaxed);
+    int64_t active_micros =
+        first > 0 ? LastActiveMicros() - first : int64_t{0};
+    if (active_micros > 0) {
+      for (int i = 0; i < kNumPipelineStages; ++i) {
+        profile.stage_utilization[i] = std::min(
+            1.0, static_cast<double>(stage_busy_micros_[i].load(
+                     std::memory_order_relaxed)) /
+                     active_micros);
+      }
+      profile.average_throughput_kbps = profile.bytes / kKbInBytes /
+                                        (active_micros / 1e6);
+    }
+
+    // Only whole seconds are counted, so the current second doesn't skew the
+    // rate downwards.
+    int64_t current_second = now / 1000000;
+    int64_t window_bytes = 0;
+    for (const auto& slot : live_slots_) {
+      int64_t second = slot.second.load(std::memory_order_relaxed);
+      if (second < current_second &&
+          second >= current_second - kThroughputWindowSeconds) {
+        window_bytes += slot.bytes.load(std::memory_order_relaxed);
+      }
+    }
+    profile.live_throughput_kbps =
+        window_bytes / kKbInBytes / kThroughputWindowSeconds;
+  }
+
+ private:
+  struct LiveSlot {
+    std::atomic<int64_t> second{-1};
+    std::atomic<int64_t> bytes{0};
+  };
+
+  // Bytes are bucketed by wall-clock second in a small ring. A slot that holds
+  // an older second is reclaimed by whoever gets there first; a concurrent
+  // writer may lose a few bytes in the handover, which is fine for a live
+  // estimate.
+  void RecordLiveBytes(int64_t now_micros, int64_t bytes) {
+    int64_t second = now_micros / 1000000;
+    LiveSlot& slot = live_slots_[second % kThroughputSlots];
+    int64_t slot_second = slot.second.load(std::memory_order_relaxed);
+    if (slot_second != second &&
+        slot.second.compare_exchange_strong(slot_second, second,
+                                            std::memory_order_relaxed)) {
+      slot.bytes.store(0, std::memory_order_relaxed);
+    }
+    slot.bytes.fetch_add(bytes, std::memory_order_relaxed);
+  }
+
+  std::array<LatencyHistogram, kNumPipelineStages> stage_latency_;
+  LatencyHistogram chunk_latency_;
+  std::array<std::atomic<int64_t>, kNumPipelineStages> stage_busy_micros_ =
+      {};
+  std::atomic<int64_t> chunks_{0};
+  std::atomic<int64_t> bytes_{0};
+  std::atomic<int64_t> first_chunk_start_micros_{0};
+  std::atomic<int64_t> last_active_micros_{0};
+  std::array<LiveSlot, kThroughputSlots> live_slots_;
+};
+
+// PayloadPipelineProfiler
+
+PayloadPipelineProfiler& PayloadPipelineProfiler::GetInstance() {
+  static std::aligned_storage_t<sizeof(PayloadPipelineProfiler),
+                                alignof(PayloadPipelineProfiler)>
+      storage;
+  static PayloadPipelineProfiler* instance =
+      new (&storage) PayloadPipelineProfiler();
+  return *instance;
+}
+
+void PayloadPipelineProfiler::OnChunkSent(
+    const std::string& endpoint_id, Medium medium,
+    const PacketMetaData& packet_meta_data) {
+  OnChunk(endpoint_id, medium, PayloadDirection::OUTGOING_PAYLOAD,
+          packet_meta_data);
+}
+
+void PayloadPipelineProfiler::OnChunkReceived(
+    const std::string& endpoint_id, Medium medium,
+    const PacketMetaData& packet_meta_data) {
+  OnChunk(endpoint_id, medium, PayloadDirection::INCOMING_PAYLOAD,
+          packet_meta_data);
+}
+
+void PayloadPipelineProfiler::OnChunk(const std::string& endpoint_id,
+                                      Medium medium,
+                                      PayloadDirection direction,
+                                      const PacketMetaData& packet_meta_data) {
+  std::array<absl::Duration, kNumPipelineStages> stage_durations = {};
+  stage_durations[static_cast<int>(PipelineStage::kFileIo)] =
+      packet_meta_data.GetFileIoDuration();
+  stage_durations[static_cast<int>(PipelineStage::kCrypto)] =
+      packet_meta_data.GetEncryptionDuration();
+  stage_durations[static_cast<int>(PipelineStage::kSocketIo)] =
+      packet_meta_data.GetSocketIoDuration();
+  GetOrCreatePipeline(endpoint_id, medium, direction)
+      ->RecordChunk(packet_meta_data.packet_size, stage_durations);
+}
+
+void PayloadPipelineProfiler::OnAckWait(const std::string& endpoint_id,
+                                        absl::Duration duration) {
+  std::shared_ptr<Pipeline> pipeline;
+  {
+    absl::ReaderMutexLock lock(&mutex_);
+    auto medium = last_outgoing_medium_.find(endpoint_id);
+    if (medium == last_outgoing_medium_.end()) return;
+    auto it = pipelines_.find(
+        Key(endpoint_id, medium->second, PayloadDirection::OUTGOING_PAYLOAD));
+    if (it == pipelines_.end()) return;
+    pipeline = it->second;
+  }
+  pipeline->RecordStage(PipelineStage::kAckWait, duration);
+}
+
+std::shared_ptr<PayloadPipelineProfiler::Pipeline>
+PayloadPipelineProfiler::GetOrCreatePipeline(const std::string& endpoint_id,
+                                             Medium medium,
+                                             PayloadDirection direction) {
+  Key key(endpoint_id, medium, direction);
+  {
+    absl::ReaderMutexLock lock(&mutex_);
+    auto it = pipelines_.find(key);
+    if (it != pipelines_.end()) {
+      if (direction != PayloadDirection::OUTGOING_PAYLOAD) return it->second;
+      // Outgoing chunks also need last_outgoing_medium_ to be current, which
+      // only changes when an endpoint switches mediums.
+      auto last = last_outgoing_medium_.find(endpoint_id);
+      if (last != last_outgoing_medium_.end() && last->second == medium) {
+        return it->second;
+      }
+    }
+  }
+
+  absl::MutexLock lock(&mutex_);
+  if (direction == PayloadDirection::OUTGOING_PAYLOAD) {
+    last_outgoing_medium_[endpoint_id] = medium;
+  }
+  auto it = pipelines_.find(key);
+  if (it != pipelines_.end()) return it->second;
+
+  if (pipelines_.size() >= kMaxPipelines) {
+    auto oldest = std::min_element(
+        pipelines_.begin(), pipelines_.end(),
+        [](const auto& a, const auto& b) {
+          return a.second->LastActiveMicros() < b.second->LastActiveMicros();
+        });
+    const std::string& evicted_endpoint_id = std::get<0>(oldest->first);
+    auto last = last_outgoing_medium_.find(evicted_endpoint_id);
+    if (last != last_outgoing_medium_.end() &&
+        std::get<1>(oldest->first) == last->second &&
+        std::get<2>(oldest->first) == PayloadDirection::OUTGOING_PAYLOAD) {
+      last_outgoing_medium_.erase(last);
+    }
+    pipelines_.erase(oldest);
+  }
+  auto pipeline = std::make_shared<Pipeline>();
+  pipelines_.emplace(std::move(key), pipeline);
+  return pipeline;
+}
+
+std::vector<PayloadPipelineProfile> PayloadPipelineProfiler::GetProfiles()
+    const {
+  std::vector<PayloadPipelineProfile> profiles;
+  absl::ReaderMutexLock lock(&mutex_);
+  profiles.reserve(pipelines_.size());
+  for (const auto& [key, pipeline] : pipelines_) {
+    PayloadPipelineProfile profile;
+    profile.endpoint_id = std::get<0>(key);
+    profile.medium = std::get<1>(key);
+    profile.direction = std::get<2>(key);
+    pipeline->FillProfile(profile);
+    profiles.push_back(std::move(profile));
+  }
+  return profiles;
+}
+
+void PayloadPipelineProfiler::Reset() {
+  absl::MutexLock lock(&mutex_);
+  pipelines_.clear();
+  last_outgoing_medium_.clear();
+}
+
+}  // namespace analytics
+}  // namespace nearby
@@ -0,0 +1,162 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NEARBY_CONNECTIONS_IMPLEMENTATION_ANALYTICS_PAYLOAD_PIPELINE_PROFILER_H_
+#define NEARBY_CONNECTIONS_IMPLEMENTATION_ANALYTICS_PAYLOAD_PIPELINE_PROFILER_H_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "connections/implementation/analytics/packet_meta_data.h"
+#include "connections/payload_type.h"
+#include "proto/connections_enums.pb.h"
+
+namespace nearby {
+namespace analytics {
+
+// The stages a payload chunk goes through on its way to or from the socket.
+enum class PipelineStage {
+  kFileIo = 0,
+  kCrypto = 1,
+  kSocketIo = 2,
+  // Sender only: waiting for PAYLOAD_RECEIVED_ACK after the last chunk.
+  kAckWait = 3,
+};
+constexpr int kNumPipelineStages = 4;
+
+// A latency histogram with power-of-two microsecond buckets. Recording is
+// lock-free and safe to call from any thread.
+class LatencyHistogram {
+ public:
+  // Bucket 0 holds latencies under 1us, bucket i (i > 0) holds latencies in
+  // [2^(i-1), 2^i) us. The last bucket also holds everything larger.
+  static constexpr int kNumBuckets = 32;
+
+  struct Snapshot {
+    std::array<int64_t, kNumBuckets> buckets = {};
+    int64_t count = 0;
+    absl::Duration sum = absl::ZeroDuration();
+
+    absl::Duration Mean() const;
+    // Returns the upper bound of the bucket holding the |percentile|-th
+    // (0-100) sample, or zero if the histogram is empty.
+    absl::Duration Percentile(double percentile) const;
+  };
+
+  void Record(absl::Duration latency);
+  Snapshot GetSnapshot() const;
+
+  static absl::Duration BucketUpperBound(int bucket);
+
+ private:
+  std::array<std::atomic<int64_t>, kNumBuckets> buckets_ = {};
+  std::atomic<int64_t> count_{0};
+  std::atomic<int64_t> sum_micros_{0};
+};
+
+// A point-in-time view of one endpoint's payload pipeline over one medium in
+// one direction.
+struct PayloadPipelineProfile {
+  std::string endpoint_id;
+  location::nearby::proto::connections::Medium medium =
+      location::nearby::proto::connections::UNKNOWN_MEDIUM;
+  connections::PayloadDirection direction =
+      connections::PayloadDirection::OUTGOING_PAYLOAD;
+
+  int64_t chunks = 0;
+  int64_t bytes = 0;
+  // Per-chunk latency of each stage, indexed by PipelineStage.
+  std::array<LatencyHistogram::Snapshot, kNumPipelineStages> stage_latency;
+  // Latency of a whole chunk (sum of its stages).
+  LatencyHistogram::Snapshot chunk_latency;
+  // Fraction of the active transfer time spent in each stage, indexed by
+  // PipelineStage.
+  std::array<double, kNumPipelineStages> stage_utilization = {};
+  // Throughput over the last few seconds, and since the first chunk.
+  double live_throughput_kbps = 0;
+  double average_throughput_kbps = 0;
+
+  // The stage with the highest utilization.
+  PipelineStage Bottleneck() const;
+};
+
+// Always-on profiler for the payload data path. PayloadManager and
+// EndpointManager report every chunk sent or received along with its
+// PacketMetaData; the profiler keeps per-endpoint, per-medium histograms that
+// can be read at any time through Core::GetPayloadPipelineProfiles().
+//
+// Recording a chunk takes a shared lock to find the endpoint's pipeline and is
+// otherwise atomic counter updates, so it is cheap enough to leave on.
+class PayloadPipelineProfiler {
+ public:
+  using Medium = location::nearby::proto::connections::Medium;
+
+  // Pipelines beyond this many are evicted, least recently active first.
+  static constexpr int kMaxPipelines = 64;
+
+  static PayloadPipelineProfiler& GetInstance();
+
+  PayloadPipelineProfiler() = default;
+  PayloadPipelineProfiler(const PayloadPipelineProfiler&) = delete;
+  PayloadPipelineProfiler& operator=(const PayloadPipelineProfiler&) = delete;
+
+  void OnChunkSent(const std::string& endpoint_id, Medium medium,
+                   const PacketMetaData& packet_meta_data)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+  void OnChunkReceived(const std::string& endpoint_id, Medium medium,
+                       const PacketMetaData& packet_meta_data)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+  // Records time the sender spent waiting for PAYLOAD_RECEIVED_ACK. It is
+  // attributed to the medium the endpoint last sent a chunk over.
+  void OnAckWait(const std::string& endpoint_id, absl::Duration duration)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  std::vector<PayloadPipelineProfile> GetProfiles() const
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  void Reset() ABSL_LOCKS_EXCLUDED(mutex_);
+
+ private:
+  class Pipeline;
+  using Key = std::tuple<std::string, Medium, connections::PayloadDirection>;
+
+  void OnChunk(const std::string& endpoint_id, Medium medium,
+               connections::PayloadDirection direction,
+               const PacketMetaData& packet_meta_data)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+  std::shared_ptr<Pipeline> GetOrCreatePipeline(
+      const std::string& endpoint_id, Medium medium,
+      connections::PayloadDirection direction) ABSL_LOCKS_EXCLUDED(mutex_);
+
+  mutable absl::Mutex mutex_;
+  absl::flat_hash_map<Key, std::shared_ptr<Pipeline>> pipelines_
+      ABSL_GUARDED_BY(mutex_);
+  // Medium of the last chunk sent to each endpoint, for OnAckWait().
+  absl::flat_hash_map<std::string, Medium> last_outgoing_medium_
+      ABSL_GUARDED_BY(mutex_);
+};
+
+}  // namespace analytics
+}  // namespace nearby
+
+#endif  // NEARBY_CONNECTIONS_IMPLEMENTATION_ANALYTICS_PAYLOAD_PIPELINE_PROFILER_H_
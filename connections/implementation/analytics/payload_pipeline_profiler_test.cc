@@ -0,0 +1,190 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "connections/implementation/analytics/payload_pipeline_profiler.h"
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/time.h"
+#include "connections/implementation/analytics/packet_meta_data.h"
+#include "connections/payload_type.h"
+#include "proto/connections_enums.pb.h"
+
+namespace nearby {
+namespace analytics {
+namespace {
+
+using ::location::nearby::proto::connections::BLUETOOTH;
+using ::location::nearby::proto::connections::WIFI_LAN;
+using ::nearby::connections::PayloadDirection;
+
+constexpr char kEndpointId[] = "ABCD";
+
+// Builds a PacketMetaData with the given stage durations, all ending now.
+PacketMetaData MakePacketMetaData(int size, absl::Duration file_io,
+                                  absl::Duration encryption,
+                                  absl::Duration socket_io) {
+  absl::Time now = absl::Now();
+  PacketMetaData packet_meta_data;
+  packet_meta_data.SetPacketSize(size);
+  packet_meta_data.file_io_start_time = now - file_io;
+  packet_meta_data.file_io_end_time = now;
+  packet_meta_data.encryption_start_time = now - encryption;
+  packet_meta_data.encryption_end_time = now;
+  packet_meta_data.socket_io_start_time = now - socket_io;
+  packet_meta_data.socket_io_end_time = now;
+  return packet_meta_data;
+}
+
+const PayloadPipelineProfile* FindProfile(
+    const std::vector<PayloadPipelineProfile>& profiles,
+    const std::string& endpoint_id,
+    location::nearby::proto::connections::Medium medium,
+    PayloadDirection direction) {
+  for (const auto& profile : profiles) {
+    if (profile.endpoint_id == endpoint_id && profile.medium == medium &&
+        profile.direction == direction) {
+      return &profile;
+    }
+  }
+  return nullptr;
+}
+
+TEST(LatencyHistogramTest, RecordsIntoPowerOfTwoBuckets) {
+  LatencyHistogram histogram;
+  histogram.Record(absl::Microseconds(3));
+  histogram.Record(absl::Microseconds(3));
+  histogram.Record(absl::Microseconds(100));
+  histogram.Record(absl::Milliseconds(10));
+
+  LatencyHistogram::Snapshot snapshot = histogram.GetSnapshot();
+  EXPECT_EQ(snapshot.count, 4);
+  EXPECT_EQ(snapshot.sum, absl::Microseconds(10106));
+  EXPECT_EQ(snapshot.Mean(), absl::Microseconds(10106) / 4);
+  EXPECT_EQ(snapshot.Percentile(50), absl::Microseconds(4));
+  EXPECT_EQ(snapshot.Percentile(75), absl::Microseconds(128));
+  EXPECT_EQ(snapshot.Percentile(100), absl::Microseconds(16384));
+}
+
+TEST(LatencyHistogramTest, EmptyHistogram) {
+  LatencyHistogram histogram;
+  LatencyHistogram::Snapshot snapshot = histogram.GetSnapshot();
+
+  EXPECT_EQ(snapshot.count, 0);
+  EXPECT_EQ(snapshot.Mean(), absl::ZeroDuration());
+  EXPECT_EQ(snapshot.Percentile(99), absl::ZeroDuration());
+}
+
+TEST(PayloadPipelineProfilerTest, ProfilesAreKeptPerEndpointMediumAndDirection) {
+  PayloadPipelineProfiler profiler;
+  PacketMetaData packet_meta_data =
+      MakePacketMetaData(1024, absl::Milliseconds(1), absl::Milliseconds(2),
+                         absl::Milliseconds(8));
+
+  profiler.OnChunkSent(kEndpointId, WIFI_LAN, packet_meta_data);
+  profiler.OnChunkSent(kEndpointId, WIFI_LAN, packet_meta_data);
+  profiler.OnChunkSent(kEndpointId, BLUETOOTH, packet_meta_data);
+  profiler.OnChunkReceived(kEndpointId, WIFI_LAN, packet_meta_data);
+
+  std::vector<PayloadPipelineProfile> profiles = profiler.GetProfiles();
+  ASSERT_EQ(profiles.size(), 3);
+  const PayloadPipelineProfile* wifi_lan_outgoing = FindProfile(
+      profiles, kEndpointId, WIFI_LAN, PayloadDirection::OUTGOING_PAYLOAD);
+  ASSERT_NE(wifi_lan_outgoing, nullptr);
+  EXPECT_EQ(wifi_lan_outgoing->chunks, 2);
+  EXPECT_EQ(wifi_lan_outgoing->bytes, 2048);
+  EXPECT_EQ(wifi_lan_outgoing->chunk_latency.count, 2);
+  EXPECT_EQ(wifi_lan_outgoing
+                ->stage_latency[static_cast<int>(PipelineStage::kSocketIo)]
+                .Mean(),
+            absl::Milliseconds(8));
+  EXPECT_EQ(wifi_lan_outgoing->Bottleneck(), PipelineStage::kSocketIo);
+
+  const PayloadPipelineProfile* bluetooth_outgoing = FindProfile(
+      profiles, kEndpointId, BLUETOOTH, PayloadDirection::OUTGOING_PAYLOAD);
+  ASSERT_NE(bluetooth_outgoing, nullptr);
+  EXPECT_EQ(bluetooth_outgoing->chunks, 1);
+
+  const PayloadPipelineProfile* wifi_lan_incoming = FindProfile(
+      profiles, kEndpointId, WIFI_LAN, PayloadDirection::INCOMING_PAYLOAD);
+  ASSERT_NE(wifi_lan_incoming, nullptr);
+  EXPECT_EQ(wifi_lan_incoming->chunks, 1);
+}
+
+TEST(PayloadPipelineProfilerTest, AckWaitIsAttributedToLastOutgoingMedium) {
+  PayloadPipelineProfiler profiler;
+  PacketMetaData packet_meta_data =
+      MakePacketMetaData(1024, absl::Milliseconds(1), absl::Milliseconds(1),
+                         absl::Milliseconds(1));
+
+  // Nothing has been sent yet, so there is nothing to attribute this to.
+  profiler.OnAckWait(kEndpointId, absl::Milliseconds(5));
+  EXPECT_TRUE(profiler.GetProfiles().empty());
+
+  profiler.OnChunkSent(kEndpointId, BLUETOOTH, packet_meta_data);
+  profiler.OnChunkSent(kEndpointId, WIFI_LAN, packet_meta_data);
+  profiler.OnAckWait(kEndpointId, absl::Milliseconds(50));
+
+  std::vector<PayloadPipelineProfile> profiles = profiler.GetProfiles();
+  const PayloadPipelineProfile* wifi_lan = FindProfile(
+      profiles, kEndpointId, WIFI_LAN, PayloadDirection::OUTGOING_PAYLOAD);
+  const PayloadPipelineProfile* bluetooth = FindProfile(
+      profiles, kEndpointId, BLUETOOTH, PayloadDirection::OUTGOING_PAYLOAD);
+  ASSERT_NE(wifi_lan, nullptr);
+  ASSERT_NE(bluetooth, nullptr);
+  EXPECT_EQ(
+      wifi_lan->stage_latency[static_cast<int>(PipelineStage::kAckWait)].count,
+      1);
+  EXPECT_EQ(
+      bluetooth->stage_latency[static_cast<int>(PipelineStage::kAckWait)].count,
+      0);
+}
+
+TEST(PayloadPipelineProfilerTest, LeastRecentlyActivePipelineIsEvicted) {
+  PayloadPipelineProfiler profiler;
+  PacketMetaData packet_meta_data =
+      MakePacketMetaData(1024, absl::Milliseconds(1), absl::Milliseconds(1),
+                         absl::Milliseconds(1));
+
+  for (int i = 0; i <= PayloadPipelineProfiler::kMaxPipelines; ++i) {
+    profiler.OnChunkReceived(absl::StrCat("endpoint_", i), WIFI_LAN,
+                             packet_meta_data);
+    absl::SleepFor(absl::Microseconds(10));
+  }
+
+  std::vector<PayloadPipelineProfile> profiles = profiler.GetProfiles();
+  EXPECT_EQ(profiles.size(), PayloadPipelineProfiler::kMaxPipelines);
+  EXPECT_EQ(FindProfile(profiles, "endpoint_0", WIFI_LAN,
+                        PayloadDirection::INCOMING_PAYLOAD),
+            nullptr);
+}
+
+TEST(PayloadPipelineProfilerTest, Reset) {
+  PayloadPipelineProfiler profiler;
+  profiler.OnChunkSent(kEndpointId, WIFI_LAN,
+                       MakePacketMetaData(1024, absl::Milliseconds(1),
+                                          absl::Milliseconds(1),
+                                          absl::Milliseconds(1)));
+
+  profiler.Reset();
+
+  EXPECT_TRUE(profiler.GetProfiles().empty());
+}
+
+}  // namespace
+}  // namespace analytics
+}  // namespace nearby
@@ -23,9 +23,11 @@
 #include <utility>
 
 #include "absl/container/flat_hash_map.h"
+#include "absl/hash/hash.h"
 #include "absl/meta/type_traits.h"
 #include "absl/strings/str_format.h"
 #include "absl/time/time.h"
+#include "connections/implementation/analytics/medium_performance_model.h"
 #include "internal/platform/implementation/system_clock.h"
 #include "internal/platform/logging.h"
 #include "internal/platform/mutex_lock.h"
@@ -173,6 +175,8 @@ bool ThroughputRecorder::Throughput::dump() {
   if (throughput_kbps == kDefaultThroughoutKbps) {
     return false;
   }
+  MediumPerformanceModel::GetInstance().OnThroughputMeasured(
+      medium_, throughput_kbps, total_byte_size_);
   int throughpu_mbps = CalculateThroughputMBps(throughput_kbps);
   int64_t other =
       total_millis - file_io_time_ - encryption_time_ - socket_io_time_;
@@ -276,62 +280,91 @@ std::string ThroughputRecorder::ToString(PayloadType type) {
 // Inplementation for ThroughputRecorderContainer
 
 void ThroughputRecorderContainer::Shutdown() {
-  MutexLock lock(&mutex_);
-  NEARBY_LOGS(INFO) << __func__
-                    << ".  Num of Instance:" << throughput_recorders_.size();
-  for (auto& throughput_recorder : throughput_recorders_) {
-    NEARBY_LOGS(INFO) << "Stop instance: " << throughput_recorder.second;
-    throughput_recorder.second->Stop();
-    delete throughput_recorder.second;
+  for (Shard& shard : shards_) {
+    MutexLock lock(&shard.mutex);
+    for (auto& [key, entry] : shard.recorders) {
+      NEARBY_LOGS(INFO) << "Stop instance: " << entry.recorder.get();
+      entry.recorder->Stop();
+    }
+    shard.recorders.clear();
+    shard.lru.clear();
   }
-  throughput_recorders_.clear();
 }
 
-ThroughputRecorder* ThroughputRecorderContainer::GetTPRecorder(
+std::shared_ptr<ThroughputRecorder> ThroughputRecorderContainer::GetTPRecorder(
     const int64_t payload_id, PayloadDirection payload_direction) {
-  MutexLock lock(&mutex_);
-  auto it = throughput_recorders_.find(
-      std::pair<int64_t, PayloadDirection>(payload_id, payload_direction));
-  if (it == throughput_recorders_.end()) {
-    auto instance = new ThroughputRecorder(payload_id);
-    std::string direction =
-        (payload_direction == PayloadDirection::INCOMING_PAYLOAD) ? "; Receive"
-                                                                  : "; Send";
-    NEARBY_LOGS(INFO) << "Add ThroughputRecorder instance : " << instance
-                      << " for payload_id:" << payload_id << direction;
-    throughput_recorders_.emplace(
-        std::pair<int64_t, PayloadDirection>(payload_id, payload_direction),
-        instance);
-    return instance;
+  Key key(payload_id, payload_direction);
+  Shard& shard = GetShard(key);
+  MutexLock lock(&shard.mutex);
+  auto it = shard.recorders.find(key);
+  if (it != shard.recorders.end()) {
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lru_position);
+    return it->second.recorder;
   }
 
-  return it->second;
+  auto instance = std::make_shared<ThroughputRecorder>(payload_id);
+  std::string direction =
+      (payload_direction == PayloadDirection::INCOMING_PAYLOAD) ? "; Receive"
+                                                                : "; Send";
+  NEARBY_LOGS(INFO) << "Add ThroughputRecorder instance : " << instance.get()
+                    << " for payload_id:" << payload_id << direction;
+  shard.lru.push_front(key);
+  shard.recorders.emplace(
+      key, Entry{.recorder = instance, .lru_position = shard.lru.begin()});
+  EvictAbandonedLocked(shard);
+  return instance;
 }
 
 void ThroughputRecorderContainer::StopTPRecorder(
     const int64_t payload_id, PayloadDirection payload_direction) {
-  MutexLock lock(&mutex_);
+  Key key(payload_id, payload_direction);
+  Shard& shard = GetShard(key);
+  MutexLock lock(&shard.mutex);
   std::string direction =
       (payload_direction == PayloadDirection::INCOMING_PAYLOAD) ? "; Receive"
                                                                 : "; Send";
-  auto it = throughput_recorders_.find(
-      std::pair<int64_t, PayloadDirection>(payload_id, payload_direction));
-  if (it != throughput_recorders_.end()) {
+  auto it = shard.recorders.find(key);
+  if (it != shard.recorders.end()) {
     NEARBY_LOGS(INFO) << "Found and stop/delete ThroughputRecorder instance : "
-                      << &(it->second) << " for payload_id:" << payload_id
-                      << direction;
-    it->second->Stop();
-    delete it->second;
-    throughput_recorders_.erase(
-        std::pair<int64_t, PayloadDirection>(payload_id, payload_direction));
+                      << it->second.recorder.get()
+                      << " for payload_id:" << payload_id << direction;
+    it->second.recorder->Stop();
+    shard.lru.erase(it->second.lru_position);
+    shard.recorders.erase(it);
     return;
   }
   NEARBY_LOGS(INFO) << "No ThroughputRecorder found for :" << payload_id;
 }
 
 int ThroughputRecorderContainer::GetSize() {
-  MutexLock lock(&mutex_);
-  return throughput_recorders_.size();
+  int size = 0;
+  for (Shard& shard : shards_) {
+    MutexLock lock(&shard.mutex);
+    size += shard.recorders.size();
+  }
+  return size;
+}
+
+ThroughputRecorderContainer::Shard& ThroughputRecorderContainer::GetShard(
+    const Key& key) {
+  return shards_[absl::HashOf(key) % kNumShards];
+}
+
+void ThroughputRecorderContainer::EvictAbandonedLocked(Shard& shard) {
+  constexpr int kMaxRecordersPerShard = kMaxRecorders / kNumShards;
+  auto position = shard.lru.end();
+  while (shard.recorders.size() > kMaxRecordersPerShard &&
+         position != shard.lru.begin()) {
+    --position;
+    auto it = shard.recorders.find(*position);
+    // Still held by a pending payload.
+    if (it->second.recorder.use_count() > 1) continue;
+    NEARBY_LOGS(INFO) << "Evict abandoned ThroughputRecorder for payload_id:"
+                      << it->first.first;
+    it->second.recorder->Stop();
+    shard.recorders.erase(it);
+    position = shard.lru.erase(position);
+  }
 }
 
 }  // namespace analytics
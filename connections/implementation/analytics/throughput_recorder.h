@@ -15,7 +15,10 @@
 #ifndef NEARBY_CONNECTIONS_IMPLEMENTATION_ANALYTICS_THROUGHPUT_RECORDER_H_
 #define NEARBY_CONNECTIONS_IMPLEMENTATION_ANALYTICS_THROUGHPUT_RECORDER_H_
 
+#include <array>
 #include <cstdint>
+#include <list>
+#include <memory>
 #include <string>
 #include <utility>
 
@@ -108,23 +111,49 @@ class ThroughputRecorder {
   int throughput_kbps_ = 0;
 };
 
+// Hands out the ThroughputRecorder of each payload and direction.
+//
+// Recorders are shared: a PendingPayload keeps a handle to its recorders for
+// the per-chunk calls, so those never look the payload up here. The container
+// is split into shards, each with its own lock. A shard holding more than its
+// share of kMaxRecorders drops its least recently used recorders that no one
+// else holds any more, i.e. those of payloads that never finished.
 class ThroughputRecorderContainer {
  public:
+  static constexpr int kNumShards = 16;
+  static constexpr int kMaxRecorders = 256;
+
   ThroughputRecorderContainer(const ThroughputRecorderContainer&) = delete;
   ThroughputRecorderContainer& operator=(const ThroughputRecorderContainer&) =
       delete;
 
   static ThroughputRecorderContainer& GetInstance();
-  void Shutdown() ABSL_LOCKS_EXCLUDED(mutex_);
+  void Shutdown();
 
-  ThroughputRecorder* GetTPRecorder(int64_t payload_id,
-                                    PayloadDirection payload_direction)
-      ABSL_LOCKS_EXCLUDED(mutex_);
-  void StopTPRecorder(int64_t payload_id, PayloadDirection payload_direction)
-      ABSL_LOCKS_EXCLUDED(mutex_);
-  int GetSize() ABSL_LOCKS_EXCLUDED(mutex_);
+  // Returns the recorder for this payload and direction, creating it first if
+  // there is none.
+  std::shared_ptr<ThroughputRecorder> GetTPRecorder(
+      int64_t payload_id, PayloadDirection payload_direction);
+  void StopTPRecorder(int64_t payload_id, PayloadDirection payload_direction);
+  int GetSize();
 
  private:
+  // <payload id, payload direction>
+  using Key = std::pair<int64_t, PayloadDirection>;
+
+  struct Entry {
+    std::shared_ptr<ThroughputRecorder> recorder;
+    // Position in Shard::lru.
+    std::list<Key>::iterator lru_position;
+  };
+
+  struct Shard {
+    Mutex mutex;
+    absl::flat_hash_map<Key, Entry> recorders ABSL_GUARDED_BY(mutex);
+    // Most recently used first.
+    std::list<Key> lru ABSL_GUARDED_BY(mutex);
+  };
+
   // This is a singleton object, for which destructor will never be called.
   // Constructor will be invoked once from Instance() static method.
   // Object is create in-place (with a placement new) to guarantee that
@@ -132,10 +161,13 @@ class ThroughputRecorderContainer {
   ThroughputRecorderContainer() = default;
   ~ThroughputRecorderContainer() = default;
 
-  Mutex mutex_;
-  // std::pair<int64_t, PayloadDirection> for <payload id, payload direction>
-  absl::flat_hash_map<std::pair<int64_t, PayloadDirection>, ThroughputRecorder*>
-      throughput_recorders_ ABSL_GUARDED_BY(mutex_);
+  Shard& GetShard(const Key& key);
+  // Drops least recently used recorders that only the shard holds, until the
+  // shard is back within its share of kMaxRecorders.
+  static void EvictAbandonedLocked(Shard& shard)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(shard.mutex);
+
+  std::array<Shard, kNumShards> shards_;
 };
 
 }  // namespace analytics
@@ -16,6 +16,7 @@
 
 #include <stdint.h>
 
+#include <memory>
 #include <ostream>
 #include <string>
 
@@ -79,6 +80,25 @@ TEST(ThroughputRecorderContainer, InstanceCreate_ContainerSize) {
   EXPECT_EQ(ThroughputRecorderContainer::GetInstance().GetSize(), 0);
 }
 
+TEST(ThroughputRecorderContainer, EvictsOnlyAbandonedRecorders) {
+  ThroughputRecorderContainer& container =
+      ThroughputRecorderContainer::GetInstance();
+  std::shared_ptr<ThroughputRecorder> held = container.GetTPRecorder(
+      kPayloadIdA, PayloadDirection::OUTGOING_PAYLOAD);
+
+  for (int64_t payload_id = 1;
+       payload_id <= 4 * ThroughputRecorderContainer::kMaxRecorders;
+       ++payload_id) {
+    container.GetTPRecorder(payload_id, PayloadDirection::INCOMING_PAYLOAD);
+  }
+
+  EXPECT_LE(container.GetSize(), ThroughputRecorderContainer::kMaxRecorders);
+  EXPECT_EQ(container.GetTPRecorder(kPayloadIdA,
+                                    PayloadDirection::OUTGOING_PAYLOAD),
+            held);
+  container.Shutdown();
+}
+
 TEST_F(ThroughputRecorderTest, OnFrameSentSaveTransferredSize) {
   auto TPRecorder = tp_recorder_container_.GetTPRecorder(
       kPayloadIdA, PayloadDirection::OUTGOING_PAYLOAD);
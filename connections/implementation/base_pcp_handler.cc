@@ -21,6 +21,7 @@
 #include <utility>
 #include <vector>
 
+#include "securegcm/d2d_connection_context_v1.h"
 #include "securegcm/ukey2_handshake.h"
 #include "absl/container/flat_hash_set.h"
 #include "absl/strings/escaping.h"
@@ -28,6 +29,7 @@
 #include "absl/types/span.h"
 #include "connections/advertising_options.h"
 #include "connections/connection_options.h"
+#include "connections/implementation/analytics/connection_setup_tracer.h"
 #include "connections/implementation/endpoint_channel_manager.h"
 #include "connections/implementation/client_proxy.h"
 #include "connections/implementation/flags/nearby_connections_feature_flags.h"
@@ -44,10 +46,15 @@
 #include "internal/platform/bluetooth_connection_info.h"
 #include "internal/platform/bluetooth_utils.h"
 #include "internal/platform/cancelable_alarm.h"
+#include "internal/platform/cancellation_flag.h"
+#include "internal/platform/cancellation_flag_listener.h"
+#include "internal/platform/condition_variable.h"
 #include "internal/platform/connection_info.h"
 #include "internal/platform/count_down_latch.h"
 #include "internal/platform/future.h"
 #include "internal/platform/logging.h"
+#include "internal/platform/mutex.h"
+#include "internal/platform/mutex_lock.h"
 #include "internal/platform/wifi_lan_connection_info.h"
 #include "proto/connections_enums.pb.h"
 
@@ -56,6 +63,14 @@ namespace connections {
 
 namespace {
 constexpr int kEndpointCancelAlarmTimeout = 10;
+
+analytics::ConnectionSetupKey GetSetupKey(ClientProxy* client,
+                                          const std::string& endpoint_id,
+                                          bool is_incoming) {
+  return {.client_id = client->GetClientId(),
+          .endpoint_id = endpoint_id,
+          .is_incoming = is_incoming};
+}
 }  // namespace
 
 using ::location::nearby::connections::ConnectionRequestFrame;
@@ -65,6 +80,10 @@ using ::location::nearby::connections::MediumMetadata;
 using ::location::nearby::connections::OfflineFrame;
 using ::location::nearby::connections::PresenceDevice;
 using ::location::nearby::connections::V1Frame;
+using ::nearby::analytics::ConnectionSetupPhase;
+using ::nearby::analytics::ConnectionSetupResult;
+using ::nearby::analytics::ConnectionSetupTracer;
+using ::securegcm::D2DConnectionContextV1;
 using ::securegcm::UKey2Handshake;
 
 constexpr absl::Duration BasePcpHandler::kConnectionRequestReadTimeout;
@@ -94,11 +113,27 @@ void BasePcpHandler::Shutdown() {
   NEARBY_LOGS(INFO) << "BasePcpHandler(" << strategy_.GetName()
                     << ") is bringing down executors.";
   serial_executor_.Shutdown();
+  connect_executor_.Shutdown();
   alarm_executor_.Shutdown();
   NEARBY_LOGS(INFO) << "BasePcpHandler(" << strategy_.GetName()
                     << ") has shut down.";
 }
 
+void BasePcpHandler::ForgetSessions(ClientProxy* client) {
+  encryption_runner_.ForgetSessions(client);
+}
+
+void BasePcpHandler::SaturateConnectExecutorForTesting(
+    CountDownLatch release) {
+  for (int i = 0; i < kMaxConcurrentConnectAttempts; ++i) {
+    ++connect_attempts_in_flight_;
+    connect_executor_.Execute("hold-connect-thread", [this, release]() mutable {
+      release.Await();
+      --connect_attempts_in_flight_;
+    });
+  }
+}
+
 void BasePcpHandler::DisconnectFromEndpointManager() {
   if (stop_.Set(true)) return;
   NEARBY_LOGS(INFO) << "BasePcpHandler(" << strategy_.GetName()
@@ -363,8 +398,11 @@ Status BasePcpHandler::StartDiscovery(ClientProxy* client,
   RunOnPcpHandlerThread(
       "start-discovery",
       [this, client, service_id, stripped_discovery_options, &listener,
-       &response]() RUN_ON_PCP_HANDLER_THREAD()
-          ABSL_LOCKS_EXCLUDED(discovered_endpoint_mutex_) {
+       &response]() RUN_ON_PCP_HANDLER_THREAD() {
+            // Discovery phases of later connection attempts are measured
+            // from here.
+            ConnectionSetupTracer::GetInstance().OnDiscoveryStarted(
+                client->GetClientId());
             // Ask the implementation to attempt to start discovery.
             auto result = StartDiscoveryImpl(client, service_id,
                                              stripped_discovery_options);
@@ -375,10 +413,7 @@ Status BasePcpHandler::StartDiscovery(ClientProxy* client,
 
             // Now that we've succeeded, mark the client as discovering and
             // clear out any old endpoints we had discovered.
-            {
-              MutexLock lock(&discovered_endpoint_mutex_);
-              discovered_endpoints_.clear();
-            }
+            discovered_endpoints_.Clear();
             client->StartedDiscovery(service_id, GetStrategy(), listener,
                                      absl::MakeSpan(result.mediums),
                                      stripped_discovery_options);
@@ -448,6 +483,30 @@ void BasePcpHandler::RunOnPcpHandlerThread(const std::string& name,
   serial_executor_.Execute(name, std::move(runnable));
 }
 
+void BasePcpHandler::RunOnPcpHandlerThreadCoalesced(const std::string& name,
+                                                    std::string key,
+                                                    Runnable runnable) {
+  {
+    MutexLock lock(&coalesced_reports_mutex_);
+    // A task for this key is already pending; it will run this report instead.
+    if (!coalesced_reports_.insert_or_assign(key, std::move(runnable))
+             .second) {
+      return;
+    }
+  }
+  RunOnPcpHandlerThread(name, [this, key = std::move(key)]() {
+    Runnable report;
+    {
+      MutexLock lock(&coalesced_reports_mutex_);
+      auto item = coalesced_reports_.find(key);
+      if (item == coalesced_reports_.end()) return;
+      report = std::move(item->second);
+      coalesced_reports_.erase(item);
+    }
+    report();
+  });
+}
+
 EncryptionRunner::ResultListener BasePcpHandler::GetResultListener() {
   return {
       .on_success_cb =
@@ -461,7 +520,7 @@ EncryptionRunner::ResultListener BasePcpHandler::GetResultListener() {
                  raw_auth_token]() RUN_ON_PCP_HANDLER_THREAD() mutable {
                   OnEncryptionSuccessRunnable(
                       endpoint_id, std::unique_ptr<UKey2Handshake>(raw_ukey2),
-                      auth_token, raw_auth_token);
+                      /*resumed_context=*/nullptr, auth_token, raw_auth_token);
                 });
           },
       .on_failure_cb =
@@ -477,11 +536,28 @@ EncryptionRunner::ResultListener BasePcpHandler::GetResultListener() {
                   OnEncryptionFailureRunnable(endpoint_id, channel);
                 });
           },
+      .on_resumed_cb =
+          [this](const std::string& endpoint_id,
+                 std::unique_ptr<D2DConnectionContextV1> context,
+                 const std::string& auth_token,
+                 const ByteArray& raw_auth_token) {
+            RunOnPcpHandlerThread(
+                "encryption-resumed",
+                [this, endpoint_id, raw_context = context.release(),
+                 auth_token,
+                 raw_auth_token]() RUN_ON_PCP_HANDLER_THREAD() mutable {
+                  OnEncryptionSuccessRunnable(
+                      endpoint_id, /*ukey2=*/nullptr,
+                      std::unique_ptr<D2DConnectionContextV1>(raw_context),
+                      auth_token, raw_auth_token);
+                });
+          },
   };
 }
 
 void BasePcpHandler::OnEncryptionSuccessRunnable(
     const std::string& endpoint_id, std::unique_ptr<UKey2Handshake> ukey2,
+    std::unique_ptr<D2DConnectionContextV1> resumed_context,
     const std::string& auth_token, const ByteArray& raw_auth_token) {
   // Quick fail if we've been removed from pending connections while we were
   // busy running UKEY2.
@@ -496,7 +572,13 @@ void BasePcpHandler::OnEncryptionSuccessRunnable(
   BasePcpHandler::PendingConnectionInfo& connection_info = it->second;
   Medium medium = connection_info.channel->GetMedium();
 
-  if (!ukey2) {
+  ConnectionSetupTracer& tracer = ConnectionSetupTracer::GetInstance();
+  const analytics::ConnectionSetupKey setup_key = GetSetupKey(
+      connection_info.client, endpoint_id, connection_info.is_incoming);
+  tracer.EndPhase(setup_key, ConnectionSetupPhase::kEncryption,
+                  ukey2 || resumed_context);
+
+  if (!ukey2 && !resumed_context) {
     // Fail early, if there is no crypto context.
     ProcessPreConnectionInitiationFailure(
         connection_info.client, medium, endpoint_id,
@@ -506,7 +588,11 @@ void BasePcpHandler::OnEncryptionSuccessRunnable(
     return;
   }
 
-  connection_info.SetCryptoContext(std::move(ukey2));
+  if (ukey2) {
+    connection_info.SetCryptoContext(std::move(ukey2));
+  } else {
+    connection_info.SetCryptoContext(std::move(resumed_context));
+  }
   connection_info.connection_token = GetHashedConnectionToken(raw_auth_token);
   NEARBY_LOGS(INFO)
       << "Register encrypted connection; wait for response; endpoint_id="
@@ -522,6 +608,8 @@ void BasePcpHandler::OnEncryptionSuccessRunnable(
   // Now we register our endpoint so that we can listen for both sides to
   // accept.
   LogConnectionAttemptSuccess(endpoint_id, connection_info);
+  tracer.BeginPhase(setup_key, ConnectionSetupPhase::kRegisterEndpoint,
+                    medium);
   endpoint_manager_->RegisterEndpoint(
       connection_info.client, endpoint_id,
       {
@@ -532,6 +620,9 @@ void BasePcpHandler::OnEncryptionSuccessRunnable(
       },
       connection_options, std::move(connection_info.channel),
       connection_info.listener, connection_info.connection_token);
+  tracer.EndPhase(setup_key, ConnectionSetupPhase::kRegisterEndpoint,
+                  /*succeeded=*/true);
+  tracer.BeginPhase(setup_key, ConnectionSetupPhase::kAcceptance, medium);
 
   if (auto future_status = connection_info.result.lock()) {
     NEARBY_LOGS(INFO) << "Connection established; Finalising future OK.";
@@ -564,6 +655,9 @@ void BasePcpHandler::OnEncryptionFailureRunnable(
                       << "; expected=" << info.channel->GetName();
     return;
   }
+  ConnectionSetupTracer::GetInstance().EndPhase(
+      GetSetupKey(info.client, endpoint_id, info.is_incoming),
+      ConnectionSetupPhase::kEncryption, /*succeeded=*/false);
 
   ProcessPreConnectionInitiationFailure(
       info.client, info.channel->GetMedium(), endpoint_id, info.channel.get(),
@@ -620,6 +714,9 @@ Status BasePcpHandler::RequestConnection(
           result->Set({Status::kEndpointUnknown});
           return;
         }
+        ConnectionSetupTracer::GetInstance().StartTrace(
+            GetSetupKey(client, endpoint_id, /*is_incoming=*/false),
+            start_time);
 
         auto remote_bluetooth_mac_address = BluetoothUtils::ToString(
             connection_options.remote_bluetooth_mac_address);
@@ -635,20 +732,10 @@ Status BasePcpHandler::RequestConnection(
         if (AppendWebRTCEndpoint(endpoint_id, client->GetDiscoveryOptions()))
           NEARBY_LOGS(INFO) << "Appended Web RTC endpoint.";
 
-        auto discovered_endpoints = GetDiscoveredEndpoints(endpoint_id);
-        std::unique_ptr<EndpointChannel> channel;
-        ConnectImplResult connect_impl_result;
-
-        for (auto connect_endpoint : discovered_endpoints) {
-          if (!MediumSupportedByClientOptions(connect_endpoint->medium,
-                                              connection_options))
-            continue;
-          connect_impl_result = ConnectImpl(client, connect_endpoint);
-          if (connect_impl_result.status.Ok()) {
-            channel = std::move(connect_impl_result.endpoint_channel);
-            break;
-          }
-        }
+        ConnectImplResult connect_impl_result = ConnectToDiscoveredEndpoint(
+            client, endpoint_id, connection_options);
+        std::unique_ptr<EndpointChannel> channel =
+            std::move(connect_impl_result.endpoint_channel);
 
         Medium channel_medium =
             channel ? channel->GetMedium() : Medium::UNKNOWN_MEDIUM;
@@ -671,9 +758,15 @@ Status BasePcpHandler::RequestConnection(
             FillConnectionInfo(client, info, connection_options);
 
         const NearbyDevice* local_device = client->GetLocalDevice();
+        ConnectionSetupTracer::GetInstance().BeginPhase(
+            GetSetupKey(client, endpoint_id, /*is_incoming=*/false),
+            ConnectionSetupPhase::kConnectionRequest, channel_medium);
         Exception write_exception = WriteConnectionRequestFrame(
             local_device->GetType(), local_device->ToProtoBytes(),
             connection_info, channel.get());
+        ConnectionSetupTracer::GetInstance().EndPhase(
+            GetSetupKey(client, endpoint_id, /*is_incoming=*/false),
+            ConnectionSetupPhase::kConnectionRequest, write_exception.Ok());
 
         if (!write_exception.Ok()) {
           NEARBY_LOGS(INFO) << "Failed to send connection request: endpoint_id="
@@ -717,6 +810,9 @@ Status BasePcpHandler::RequestConnection(
                           << endpoint_id;
         // Next, we'll set up encryption. When it's done, our future will return
         // and RequestConnection() will finish.
+        ConnectionSetupTracer::GetInstance().BeginPhase(
+            GetSetupKey(client, endpoint_id, /*is_incoming=*/false),
+            ConnectionSetupPhase::kEncryption, channel_medium);
         encryption_runner_.StartClient(client, endpoint_id, endpoint_channel,
                                        GetResultListener());
       });
@@ -757,6 +853,9 @@ Status BasePcpHandler::RequestConnectionV3(
           result->Set({Status::kEndpointUnknown});
           return;
         }
+        ConnectionSetupTracer::GetInstance().StartTrace(
+            GetSetupKey(client, endpoint_id, /*is_incoming=*/false),
+            start_time);
 
         auto remote_bluetooth_mac_address = BluetoothUtils::ToString(
             connection_options.remote_bluetooth_mac_address);
@@ -772,25 +871,10 @@ Status BasePcpHandler::RequestConnectionV3(
         if (AppendWebRTCEndpoint(endpoint_id, client->GetDiscoveryOptions()))
           NEARBY_LOGS(INFO) << "Appended Web RTC endpoint.";
 
-        auto discovered_endpoints = GetDiscoveredEndpoints(endpoint_id);
-        std::unique_ptr<EndpointChannel> channel;
-        ConnectImplResult connect_impl_result;
-
-        for (auto connect_endpoint : discovered_endpoints) {
-          if (!MediumSupportedByClientOptions(connect_endpoint->medium,
-                                              connection_options))
-            continue;
-          NEARBY_LOGS(INFO)
-              << "Try to connect with endpoint(id=" << endpoint_id
-              << ") by Medium: "
-              << location::nearby::proto::connections::Medium_Name(
-                     connect_endpoint->medium);
-          connect_impl_result = ConnectImpl(client, connect_endpoint);
-          if (connect_impl_result.status.Ok()) {
-            channel = std::move(connect_impl_result.endpoint_channel);
-            break;
-          }
-        }
+        ConnectImplResult connect_impl_result = ConnectToDiscoveredEndpoint(
+            client, endpoint_id, connection_options);
+        std::unique_ptr<EndpointChannel> channel =
+            std::move(connect_impl_result.endpoint_channel);
 
         Medium channel_medium =
             channel ? channel->GetMedium() : Medium::UNKNOWN_MEDIUM;
@@ -816,9 +900,15 @@ Status BasePcpHandler::RequestConnectionV3(
             FillConnectionInfo(client, info, connection_options);
 
         const NearbyDevice* local_device = client->GetLocalDevice();
+        ConnectionSetupTracer::GetInstance().BeginPhase(
+            GetSetupKey(client, endpoint_id, /*is_incoming=*/false),
+            ConnectionSetupPhase::kConnectionRequest, channel_medium);
         Exception write_exception = WriteConnectionRequestFrame(
             local_device->GetType(), local_device->ToProtoBytes(),
             connection_info, channel.get());
+        ConnectionSetupTracer::GetInstance().EndPhase(
+            GetSetupKey(client, endpoint_id, /*is_incoming=*/false),
+            ConnectionSetupPhase::kConnectionRequest, write_exception.Ok());
 
         if (!write_exception.Ok()) {
           NEARBY_LOGS(INFO) << "Failed to send connection request: endpoint_id="
@@ -860,6 +950,9 @@ Status BasePcpHandler::RequestConnectionV3(
                           << endpoint_id;
         // Next, we'll set up encryption. When it's done, our future will return
         // and RequestConnection() will finish.
+        ConnectionSetupTracer::GetInstance().BeginPhase(
+            GetSetupKey(client, endpoint_id, /*is_incoming=*/false),
+            ConnectionSetupPhase::kEncryption, channel_medium);
         encryption_runner_.StartClient(client, endpoint_id, endpoint_channel,
                                        GetResultListener());
       });
@@ -884,6 +977,208 @@ bool BasePcpHandler::MediumSupportedByClientOptions(
   return false;
 }
 
+// State shared by RaceConnectImpl() and the connection attempts it starts.
+// Attempts that lose the race can outlive RaceConnectImpl(), so this is
+// reference counted.
+struct BasePcpHandler::ConnectRace {
+  explicit ConnectRace(int attempts) {
+    for (int i = 0; i < attempts; ++i) {
+      cancellation_flags.push_back(std::make_unique<CancellationFlag>());
+    }
+  }
+
+  void CancelAllExcept(int attempt) {
+    for (int i = 0; i < static_cast<int>(cancellation_flags.size()); ++i) {
+      if (i != attempt) cancellation_flags[i]->Cancel();
+    }
+  }
+
+  // One flag per attempt. Fixed in size once the race starts.
+  std::vector<std::unique_ptr<CancellationFlag>> cancellation_flags;
+
+  Mutex mutex;
+  ConditionVariable attempt_finished{&mutex};
+  // Attempts started and not yet finished.
+  int running ABSL_GUARDED_BY(mutex) = 0;
+  // Index of the first attempt to connect, or -1.
+  int winner ABSL_GUARDED_BY(mutex) = -1;
+  ConnectImplResult winner_result ABSL_GUARDED_BY(mutex);
+  ConnectImplResult last_failure ABSL_GUARDED_BY(mutex);
+};
+
+BasePcpHandler::ConnectImplResult BasePcpHandler::ConnectToDiscoveredEndpoint(
+    ClientProxy* client, const std::string& endpoint_id,
+    const ConnectionOptions& connection_options) {
+  // Medium availability may have changed since the endpoints were found.
+  discovered_endpoints_.SetMediumPriority(GetConnectionMediumsByPriority());
+  std::vector<std::shared_ptr<DiscoveredEndpoint>> endpoints =
+      discovered_endpoints_.Get(endpoint_id);
+  endpoints.erase(
+      std::remove_if(endpoints.begin(), endpoints.end(),
+                     [this, &connection_options](
+                         const std::shared_ptr<DiscoveredEndpoint>& endpoint) {
+                       return !MediumSupportedByClientOptions(
+                           endpoint->medium, connection_options);
+                     }),
+      endpoints.end());
+
+  if (connection_options.race_connection_mediums && endpoints.size() > 1) {
+    return RaceConnectImpl(
+        client, endpoint_id, endpoints,
+        absl::Milliseconds(connection_options.connection_race_stagger_millis));
+  }
+
+  ConnectImplResult result;
+  for (const auto& endpoint : endpoints) {
+    NEARBY_LOGS(INFO) << "Try to connect with endpoint(id=" << endpoint_id
+                      << ") by Medium: "
+                      << location::nearby::proto::connections::Medium_Name(
+                             endpoint->medium);
+    ConnectionSetupTracer::GetInstance().BeginPhase(
+        GetSetupKey(client, endpoint_id, /*is_incoming=*/false),
+        ConnectionSetupPhase::kMediumConnect, endpoint->medium);
+    result = ConnectImpl(client, endpoint.get(),
+                         client->GetCancellationFlag(endpoint_id));
+    ConnectionSetupTracer::GetInstance().EndPhase(
+        GetSetupKey(client, endpoint_id, /*is_incoming=*/false),
+        ConnectionSetupPhase::kMediumConnect, result.status.Ok(),
+        endpoint->medium);
+    if (result.status.Ok()) break;
+  }
+  return result;
+}
+
+BasePcpHandler::ConnectImplResult BasePcpHandler::RaceConnectImpl(
+    ClientProxy* client, const std::string& endpoint_id,
+    const std::vector<std::shared_ptr<DiscoveredEndpoint>>& endpoints,
+    absl::Duration stagger) {
+  auto race = std::make_shared<ConnectRace>(endpoints.size());
+
+  // Cancelling the endpoint cancels every attempt still in the race.
+  CancellationFlag* endpoint_cancellation_flag =
+      client->GetCancellationFlag(endpoint_id);
+  CancellationFlagListener endpoint_cancellation_listener(
+      endpoint_cancellation_flag, [race]() { race->CancelAllExcept(-1); });
+  if (endpoint_cancellation_flag->Cancelled()) race->CancelAllExcept(-1);
+
+  const int attempts = endpoints.size();
+  int next = 0;
+  absl::Time next_start_time = SystemClock::ElapsedRealtime();
+  int winner = -1;
+  {
+    MutexLock lock(&race->mutex);
+    while (race->winner < 0) {
+      absl::Time now = SystemClock::ElapsedRealtime();
+      bool can_start_next = next < attempts;
+      bool thread_free =
+          connect_attempts_in_flight_ < kMaxConcurrentConnectAttempts;
+      if (can_start_next && thread_free &&
+          (race->running == 0 || now >= next_start_time)) {
+        int attempt = next++;
+        std::shared_ptr<DiscoveredEndpoint> endpoint = endpoints[attempt];
+        NEARBY_LOGS(INFO) << "Try to connect with endpoint(id=" << endpoint_id
+                          << ") by Medium: "
+                          << location::nearby::proto::connections::Medium_Name(
+                                 endpoint->medium);
+        ++race->running;
+        ++connect_attempts_in_flight_;
+        next_start_time = now + stagger;
+        connect_executor_.Execute(
+            "connect-attempt", [this, client, race, endpoint, attempt]() {
+              ConnectionSetupTracer& tracer =
+                  ConnectionSetupTracer::GetInstance();
+              const analytics::ConnectionSetupKey setup_key = GetSetupKey(
+                  client, endpoint->endpoint_id, /*is_incoming=*/false);
+              tracer.BeginPhase(setup_key,
+                                ConnectionSetupPhase::kMediumConnect,
+                                endpoint->medium);
+              ConnectImplResult result = ConnectImpl(
+                  client, endpoint.get(),
+                  race->cancellation_flags[attempt].get());
+              tracer.EndPhase(setup_key, ConnectionSetupPhase::kMediumConnect,
+                              result.status.Ok(), endpoint->medium);
+              std::unique_ptr<EndpointChannel> unused_channel;
+              {
+                MutexLock lock(&race->mutex);
+                --race->running;
+                if (!result.status.Ok()) {
+                  race->last_failure = std::move(result);
+                } else if (race->winner < 0) {
+                  race->winner = attempt;
+                  race->winner_result = std::move(result);
+                } else {
+                  unused_channel = std::move(result.endpoint_channel);
+                }
+                race->attempt_finished.Notify();
+              }
+              if (unused_channel) {
+                NEARBY_LOGS(INFO)
+                    << "Closing the channel to endpoint(id="
+                    << endpoint->endpoint_id << ") over "
+                    << location::nearby::proto::connections::Medium_Name(
+                           endpoint->medium)
+                    << ", which lost the connection race.";
+                unused_channel->Close();
+              }
+              --connect_attempts_in_flight_;
+            });
+        continue;
+      }
+      if (race->running == 0) {
+        // Every medium was tried and failed.
+        if (!can_start_next) return std::move(race->last_failure);
+        // Attempts of earlier races that ignore cancellation hold every
+        // thread of connect_executor_.
+        break;
+      }
+      if (can_start_next && thread_free) {
+        race->attempt_finished.Wait(next_start_time - now);
+      } else {
+        race->attempt_finished.Wait();
+      }
+    }
+    winner = race->winner;
+  }
+
+  if (winner < 0) {
+    NEARBY_LOGS(WARNING) << "No thread left to race connections to endpoint(id="
+                         << endpoint_id
+                         << "), trying the remaining mediums one at a time.";
+    ConnectImplResult result;
+    {
+      MutexLock lock(&race->mutex);
+      result = std::move(race->last_failure);
+    }
+    for (; next < attempts; ++next) {
+      DiscoveredEndpoint* endpoint = endpoints[next].get();
+      NEARBY_LOGS(INFO) << "Try to connect with endpoint(id=" << endpoint_id
+                        << ") by Medium: "
+                        << location::nearby::proto::connections::Medium_Name(
+                               endpoint->medium);
+      ConnectionSetupTracer::GetInstance().BeginPhase(
+          GetSetupKey(client, endpoint_id, /*is_incoming=*/false),
+          ConnectionSetupPhase::kMediumConnect, endpoint->medium);
+      result = ConnectImpl(client, endpoint,
+                           race->cancellation_flags[next].get());
+      ConnectionSetupTracer::GetInstance().EndPhase(
+          GetSetupKey(client, endpoint_id, /*is_incoming=*/false),
+          ConnectionSetupPhase::kMediumConnect, result.status.Ok(),
+          endpoint->medium);
+      if (result.status.Ok()) break;
+    }
+    return result;
+  }
+
+  race->CancelAllExcept(winner);
+  MutexLock lock(&race->mutex);
+  NEARBY_LOGS(INFO) << "Connected to endpoint(id=" << endpoint_id << ") over "
+                    << location::nearby::proto::connections::Medium_Name(
+                           endpoints[winner]->medium)
+                    << " after trying " << next << " of " << attempts
+                    << " mediums.";
+  return std::move(race->winner_result);
+}
+
 // Get ordered supported connection medium based on local advertising/discovery
 // option.
 std::vector<location::nearby::proto::connections::Medium>
@@ -963,27 +1258,15 @@ void BasePcpHandler::StripOutUnavailableMediums(
 // Get any single discovered endpoint for a given endpoint_id.
 BasePcpHandler::DiscoveredEndpoint* BasePcpHandler::GetDiscoveredEndpoint(
     const std::string& endpoint_id) {
-  MutexLock lock(&discovered_endpoint_mutex_);
-  auto it = discovered_endpoints_.find(endpoint_id);
-  if (it == discovered_endpoints_.end()) {
-    return nullptr;
-  }
-  return it->second.get();
+  return discovered_endpoints_.GetPreferred(endpoint_id).get();
 }
 
 std::vector<BasePcpHandler::DiscoveredEndpoint*>
 BasePcpHandler::GetDiscoveredEndpoints(const std::string& endpoint_id) {
   std::vector<BasePcpHandler::DiscoveredEndpoint*> result;
-  MutexLock lock(&discovered_endpoint_mutex_);
-  auto it = discovered_endpoints_.equal_range(endpoint_id);
-  for (auto item = it.first; item != it.second; item++) {
-    result.push_back(item->second.get());
-  }
-  std::sort(result.begin(), result.end(),
-            [this](DiscoveredEndpoint* a, DiscoveredEndpoint* b) -> bool {
-              return IsPreferred(*a, *b);
-            });
-
+  for (const auto& endpoint : discovered_endpoints_.Get(endpoint_id)) {
+    result.push_back(endpoint.get());
+  }
   return result;
 }
 
@@ -991,33 +1274,25 @@ std::vector<BasePcpHandler::DiscoveredEndpoint*>
 BasePcpHandler::GetDiscoveredEndpoints(
     const location::nearby::proto::connections::Medium medium) {
   std::vector<BasePcpHandler::DiscoveredEndpoint*> result;
-  MutexLock lock(&discovered_endpoint_mutex_);
-  for (const auto& item : discovered_endpoints_) {
-    if (item.second->medium == medium) {
-      result.push_back(item.second.get());
-    }
+  for (const auto& endpoint : discovered_endpoints_.GetByMedium(medium)) {
+    result.push_back(endpoint.get());
   }
   return result;
 }
 
-namespace {
-std::string GetEndpointLostByMediumAlarmKey(absl::string_view endpoint_id,
-                                            Medium medium) {
-  return absl::StrCat(location::nearby::proto::connections::Medium_Name(medium),
-                      "_", endpoint_id);
-}
-}  // namespace
-
 void BasePcpHandler::StartEndpointLostByMediumAlarms(
     ClientProxy* client, location::nearby::proto::connections::Medium medium) {
-  auto discovered_endpoints_medium = GetDiscoveredEndpoints(medium);
-  for (const auto discovered_endpoint : discovered_endpoints_medium) {
-    std::string key = GetEndpointLostByMediumAlarmKey(
-        discovered_endpoint->endpoint_id, medium);
+  for (const std::shared_ptr<DiscoveredEndpoint>& discovered_endpoint :
+       discovered_endpoints_.GetByMedium(medium)) {
+    std::pair<std::string, Medium> key(discovered_endpoint->endpoint_id,
+                                       medium);
     StopEndpointLostByMediumAlarm(discovered_endpoint->endpoint_id, medium);
     endpoint_lost_by_medium_alarms_.emplace(
         key, std::make_unique<CancelableAlarm>(
-                 absl::StrCat("EndpointLostByMediumAlarm_", key),
+                 absl::StrCat(
+                     "EndpointLostByMediumAlarm_",
+                     location::nearby::proto::connections::Medium_Name(medium),
+                     "_", discovered_endpoint->endpoint_id),
                  [this, discovered_endpoint, key, client]() {
                    RunOnPcpHandlerThread(
                        "endpoint-lost-by-medium-alarm",
@@ -1035,10 +1310,11 @@ void BasePcpHandler::StartEndpointLostByMediumAlarms(
 void BasePcpHandler::StopEndpointLostByMediumAlarm(
     absl::string_view endpoint_id,
     location::nearby::proto::connections::Medium medium) {
-  std::string key = GetEndpointLostByMediumAlarmKey(endpoint_id, medium);
-  if (endpoint_lost_by_medium_alarms_.contains(key)) {
-    endpoint_lost_by_medium_alarms_[key]->Cancel();
-    endpoint_lost_by_medium_alarms_.erase(key);
+  auto it = endpoint_lost_by_medium_alarms_.find(
+      std::make_pair(std::string(endpoint_id), medium));
+  if (it != endpoint_lost_by_medium_alarms_.end()) {
+    it->second->Cancel();
+    endpoint_lost_by_medium_alarms_.erase(it);
   }
 }
 
@@ -1120,6 +1396,9 @@ void BasePcpHandler::ProcessPreConnectionInitiationFailure(
 
   LogConnectionAttemptFailure(client, medium, endpoint_id, is_incoming,
                               start_time, channel);
+  ConnectionSetupTracer::GetInstance().OnSetupFinished(
+      GetSetupKey(client, endpoint_id, is_incoming),
+      ConnectionSetupResult::kFailed, medium);
   // result is hold inside a swapper, and saved in PendingConnectionInfo.
   // PendingConnectionInfo destructor will clear the memory of SettableFuture
   // shared_ptr for result.
@@ -1318,6 +1597,12 @@ void BasePcpHandler::OnIncomingFrame(
         }
         channel_manager_->UpdateSafeToDisconnectForEndpoint(endpoint_id,
                          client->IsSafeToDisconnectEnabled(endpoint_id));
+        if (connection_response.supports_session_resumption()) {
+          auto pending = pending_connections_.find(endpoint_id);
+          if (pending != pending_connections_.end()) {
+            pending->second.remote_supports_session_resumption = true;
+          }
+        }
         EvaluateConnectionResult(client, endpoint_id,
                                  /* can_close_immediately= */ true);
 
@@ -1335,6 +1620,9 @@ void BasePcpHandler::OnEndpointDisconnect(ClientProxy* client,
     barrier.CountDown();
     return;
   }
+  // A remembered session is only good for a short while after the connection
+  // is gone, so that the endpoints can quickly reconnect.
+  encryption_runner_.EndSession(client, endpoint_id);
   RunOnPcpHandlerThread("on-endpoint-disconnect",
                         [this, client, endpoint_id, barrier, reason]()
                             RUN_ON_PCP_HANDLER_THREAD() mutable {
@@ -1348,6 +1636,8 @@ void BasePcpHandler::OnEndpointDisconnect(ClientProxy* client,
                                   client, endpoint_id,
                                   /* should_call_disconnect_endpoint= */ false,
                                   reason);
+                              ConnectionSetupTracer::GetInstance().EndTraces(
+                                  client->GetClientId(), endpoint_id);
                               barrier.CountDown();
                             });
 }
@@ -1361,50 +1651,35 @@ BluetoothDevice BasePcpHandler::GetRemoteBluetoothDevice(
 void BasePcpHandler::OnEndpointFound(
     ClientProxy* client, std::shared_ptr<DiscoveredEndpoint> endpoint) {
   // Check if we've seen this endpoint ID before.
-  std::string& endpoint_id = endpoint->endpoint_id;
+  std::string endpoint_id = endpoint->endpoint_id;
   NEARBY_LOGS(INFO) << "OnEndpointFound: id=" << endpoint_id << " [enter]";
-  MutexLock lock(&discovered_endpoint_mutex_);
-  auto range = discovered_endpoints_.equal_range(endpoint->endpoint_id);
-  bool is_range_empty = range.first == range.second;
-  DiscoveredEndpoint* owned_endpoint = nullptr;
-  for (auto& item = range.first; item != range.second; ++item) {
-    auto& discovered_endpoint = item->second;
-    if (discovered_endpoint->medium != endpoint->medium) continue;
-    // Check if there was a info change. If there was, report the previous
-    // endpoint as lost.
-    if (discovered_endpoint->endpoint_info != endpoint->endpoint_info) {
-      owned_endpoint = discovered_endpoint.get();
-      client->OnEndpointLost(owned_endpoint->service_id,
-                             owned_endpoint->endpoint_id);
-      discovered_endpoints_.erase(item);
-      owned_endpoint =
-          discovered_endpoints_.emplace(endpoint_id, std::move(endpoint))
-              ->second.get();
-      StopEndpointLostByMediumAlarm(owned_endpoint->endpoint_id,
-                                    owned_endpoint->medium);
-      client->OnEndpointFound(
-          owned_endpoint->service_id, owned_endpoint->endpoint_id,
-          owned_endpoint->endpoint_info, owned_endpoint->medium);
-      return;
-    } else {
-      owned_endpoint = endpoint.get();
-      break;
-    }
+  discovered_endpoints_.SetMediumPriority(GetConnectionMediumsByPriority());
+  DiscoveredEndpointRegistry<DiscoveredEndpoint>::Update update =
+      discovered_endpoints_.AddOrReplace(std::move(endpoint));
+  DiscoveredEndpoint* owned_endpoint = update.endpoint.get();
+  // Check if there was a info change. If there was, report the previous
+  // endpoint as lost.
+  if (update.result ==
+      DiscoveredEndpointRegistry<DiscoveredEndpoint>::UpdateResult::kReplaced) {
+    client->OnEndpointLost(update.replaced->service_id,
+                           update.replaced->endpoint_id);
+    StopEndpointLostByMediumAlarm(owned_endpoint->endpoint_id,
+                                  owned_endpoint->medium);
+    client->OnEndpointFound(
+        owned_endpoint->service_id, owned_endpoint->endpoint_id,
+        owned_endpoint->endpoint_info, owned_endpoint->medium);
+    return;
   }
 
-  if (!owned_endpoint) {
-    owned_endpoint =
-        discovered_endpoints_.emplace(endpoint_id, std::move(endpoint))
-            ->second.get();
-  }
   NEARBY_LOGS(INFO) << "Adding new medium for endpoint: endpoint_id="
                     << endpoint_id << "; medium="
                     << location::nearby::proto::connections::Medium_Name(
                            owned_endpoint->medium);
+  ConnectionSetupTracer::GetInstance().OnEndpointFound(
+      client->GetClientId(), endpoint_id, owned_endpoint->medium);
 
-  // Range is empty: this is the first endpoint we discovered so far.
-  // Report this endpoint_id to client.
-  if (is_range_empty) {
+  // This is the first medium we discovered the endpoint on so far.
+  if (update.first_for_endpoint) {
     // And, as it's the first time, report it to the client.
     client->OnEndpointFound(
         owned_endpoint->service_id, owned_endpoint->endpoint_id,
@@ -1416,40 +1691,30 @@ void BasePcpHandler::OnEndpointLost(
     ClientProxy* client, const BasePcpHandler::DiscoveredEndpoint& endpoint) {
   // Look up the DiscoveredEndpoint we have in our cache.
   NEARBY_LOGS(INFO) << "OnEndpointLost: id=" << endpoint.endpoint_id;
-  MutexLock lock(&discovered_endpoint_mutex_);
-  auto range = discovered_endpoints_.equal_range(endpoint.endpoint_id);
-  bool is_range_empty = range.first == range.second;
-  if (is_range_empty) {
+  DiscoveredEndpointRegistry<DiscoveredEndpoint>::Removal removal =
+      discovered_endpoints_.Remove(endpoint.endpoint_id, endpoint.medium);
+  if (removal.removed == nullptr) {
     NEARBY_LOGS(INFO) << "No previous endpoint (nothing to lose): endpoint_id="
                       << endpoint.endpoint_id;
     return;
   }
-  int count = discovered_endpoints_.count(endpoint.endpoint_id);
-  absl::btree_multimap<std::string,
-                       std::shared_ptr<DiscoveredEndpoint>>::iterator item;
-  for (item = range.first; item != range.second; ++item) {
-    auto& discovered_endpoint = item->second;
-    if (discovered_endpoint->medium != endpoint.medium) continue;
-
-    // Validate that the cached endpoint has the same info as the one reported
-    // as onLost. If the info differs, we still remove it. This likely means
-    // that the remote device changed their info. We reported onFound for the
-    // new info and are just now figuring out that we lost the old info.
-    if (discovered_endpoint->endpoint_info != endpoint.endpoint_info) {
-      NEARBY_LOGS(INFO) << "Previous endpoint name mismatch; passed="
-                        << absl::BytesToHexString(endpoint.endpoint_info.data())
-                        << "; expected="
-                        << absl::BytesToHexString(
-                               discovered_endpoint->endpoint_info.data());
-    }
-    NEARBY_LOGS(INFO) << "Erase Endpoint with Meduim: "
-                      << location::nearby::proto::connections::Medium_Name(
-                             discovered_endpoint->medium);
-    if (--count == 0) {
-      client->OnEndpointLost(endpoint.service_id, endpoint.endpoint_id);
-    }
-    discovered_endpoints_.erase(item);
-    break;
+
+  // Validate that the cached endpoint has the same info as the one reported
+  // as onLost. If the info differs, we still remove it. This likely means
+  // that the remote device changed their info. We reported onFound for the
+  // new info and are just now figuring out that we lost the old info.
+  if (removal.removed->endpoint_info != endpoint.endpoint_info) {
+    NEARBY_LOGS(INFO) << "Previous endpoint name mismatch; passed="
+                      << absl::BytesToHexString(endpoint.endpoint_info.data())
+                      << "; expected="
+                      << absl::BytesToHexString(
+                             removal.removed->endpoint_info.data());
+  }
+  NEARBY_LOGS(INFO) << "Erase Endpoint with Meduim: "
+                    << location::nearby::proto::connections::Medium_Name(
+                           removal.removed->medium);
+  if (removal.was_last) {
+    client->OnEndpointLost(endpoint.service_id, endpoint.endpoint_id);
   }
 }
 
@@ -1517,39 +1782,6 @@ bool BasePcpHandler::NeedsToTurnOffDiscoveryMedium(
                     medium) != new_disabled_mediums.end());
 }
 
-bool BasePcpHandler::IsPreferred(
-    const BasePcpHandler::DiscoveredEndpoint& new_endpoint,
-    const BasePcpHandler::DiscoveredEndpoint& old_endpoint) {
-  std::vector<location::nearby::proto::connections::Medium> mediums =
-      GetConnectionMediumsByPriority();
-  // Make sure the comparator is irreflexive, so we have a strict weak ordering.
-  if (new_endpoint.medium != old_endpoint.medium) {
-    // As we iterate through the list of mediums, we see if we run into the new
-    // endpoint's medium or the old endpoint's medium first.
-    for (const auto& medium : mediums) {
-      if (medium == new_endpoint.medium) {
-        // The new endpoint's medium came first. It's preferred!
-        return true;
-      }
-
-      if (medium == old_endpoint.medium) {
-        // The old endpoint's medium came first. Stick with the old endpoint!
-        return false;
-      }
-    }
-  }
-  std::string medium_string;
-  for (const auto& medium : mediums) {
-    absl::StrAppend(&medium_string, medium, "; ");
-  }
-  NEARBY_LOGS(ERROR) << "Failed to find either " << new_endpoint.medium
-                     << " or " << old_endpoint.medium
-                     << " in the list of locally supported mediums despite "
-                        "expecting to find both, when deciding which medium "
-                     << medium_string << " is preferred.";
-  return false;
-}
-
 Exception BasePcpHandler::OnIncomingConnection(
     ClientProxy* client, const ByteArray& remote_endpoint_info,
     std::unique_ptr<EndpointChannel> channel,
@@ -1713,6 +1945,16 @@ Exception BasePcpHandler::OnIncomingConnection(
                                      std::move(pendingConnectionInfo))
                             .first->second.channel.get();
 
+  // The trace starts only now, so that a request that loses a tie-break or is
+  // turned away doesn't complete the trace of our own outgoing attempt.
+  ConnectionSetupTracer& tracer = ConnectionSetupTracer::GetInstance();
+  const analytics::ConnectionSetupKey setup_key = GetSetupKey(
+      client, connection_request.endpoint_id(), /*is_incoming=*/true);
+  tracer.StartTrace(setup_key, start_time);
+  tracer.RecordPhase(setup_key, ConnectionSetupPhase::kConnectionRequest,
+                     medium, start_time, /*succeeded=*/true);
+  tracer.BeginPhase(setup_key, ConnectionSetupPhase::kEncryption, medium);
+
   // Next, we'll set up encryption.
   encryption_runner_.StartServer(client, connection_request.endpoint_id(),
                                  owned_channel, GetResultListener());
@@ -1829,15 +2071,15 @@ bool BasePcpHandler::AppendRemoteBluetoothMacAddressEndpoint(
   if (!local_discovery_options.allowed.bluetooth) {
     return false;
   }
-  MutexLock lock(&discovered_endpoint_mutex_);
 
-  auto it = discovered_endpoints_.equal_range(endpoint_id);
-  if (it.first == it.second) {
+  std::vector<std::shared_ptr<DiscoveredEndpoint>> endpoints =
+      discovered_endpoints_.Get(endpoint_id);
+  if (endpoints.empty()) {
     return false;
   }
-  auto endpoint = it.first->second.get();
-  for (auto item = it.first; item != it.second; item++) {
-    if (item->second->medium ==
+  auto endpoint = endpoints.front();
+  for (const auto& item : endpoints) {
+    if (item->medium ==
         location::nearby::proto::connections::Medium::BLUETOOTH) {
       NEARBY_LOGS(INFO)
           << "Cannot append remote Bluetooth MAC Address endpoint, because "
@@ -1865,8 +2107,9 @@ bool BasePcpHandler::AppendRemoteBluetoothMacAddressEndpoint(
           remote_bluetooth_device,
       });
 
-  discovered_endpoints_.emplace(endpoint_id, std::move(bluetooth_endpoint));
-  return true;
+  discovered_endpoints_.SetMediumPriority(GetConnectionMediumsByPriority());
+  return discovered_endpoints_.AddToKnownEndpoint(
+      std::move(bluetooth_endpoint));
 }
 
 bool BasePcpHandler::AppendWebRTCEndpoint(
@@ -1875,14 +2118,14 @@ bool BasePcpHandler::AppendWebRTCEndpoint(
   if (!local_discovery_options.allowed.web_rtc) {
     return false;
   }
-  MutexLock lock(&discovered_endpoint_mutex_);
 
   bool should_connect_web_rtc = false;
-  auto it = discovered_endpoints_.equal_range(endpoint_id);
-  if (it.first == it.second) return false;
-  auto endpoint = it.first->second.get();
-  for (auto item = it.first; item != it.second; item++) {
-    if (item->second->web_rtc_state != WebRtcState::kUnconnectable) {
+  std::vector<std::shared_ptr<DiscoveredEndpoint>> endpoints =
+      discovered_endpoints_.Get(endpoint_id);
+  if (endpoints.empty()) return false;
+  auto endpoint = endpoints.front();
+  for (const auto& item : endpoints) {
+    if (item->web_rtc_state != WebRtcState::kUnconnectable) {
       should_connect_web_rtc = true;
       break;
     }
@@ -1897,8 +2140,8 @@ bool BasePcpHandler::AppendWebRTCEndpoint(
                                     endpoint->endpoint_info),
   });
 
-  discovered_endpoints_.emplace(endpoint_id, std::move(webrtc_endpoint));
-  return true;
+  discovered_endpoints_.SetMediumPriority(GetConnectionMediumsByPriority());
+  return discovered_endpoints_.AddToKnownEndpoint(std::move(webrtc_endpoint));
 }
 
 void BasePcpHandler::EvaluateConnectionResult(ClientProxy* client,
@@ -1943,25 +2186,58 @@ void BasePcpHandler::EvaluateConnectionResult(ClientProxy* client,
     // channels
     // Now, after both parties accepted connection (presumably after verifying &
     // matching security tokens), we are allowed to extract the shared key.
-    auto ukey2 = std::move(connection_info.ukey2);
-    bool succeeded = ukey2->VerifyHandshake();
-    CHECK(succeeded);  // If this fails, it's a UKEY2 protocol bug.
-    auto context = ukey2->ToConnectionContext();
-    CHECK(context);  // there is no way how this can fail, if Verify succeeded.
-    // If it did, it's a UKEY2 protocol bug.
+    std::unique_ptr<D2DConnectionContextV1> context;
+    if (connection_info.resumed_context) {
+      context = std::move(connection_info.resumed_context);
+    } else {
+      auto ukey2 = std::move(connection_info.ukey2);
+      bool succeeded = ukey2->VerifyHandshake();
+      CHECK(succeeded);  // If this fails, it's a UKEY2 protocol bug.
+      context = ukey2->ToConnectionContext();
+      CHECK(context);  // there is no way how this can fail, if Verify
+                       // succeeded. If it did, it's a UKEY2 protocol bug.
+    }
+
+    // Both sides remember the session only once it is accepted, and only if
+    // both can resume it, so that a quick reconnect can skip UKEY2. A resumed
+    // session is remembered again under its new keys.
+    if (NearbyFlags::GetInstance().GetBoolFlag(
+            config_package_nearby::nearby_connections_feature::
+                kEnableSessionResumption)) {
+      if (connection_info.remote_supports_session_resumption) {
+        encryption_runner_.RememberSession(client, endpoint_id, *context);
+      } else {
+        encryption_runner_.ForgetSession(client, endpoint_id);
+      }
+    } else {
+      // Don't resume sessions remembered before the flag was turned off.
+      encryption_runner_.ForgetAllSessions();
+    }
 
     if (!channel_manager_->EncryptChannelForEndpoint(endpoint_id,
                                                      std::move(context))) {
       response_code = {Status::kEndpointUnknown};
+      encryption_runner_.ForgetSession(client, endpoint_id);
     }
   } else {
     NEARBY_LOGS(INFO) << "Pending connection rejected; endpoint_id="
                       << endpoint_id;
     response_code = {Status::kConnectionRejected};
+    encryption_runner_.ForgetSession(client, endpoint_id);
   }
 
+  ConnectionSetupTracer& tracer = ConnectionSetupTracer::GetInstance();
+  const analytics::ConnectionSetupKey setup_key =
+      GetSetupKey(client, endpoint_id, connection_info.is_incoming);
+  tracer.EndPhase(setup_key, ConnectionSetupPhase::kAcceptance,
+                  response_code.Ok());
+
   // If the connection failed, clean everything up and short circuit.
   if (!response_code.Ok()) {
+    tracer.OnSetupFinished(setup_key,
+                           is_connection_accepted
+                               ? ConnectionSetupResult::kFailed
+                               : ConnectionSetupResult::kRejected);
     client->OnConnectionRejected(endpoint_id, response_code);
 
     // Clean up the channel in EndpointManager if it's no longer required.
@@ -1987,6 +2263,7 @@ void BasePcpHandler::EvaluateConnectionResult(ClientProxy* client,
       channel_manager_->GetChannelForEndpoint(endpoint_id)->GetMedium();
   client->GetAnalyticsRecorder().OnConnectionEstablished(
       endpoint_id, medium, connection_info.connection_token);
+  tracer.OnSetupFinished(setup_key, ConnectionSetupResult::kConnected, medium);
 
   // Invoke the client callback to let it know of the connection result.
   client->OnConnectionAccepted(endpoint_id);
@@ -2129,6 +2406,11 @@ void BasePcpHandler::PendingConnectionInfo::SetCryptoContext(
   this->ukey2 = std::move(ukey2);
 }
 
+void BasePcpHandler::PendingConnectionInfo::SetCryptoContext(
+    std::unique_ptr<D2DConnectionContextV1> resumed_context) {
+  this->resumed_context = std::move(resumed_context);
+}
+
 BasePcpHandler::PendingConnectionInfo::~PendingConnectionInfo() {
   auto future_status = result.lock();
   if (future_status && !future_status->IsSet()) {
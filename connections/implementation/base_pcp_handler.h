@@ -15,19 +15,21 @@
 #ifndef CORE_INTERNAL_BASE_PCP_HANDLER_H_
 #define CORE_INTERNAL_BASE_PCP_HANDLER_H_
 
+#include <atomic>
 #include <cstdint>
 #include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "securegcm/d2d_connection_context_v1.h"
 #include "securegcm/ukey2_handshake.h"
 #include "absl/base/thread_annotations.h"
-#include "absl/container/btree_map.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/time/time.h"
 #include "connections/implementation/bwu_manager.h"
 #include "connections/implementation/client_proxy.h"
+#include "connections/implementation/discovered_endpoint_registry.h"
 #include "connections/implementation/encryption_runner.h"
 #include "connections/implementation/endpoint_channel_manager.h"
 #include "connections/implementation/endpoint_manager.h"
@@ -42,9 +44,12 @@
 #include "internal/platform/atomic_boolean.h"
 #include "internal/platform/byte_array.h"
 #include "internal/platform/cancelable_alarm.h"
+#include "internal/platform/cancellation_flag.h"
 #include "internal/platform/connection_info.h"
 #include "internal/platform/count_down_latch.h"
 #include "internal/platform/future.h"
+#include "internal/platform/multi_thread_executor.h"
+#include "internal/platform/mutex.h"
 #include "internal/platform/prng.h"
 #include "internal/platform/scheduled_executor.h"
 #include "internal/platform/single_thread_executor.h"
@@ -169,6 +174,15 @@ class BasePcpHandler : public PcpHandler,
   Strategy GetStrategy() const override { return strategy_; }
   void DisconnectFromEndpointManager();
 
+  // Drops the sessions `client` remembered for resumption, so that its next
+  // connection to any endpoint runs UKEY2.
+  void ForgetSessions(ClientProxy* client);
+
+  // Test only. Keeps every thread of connect_executor_ busy until `release` is
+  // counted down, as attempts of earlier races that ignore their cancellation
+  // would.
+  void SaturateConnectExecutorForTesting(CountDownLatch release);
+
  protected:
   // The result of a call to startAdvertisingImpl() or startDiscoveryImpl().
   struct StartOperationResult {
@@ -260,18 +274,24 @@ class BasePcpHandler : public PcpHandler,
 
   void Shutdown();
   void RunOnPcpHandlerThread(const std::string& name, Runnable runnable);
+  // Like RunOnPcpHandlerThread(), for the found and lost reports of the
+  // discovery mediums. Of the reports with the same `key` that have not run yet
+  // only the latest one runs, so a burst of scan results for one device costs
+  // a single task on the PCP handler thread. All reports about one device must
+  // use the same key, so that the one that runs is the device's latest state.
+  void RunOnPcpHandlerThreadCoalesced(const std::string& name, std::string key,
+                                      Runnable runnable)
+      ABSL_LOCKS_EXCLUDED(coalesced_reports_mutex_);
 
   BluetoothDevice GetRemoteBluetoothDevice(
       const std::string& remote_bluetooth_mac_address);
 
   void OnEndpointFound(ClientProxy* client,
                        std::shared_ptr<DiscoveredEndpoint> endpoint)
-      RUN_ON_PCP_HANDLER_THREAD()
-          ABSL_LOCKS_EXCLUDED(discovered_endpoint_mutex_);
+      RUN_ON_PCP_HANDLER_THREAD();
 
   void OnEndpointLost(ClientProxy* client, const DiscoveredEndpoint& endpoint)
-      RUN_ON_PCP_HANDLER_THREAD()
-          ABSL_LOCKS_EXCLUDED(discovered_endpoint_mutex_);
+      RUN_ON_PCP_HANDLER_THREAD();
 
   Exception OnIncomingConnection(
       ClientProxy* client, const ByteArray& remote_endpoint_info,
@@ -316,9 +336,14 @@ class BasePcpHandler : public PcpHandler,
                                     const OutOfBandConnectionMetadata& metadata)
       RUN_ON_PCP_HANDLER_THREAD() = 0;
 
+  // Connects to `endpoint` over its medium, giving up once
+  // `cancellation_flag` is cancelled. When the connection mediums are raced
+  // (see ConnectionOptions::race_connection_mediums), this is called
+  // concurrently for different mediums of the same endpoint, off the PCP
+  // handler thread.
   virtual ConnectImplResult ConnectImpl(ClientProxy* client,
-                                        DiscoveredEndpoint* endpoint)
-      RUN_ON_PCP_HANDLER_THREAD() = 0;
+                                        DiscoveredEndpoint* endpoint,
+                                        CancellationFlag* cancellation_flag) = 0;
 
   virtual StartOperationResult UpdateAdvertisingOptionsImpl(
       ClientProxy* client, absl::string_view service_id,
@@ -348,20 +373,17 @@ class BasePcpHandler : public PcpHandler,
   virtual location::nearby::proto::connections::Medium
   GetDefaultUpgradeMedium() = 0;
 
-  // Returns the first discovered endpoint for the given endpoint_id.
-  DiscoveredEndpoint* GetDiscoveredEndpoint(const std::string& endpoint_id)
-      ABSL_LOCKS_EXCLUDED(discovered_endpoint_mutex_);
+  // Returns the preferred discovered endpoint for the given endpoint_id.
+  DiscoveredEndpoint* GetDiscoveredEndpoint(const std::string& endpoint_id);
 
   // Returns a vector of discovered endpoints, sorted in order of decreasing
   // preference.
   std::vector<BasePcpHandler::DiscoveredEndpoint*> GetDiscoveredEndpoints(
-      const std::string& endpoint_id)
-      ABSL_LOCKS_EXCLUDED(discovered_endpoint_mutex_);
+      const std::string& endpoint_id);
 
   // Returns a vector of discovered endpoints that share a given Medium.
   std::vector<BasePcpHandler::DiscoveredEndpoint*> GetDiscoveredEndpoints(
-      const location::nearby::proto::connections::Medium medium)
-      ABSL_LOCKS_EXCLUDED(discovered_endpoint_mutex_);
+      const location::nearby::proto::connections::Medium medium);
 
   // Start alarms for endpoints lost by their mediums. Used when updating
   // discovery options.
@@ -407,6 +429,8 @@ class BasePcpHandler : public PcpHandler,
     // Passes crypto context that we acquired in DH session for temporary
     // ownership here.
     void SetCryptoContext(std::unique_ptr<securegcm::UKey2Handshake> ukey2);
+    void SetCryptoContext(
+        std::unique_ptr<securegcm::D2DConnectionContextV1> resumed_context);
 
     // Pass Accept notification to client.
     void LocalEndpointAcceptedConnection(const std::string& endpoint_id,
@@ -446,6 +470,12 @@ class BasePcpHandler : public PcpHandler,
     // accepted. Crypto context is passed over to channel_manager_ before
     // switching to connected state, where Payload may be exchanged.
     std::unique_ptr<securegcm::UKey2Handshake> ukey2;
+    // Set instead of ukey2 when the session was resumed rather than
+    // negotiated; it is ready to use as is.
+    std::unique_ptr<securegcm::D2DConnectionContextV1> resumed_context;
+    // Set once the remote's connection response says it can resume sessions;
+    // older peers would fail to parse a resumption request.
+    bool remote_supports_session_resumption = false;
 
     // Used in AnalyticsRecorder for devices connection tracking.
     std::string connection_token;
@@ -465,9 +495,11 @@ class BasePcpHandler : public PcpHandler,
 
   EncryptionRunner::ResultListener GetResultListener();
 
+  // Exactly one of `ukey2` and `resumed_context` is set on success.
   void OnEncryptionSuccessRunnable(
       const std::string& endpoint_id,
       std::unique_ptr<securegcm::UKey2Handshake> ukey2,
+      std::unique_ptr<securegcm::D2DConnectionContextV1> resumed_context,
       const std::string& auth_token, const ByteArray& raw_auth_token);
   void OnEncryptionFailureRunnable(const std::string& endpoint_id,
                                    EndpointChannel* endpoint_channel);
@@ -480,10 +512,8 @@ class BasePcpHandler : public PcpHandler,
   static constexpr absl::Duration kRejectedConnectionCloseDelay =
       absl::Seconds(2);
   static constexpr int kConnectionTokenLength = 8;
-
-  // Returns true if the new endpoint is preferred over the old endpoint.
-  bool IsPreferred(const BasePcpHandler::DiscoveredEndpoint& new_endpoint,
-                   const BasePcpHandler::DiscoveredEndpoint& old_endpoint);
+  // One per medium that ConnectImpl() can connect over.
+  static constexpr int kMaxConcurrentConnectAttempts = 4;
 
   // Returns true if the incoming connection should be killed. This only
   // happens when an incoming connection arrives while we have an outgoing
@@ -502,8 +532,7 @@ class BasePcpHandler : public PcpHandler,
   bool AppendRemoteBluetoothMacAddressEndpoint(
       const std::string& endpoint_id,
       const std::string& remote_bluetooth_mac_address,
-      const DiscoveryOptions& local_discovery_options)
-      ABSL_LOCKS_EXCLUDED(discovered_endpoint_mutex_);
+      const DiscoveryOptions& local_discovery_options);
 
   Status VerifyConnectionRequest(const std::string& endpoint_id,
                                  ClientProxy* client);
@@ -511,8 +540,7 @@ class BasePcpHandler : public PcpHandler,
   // Returns true if the webrtc endpoint is created and appended into
   // discovered_endpoints_ with key endpoint_id.
   bool AppendWebRTCEndpoint(const std::string& endpoint_id,
-                            const DiscoveryOptions& local_discovery_options)
-      ABSL_LOCKS_EXCLUDED(discovered_endpoint_mutex_);
+                            const DiscoveryOptions& local_discovery_options);
 
   void ProcessPreConnectionInitiationFailure(
       ClientProxy* client, Medium medium, const std::string& endpoint_id,
@@ -557,6 +585,29 @@ class BasePcpHandler : public PcpHandler,
   // endpoint id. This is done by CancellationFlag.
   static bool Cancelled(ClientProxy* client, const std::string& endpoint_id);
 
+  // Connects to one of the discovered mediums of `endpoint_id` that
+  // `connection_options` allows, in order of preference. Returns the result
+  // of the attempt that produced a channel or, if none did, of the last
+  // attempt that failed.
+  ConnectImplResult ConnectToDiscoveredEndpoint(
+      ClientProxy* client, const std::string& endpoint_id,
+      const ConnectionOptions& connection_options) RUN_ON_PCP_HANDLER_THREAD();
+
+  struct ConnectRace;
+
+  // Races ConnectImpl() over `endpoints`, starting one attempt every `stagger`
+  // in order until one of them connects. An attempt also starts as soon as all
+  // running ones have failed. Attempts that lose the race are cancelled and
+  // finish on connect_executor_, closing any channel they still produce.
+  // A medium that ignores cancellation keeps its thread until its connect
+  // times out, so no attempt is started while every thread is taken; if that
+  // leaves nothing running, the remaining mediums are tried one at a time on
+  // the calling thread instead.
+  ConnectImplResult RaceConnectImpl(
+      ClientProxy* client, const std::string& endpoint_id,
+      const std::vector<std::shared_ptr<DiscoveredEndpoint>>& endpoints,
+      absl::Duration stagger) RUN_ON_PCP_HANDLER_THREAD();
+
   void WaitForLatch(const std::string& method_name, CountDownLatch* latch);
   Status WaitForResult(const std::string& method_name, std::int64_t client_id,
                        Future<Status>* future);
@@ -592,7 +643,16 @@ class BasePcpHandler : public PcpHandler,
 
   ScheduledExecutor alarm_executor_;
   SingleThreadExecutor serial_executor_;
-  Mutex discovered_endpoint_mutex_;
+  // The latest report queued by RunOnPcpHandlerThreadCoalesced() for each key
+  // that has a task pending on serial_executor_.
+  Mutex coalesced_reports_mutex_;
+  absl::flat_hash_map<std::string, Runnable> coalesced_reports_
+      ABSL_GUARDED_BY(coalesced_reports_mutex_);
+  // Attempts queued or running on connect_executor_, including those of races
+  // that already ended.
+  std::atomic<int> connect_attempts_in_flight_ = 0;
+  // Runs the connection attempts of RaceConnectImpl().
+  MultiThreadExecutor connect_executor_{kMaxConcurrentConnectAttempts};
 
   // A map of endpoint id -> PendingConnectionInfo. Entries in this map imply
   // that there is an active connection to the endpoint and we're waiting for
@@ -600,9 +660,9 @@ class BasePcpHandler : public PcpHandler,
   // the connection is decided (either accepted or rejected), it should be
   // removed from this map.
   absl::flat_hash_map<std::string, PendingConnectionInfo> pending_connections_;
-  // A map of endpoint id -> DiscoveredEndpoint.
-  absl::btree_multimap<std::string, std::shared_ptr<DiscoveredEndpoint>>
-      discovered_endpoints_ ABSL_GUARDED_BY(discovered_endpoint_mutex_);
+  // The endpoints found since discovery last started, by endpoint id and by
+  // medium. Thread-safe.
+  DiscoveredEndpointRegistry<DiscoveredEndpoint> discovered_endpoints_;
   // A map of endpoint id -> alarm. These alarms delay closing the
   // EndpointChannel to give the other side enough time to read the rejection
   // message. It's expected that the other side will close the connection
@@ -616,9 +676,10 @@ class BasePcpHandler : public PcpHandler,
   // advertising.
   ConnectionListener advertising_listener_;
 
-  // Mapping from endpoint_id -> CancelableAlarm for triggering endpoint loss
-  // while discovery options are updated.
-  absl::flat_hash_map<std::string, std::unique_ptr<CancelableAlarm>>
+  // Mapping from (endpoint_id, medium) -> CancelableAlarm for triggering
+  // endpoint loss while discovery options are updated.
+  absl::flat_hash_map<std::pair<std::string, Medium>,
+                      std::unique_ptr<CancelableAlarm>>
       endpoint_lost_by_medium_alarms_ ABSL_GUARDED_BY(GetPcpHandlerThread());
 
   Pcp pcp_;
@@ -25,7 +25,9 @@
 #include "protobuf-matchers/protocol-buffer-matchers.h"
 #include "gtest/gtest.h"
 #include "absl/base/thread_annotations.h"
+#include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
+#include "absl/synchronization/notification.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
 #include "connections/advertising_options.h"
@@ -54,6 +56,8 @@
 #include "internal/interop/device.h"
 #include "internal/interop/device_provider.h"
 #include "internal/platform/byte_array.h"
+#include "internal/platform/cancellation_flag.h"
+#include "internal/platform/count_down_latch.h"
 #include "internal/platform/exception.h"
 #include "internal/platform/feature_flags.h"
 #include "internal/platform/logging.h"
@@ -70,6 +74,7 @@ using ::location::nearby::connections::OsInfo;
 using ::location::nearby::proto::connections::Medium;
 using ::testing::_;
 using ::testing::AtLeast;
+using ::testing::ElementsAre;
 using ::testing::Invoke;
 using ::testing::MockFunction;
 using ::testing::NiceMock;
@@ -177,6 +182,9 @@ class MockPcpHandler : public BasePcpHandler {
   using BasePcpHandler::DiscoveredEndpoint;
   using BasePcpHandler::StartOperationResult;
 
+  using BasePcpHandler::RunOnPcpHandlerThread;
+  using BasePcpHandler::RunOnPcpHandlerThreadCoalesced;
+
   MOCK_METHOD(Strategy, GetStrategy, (), (const override));
   MOCK_METHOD(Pcp, GetPcp, (), (const override));
 
@@ -214,7 +222,9 @@ class MockPcpHandler : public BasePcpHandler {
                const OutOfBandConnectionMetadata& metadata),
               (override));
   MOCK_METHOD(ConnectImplResult, ConnectImpl,
-              (ClientProxy * client, DiscoveredEndpoint* endpoint), (override));
+              (ClientProxy * client, DiscoveredEndpoint* endpoint,
+               CancellationFlag* cancellation_flag),
+              (override));
   MOCK_METHOD(location::nearby::proto::connections::Medium,
               GetDefaultUpgradeMedium, (), (override));
   MOCK_METHOD(StartOperationResult, UpdateAdvertisingOptionsImpl,
@@ -613,7 +623,8 @@ class BasePcpHandlerTest
     EXPECT_CALL(*pcp_handler, ConnectImpl)
         .WillOnce(Invoke([&channel_a, connect_medium](
                              ClientProxy* client,
-                             MockPcpHandler::DiscoveredEndpoint* endpoint) {
+                             MockPcpHandler::DiscoveredEndpoint* endpoint,
+                             CancellationFlag* cancellation_flag) {
           return MockPcpHandler::ConnectImplResult{
               .medium = connect_medium,
               .status = {Status::kSuccess},
@@ -684,7 +695,8 @@ class BasePcpHandlerTest
         .WillRepeatedly(
             Invoke([&channel_a, connect_medium](
                        ClientProxy* client,
-                       MockPcpHandler::DiscoveredEndpoint* endpoint) {
+                       MockPcpHandler::DiscoveredEndpoint* endpoint,
+                       CancellationFlag* cancellation_flag) {
               return MockPcpHandler::ConnectImplResult{
                   .medium = connect_medium,
                   .status = {Status::kSuccess},
@@ -719,6 +731,86 @@ class BasePcpHandlerTest
               expected_result);
   }
 
+  // Requests a connection with the mediums raced. Connecting over
+  // `winning_medium` succeeds at once; connecting over any other medium stalls
+  // until the attempt is cancelled, which counts down `cancelled`.
+  void RequestConnectionRacingMediums(
+      const std::string& endpoint_id,
+      std::unique_ptr<MockEndpointChannel> channel_a,
+      MockEndpointChannel* channel_b, ClientProxy* client,
+      MockPcpHandler* pcp_handler, absl::Duration stagger,
+      location::nearby::proto::connections::Medium winning_medium,
+      std::atomic_int* attempts, CountDownLatch* cancelled) {
+    ConnectionRequestInfo info{
+        .endpoint_info = ByteArray{"ABCD"},
+        .listener = connection_listener_,
+    };
+    ConnectionOptions connection_options{
+        .keep_alive_interval_millis =
+            FeatureFlags::GetInstance().GetFlags().keep_alive_interval_millis,
+        .keep_alive_timeout_millis =
+            FeatureFlags::GetInstance().GetFlags().keep_alive_timeout_millis,
+        .race_connection_mediums = true,
+        .connection_race_stagger_millis =
+            static_cast<int>(absl::ToInt64Milliseconds(stagger)),
+    };
+    EXPECT_CALL(mock_discovery_listener_.endpoint_found_cb, Call);
+    EXPECT_CALL(*pcp_handler, CanSendOutgoingConnection)
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(*pcp_handler, GetStrategy)
+        .WillRepeatedly(Return(Strategy::kP2pCluster));
+    EXPECT_CALL(mock_connection_listener_.initiated_cb, Call).Times(1);
+    auto encryption_runner = std::make_unique<EncryptionRunner>();
+    auto allowed_mediums = pcp_handler->GetDiscoveryMediums(client);
+
+    EXPECT_CALL(*pcp_handler, ConnectImpl)
+        .WillRepeatedly(Invoke([&channel_a, winning_medium, attempts,
+                                cancelled](
+                                   ClientProxy* client,
+                                   MockPcpHandler::DiscoveredEndpoint* endpoint,
+                                   CancellationFlag* cancellation_flag) {
+          ++*attempts;
+          if (endpoint->medium == winning_medium) {
+            return MockPcpHandler::ConnectImplResult{
+                .medium = endpoint->medium,
+                .status = {Status::kSuccess},
+                .endpoint_channel = std::move(channel_a),
+            };
+          }
+          absl::Time deadline = absl::Now() + absl::Seconds(5);
+          while (!cancellation_flag->Cancelled() && absl::Now() < deadline) {
+            absl::SleepFor(absl::Milliseconds(10));
+          }
+          if (cancellation_flag->Cancelled()) cancelled->CountDown();
+          return MockPcpHandler::ConnectImplResult{
+              .medium = endpoint->medium,
+              .status = {Status::kError},
+          };
+        }));
+
+    for (const auto& discovered_medium : allowed_mediums) {
+      pcp_handler->OnEndpointFound(
+          client,
+          std::make_shared<MockDiscoveredEndpoint>(MockDiscoveredEndpoint{
+              {
+                  endpoint_id,
+                  info.endpoint_info,
+                  "service",
+                  discovered_medium,
+                  WebRtcState::kUndefined,
+              },
+              MockContext{nullptr},
+          }));
+    }
+    auto other_client = std::make_unique<ClientProxy>();
+    encryption_runner->StartServer(other_client.get(), endpoint_id, channel_b,
+                                   {});
+    client->AddCancellationFlag(endpoint_id);
+    EXPECT_EQ(pcp_handler->RequestConnection(client, endpoint_id, info,
+                                             connection_options),
+              Status{Status::kSuccess});
+  }
+
   void RequestConnectionWifiLanFail(
       const std::string& endpoint_id,
       std::unique_ptr<MockEndpointChannel> channel_a,
@@ -752,7 +844,8 @@ class BasePcpHandlerTest
     EXPECT_CALL(*pcp_handler, ConnectImpl)
         .WillRepeatedly(
             Invoke([&channel_a](ClientProxy* client,
-                                MockPcpHandler::DiscoveredEndpoint* endpoint) {
+                                MockPcpHandler::DiscoveredEndpoint* endpoint,
+                                CancellationFlag* cancellation_flag) {
               if (endpoint->medium ==
                   location::nearby::proto::connections::WIFI_LAN) {
                 NEARBY_LOGS(INFO) << "Connect with Medium WIFI_LAN failed.";
@@ -956,6 +1049,38 @@ TEST_P(BasePcpHandlerTest, StartStopStartDiscoveryClearsEndpoints) {
   env_.Stop();
 }
 
+TEST_F(BasePcpHandlerTest, CoalescedReportsRunOnlyTheLatestPerKey) {
+  env_.Start();
+  Mediums m;
+  EndpointChannelManager ecm;
+  EndpointManager em(&ecm);
+  BwuManager bwu(m, em, ecm, {}, {});
+  MockPcpHandler pcp_handler(&m, &em, &ecm, &bwu);
+  // Keep the PCP handler thread busy while the reports come in.
+  absl::Notification release;
+  pcp_handler.RunOnPcpHandlerThread(
+      "block", [&release]() { release.WaitForNotification(); });
+  // Only touched on the PCP handler thread.
+  std::vector<std::string> reports;
+
+  for (int i = 0; i < 3; ++i) {
+    pcp_handler.RunOnPcpHandlerThreadCoalesced(
+        "report", "A", [&reports, i]() {
+          reports.push_back(absl::StrCat("A", i));
+        });
+  }
+  pcp_handler.RunOnPcpHandlerThreadCoalesced(
+      "report", "B", [&reports]() { reports.push_back("B0"); });
+  release.Notify();
+  CountDownLatch done(1);
+  pcp_handler.RunOnPcpHandlerThread("done", [&done]() { done.CountDown(); });
+
+  EXPECT_TRUE(done.Await(absl::Seconds(1)).result());
+  EXPECT_THAT(reports, ElementsAre("A2", "B0"));
+  bwu.Shutdown();
+  env_.Stop();
+}
+
 TEST_F(BasePcpHandlerTest, WifiMediumFailFallBackToBT) {
   env_.Start();
   std::string service_id{"service"};
@@ -1006,6 +1131,110 @@ TEST_F(BasePcpHandlerTest, WifiMediumFailFallBackToBT) {
   env_.Stop();
 }
 
+TEST_F(BasePcpHandlerTest, RacingMediumsFallsBackToBTWhileWifiLanStalls) {
+  env_.Start();
+  std::string endpoint_id{"ABCD"};
+  ClientProxy client;
+  Mediums m;
+  EndpointChannelManager ecm;
+  EndpointManager em(&ecm);
+  BwuManager bwu(m, em, ecm, {}, {});
+  MockPcpHandler pcp_handler(&m, &em, &ecm, &bwu);
+  StartDiscovery(&client, &pcp_handler,
+                 BooleanMediumSelector{.bluetooth = true, .wifi_lan = true});
+  auto channel_pair = SetupConnection(Medium::BLUETOOTH);
+  auto& channel_a = channel_pair.first;
+  auto& channel_b = channel_pair.second;
+  EXPECT_CALL(*channel_a, CloseImpl).Times(1);
+  EXPECT_CALL(*channel_b, CloseImpl).Times(1);
+  EXPECT_CALL(mock_connection_listener_.rejected_cb, Call).Times(AtLeast(0));
+  std::atomic_int attempts = 0;
+  CountDownLatch wifi_lan_cancelled(1);
+
+  absl::Time start = absl::Now();
+  RequestConnectionRacingMediums(endpoint_id, std::move(channel_a),
+                                 channel_b.get(), &client, &pcp_handler,
+                                 absl::Milliseconds(50), Medium::BLUETOOTH,
+                                 &attempts, &wifi_lan_cancelled);
+
+  EXPECT_LT(absl::Now() - start, absl::Seconds(5));
+  EXPECT_TRUE(wifi_lan_cancelled.Await(absl::Seconds(1)).result());
+  EXPECT_EQ(attempts, 2);
+  channel_b->Close();
+  bwu.Shutdown();
+  pcp_handler.DisconnectFromEndpointManager();
+  env_.Stop();
+}
+
+TEST_F(BasePcpHandlerTest, RacingMediumsDoesNotStartFallbackWhenPreferredWins) {
+  env_.Start();
+  std::string endpoint_id{"ABCD"};
+  ClientProxy client;
+  Mediums m;
+  EndpointChannelManager ecm;
+  EndpointManager em(&ecm);
+  BwuManager bwu(m, em, ecm, {}, {});
+  MockPcpHandler pcp_handler(&m, &em, &ecm, &bwu);
+  StartDiscovery(&client, &pcp_handler,
+                 BooleanMediumSelector{.bluetooth = true, .wifi_lan = true});
+  auto channel_pair = SetupConnection(Medium::WIFI_LAN);
+  auto& channel_a = channel_pair.first;
+  auto& channel_b = channel_pair.second;
+  EXPECT_CALL(*channel_a, CloseImpl).Times(1);
+  EXPECT_CALL(*channel_b, CloseImpl).Times(1);
+  EXPECT_CALL(mock_connection_listener_.rejected_cb, Call).Times(AtLeast(0));
+  std::atomic_int attempts = 0;
+  CountDownLatch bluetooth_cancelled(1);
+
+  RequestConnectionRacingMediums(endpoint_id, std::move(channel_a),
+                                 channel_b.get(), &client, &pcp_handler,
+                                 absl::Seconds(5), Medium::WIFI_LAN, &attempts,
+                                 &bluetooth_cancelled);
+
+  EXPECT_EQ(attempts, 1);
+  channel_b->Close();
+  bwu.Shutdown();
+  pcp_handler.DisconnectFromEndpointManager();
+  env_.Stop();
+}
+
+TEST_F(BasePcpHandlerTest, RacingMediumsFallsBackToSequentialWhenSaturated) {
+  env_.Start();
+  std::string endpoint_id{"ABCD"};
+  ClientProxy client;
+  Mediums m;
+  EndpointChannelManager ecm;
+  EndpointManager em(&ecm);
+  BwuManager bwu(m, em, ecm, {}, {});
+  MockPcpHandler pcp_handler(&m, &em, &ecm, &bwu);
+  StartDiscovery(&client, &pcp_handler,
+                 BooleanMediumSelector{.bluetooth = true, .wifi_lan = true});
+  auto channel_pair = SetupConnection(Medium::WIFI_LAN);
+  auto& channel_a = channel_pair.first;
+  auto& channel_b = channel_pair.second;
+  EXPECT_CALL(*channel_a, CloseImpl).Times(1);
+  EXPECT_CALL(*channel_b, CloseImpl).Times(1);
+  EXPECT_CALL(mock_connection_listener_.rejected_cb, Call).Times(AtLeast(0));
+  std::atomic_int attempts = 0;
+  CountDownLatch bluetooth_cancelled(1);
+  // Earlier attempts hold every connect thread, so the race can't start.
+  CountDownLatch release(1);
+  pcp_handler.SaturateConnectExecutorForTesting(release);
+
+  RequestConnectionRacingMediums(endpoint_id, std::move(channel_a),
+                                 channel_b.get(), &client, &pcp_handler,
+                                 absl::Milliseconds(50), Medium::WIFI_LAN,
+                                 &attempts, &bluetooth_cancelled);
+
+  // The mediums were tried one at a time, and the preferred one won.
+  EXPECT_EQ(attempts, 1);
+  release.CountDown();
+  channel_b->Close();
+  bwu.Shutdown();
+  pcp_handler.DisconnectFromEndpointManager();
+  env_.Stop();
+}
+
 TEST_P(BasePcpHandlerTest, RequestConnectionChangesState) {
   env_.Start();
   ClientProxy client;
@@ -1180,7 +1409,8 @@ TEST_P(BasePcpHandlerTest, RequestConnectionV3_ConnectImplFailure) {
   EXPECT_CALL(pcp_handler, ConnectImpl)
       .WillRepeatedly(Invoke(
           [connect_medium](ClientProxy* client,
-                           MockPcpHandler::DiscoveredEndpoint* endpoint) {
+                           MockPcpHandler::DiscoveredEndpoint* endpoint,
+                           CancellationFlag* cancellation_flag) {
             return MockPcpHandler::ConnectImplResult{
                 .medium = connect_medium,
                 .status = {Status::kError},
@@ -1256,7 +1486,8 @@ TEST_P(BasePcpHandlerTest, RequestConnection_ConnectImplFailure) {
   EXPECT_CALL(pcp_handler, ConnectImpl)
       .WillRepeatedly(Invoke(
           [connect_medium](ClientProxy* client,
-                           MockPcpHandler::DiscoveredEndpoint* endpoint) {
+                           MockPcpHandler::DiscoveredEndpoint* endpoint,
+                           CancellationFlag* cancellation_flag) {
             return MockPcpHandler::ConnectImplResult{
                 .medium = connect_medium,
                 .status = {Status::kError},
@@ -22,10 +22,12 @@
 
 #include "absl/functional/bind_front.h"
 #include "absl/time/time.h"
+#include "connections/implementation/analytics/connection_setup_tracer.h"
 #include "connections/implementation/bluetooth_bwu_handler.h"
 #include "connections/implementation/bwu_handler.h"
 #include "connections/implementation/client_proxy.h"
 #include "connections/implementation/endpoint_channel_manager.h"
+#include "connections/implementation/flags/nearby_connections_feature_flags.h"
 #include "connections/implementation/offline_frames.h"
 #include "connections/implementation/service_id_constants.h"
 #ifdef NO_WEBRTC
@@ -36,9 +38,12 @@
 #include "connections/implementation/wifi_direct_bwu_handler.h"
 #include "connections/implementation/wifi_hotspot_bwu_handler.h"
 #include "connections/implementation/wifi_lan_bwu_handler.h"
+#include "internal/flags/nearby_flags.h"
 #include "internal/platform/byte_array.h"
 #include "internal/platform/count_down_latch.h"
 #include "internal/platform/feature_flags.h"
+#include "internal/platform/implementation/platform.h"
+#include "internal/platform/implementation/preferences_manager.h"
 #include "internal/platform/logging.h"
 
 namespace nearby {
@@ -49,6 +54,25 @@ using ::location::nearby::connections::OfflineFrame;
 using ::location::nearby::connections::V1Frame;
 using ::location::nearby::proto::connections::DisconnectionReason;
 
+namespace {
+
+#ifndef NEARBY_CHROMIUM
+constexpr char kMediumPerformancePreferencesPath[] =
+    "nearby_connections_medium_performance";
+
+// The store that keeps the history of the process-wide medium performance
+// model across restarts. It lives as long as the process, like the model.
+api::PreferencesManager* GetMediumPerformancePreferencesManager() {
+  static api::PreferencesManager* preferences_manager =
+      api::ImplementationPlatform::CreatePreferencesManager(
+          kMediumPerformancePreferencesPath)
+          .release();
+  return preferences_manager;
+}
+#endif
+
+}  // namespace
+
 // Required for C++ 14 support in Chrome
 constexpr absl::Duration BwuManager::kReadClientIntroductionFrameTimeout;
 
@@ -81,6 +105,18 @@ BwuManager::BwuManager(
       config_.bandwidth_upgrade_retry_max_delay = absl::Seconds(10);
     }
   }
+  if (config_.medium_performance_model == nullptr) {
+    config_.medium_performance_model =
+        &analytics::MediumPerformanceModel::GetInstance();
+#ifndef NEARBY_CHROMIUM
+    if (NearbyFlags::GetInstance().GetBoolFlag(
+            config_package_nearby::nearby_connections_feature::
+                kEnableBwuMediumPerformanceModel)) {
+      config_.medium_performance_model->SetPreferencesManager(
+          GetMediumPerformancePreferencesManager());
+    }
+#endif
+  }
   if (config_.allow_upgrade_to.All(false)) {
     config_.allow_upgrade_to.web_rtc = true;
     config_.allow_upgrade_to.wifi_direct = true;
@@ -150,6 +186,7 @@ void BwuManager::Shutdown() {
 
   // Stop all the ongoing Runnables (as gracefully as possible).
   ShutdownExecutors();
+  config_.medium_performance_model->Flush();
 
   // After worker threads are down we became exclusive owners of data and
   // may access it from current thread.
@@ -824,9 +861,17 @@ BwuManager::ProcessBwuPathAvailableEventInternal(
     service_id = old_channel->GetServiceId();
   }
 
+  analytics::ConnectionSetupTracer& tracer =
+      analytics::ConnectionSetupTracer::GetInstance();
+  tracer.BeginConnectedPhase(client->GetClientId(), endpoint_id,
+                             analytics::ConnectionSetupPhase::kBwuMediumConnect,
+                             medium);
   std::unique_ptr<EndpointChannel> new_channel =
       handler->CreateUpgradedEndpointChannel(client, service_id, endpoint_id,
                                              upgrade_path_info);
+  tracer.EndConnectedPhase(client->GetClientId(), endpoint_id,
+                           analytics::ConnectionSetupPhase::kBwuMediumConnect,
+                           new_channel != nullptr);
   if (!new_channel) {
     NEARBY_LOGS(ERROR) << "BwuManager failed to create an endpoint "
                           "channel to endpoint"
@@ -1210,8 +1255,8 @@ void BwuManager::ProcessUpgradeFailureEvent(
   // top element until we get to the medium we last attempted to upgrade to. The
   // remainder of the list will contain the mediums we haven't attempted yet.
   Medium last = parser::UpgradePathInfoMediumToMedium(upgrade_info.medium());
-  std::vector<Medium> all_possible_mediums =
-      client->GetUpgradeMediums(endpoint_id).GetMediums(true);
+  std::vector<Medium> all_possible_mediums = RankUpgradeMediums(
+      endpoint_id, client->GetUpgradeMediums(endpoint_id).GetMediums(true));
   std::vector<Medium> untried_mediums(all_possible_mediums);
   for (Medium medium : all_possible_mediums) {
     untried_mediums.erase(untried_mediums.begin());
@@ -1300,6 +1345,25 @@ std::vector<Medium> BwuManager::StripOutUnavailableMediums(
   return available_mediums;
 }
 
+std::vector<Medium> BwuManager::RankUpgradeMediums(
+    const std::string& endpoint_id, const std::vector<Medium>& mediums) const {
+  if (!NearbyFlags::GetInstance().GetBoolFlag(
+          config_package_nearby::nearby_connections_feature::
+              kEnableBwuMediumPerformanceModel)) {
+    return mediums;
+  }
+  auto channel = channel_manager_->GetChannelForEndpoint(endpoint_id);
+  location::nearby::proto::connections::ConnectionBand band =
+      location::nearby::proto::connections::CONNECTION_BAND_UNKNOWN_BAND;
+  int frequency = -1;
+  if (channel != nullptr) {
+    band = channel->GetBand();
+    frequency = channel->GetFrequency();
+  }
+  return config_.medium_performance_model->RankMediums(mediums, band,
+                                                       frequency);
+}
+
 // Returns the optimal medium supported by both devices.
 // Each medium in the passed in list is checked for its availability with the
 // medium_manager_ to ensure that the chosen upgrade medium is supported and
@@ -1310,15 +1374,18 @@ std::vector<Medium> BwuManager::StripOutUnavailableMediums(
 // way to prevent mediums, like Wifi Hotspot, from interfering with active
 // connections (although it's suboptimal for bandwidth throughput). When all
 // endpoints disconnect, we reset the bandwidth upgrade medium.
+// With kEnableBwuMediumPerformanceModel, the first-time pick is the available
+// medium with the best measured performance instead of the first preference.
 Medium BwuManager::ChooseBestUpgradeMedium(
     const std::string& endpoint_id, const std::vector<Medium>& mediums) const {
-  auto available_mediums = StripOutUnavailableMediums(mediums);
+  auto available_mediums =
+      RankUpgradeMediums(endpoint_id, StripOutUnavailableMediums(mediums));
   Medium current_medium = GetBwuMediumForEndpoint(endpoint_id);
   if (current_medium == Medium::UNKNOWN_MEDIUM) {
     if (!available_mediums.empty()) {
       // Case 1: This is our first time upgrading, and we have at least one
       // supported medium to choose from. Return the first medium in the list,
-      // since they are ordered by preference.
+      // since they are ordered by preference (or by expected performance).
       return available_mediums[0];
     }
     // Case 2: This is our first time upgrading, but there are no available
@@ -1358,7 +1425,7 @@ Medium BwuManager::ChooseBestUpgradeMedium(
 
 void BwuManager::RetryUpgradesAfterDelay(ClientProxy* client,
                                          const std::string& endpoint_id) {
-  absl::Duration delay = CalculateNextRetryDelay(endpoint_id);
+  absl::Duration delay = CalculateNextRetryDelay(client, endpoint_id);
   CancelRetryUpgradeAlarm(endpoint_id);
   auto alarm = std::make_unique<CancelableAlarm>(
       "BWU alarm",
@@ -1420,20 +1487,36 @@ void BwuManager::AttemptToRecordBandwidthUpgradeErrorForUnknownEndpoint(
 }
 
 absl::Duration BwuManager::CalculateNextRetryDelay(
-    const std::string& endpoint_id) {
+    ClientProxy* client, const std::string& endpoint_id) {
   auto item = retry_delays_.find(endpoint_id);
   auto initial_delay = config_.bandwidth_upgrade_retry_delay;
-  if (item == retry_delays_.end()) return initial_delay;
   /*
    * Without use_exp_backoff_in_bwu_retry, bwu retry intervals for the same
    * endpoint_id in seconds will be like: 5, 10, 10, 10...
    * With use_exp_backoff_in_bwu_retry enabled, bwu retry intervals in seconds
    * would be like: 3, 6, 12, 24, ... 300, 300, ...
    */
-  auto delay =
-      FeatureFlags::GetInstance().GetFlags().use_exp_backoff_in_bwu_retry
-          ? item->second * 2
-          : item->second + initial_delay;
+  absl::Duration delay = initial_delay;
+  if (item != retry_delays_.end()) {
+    delay = FeatureFlags::GetInstance().GetFlags().use_exp_backoff_in_bwu_retry
+                ? item->second * 2
+                : item->second + initial_delay;
+  }
+
+  // The retry starts over from the best-ranked medium, so let its connection
+  // history stretch or shrink the delay.
+  if (NearbyFlags::GetInstance().GetBoolFlag(
+          config_package_nearby::nearby_connections_feature::
+              kEnableBwuMediumPerformanceModel)) {
+    std::vector<Medium> candidates = RankUpgradeMediums(
+        endpoint_id,
+        StripOutUnavailableMediums(
+            client->GetUpgradeMediums(endpoint_id).GetMediums(true)));
+    if (!candidates.empty()) {
+      delay = config_.medium_performance_model->AdjustRetryDelay(candidates[0],
+                                                                 delay);
+    }
+  }
   return std::min(delay, config_.bandwidth_upgrade_retry_max_delay);
 }
 
@@ -24,6 +24,7 @@
 #include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
 #include "absl/time/time.h"
+#include "connections/implementation/analytics/medium_performance_model.h"
 #include "connections/implementation/bwu_handler.h"
 #include "connections/implementation/client_proxy.h"
 #include "connections/implementation/endpoint_manager.h"
@@ -64,6 +65,10 @@ class BwuManager : public EndpointManager::FrameProcessor {
     BooleanMediumSelector allow_upgrade_to;
     absl::Duration bandwidth_upgrade_retry_delay;
     absl::Duration bandwidth_upgrade_retry_max_delay;
+    // History used to rank upgrade mediums when
+    // kEnableBwuMediumPerformanceModel is on. Defaults to the process-wide
+    // model, whose history is then kept in the platform's preferences.
+    analytics::MediumPerformanceModel* medium_performance_model = nullptr;
   };
 
   BwuManager(Mediums& mediums, EndpointManager& endpoint_manager,
@@ -126,6 +131,11 @@ class BwuManager : public EndpointManager::FrameProcessor {
   void RunOnBwuManagerThread(const std::string& name, Runnable runnable);
   std::vector<Medium> StripOutUnavailableMediums(
       const std::vector<Medium>& mediums) const;
+  // Orders |mediums| by expected performance for |endpoint_id|'s current link
+  // if the medium performance model is enabled; returns |mediums| as-is
+  // otherwise.
+  std::vector<Medium> RankUpgradeMediums(
+      const std::string& endpoint_id, const std::vector<Medium>& mediums) const;
   Medium ChooseBestUpgradeMedium(const std::string& endpoint_id,
                                  const std::vector<Medium>& mediums) const;
 
@@ -189,7 +199,8 @@ class BwuManager : public EndpointManager::FrameProcessor {
   void TryNextBestUpgradeMediums(ClientProxy* client,
                                  const std::string& endpoint_id,
                                  std::vector<Medium> upgrade_mediums);
-  absl::Duration CalculateNextRetryDelay(const std::string& endpoint_id);
+  absl::Duration CalculateNextRetryDelay(ClientProxy* client,
+                                         const std::string& endpoint_id);
   void RetryUpgradesAfterDelay(ClientProxy* client,
                                const std::string& endpoint_id);
   void AttemptToRecordBandwidthUpgradeErrorForUnknownEndpoint(
@@ -63,7 +63,7 @@ ClientProxy::ClientProxy(::nearby::analytics::EventLogger* event_logger)
     : client_id_(Prng().NextInt64()) {
   NEARBY_LOGS(INFO) << "ClientProxy ctor event_logger=" << event_logger;
   analytics_recorder_ =
-      std::make_unique<analytics::AnalyticsRecorder>(event_logger);
+      std::make_unique<analytics::AnalyticsRecorder>(event_logger, client_id_);
   error_code_recorder_ = std::make_unique<ErrorCodeRecorder>(
       [this](const ErrorCodeParams& params) {
         analytics_recorder_->OnErrorCode(params);
@@ -296,6 +296,7 @@ void ClientProxy::StoppedDiscovery() {
 
   if (IsDiscovering()) {
     discovered_endpoint_ids_.clear();
+    ClearDiscoveryEvents();
     discovery_info_.Clear();
     analytics_recorder_->OnStopDiscovery();
   }
@@ -347,9 +348,22 @@ void ClientProxy::OnEndpointFound(
     return;
   }
 
+  if (discovery_options_.endpoint_info_filter &&
+      !discovery_options_.endpoint_info_filter(endpoint_info)) {
+    NEARBY_LOGS(INFO) << "ClientProxy [Endpoint Found]: Ignoring event for id="
+                      << endpoint_id
+                      << " because the client filtered out its endpoint info.";
+    return;
+  }
+
   discovered_endpoint_ids_.insert(endpoint_id);
-  discovery_info_.listener.endpoint_found_cb(endpoint_id, endpoint_info,
-                                             service_id);
+  if (!QueueDiscoveryEvent({.type = DiscoveryEvent::Type::kFound,
+                            .endpoint_id = endpoint_id,
+                            .endpoint_info = endpoint_info,
+                            .service_id = service_id})) {
+    discovery_info_.listener.endpoint_found_cb(endpoint_id, endpoint_info,
+                                               service_id);
+  }
   analytics_recorder_->OnEndpointFound(medium);
 }
 
@@ -376,7 +390,78 @@ void ClientProxy::OnEndpointLost(const std::string& service_id,
   }
 
   discovered_endpoint_ids_.erase(it);
-  discovery_info_.listener.endpoint_lost_cb(endpoint_id);
+  if (!QueueDiscoveryEvent({.type = DiscoveryEvent::Type::kLost,
+                            .endpoint_id = endpoint_id,
+                            .service_id = service_id})) {
+    discovery_info_.listener.endpoint_lost_cb(endpoint_id);
+  }
+}
+
+bool ClientProxy::QueueDiscoveryEvent(DiscoveryEvent event) {
+  MutexLock lock(&mutex_);
+
+  if (discovery_options_.batch_interval_millis <= 0) return false;
+
+  if (event.type == DiscoveryEvent::Type::kLost) {
+    // An endpoint found within this batch has not been reported yet, so
+    // neither needs its loss.
+    const auto found = pending_found_events_.find(event.endpoint_id);
+    if (found != pending_found_events_.end()) {
+      pending_discovery_events_[found->second].cancelled = true;
+      pending_found_events_.erase(found);
+      return true;
+    }
+  } else {
+    pending_found_events_[event.endpoint_id] = pending_discovery_events_.size();
+  }
+  pending_discovery_events_.push_back({.event = std::move(event)});
+  if (pending_discovery_events_.size() > 1) return true;
+
+  // The first event of a batch schedules its delivery.
+  discovery_batch_alarm_ = std::make_unique<CancelableAlarm>(
+      "discovery_batch", [this]() { FlushDiscoveryEvents(); },
+      absl::Milliseconds(discovery_options_.batch_interval_millis),
+      &single_thread_executor_);
+  return true;
+}
+
+void ClientProxy::FlushDiscoveryEvents() {
+  MutexLock lock(&mutex_);
+
+  std::vector<DiscoveryEvent> events;
+  events.reserve(pending_discovery_events_.size());
+  for (PendingDiscoveryEvent& pending : pending_discovery_events_) {
+    if (!pending.cancelled) events.push_back(std::move(pending.event));
+  }
+  pending_discovery_events_.clear();
+  pending_found_events_.clear();
+  if (events.empty() || !IsDiscovering()) return;
+
+  NEARBY_LOGS(INFO) << "ClientProxy [Discovery Batch]: client="
+                    << GetClientId() << "; events=" << events.size();
+  if (discovery_info_.listener.endpoints_changed_cb) {
+    discovery_info_.listener.endpoints_changed_cb(events);
+    return;
+  }
+  for (const DiscoveryEvent& event : events) {
+    if (event.type == DiscoveryEvent::Type::kFound) {
+      discovery_info_.listener.endpoint_found_cb(
+          event.endpoint_id, event.endpoint_info, event.service_id);
+    } else {
+      discovery_info_.listener.endpoint_lost_cb(event.endpoint_id);
+    }
+  }
+}
+
+void ClientProxy::ClearDiscoveryEvents() {
+  MutexLock lock(&mutex_);
+
+  if (discovery_batch_alarm_ != nullptr) {
+    discovery_batch_alarm_->Cancel();
+    discovery_batch_alarm_.reset();
+  }
+  pending_discovery_events_.clear();
+  pending_found_events_.clear();
 }
 
 void ClientProxy::OnRequestConnection(
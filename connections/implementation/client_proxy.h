@@ -335,6 +335,12 @@ class ClientProxy final {
     bool IsEmpty() const { return service_id.empty(); }
   };
 
+  struct PendingDiscoveryEvent {
+    DiscoveryEvent event;
+    // Set when the endpoint was lost again before the batch went out.
+    bool cancelled = false;
+  };
+
   // `RemoveAllEndpoints` is expected to only be called during destruction of
   // ClientProxy via `ClientProxy::Reset`, which makes destroying
   // CancellationFlags safe here since we are destroying ClientProxy. Do not
@@ -359,6 +365,13 @@ class ClientProxy final {
   void ScheduleClearLocalHighVisModeCacheEndpointIdAlarm();
   void CancelClearLocalHighVisModeCacheEndpointIdAlarm();
 
+  // Batched discovery events; see DiscoveryOptions::batch_interval_millis.
+  // Returns false if the client doesn't take events in batches, in which case
+  // `event` must be delivered right away.
+  bool QueueDiscoveryEvent(DiscoveryEvent event);
+  void FlushDiscoveryEvents();
+  void ClearDiscoveryEvents();
+
   location::nearby::connections::OsInfo::OsType OSNameToOsInfoType(
       api::OSName osName);
 
@@ -422,6 +435,14 @@ class ClientProxy final {
   // endpoints after each scan.
   absl::flat_hash_set<std::string> discovered_endpoint_ids_;
 
+  // Found and lost events waiting for the next batch, when the client asked
+  // for them in batches.
+  std::vector<PendingDiscoveryEvent> pending_discovery_events_;
+  // Maps endpoint_id to the index of its kFound event in
+  // pending_discovery_events_.
+  absl::flat_hash_map<std::string, size_t> pending_found_events_;
+  std::unique_ptr<CancelableAlarm> discovery_batch_alarm_;
+
   // Maps endpoint_id to CancellationFlag. CancellationFlags are passed around
   // as raw pointers to other classes in Nearby Connections, so it is important
   // that objects in this map are not cleared, even if they are cancelled.
@@ -570,6 +570,69 @@ TEST_F(ClientProxyTest, OnEndpointLostFiresNotificationInDiscovery) {
   OnDiscoveryEndpointLost(&client2_, advertising_endpoint);
 }
 
+TEST_F(ClientProxyTest, BatchedDiscoveryDeliversEventsTogether) {
+  CountDownLatch latch(1);
+  std::vector<DiscoveryEvent> delivered;
+  DiscoveryListener listener{
+      .endpoints_changed_cb =
+          [&](const std::vector<DiscoveryEvent>& events) {
+            delivered = events;
+            latch.CountDown();
+          },
+  };
+  DiscoveryOptions options;
+  options.batch_interval_millis = 50;
+  client2_.StartedDiscovery(service_id_, strategy_, listener,
+                            absl::MakeSpan(mediums_), options);
+
+  client2_.OnEndpointFound(service_id_, "ABCD", ByteArray("a"), medium_);
+  client2_.OnEndpointFound(service_id_, "WXYZ", ByteArray("b"), medium_);
+  // Found and lost within one batch: never reported.
+  client2_.OnEndpointFound(service_id_, "LOST", ByteArray("c"), medium_);
+  client2_.OnEndpointLost(service_id_, "LOST");
+
+  EXPECT_TRUE(latch.Await(absl::Seconds(1)).result());
+  ASSERT_EQ(delivered.size(), 2);
+  EXPECT_EQ(delivered[0].type, DiscoveryEvent::Type::kFound);
+  EXPECT_EQ(delivered[0].endpoint_id, "ABCD");
+  EXPECT_EQ(delivered[0].endpoint_info, ByteArray("a"));
+  EXPECT_EQ(delivered[1].endpoint_id, "WXYZ");
+  StopDiscovery(&client2_);
+}
+
+TEST_F(ClientProxyTest, BatchedDiscoveryFallsBackToEndpointCallbacks) {
+  CountDownLatch latch(1);
+  EXPECT_CALL(mock_discovery_.endpoint_found_cb, Call).Times(1);
+  EXPECT_CALL(mock_discovery_.endpoint_lost_cb, Call)
+      .WillOnce([&latch](const std::string&) { latch.CountDown(); });
+  DiscoveryOptions options;
+  options.batch_interval_millis = 50;
+  client2_.StartedDiscovery(service_id_, strategy_, discovery_listener_,
+                            absl::MakeSpan(mediums_), options);
+  client2_.OnEndpointFound(service_id_, "ABCD", ByteArray("a"), medium_);
+  absl::SleepFor(absl::Milliseconds(200));
+
+  client2_.OnEndpointLost(service_id_, "ABCD");
+
+  EXPECT_TRUE(latch.Await(absl::Seconds(1)).result());
+  StopDiscovery(&client2_);
+}
+
+TEST_F(ClientProxyTest, EndpointInfoFilterDropsEndpoints) {
+  EXPECT_CALL(mock_discovery_.endpoint_found_cb, Call).Times(1);
+  DiscoveryOptions options;
+  options.endpoint_info_filter = [](const ByteArray& endpoint_info) {
+    return std::string(endpoint_info) == "keep";
+  };
+  client2_.StartedDiscovery(service_id_, strategy_, discovery_listener_,
+                            absl::MakeSpan(mediums_), options);
+
+  client2_.OnEndpointFound(service_id_, "ABCD", ByteArray("keep"), medium_);
+  client2_.OnEndpointFound(service_id_, "WXYZ", ByteArray("drop"), medium_);
+  // Never reported as found, so its loss is not reported either.
+  client2_.OnEndpointLost(service_id_, "WXYZ");
+}
+
 TEST_F(ClientProxyTest, OnConnectionInitiatedFiresNotificationInDiscovery) {
   Endpoint advertising_endpoint =
       StartAdvertising(&client1_, advertising_connection_listener_);
@@ -0,0 +1,263 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CORE_INTERNAL_DISCOVERED_ENDPOINT_REGISTRY_H_
+#define CORE_INTERNAL_DISCOVERED_ENDPOINT_REGISTRY_H_
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/btree_map.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/node_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "proto/connections_enums.pb.h"
+
+namespace nearby {
+namespace connections {
+
+// The endpoints found during discovery, at most one per (endpoint id, medium).
+//
+// Endpoints of the same id are kept in order of decreasing medium preference,
+// which is worked out when an endpoint is added or the preference changes,
+// instead of on every lookup. A per-medium index serves lookups by medium.
+// Each endpoint id is stored once, as the key of the id index; the medium
+// index refers to it.
+//
+// Lookups take a reader lock, so they don't wait on each other, only on
+// discovery updates.
+//
+// `Endpoint` needs `endpoint_id`, `medium` and `endpoint_info` members, as
+// BasePcpHandler::DiscoveredEndpoint has.
+template <typename Endpoint>
+class DiscoveredEndpointRegistry {
+ public:
+  using Medium = location::nearby::proto::connections::Medium;
+
+  enum class UpdateResult {
+    // There was no endpoint with this id on this medium.
+    kAdded = 0,
+    // The endpoint was already known with the same info; nothing changed.
+    kUnchanged = 1,
+    // The endpoint was known with a different info and has been replaced.
+    kReplaced = 2,
+  };
+
+  struct Update {
+    UpdateResult result = UpdateResult::kUnchanged;
+    // Set for kAdded when no other medium knew the endpoint id yet.
+    bool first_for_endpoint = false;
+    // The endpoint now registered.
+    std::shared_ptr<Endpoint> endpoint;
+    // The endpoint that was replaced, for kReplaced.
+    std::shared_ptr<Endpoint> replaced;
+  };
+
+  struct Removal {
+    // Null if nothing was registered for the endpoint id and medium.
+    std::shared_ptr<Endpoint> removed;
+    // Set if no other medium knows the endpoint id any more.
+    bool was_last = false;
+  };
+
+  // Mediums in order of decreasing preference. Mediums not listed rank after
+  // all listed ones. Cheap when the order did not change.
+  void SetMediumPriority(absl::Span<const Medium> mediums)
+      ABSL_LOCKS_EXCLUDED(mutex_) {
+    {
+      absl::ReaderMutexLock lock(&mutex_);
+      if (std::equal(priority_.begin(), priority_.end(), mediums.begin(),
+                     mediums.end())) {
+        return;
+      }
+    }
+    absl::MutexLock lock(&mutex_);
+    priority_.assign(mediums.begin(), mediums.end());
+    for (auto& [endpoint_id, ranked] : by_id_) {
+      for (Ranked& item : ranked) item.rank = GetRankLocked(item.medium());
+      std::stable_sort(ranked.begin(), ranked.end(),
+                       [](const Ranked& a, const Ranked& b) {
+                         return a.rank < b.rank;
+                       });
+    }
+  }
+
+  // Registers `endpoint`, replacing an endpoint of the same id and medium if
+  // its info differs.
+  Update AddOrReplace(std::shared_ptr<Endpoint> endpoint)
+      ABSL_LOCKS_EXCLUDED(mutex_) {
+    absl::MutexLock lock(&mutex_);
+    Update update;
+    auto [it, inserted] = by_id_.try_emplace(endpoint->endpoint_id);
+    std::vector<Ranked>& ranked = it->second;
+    auto existing = FindLocked(ranked, endpoint->medium);
+    if (existing != ranked.end()) {
+      if (existing->endpoint->endpoint_info == endpoint->endpoint_info) {
+        update.result = UpdateResult::kUnchanged;
+        update.endpoint = existing->endpoint;
+        return update;
+      }
+      update.result = UpdateResult::kReplaced;
+      update.replaced = std::move(existing->endpoint);
+      ranked.erase(existing);
+    } else {
+      update.result = UpdateResult::kAdded;
+      update.first_for_endpoint = ranked.empty();
+    }
+    update.endpoint = endpoint;
+    InsertLocked(it->first, ranked, std::move(endpoint));
+    return update;
+  }
+
+  // Registers `endpoint` only if its id is already known, and not yet on its
+  // medium. Returns true if it was added.
+  bool AddToKnownEndpoint(std::shared_ptr<Endpoint> endpoint)
+      ABSL_LOCKS_EXCLUDED(mutex_) {
+    absl::MutexLock lock(&mutex_);
+    auto it = by_id_.find(endpoint->endpoint_id);
+    if (it == by_id_.end() ||
+        FindLocked(it->second, endpoint->medium) != it->second.end()) {
+      return false;
+    }
+    InsertLocked(it->first, it->second, std::move(endpoint));
+    return true;
+  }
+
+  Removal Remove(absl::string_view endpoint_id, Medium medium)
+      ABSL_LOCKS_EXCLUDED(mutex_) {
+    absl::MutexLock lock(&mutex_);
+    Removal removal;
+    auto it = by_id_.find(endpoint_id);
+    if (it == by_id_.end()) return removal;
+    auto existing = FindLocked(it->second, medium);
+    if (existing == it->second.end()) return removal;
+    removal.removed = std::move(existing->endpoint);
+    it->second.erase(existing);
+    auto medium_index = by_medium_.find(medium);
+    if (medium_index != by_medium_.end()) {
+      medium_index->second.erase(it->first);
+      if (medium_index->second.empty()) by_medium_.erase(medium_index);
+    }
+    if (it->second.empty()) {
+      by_id_.erase(it);
+      removal.was_last = true;
+    }
+    return removal;
+  }
+
+  void Clear() ABSL_LOCKS_EXCLUDED(mutex_) {
+    absl::MutexLock lock(&mutex_);
+    by_medium_.clear();
+    by_id_.clear();
+  }
+
+  // The preferred endpoint of this id, or null.
+  std::shared_ptr<Endpoint> GetPreferred(absl::string_view endpoint_id) const
+      ABSL_LOCKS_EXCLUDED(mutex_) {
+    absl::ReaderMutexLock lock(&mutex_);
+    auto it = by_id_.find(endpoint_id);
+    if (it == by_id_.end()) return nullptr;
+    return it->second.front().endpoint;
+  }
+
+  // The endpoints of this id, in order of decreasing preference.
+  std::vector<std::shared_ptr<Endpoint>> Get(
+      absl::string_view endpoint_id) const ABSL_LOCKS_EXCLUDED(mutex_) {
+    std::vector<std::shared_ptr<Endpoint>> result;
+    absl::ReaderMutexLock lock(&mutex_);
+    auto it = by_id_.find(endpoint_id);
+    if (it == by_id_.end()) return result;
+    result.reserve(it->second.size());
+    for (const Ranked& item : it->second) result.push_back(item.endpoint);
+    return result;
+  }
+
+  // The endpoints found on this medium, ordered by endpoint id.
+  std::vector<std::shared_ptr<Endpoint>> GetByMedium(Medium medium) const
+      ABSL_LOCKS_EXCLUDED(mutex_) {
+    std::vector<std::shared_ptr<Endpoint>> result;
+    absl::ReaderMutexLock lock(&mutex_);
+    auto it = by_medium_.find(medium);
+    if (it == by_medium_.end()) return result;
+    result.reserve(it->second.size());
+    for (const auto& [endpoint_id, endpoint] : it->second) {
+      result.push_back(endpoint);
+    }
+    return result;
+  }
+
+  // The number of endpoint ids.
+  int GetSize() const ABSL_LOCKS_EXCLUDED(mutex_) {
+    absl::ReaderMutexLock lock(&mutex_);
+    return by_id_.size();
+  }
+
+ private:
+  struct Ranked {
+    Medium medium() const { return endpoint->medium; }
+
+    int rank;
+    std::shared_ptr<Endpoint> endpoint;
+  };
+
+  int GetRankLocked(Medium medium) const ABSL_SHARED_LOCKS_REQUIRED(mutex_) {
+    auto it = std::find(priority_.begin(), priority_.end(), medium);
+    return it - priority_.begin();
+  }
+
+  static typename std::vector<Ranked>::iterator FindLocked(
+      std::vector<Ranked>& ranked, Medium medium) {
+    return std::find_if(ranked.begin(), ranked.end(),
+                        [medium](const Ranked& item) {
+                          return item.medium() == medium;
+                        });
+  }
+
+  // Inserts after the endpoints of equal or better rank, so endpoints on
+  // mediums of the same rank keep the order they were found in.
+  void InsertLocked(const std::string& endpoint_id,
+                    std::vector<Ranked>& ranked,
+                    std::shared_ptr<Endpoint> endpoint)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    Ranked item{GetRankLocked(endpoint->medium), endpoint};
+    auto position = std::upper_bound(
+        ranked.begin(), ranked.end(), item,
+        [](const Ranked& a, const Ranked& b) { return a.rank < b.rank; });
+    ranked.insert(position, std::move(item));
+    by_medium_[endpoint->medium].insert_or_assign(endpoint_id,
+                                                  std::move(endpoint));
+  }
+
+  mutable absl::Mutex mutex_;
+  std::vector<Medium> priority_ ABSL_GUARDED_BY(mutex_);
+  // Endpoint id -> endpoints, in order of decreasing preference. The node map
+  // keeps keys in place, so `by_medium_` can refer to them.
+  absl::node_hash_map<std::string, std::vector<Ranked>> by_id_
+      ABSL_GUARDED_BY(mutex_);
+  absl::flat_hash_map<Medium,
+                      absl::btree_map<absl::string_view,
+                                      std::shared_ptr<Endpoint>>>
+      by_medium_ ABSL_GUARDED_BY(mutex_);
+};
+
+}  // namespace connections
+}  // namespace nearby
+
+#endif  // CORE_INTERNAL_DISCOVERED_ENDPOINT_REGISTRY_H_
@@ -0,0 +1,182 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "connections/implementation/discovered_endpoint_registry.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "proto/connections_enums.pb.h"
+
+namespace nearby {
+namespace connections {
+namespace {
+
+using ::location::nearby::proto::connections::Medium;
+
+struct FakeEndpoint {
+  std::string endpoint_id;
+  std::string endpoint_info;
+  Medium medium;
+};
+
+using Registry = DiscoveredEndpointRegistry<FakeEndpoint>;
+
+std::shared_ptr<FakeEndpoint> MakeEndpoint(const std::string& endpoint_id,
+                                           Medium medium,
+                                           const std::string& info = "info") {
+  return std::make_shared<FakeEndpoint>(
+      FakeEndpoint{.endpoint_id = endpoint_id,
+                   .endpoint_info = info,
+                   .medium = medium});
+}
+
+std::vector<Medium> GetMediums(
+    const std::vector<std::shared_ptr<FakeEndpoint>>& endpoints) {
+  std::vector<Medium> mediums;
+  for (const auto& endpoint : endpoints) mediums.push_back(endpoint->medium);
+  return mediums;
+}
+
+TEST(DiscoveredEndpointRegistryTest, GetReturnsEndpointsByPreference) {
+  Registry registry;
+  registry.SetMediumPriority(
+      {Medium::WIFI_LAN, Medium::BLUETOOTH, Medium::BLE});
+
+  registry.AddOrReplace(MakeEndpoint("ABCD", Medium::BLE));
+  registry.AddOrReplace(MakeEndpoint("ABCD", Medium::WIFI_LAN));
+  registry.AddOrReplace(MakeEndpoint("ABCD", Medium::BLUETOOTH));
+
+  EXPECT_EQ(GetMediums(registry.Get("ABCD")),
+            std::vector<Medium>(
+                {Medium::WIFI_LAN, Medium::BLUETOOTH, Medium::BLE}));
+  EXPECT_EQ(registry.GetPreferred("ABCD")->medium, Medium::WIFI_LAN);
+  EXPECT_EQ(registry.GetPreferred("WXYZ"), nullptr);
+}
+
+TEST(DiscoveredEndpointRegistryTest, NewPriorityReordersEndpoints) {
+  Registry registry;
+  registry.SetMediumPriority({Medium::WIFI_LAN, Medium::BLE});
+  registry.AddOrReplace(MakeEndpoint("ABCD", Medium::BLE));
+  registry.AddOrReplace(MakeEndpoint("ABCD", Medium::WIFI_LAN));
+
+  registry.SetMediumPriority({Medium::BLE});
+
+  EXPECT_EQ(GetMediums(registry.Get("ABCD")),
+            std::vector<Medium>({Medium::BLE, Medium::WIFI_LAN}));
+}
+
+TEST(DiscoveredEndpointRegistryTest, UnlistedMediumsKeepOrderFound) {
+  Registry registry;
+  registry.SetMediumPriority({Medium::WIFI_LAN});
+
+  registry.AddOrReplace(MakeEndpoint("ABCD", Medium::BLE));
+  registry.AddOrReplace(MakeEndpoint("ABCD", Medium::BLUETOOTH));
+  registry.AddOrReplace(MakeEndpoint("ABCD", Medium::WIFI_LAN));
+
+  EXPECT_EQ(GetMediums(registry.Get("ABCD")),
+            std::vector<Medium>(
+                {Medium::WIFI_LAN, Medium::BLE, Medium::BLUETOOTH}));
+}
+
+TEST(DiscoveredEndpointRegistryTest, AddOrReplaceReportsWhatChanged) {
+  Registry registry;
+
+  Registry::Update first = registry.AddOrReplace(MakeEndpoint(
+      "ABCD", Medium::BLE));
+  Registry::Update second =
+      registry.AddOrReplace(MakeEndpoint("ABCD", Medium::BLUETOOTH));
+  Registry::Update same = registry.AddOrReplace(MakeEndpoint(
+      "ABCD", Medium::BLE));
+  Registry::Update changed =
+      registry.AddOrReplace(MakeEndpoint("ABCD", Medium::BLE, "new info"));
+
+  EXPECT_EQ(first.result, Registry::UpdateResult::kAdded);
+  EXPECT_TRUE(first.first_for_endpoint);
+  EXPECT_EQ(second.result, Registry::UpdateResult::kAdded);
+  EXPECT_FALSE(second.first_for_endpoint);
+  EXPECT_EQ(same.result, Registry::UpdateResult::kUnchanged);
+  EXPECT_EQ(same.endpoint, first.endpoint);
+  EXPECT_EQ(changed.result, Registry::UpdateResult::kReplaced);
+  EXPECT_EQ(changed.replaced, first.endpoint);
+  EXPECT_EQ(registry.GetByMedium(Medium::BLE).front()->endpoint_info,
+            "new info");
+  EXPECT_EQ(registry.Get("ABCD").size(), 2);
+}
+
+TEST(DiscoveredEndpointRegistryTest, GetByMediumUsesMediumIndex) {
+  Registry registry;
+  registry.AddOrReplace(MakeEndpoint("WXYZ", Medium::BLE));
+  registry.AddOrReplace(MakeEndpoint("ABCD", Medium::BLE));
+  registry.AddOrReplace(MakeEndpoint("ABCD", Medium::BLUETOOTH));
+
+  std::vector<std::shared_ptr<FakeEndpoint>> ble =
+      registry.GetByMedium(Medium::BLE);
+
+  ASSERT_EQ(ble.size(), 2);
+  EXPECT_EQ(ble[0]->endpoint_id, "ABCD");
+  EXPECT_EQ(ble[1]->endpoint_id, "WXYZ");
+  EXPECT_EQ(registry.GetByMedium(Medium::BLUETOOTH).size(), 1);
+  EXPECT_TRUE(registry.GetByMedium(Medium::WIFI_LAN).empty());
+}
+
+TEST(DiscoveredEndpointRegistryTest, RemoveReportsLastMedium) {
+  Registry registry;
+  registry.AddOrReplace(MakeEndpoint("ABCD", Medium::BLE));
+  registry.AddOrReplace(MakeEndpoint("ABCD", Medium::BLUETOOTH));
+
+  Registry::Removal missing = registry.Remove("ABCD", Medium::WIFI_LAN);
+  Registry::Removal first = registry.Remove("ABCD", Medium::BLE);
+  Registry::Removal last = registry.Remove("ABCD", Medium::BLUETOOTH);
+
+  EXPECT_EQ(missing.removed, nullptr);
+  ASSERT_NE(first.removed, nullptr);
+  EXPECT_FALSE(first.was_last);
+  ASSERT_NE(last.removed, nullptr);
+  EXPECT_TRUE(last.was_last);
+  EXPECT_EQ(registry.GetSize(), 0);
+  EXPECT_TRUE(registry.GetByMedium(Medium::BLE).empty());
+  EXPECT_TRUE(registry.GetByMedium(Medium::BLUETOOTH).empty());
+}
+
+TEST(DiscoveredEndpointRegistryTest, AddToKnownEndpointNeedsNewMedium) {
+  Registry registry;
+  registry.AddOrReplace(MakeEndpoint("ABCD", Medium::BLE));
+
+  EXPECT_FALSE(registry.AddToKnownEndpoint(
+      MakeEndpoint("WXYZ", Medium::BLUETOOTH)));
+  EXPECT_FALSE(registry.AddToKnownEndpoint(MakeEndpoint("ABCD", Medium::BLE)));
+  EXPECT_TRUE(
+      registry.AddToKnownEndpoint(MakeEndpoint("ABCD", Medium::BLUETOOTH)));
+  EXPECT_EQ(registry.Get("ABCD").size(), 2);
+  EXPECT_EQ(registry.GetSize(), 1);
+}
+
+TEST(DiscoveredEndpointRegistryTest, ClearDropsEverything) {
+  Registry registry;
+  registry.AddOrReplace(MakeEndpoint("ABCD", Medium::BLE));
+  registry.AddOrReplace(MakeEndpoint("WXYZ", Medium::BLE));
+
+  registry.Clear();
+
+  EXPECT_EQ(registry.GetSize(), 0);
+  EXPECT_TRUE(registry.Get("ABCD").empty());
+  EXPECT_TRUE(registry.GetByMedium(Medium::BLE).empty());
+}
+
+}  // namespace
+}  // namespace connections
+}  // namespace nearby
@@ -17,15 +17,19 @@
 #include <cinttypes>
 #include <cstdint>
 #include <memory>
+#include <optional>
 #include <string>
 #include <utility>
 
+#include "securegcm/d2d_connection_context_v1.h"
 #include "securegcm/ukey2_handshake.h"
 #include "absl/strings/ascii.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
 #include "connections/implementation/client_proxy.h"
 #include "connections/implementation/endpoint_channel.h"
+#include "connections/implementation/session_resumption.h"
+#include "connections/implementation/ukey2_handshake_pool.h"
 #include "internal/platform/base64_utils.h"
 #include "internal/platform/byte_array.h"
 #include "internal/platform/cancelable_alarm.h"
@@ -39,8 +43,6 @@ namespace {
 constexpr absl::Duration kTimeout = absl::Seconds(15);
 constexpr std::int32_t kMaxUkey2VerificationStringLength = 32;
 constexpr std::int32_t kTokenLength = 5;
-constexpr securegcm::UKey2Handshake::HandshakeCipher kCipher =
-    securegcm::UKey2Handshake::HandshakeCipher::P256_SHA512;
 
 // Transforms a raw UKEY2 token (which is a random ByteArray that's
 // kMaxUkey2VerificationStringLength long) into a kTokenLength string that only
@@ -69,6 +71,24 @@ bool HandleEncryptionSuccess(const std::string& endpoint_id,
   return true;
 }
 
+bool HandleResumptionSuccess(const std::string& endpoint_id,
+                             const SessionResumption& resumption,
+                             EncryptionRunner::ResultListener& listener) {
+  std::unique_ptr<securegcm::D2DConnectionContextV1> context =
+      resumption.CreateContext();
+  if (context == nullptr) {
+    return false;
+  }
+
+  ByteArray raw_authentication_token = resumption.GetRawAuthToken();
+
+  listener.CallResumedCallback(endpoint_id, std::move(context),
+                               ToHumanReadableString(raw_authentication_token),
+                               raw_authentication_token);
+
+  return true;
+}
+
 void CancelableAlarmRunnable(ClientProxy* client,
                              const std::string& endpoint_id,
                              EndpointChannel* endpoint_channel) {
@@ -82,10 +102,14 @@ void CancelableAlarmRunnable(ClientProxy* client,
 class ServerRunnable final {
  public:
   ServerRunnable(ClientProxy* client, ScheduledExecutor* alarm_executor,
+                 Ukey2HandshakePool* handshake_pool,
+                 SessionResumptionCache* resumption_cache,
                  const std::string& endpoint_id, EndpointChannel* channel,
                  EncryptionRunner::ResultListener listener)
       : client_(client),
         alarm_executor_(alarm_executor),
+        handshake_pool_(handshake_pool),
+        resumption_cache_(resumption_cache),
         endpoint_id_(endpoint_id),
         channel_(channel),
         listener_(std::move(listener)) {}
@@ -96,17 +120,62 @@ class ServerRunnable final {
         [this]() { CancelableAlarmRunnable(client_, endpoint_id_, channel_); },
         kTimeout, alarm_executor_);
 
-    std::unique_ptr<securegcm::UKey2Handshake> server =
-        securegcm::UKey2Handshake::ForResponder(kCipher);
-    if (server == nullptr) {
+    // Message 1 (Client Init, or a resumption request)
+    ExceptionOr<ByteArray> client_init = channel_->Read();
+    if (!client_init.ok()) {
       LogException();
       HandleHandshakeOrIoException(&timeout_alarm);
       return;
     }
 
-    // Message 1 (Client Init)
-    ExceptionOr<ByteArray> client_init = channel_->Read();
-    if (!client_init.ok()) {
+    if (SessionResumption::IsResumptionMessage(client_init.result())) {
+      std::optional<SessionResumption> resumption =
+          AcceptResumption(client_init.result());
+      if (resumption.has_value()) {
+        Exception write_exception =
+            channel_->Write(resumption->CreateAccept());
+        if (!write_exception.Ok()) {
+          LogException();
+          HandleHandshakeOrIoException(&timeout_alarm);
+          return;
+        }
+
+        NEARBY_LOGS(INFO) << "In StartServer(), resumed the session with "
+                             "endpoint(id="
+                          << endpoint_id_ << ").";
+
+        timeout_alarm.Cancel();
+
+        if (!HandleResumptionSuccess(endpoint_id_, *resumption, listener_)) {
+          LogException();
+          HandleHandshakeOrIoException(&timeout_alarm);
+        }
+        return;
+      }
+
+      // The client falls back to UKEY2 on the same channel, so what comes
+      // next is the real Client Init.
+      NEARBY_LOGS(INFO) << "In StartServer(), can't resume the session with "
+                           "endpoint(id="
+                        << endpoint_id_ << "); asking for UKEY2.";
+      Exception write_exception =
+          channel_->Write(SessionResumption::CreateReject());
+      if (!write_exception.Ok()) {
+        LogException();
+        HandleHandshakeOrIoException(&timeout_alarm);
+        return;
+      }
+      client_init = channel_->Read();
+      if (!client_init.ok()) {
+        LogException();
+        HandleHandshakeOrIoException(&timeout_alarm);
+        return;
+      }
+    }
+
+    std::unique_ptr<securegcm::UKey2Handshake> server =
+        handshake_pool_->TakeResponder();
+    if (server == nullptr) {
       LogException();
       HandleHandshakeOrIoException(&timeout_alarm);
       return;
@@ -188,6 +257,25 @@ class ServerRunnable final {
   }
 
  private:
+  // Returns the resumption to complete, or std::nullopt if `request` doesn't
+  // match the ticket we hold for the client. The ticket is used up either way.
+  std::optional<SessionResumption> AcceptResumption(const ByteArray& request) {
+    std::optional<ResumptionTicket> ticket =
+        resumption_cache_->Take(client_->GetLocalEndpointId(), endpoint_id_);
+    if (!ticket.has_value()) {
+      return std::nullopt;
+    }
+    SessionResumption resumption(SessionResumption::Role::kServer,
+                                 std::move(*ticket), endpoint_id_,
+                                 client_->GetLocalEndpointId());
+    if (!resumption.ParseRequest(request)) {
+      NEARBY_LOGS(WARNING) << "In StartServer(), endpoint(id=" << endpoint_id_
+                           << ") sent an invalid resumption request.";
+      return std::nullopt;
+    }
+    return resumption;
+  }
+
   void LogException() const {
     NEARBY_LOGS(ERROR) << "In StartServer(), UKEY2 failed with endpoint(id="
                        << endpoint_id_ << ").";
@@ -212,6 +300,8 @@ class ServerRunnable final {
 
   ClientProxy* client_;
   ScheduledExecutor* alarm_executor_;
+  Ukey2HandshakePool* handshake_pool_;
+  SessionResumptionCache* resumption_cache_;
   const std::string endpoint_id_;
   EndpointChannel* channel_;
   EncryptionRunner::ResultListener listener_;
@@ -220,10 +310,14 @@ class ServerRunnable final {
 class ClientRunnable final {
  public:
   ClientRunnable(ClientProxy* client, ScheduledExecutor* alarm_executor,
+                 Ukey2HandshakePool* handshake_pool,
+                 SessionResumptionCache* resumption_cache,
                  const std::string& endpoint_id, EndpointChannel* channel,
                  EncryptionRunner::ResultListener listener)
       : client_(client),
         alarm_executor_(alarm_executor),
+        handshake_pool_(handshake_pool),
+        resumption_cache_(resumption_cache),
         endpoint_id_(endpoint_id),
         channel_(channel),
         listener_(std::move(listener)) {}
@@ -234,8 +328,37 @@ class ClientRunnable final {
         [this]() { CancelableAlarmRunnable(client_, endpoint_id_, channel_); },
         kTimeout, alarm_executor_);
 
+    std::optional<ResumptionTicket> ticket =
+        resumption_cache_->Take(client_->GetLocalEndpointId(), endpoint_id_);
+    if (ticket.has_value()) {
+      SessionResumption resumption(SessionResumption::Role::kClient,
+                                   std::move(*ticket),
+                                   client_->GetLocalEndpointId(), endpoint_id_);
+      switch (TryResume(resumption)) {
+        case ResumeResult::kResumed:
+          NEARBY_LOGS(INFO) << "In StartClient(), resumed the session with "
+                               "endpoint(id="
+                            << endpoint_id_ << ").";
+          timeout_alarm.Cancel();
+          if (!HandleResumptionSuccess(endpoint_id_, resumption, listener_)) {
+            LogException();
+            HandleHandshakeOrIoException(&timeout_alarm);
+          }
+          return;
+        case ResumeResult::kRejected:
+          NEARBY_LOGS(INFO) << "In StartClient(), endpoint(id=" << endpoint_id_
+                            << ") can't resume the session; falling back to "
+                               "UKEY2.";
+          break;
+        case ResumeResult::kFailed:
+          LogException();
+          HandleHandshakeOrIoException(&timeout_alarm);
+          return;
+      }
+    }
+
     std::unique_ptr<securegcm::UKey2Handshake> crypto =
-        securegcm::UKey2Handshake::ForInitiator(kCipher);
+        handshake_pool_->TakeInitiator();
 
     // Java code throws a HandshakeException.
     if (crypto == nullptr) {
@@ -325,6 +448,33 @@ class ClientRunnable final {
   }
 
  private:
+  enum class ResumeResult {
+    kResumed,
+    kRejected,
+    kFailed,
+  };
+
+  // Sends the resumption request and reads the server's answer.
+  ResumeResult TryResume(SessionResumption& resumption) {
+    Exception write_exception = channel_->Write(resumption.CreateRequest());
+    if (!write_exception.Ok()) {
+      return ResumeResult::kFailed;
+    }
+    ExceptionOr<ByteArray> response = channel_->Read();
+    if (!response.ok()) {
+      return ResumeResult::kFailed;
+    }
+    if (SessionResumption::IsReject(response.result())) {
+      return ResumeResult::kRejected;
+    }
+    if (!resumption.ParseAccept(response.result())) {
+      NEARBY_LOGS(WARNING) << "In StartClient(), endpoint(id=" << endpoint_id_
+                           << ") sent an invalid resumption response.";
+      return ResumeResult::kFailed;
+    }
+    return ResumeResult::kResumed;
+  }
+
   void LogException() const {
     NEARBY_LOGS(ERROR) << "In StartClient(), UKEY2 failed with endpoint(id="
                        << endpoint_id_ << ").";
@@ -349,6 +499,8 @@ class ClientRunnable final {
 
   ClientProxy* client_;
   ScheduledExecutor* alarm_executor_;
+  Ukey2HandshakePool* handshake_pool_;
+  SessionResumptionCache* resumption_cache_;
   const std::string endpoint_id_;
   EndpointChannel* channel_;
   EncryptionRunner::ResultListener listener_;
@@ -367,8 +519,9 @@ void EncryptionRunner::StartServer(ClientProxy* client,
                                    const std::string& endpoint_id,
                                    EndpointChannel* endpoint_channel,
                                    EncryptionRunner::ResultListener listener) {
-  ServerRunnable runnable(client, &alarm_executor_, endpoint_id,
-                          endpoint_channel, std::move(listener));
+  ServerRunnable runnable(client, &alarm_executor_, &handshake_pool_,
+                          &resumption_cache_, endpoint_id, endpoint_channel,
+                          std::move(listener));
   server_executor_.Execute("encryption-server", std::move(runnable));
 }
 
@@ -376,11 +529,41 @@ void EncryptionRunner::StartClient(ClientProxy* client,
                                    const std::string& endpoint_id,
                                    EndpointChannel* endpoint_channel,
                                    EncryptionRunner::ResultListener listener) {
-  ClientRunnable runnable(client, &alarm_executor_, endpoint_id,
-                          endpoint_channel, std::move(listener));
+  ClientRunnable runnable(client, &alarm_executor_, &handshake_pool_,
+                          &resumption_cache_, endpoint_id, endpoint_channel,
+                          std::move(listener));
   client_executor_.Execute("encryption-client", std::move(runnable));
 }
 
+void EncryptionRunner::RememberSession(
+    ClientProxy* client, const std::string& endpoint_id,
+    securegcm::D2DConnectionContextV1& context) {
+  std::optional<ResumptionTicket> ticket = CreateResumptionTicket(context);
+  if (!ticket.has_value()) {
+    NEARBY_LOGS(WARNING) << "Can't remember the session with endpoint(id="
+                         << endpoint_id << "); it has no session keys.";
+    return;
+  }
+  resumption_cache_.Store(client->GetLocalEndpointId(), endpoint_id,
+                          std::move(*ticket));
+}
+
+void EncryptionRunner::EndSession(ClientProxy* client,
+                                  const std::string& endpoint_id) {
+  resumption_cache_.StartExpiry(client->GetLocalEndpointId(), endpoint_id);
+}
+
+void EncryptionRunner::ForgetSession(ClientProxy* client,
+                                     const std::string& endpoint_id) {
+  resumption_cache_.Revoke(client->GetLocalEndpointId(), endpoint_id);
+}
+
+void EncryptionRunner::ForgetSessions(ClientProxy* client) {
+  resumption_cache_.RevokeAllFor(client->GetLocalEndpointId());
+}
+
+void EncryptionRunner::ForgetAllSessions() { resumption_cache_.RevokeAll(); }
+
 void EncryptionRunner::ResultListener::CallSuccessCallback(
     const std::string& endpoint_id,
     std::unique_ptr<securegcm::UKey2Handshake> ukey2,
@@ -400,9 +583,21 @@ void EncryptionRunner::ResultListener::CallFailureCallback(
   Reset();
 }
 
+void EncryptionRunner::ResultListener::CallResumedCallback(
+    const std::string& endpoint_id,
+    std::unique_ptr<securegcm::D2DConnectionContextV1> context,
+    const std::string& auth_token, const ByteArray& raw_auth_token) {
+  if (on_resumed_cb) {
+    std::move(on_resumed_cb)(endpoint_id, std::move(context), auth_token,
+                             raw_auth_token);
+  }
+  Reset();
+}
+
 void EncryptionRunner::ResultListener::Reset() {
   on_success_cb = nullptr;
   on_failure_cb = nullptr;
+  on_resumed_cb = nullptr;
 }
 
 }  // namespace connections
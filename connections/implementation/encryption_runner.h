@@ -15,12 +15,16 @@
 #ifndef CORE_INTERNAL_ENCRYPTION_RUNNER_H_
 #define CORE_INTERNAL_ENCRYPTION_RUNNER_H_
 
+#include <memory>
 #include <string>
 
+#include "securegcm/d2d_connection_context_v1.h"
 #include "securegcm/ukey2_handshake.h"
 #include "absl/functional/any_invocable.h"
 #include "connections/implementation/client_proxy.h"
 #include "connections/implementation/endpoint_channel.h"
+#include "connections/implementation/session_resumption.h"
+#include "connections/implementation/ukey2_handshake_pool.h"
 #include "connections/listeners.h"
 #include "internal/platform/byte_array.h"
 #include "internal/platform/scheduled_executor.h"
@@ -31,6 +35,11 @@ namespace connections {
 
 // Encrypts a connection over UKEY2.
 //
+// If both sides remembered the session of an earlier connection between the
+// same pair of endpoints (see RememberSession()), the connection is encrypted
+// by resuming that session instead, which takes a single round trip. If the
+// server can't resume, the client falls back to UKEY2 on the same channel.
+//
 // NOTE: Stalled EndpointChannels will be disconnected after kTimeout.
 // This is to prevent unverified endpoints from maintaining an
 // indefinite connection to us.
@@ -46,6 +55,10 @@ class EncryptionRunner {
                              const ByteArray& raw_auth_token);
     void CallFailureCallback(const std::string& endpoint_id,
                              EndpointChannel* channel);
+    void CallResumedCallback(
+        const std::string& endpoint_id,
+        std::unique_ptr<securegcm::D2DConnectionContextV1> context,
+        const std::string& auth_token, const ByteArray& raw_auth_token);
     void Reset();
 
     // @EncryptionRunnerThread
@@ -67,6 +80,18 @@ class EncryptionRunner {
     absl::AnyInvocable<void(const std::string& endpoint_id,
                             EndpointChannel* channel) &&>
         on_failure_cb;
+
+    // The session was resumed, so there is no UKEY2 handshake; `context` is
+    // ready to encrypt the channel. Resumption is only attempted once
+    // RememberSession() has been called, so listeners that never remember
+    // sessions may leave this unset.
+    //
+    // @EncryptionRunnerThread
+    absl::AnyInvocable<void(
+        const std::string& endpoint_id,
+        std::unique_ptr<securegcm::D2DConnectionContextV1> context,
+        const std::string& auth_token, const ByteArray& raw_auth_token) &&>
+        on_resumed_cb;
   };
 
   // @AnyThread
@@ -78,8 +103,34 @@ class EncryptionRunner {
                    EndpointChannel* endpoint_channel,
                    ResultListener result_listener);
 
+  // Keeps a resumption ticket derived from `context`, so that the next
+  // connection between the client's local endpoint and `endpoint_id` can
+  // resume this session instead of running UKEY2. Both sides must remember
+  // the session for resumption to succeed. The ticket is kept for a short
+  // while after EndSession() is called.
+  // @AnyThread
+  void RememberSession(ClientProxy* client, const std::string& endpoint_id,
+                       securegcm::D2DConnectionContextV1& context);
+  // Tells that the connection with `endpoint_id` is gone, which starts the
+  // lifetime of its remembered session.
+  // @AnyThread
+  void EndSession(ClientProxy* client, const std::string& endpoint_id);
+  // Drops the remembered session with `endpoint_id`, if any.
+  // @AnyThread
+  void ForgetSession(ClientProxy* client, const std::string& endpoint_id);
+  // Drops the sessions remembered by `client`.
+  // @AnyThread
+  void ForgetSessions(ClientProxy* client);
+  // Drops all remembered sessions.
+  // @AnyThread
+  void ForgetAllSessions();
+
  private:
   ScheduledExecutor alarm_executor_;
+  // Supplies the handshakes, so that their ephemeral keys are generated ahead
+  // of time.
+  Ukey2HandshakePool handshake_pool_;
+  SessionResumptionCache resumption_cache_;
   SingleThreadExecutor server_executor_;
   SingleThreadExecutor client_executor_;
 };
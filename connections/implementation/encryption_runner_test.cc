@@ -15,7 +15,9 @@
 #include "connections/implementation/encryption_runner.h"
 
 #include <cstddef>
+#include <memory>
 #include <string>
+#include <utility>
 
 #include "gtest/gtest.h"
 #include "absl/time/time.h"
@@ -30,6 +32,7 @@
 #include "internal/platform/pipe.h"
 #include "internal/platform/system_clock.h"
 #include "proto/connections_enums.pb.h"
+#include "third_party/ukey2/src/main/cpp/include/securegcm/d2d_connection_context_v1.h"
 #include "third_party/ukey2/src/main/cpp/include/securegcm/ukey2_handshake.h"
 
 namespace nearby {
@@ -179,6 +182,132 @@ TEST(EncryptionRunnerTest, ReadWrite) {
   EXPECT_EQ(response.client_status, Response::Status::kDone);
 }
 
+// The outcome of one side of an encryption attempt.
+struct Outcome {
+  enum class Status {
+    kUnknown = 0,
+    kHandshake = 1,
+    kResumed = 2,
+    kFailed = 3,
+  };
+
+  Status status = Status::kUnknown;
+  std::unique_ptr<securegcm::D2DConnectionContextV1> context;
+  std::string auth_token;
+};
+
+EncryptionRunner::ResultListener ListenerFor(Outcome* outcome,
+                                             CountDownLatch* latch) {
+  return {
+      .on_success_cb =
+          [outcome, latch](const std::string& endpoint_id,
+                           std::unique_ptr<securegcm::UKey2Handshake> ukey2,
+                           const std::string& auth_token,
+                           const ByteArray& raw_auth_token) {
+            outcome->status = Outcome::Status::kHandshake;
+            ukey2->VerifyHandshake();
+            outcome->context = ukey2->ToConnectionContext();
+            outcome->auth_token = auth_token;
+            latch->CountDown();
+          },
+      .on_failure_cb =
+          [outcome, latch](const std::string& endpoint_id,
+                           EndpointChannel* channel) {
+            outcome->status = Outcome::Status::kFailed;
+            latch->CountDown();
+          },
+      .on_resumed_cb =
+          [outcome, latch](
+              const std::string& endpoint_id,
+              std::unique_ptr<securegcm::D2DConnectionContextV1> context,
+              const std::string& auth_token, const ByteArray& raw_auth_token) {
+            outcome->status = Outcome::Status::kResumed;
+            outcome->context = std::move(context);
+            outcome->auth_token = auth_token;
+            latch->CountDown();
+          },
+  };
+}
+
+// Encrypts a fresh pair of channels between `server` and `client`.
+void Connect(EncryptionRunner& server_crypto, ClientProxy& server,
+             Outcome* server_outcome, EncryptionRunner& client_crypto,
+             ClientProxy& client, Outcome* client_outcome) {
+  auto from_server = CreatePipe();
+  auto from_client = CreatePipe();
+  FakeEndpointChannel server_channel(/*in=*/from_client.first.get(),
+                                     /*out=*/from_server.second.get());
+  FakeEndpointChannel client_channel(/*in=*/from_server.first.get(),
+                                     /*out=*/from_client.second.get());
+  CountDownLatch latch(2);
+
+  server_crypto.StartServer(&server, client.GetLocalEndpointId(),
+                            &server_channel,
+                            ListenerFor(server_outcome, &latch));
+  client_crypto.StartClient(&client, server.GetLocalEndpointId(),
+                            &client_channel,
+                            ListenerFor(client_outcome, &latch));
+  EXPECT_TRUE(latch.Await(absl::Milliseconds(5000)).result());
+}
+
+TEST(EncryptionRunnerTest, ResumesRememberedSession) {
+  EncryptionRunner server_crypto;
+  EncryptionRunner client_crypto;
+  ClientProxy server;
+  ClientProxy client;
+  Outcome server_first;
+  Outcome client_first;
+  Connect(server_crypto, server, &server_first, client_crypto, client,
+          &client_first);
+  ASSERT_EQ(server_first.status, Outcome::Status::kHandshake);
+  ASSERT_EQ(client_first.status, Outcome::Status::kHandshake);
+  server_crypto.RememberSession(&server, client.GetLocalEndpointId(),
+                                *server_first.context);
+  client_crypto.RememberSession(&client, server.GetLocalEndpointId(),
+                                *client_first.context);
+
+  Outcome server_second;
+  Outcome client_second;
+  Connect(server_crypto, server, &server_second, client_crypto, client,
+          &client_second);
+
+  ASSERT_EQ(server_second.status, Outcome::Status::kResumed);
+  ASSERT_EQ(client_second.status, Outcome::Status::kResumed);
+  EXPECT_EQ(server_second.auth_token, client_second.auth_token);
+  EXPECT_NE(server_second.auth_token, server_first.auth_token);
+  std::unique_ptr<std::string> message =
+      client_second.context->EncodeMessageToPeer("hello");
+  ASSERT_NE(message, nullptr);
+  EXPECT_EQ(*server_second.context->DecodeMessageFromPeer(*message), "hello");
+}
+
+TEST(EncryptionRunnerTest, FallsBackToUkey2WhenServerForgotSession) {
+  EncryptionRunner server_crypto;
+  EncryptionRunner client_crypto;
+  ClientProxy server;
+  ClientProxy client;
+  Outcome server_first;
+  Outcome client_first;
+  Connect(server_crypto, server, &server_first, client_crypto, client,
+          &client_first);
+  ASSERT_EQ(server_first.status, Outcome::Status::kHandshake);
+  ASSERT_EQ(client_first.status, Outcome::Status::kHandshake);
+  server_crypto.RememberSession(&server, client.GetLocalEndpointId(),
+                                *server_first.context);
+  client_crypto.RememberSession(&client, server.GetLocalEndpointId(),
+                                *client_first.context);
+  server_crypto.ForgetSession(&server, client.GetLocalEndpointId());
+
+  Outcome server_second;
+  Outcome client_second;
+  Connect(server_crypto, server, &server_second, client_crypto, client,
+          &client_second);
+
+  EXPECT_EQ(server_second.status, Outcome::Status::kHandshake);
+  EXPECT_EQ(client_second.status, Outcome::Status::kHandshake);
+  EXPECT_EQ(server_second.auth_token, client_second.auth_token);
+}
+
 }  // namespace
 }  // namespace connections
 }  // namespace nearby
@@ -22,6 +22,7 @@
 #include <vector>
 
 #include "absl/time/time.h"
+#include "connections/implementation/analytics/payload_pipeline_profiler.h"
 #include "connections/implementation/analytics/throughput_recorder.h"
 #include "connections/implementation/client_proxy.h"
 #include "connections/implementation/endpoint_channel.h"
@@ -194,8 +195,9 @@ ExceptionOr<OfflineFrame> EndpointManager::TryDecryptFrame(
   while (true) {
     ExceptionOr<ByteArray> decrypted = endpoint_channel->TryDecrypt(data);
     if (decrypted.ok()) {
-      NEARBY_LOGS(VERBOSE) << "Message decrypted after "
-                           << SystemClock::ElapsedRealtime() - start_time;
+      NEARBY_LOGS_EVERY_N(VERBOSE, 100)
+          << "Message decrypted after "
+          << SystemClock::ElapsedRealtime() - start_time;
       return parser::FromBytes(decrypted.result());
     }
     if (decrypted.exception() == Exception::kExecution) {
@@ -636,7 +638,8 @@ std::vector<std::string> EndpointManager::SendPayloadChunk(
     const PayloadTransferFrame::PayloadHeader& payload_header,
     const PayloadTransferFrame::PayloadChunk& payload_chunk,
     const std::vector<std::string>& endpoint_ids,
-    PacketMetaData& packet_meta_data) {
+    PacketMetaData& packet_meta_data,
+    analytics::ThroughputRecorder* throughput_recorder) {
   ByteArray bytes =
       parser::ForDataPayloadTransfer(payload_header, payload_chunk);
 
@@ -645,7 +648,7 @@ std::vector<std::string> EndpointManager::SendPayloadChunk(
       /*offset=*/payload_chunk.offset(),
       /*packet_type=*/
       PayloadTransferFrame::PacketType_Name(PayloadTransferFrame::DATA),
-      packet_meta_data);
+      packet_meta_data, throughput_recorder);
 }
 
 // Designed to run asynchronously. It is called from IO thread pools, and
@@ -887,7 +890,8 @@ CountDownLatch EndpointManager::NotifyFrameProcessorsOnEndpointDisconnect(
 std::vector<std::string> EndpointManager::SendTransferFrameBytes(
     const std::vector<std::string>& endpoint_ids, const ByteArray& bytes,
     std::int64_t payload_id, std::int64_t offset,
-    const std::string& packet_type, PacketMetaData& packet_meta_data) {
+    const std::string& packet_type, PacketMetaData& packet_meta_data,
+    analytics::ThroughputRecorder* throughput_recorder) {
   std::vector<std::string> failed_endpoint_ids;
   for (const std::string& endpoint_id : endpoint_ids) {
     std::shared_ptr<EndpointChannel> channel =
@@ -913,9 +917,14 @@ std::vector<std::string> EndpointManager::SendTransferFrameBytes(
       NEARBY_LOGS(INFO) << "Failed to send packet; endpoint_id=" << endpoint_id;
       continue;
     }
-    analytics::ThroughputRecorderContainer::GetInstance()
-        .GetTPRecorder(payload_id, PayloadDirection::OUTGOING_PAYLOAD)
-        ->OnFrameSent(channel->GetMedium(), packet_meta_data);
+    if (throughput_recorder != nullptr) {
+      throughput_recorder->OnFrameSent(channel->GetMedium(), packet_meta_data);
+    }
+    if (packet_type ==
+        PayloadTransferFrame::PacketType_Name(PayloadTransferFrame::DATA)) {
+      analytics::PayloadPipelineProfiler::GetInstance().OnChunkSent(
+          endpoint_id, channel->GetMedium(), packet_meta_data);
+    }
   }
 
   return failed_endpoint_ids;
@@ -28,6 +28,7 @@
 #include "absl/functional/any_invocable.h"
 #include "absl/time/time.h"
 #include "connections/implementation/analytics/packet_meta_data.h"
+#include "connections/implementation/analytics/throughput_recorder.h"
 #include "connections/implementation/client_proxy.h"
 #include "connections/implementation/endpoint_channel.h"
 #include "connections/implementation/endpoint_channel_manager.h"
@@ -126,6 +127,7 @@ class EndpointManager {
   int GetMaxTransmitPacketSize(const std::string& endpoint_id);
 
   // Returns the list of endpoints to which sending this chunk failed.
+  // `throughput_recorder`, if set, records every chunk sent.
   //
   // Invoked from the PayloadManager's sendPayload() method.
   std::vector<std::string> SendPayloadChunk(
@@ -134,7 +136,8 @@ class EndpointManager {
       const location::nearby::connections::PayloadTransferFrame::PayloadChunk&
           payload_chunk,
       const std::vector<std::string>& endpoint_ids,
-      analytics::PacketMetaData& packet_meta_data);
+      analytics::PacketMetaData& packet_meta_data,
+      analytics::ThroughputRecorder* throughput_recorder = nullptr);
   std::vector<std::string> SendControlMessage(
       const location::nearby::connections::PayloadTransferFrame::PayloadHeader&
           payload_header,
@@ -282,7 +285,8 @@ class EndpointManager {
       const std::vector<std::string>& endpoint_ids,
       const ByteArray& payload_transfer_frame_bytes, std::int64_t payload_id,
       std::int64_t offset, const std::string& packet_type,
-      analytics::PacketMetaData& packet_meta_data);
+      analytics::PacketMetaData& packet_meta_data,
+      analytics::ThroughputRecorder* throughput_recorder = nullptr);
 
   // Executes all jobs sequentially, on a serial_executor_.
   void RunOnEndpointManagerThread(const std::string& name, Runnable runnable);
@@ -58,6 +58,18 @@ constexpr auto kEnablePayloadReceivedAck =
 constexpr auto kSafeToDisconnectVersion =
     flags::Flag<int64_t>(kConfigPackage, "45425841", 0);
 
+// Enable/Disable ranking bandwidth upgrade mediums (and scaling upgrade retry
+// delays) by their measured throughput and connection history.
+constexpr auto kEnableBwuMediumPerformanceModel =
+    flags::Flag<bool>(kConfigPackage, "45428547", false);
+
+// Enable/Disable remembering accepted sessions so that a reconnect to the same
+// endpoint can resume the session instead of running UKEY2 again. Only enable
+// it where peers understand resumption; a peer that holds no matching session
+// rejects the resumption and both sides fall back to UKEY2.
+constexpr auto kEnableSessionResumption =
+    flags::Flag<bool>(kConfigPackage, "45429713", false);
+
 }  // namespace nearby_connections_feature
 }  // namespace config_package_nearby
 }  // namespace connections
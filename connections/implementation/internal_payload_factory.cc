@@ -23,6 +23,7 @@
 #include "absl/strings/str_cat.h"
 #include "connections/implementation/internal_payload.h"
 #include "connections/implementation/proto/offline_wire_formats.pb.h"
+#include "connections/implementation/stream_memory_budget.h"
 #include "connections/payload.h"
 #include "connections/payload_type.h"
 #include "internal/platform/byte_array.h"
@@ -154,11 +155,39 @@ class OutgoingStreamInternalPayload : public InternalPayload {
   }
 };
 
+// The InputStream handed to the client for an incoming stream payload. Gives
+// the bytes read back to the stream's memory budget.
+class BudgetedInputStream : public InputStream {
+ public:
+  BudgetedInputStream(std::unique_ptr<InputStream> input,
+                      std::shared_ptr<StreamMemoryBudget::Stream> budget)
+      : input_(std::move(input)), budget_(std::move(budget)) {}
+  ~BudgetedInputStream() override { budget_->CloseReader(); }
+
+  ExceptionOr<ByteArray> Read(std::int64_t size) override {
+    ExceptionOr<ByteArray> bytes = input_->Read(size);
+    if (bytes.ok()) budget_->Release(bytes.result().size());
+    return bytes;
+  }
+
+  Exception Close() override {
+    budget_->CloseReader();
+    return input_->Close();
+  }
+
+ private:
+  std::unique_ptr<InputStream> input_;
+  std::shared_ptr<StreamMemoryBudget::Stream> budget_;
+};
+
 class IncomingStreamInternalPayload : public InternalPayload {
  public:
-  IncomingStreamInternalPayload(Payload payload,
-                                std::unique_ptr<OutputStream> output)
-      : InternalPayload(std::move(payload)), output_(std::move(output)) {}
+  IncomingStreamInternalPayload(
+      Payload payload, std::unique_ptr<OutputStream> output,
+      std::shared_ptr<StreamMemoryBudget::Stream> budget)
+      : InternalPayload(std::move(payload)),
+        output_(std::move(output)),
+        budget_(std::move(budget)) {}
 
   PayloadTransferFrame::PayloadHeader::PayloadType GetType() const override {
     return PayloadTransferFrame::PayloadHeader::STREAM;
@@ -176,7 +205,15 @@ class IncomingStreamInternalPayload : public InternalPayload {
       return {Exception::kSuccess};
     }
 
-    return output_->Write(chunk);
+    // Waits for the client to read if it is too far behind.
+    if (!budget_->Acquire(chunk.size())) {
+      return {Exception::kIo};
+    }
+    Exception write_exception = output_->Write(chunk);
+    if (write_exception.Raised()) {
+      budget_->Release(chunk.size());
+    }
+    return write_exception;
   }
 
   ExceptionOr<size_t> SkipToOffset(size_t offset) override {
@@ -185,10 +222,14 @@ class IncomingStreamInternalPayload : public InternalPayload {
     return {Exception::kIo};
   }
 
-  void Close() override { output_->Close(); }
+  void Close() override {
+    budget_->CloseWriter();
+    output_->Close();
+  }
 
  private:
   std::unique_ptr<OutputStream> output_;
+  std::shared_ptr<StreamMemoryBudget::Stream> budget_;
 };
 
 class OutgoingFileInternalPayload : public InternalPayload {
@@ -367,9 +408,13 @@ std::unique_ptr<InternalPayload> CreateIncomingInternalPayload(
 
     case PayloadTransferFrame::PayloadHeader::STREAM: {
       auto [input, output] = CreatePipe();
+      std::shared_ptr<StreamMemoryBudget::Stream> budget =
+          StreamMemoryBudget::GetInstance().OpenStream();
 
       return std::make_unique<IncomingStreamInternalPayload>(
-          Payload(payload_id, std::move(input)), std::move(output));
+          Payload(payload_id, std::make_unique<BudgetedInputStream>(
+                                  std::move(input), budget)),
+          std::move(output), budget);
     }
 
     case PayloadTransferFrame::PayloadHeader::FILE: {
@@ -22,6 +22,7 @@
 #include "gtest/gtest.h"
 #include "connections/implementation/internal_payload.h"
 #include "connections/implementation/proto/offline_wire_formats.pb.h"
+#include "connections/implementation/stream_memory_budget.h"
 #include "connections/payload.h"
 #include "connections/payload_type.h"
 #include "internal/platform/byte_array.h"
@@ -118,6 +119,32 @@ TEST(InternalPayloadFactoryTest, CanCreateInternalPayloadFromStreamMessage) {
   internal_payload->Close();
 }
 
+TEST(InternalPayloadFactoryTest, IncomingStreamCountsUnreadBytes) {
+  PayloadTransferFrame frame;
+  std::string path = "C:\\Downloads";
+  frame.set_packet_type(PayloadTransferFrame::DATA);
+  auto& header = *frame.mutable_payload_header();
+  header.set_type(PayloadTransferFrame::PayloadHeader::STREAM);
+  header.set_id(12345);
+  header.set_total_size(0);
+  StreamMemoryBudget& budget = StreamMemoryBudget::GetInstance();
+  std::int64_t buffered_bytes = budget.GetStats().buffered_bytes;
+  std::unique_ptr<InternalPayload> internal_payload =
+      CreateIncomingInternalPayload(frame, path);
+  ASSERT_NE(internal_payload, nullptr);
+  Payload payload = internal_payload->ReleasePayload();
+  ByteArray data(kText);
+
+  EXPECT_FALSE(internal_payload->AttachNextChunk(data).Raised());
+  EXPECT_EQ(budget.GetStats().buffered_bytes, buffered_bytes + data.size());
+
+  ExceptionOr<ByteArray> read = payload.AsStream()->Read(data.size());
+  ASSERT_TRUE(read.ok());
+  EXPECT_EQ(read.result(), data);
+  EXPECT_EQ(budget.GetStats().buffered_bytes, buffered_bytes);
+  internal_payload->Close();
+}
+
 TEST(InternalPayloadFactoryTest, CanCreateInternalPayloadFromFileMessage) {
   PayloadTransferFrame frame;
   std::string path = "C:\\Downloads";
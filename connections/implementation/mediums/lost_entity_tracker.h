@@ -15,6 +15,10 @@
 #ifndef CORE_INTERNAL_MEDIUMS_LOST_ENTITY_TRACKER_H_
 #define CORE_INTERNAL_MEDIUMS_LOST_ENTITY_TRACKER_H_
 
+#include <cstdint>
+#include <utility>
+
+#include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
 #include "internal/platform/mutex.h"
 #include "internal/platform/mutex_lock.h"
@@ -28,6 +32,11 @@ namespace mediums {
 // of whether a specific entity was rediscovered since the last call to
 // ComputeLostEntities.
 //
+// Each call to ComputeLostEntities ends a generation. A found entity is given
+// the generation it expires in, and is filed under it; ComputeLostEntities
+// hands out the entities filed under the generation it ends. Its cost is in
+// the number of lost entities, not in the number of tracked ones.
+//
 // Note: Entity must overload the < and == operators.
 template <typename Entity>
 class LostEntityTracker {
@@ -38,8 +47,11 @@ class LostEntityTracker {
   ~LostEntityTracker();
 
   // Records the given entity as being recently found, whether or not this is
-  // our first time discovering the entity.
-  void RecordFoundEntity(const Entity& entity) ABSL_LOCKS_EXCLUDED(mutex_);
+  // our first time discovering the entity. Unless it is found again, the
+  // entity is lost in the `timeout_generations`th call to ComputeLostEntities
+  // after the next one.
+  void RecordFoundEntity(const Entity& entity, int timeout_generations = 1)
+      ABSL_LOCKS_EXCLUDED(mutex_);
 
   // Computes and returns the set of entities considered lost since the last
   // time this method was called.
@@ -47,25 +59,44 @@ class LostEntityTracker {
 
  private:
   Mutex mutex_;
-  EntitySet current_entities_ ABSL_GUARDED_BY(mutex_);
-  EntitySet previously_found_entities_ ABSL_GUARDED_BY(mutex_);
+  // The generation the next call to ComputeLostEntities ends.
+  std::uint64_t generation_ ABSL_GUARDED_BY(mutex_) = 0;
+  // Entity -> the generation it expires in.
+  absl::flat_hash_map<Entity, std::uint64_t> expiry_generations_
+      ABSL_GUARDED_BY(mutex_);
+  // Generation -> the entities that expire in it.
+  absl::flat_hash_map<std::uint64_t, EntitySet> expiring_entities_
+      ABSL_GUARDED_BY(mutex_);
 };
 
 template <typename Entity>
-LostEntityTracker<Entity>::LostEntityTracker()
-    : current_entities_{}, previously_found_entities_{} {}
+LostEntityTracker<Entity>::LostEntityTracker() = default;
 
 template <typename Entity>
 LostEntityTracker<Entity>::~LostEntityTracker() {
-  previously_found_entities_.clear();
-  current_entities_.clear();
+  expiring_entities_.clear();
+  expiry_generations_.clear();
 }
 
 template <typename Entity>
-void LostEntityTracker<Entity>::RecordFoundEntity(const Entity& entity) {
+void LostEntityTracker<Entity>::RecordFoundEntity(const Entity& entity,
+                                                  int timeout_generations) {
   MutexLock lock(&mutex_);
 
-  current_entities_.insert(entity);
+  std::uint64_t expiry =
+      generation_ + (timeout_generations > 0 ? timeout_generations : 1);
+  auto [it, inserted] = expiry_generations_.try_emplace(entity, expiry);
+  if (!inserted) {
+    // Already found during this generation.
+    if (it->second == expiry) return;
+    auto bucket = expiring_entities_.find(it->second);
+    if (bucket != expiring_entities_.end()) {
+      bucket->second.erase(entity);
+      if (bucket->second.empty()) expiring_entities_.erase(bucket);
+    }
+    it->second = expiry;
+  }
+  expiring_entities_[expiry].insert(entity);
 }
 
 template <typename Entity>
@@ -73,14 +104,18 @@ typename LostEntityTracker<Entity>::EntitySet
 LostEntityTracker<Entity>::ComputeLostEntities() {
   MutexLock lock(&mutex_);
 
-  // The set of lost entities is the previously found set MINUS the currently
-  // found set.
-  for (const auto& item : current_entities_) {
-    previously_found_entities_.erase(item);
+  // The lost entities are the ones that were due to expire in the generation
+  // ending now.
+  EntitySet lost_entities;
+  auto bucket = expiring_entities_.find(generation_);
+  if (bucket != expiring_entities_.end()) {
+    lost_entities = std::move(bucket->second);
+    expiring_entities_.erase(bucket);
+    for (const auto& item : lost_entities) {
+      expiry_generations_.erase(item);
+    }
   }
-  auto lost_entities = std::move(previously_found_entities_);
-  previously_found_entities_ = std::move(current_entities_);
-  current_entities_ = {};
+  ++generation_;
 
   return lost_entities;
 }
@@ -129,6 +129,57 @@ TEST(LostEntityTrackerTest, SameEntityMultipleCopies) {
   EXPECT_TRUE(lost_entities.find(entity_1_copy) != lost_entities.end());
 }
 
+TEST(LostEntityTrackerTest, LostEntityIsReportedOnce) {
+  LostEntityTracker<TestEntity> lost_entity_tracker;
+  TestEntity entity_1{1};
+
+  lost_entity_tracker.RecordFoundEntity(entity_1);
+  EXPECT_TRUE(lost_entity_tracker.ComputeLostEntities().empty());
+  EXPECT_EQ(lost_entity_tracker.ComputeLostEntities().size(), 1);
+
+  // Already lost; nothing left to report.
+  EXPECT_TRUE(lost_entity_tracker.ComputeLostEntities().empty());
+
+  // Found again after being lost, and lost again.
+  lost_entity_tracker.RecordFoundEntity(entity_1);
+  EXPECT_TRUE(lost_entity_tracker.ComputeLostEntities().empty());
+  EXPECT_EQ(lost_entity_tracker.ComputeLostEntities().size(), 1);
+}
+
+TEST(LostEntityTrackerTest, EntityWithLongerTimeoutIsLostLater) {
+  LostEntityTracker<TestEntity> lost_entity_tracker;
+  TestEntity entity_1{1};
+  TestEntity entity_2{2};
+
+  lost_entity_tracker.RecordFoundEntity(entity_1);
+  lost_entity_tracker.RecordFoundEntity(entity_2, /*timeout_generations=*/3);
+  EXPECT_TRUE(lost_entity_tracker.ComputeLostEntities().empty());
+
+  typename LostEntityTracker<TestEntity>::EntitySet lost_entities =
+      lost_entity_tracker.ComputeLostEntities();
+  EXPECT_EQ(lost_entities.size(), 1);
+  EXPECT_TRUE(lost_entities.find(entity_1) != lost_entities.end());
+
+  EXPECT_TRUE(lost_entity_tracker.ComputeLostEntities().empty());
+  lost_entities = lost_entity_tracker.ComputeLostEntities();
+  EXPECT_EQ(lost_entities.size(), 1);
+  EXPECT_TRUE(lost_entities.find(entity_2) != lost_entities.end());
+}
+
+TEST(LostEntityTrackerTest, RediscoveryResetsTimeout) {
+  LostEntityTracker<TestEntity> lost_entity_tracker;
+  TestEntity entity_1{1};
+
+  lost_entity_tracker.RecordFoundEntity(entity_1, /*timeout_generations=*/2);
+  EXPECT_TRUE(lost_entity_tracker.ComputeLostEntities().empty());
+  EXPECT_TRUE(lost_entity_tracker.ComputeLostEntities().empty());
+
+  // Found again just before it expired, with the default timeout.
+  lost_entity_tracker.RecordFoundEntity(entity_1);
+  EXPECT_TRUE(lost_entity_tracker.ComputeLostEntities().empty());
+  EXPECT_EQ(lost_entity_tracker.ComputeLostEntities().size(), 1);
+}
+
 }  // namespace
 }  // namespace mediums
 }  // namespace connections
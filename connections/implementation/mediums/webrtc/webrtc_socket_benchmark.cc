@@ -0,0 +1,86 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks WebRtcSocket throughput between two sockets connected by an
+// in-process FakeDataChannel pair, so the numbers reflect the socket's own
+// buffering and backpressure rather than SCTP.
+//
+// Run with:
+//   bazel run -c opt //connections/implementation/mediums/webrtc:webrtc_socket_benchmark
+
+#include <cstdint>
+#include <string>
+#include <thread>  // NOLINT
+
+#include "benchmark/benchmark.h"
+#include "connections/implementation/mediums/webrtc/webrtc_socket_impl.h"
+#include "internal/platform/byte_array.h"
+#include "internal/test/fake_webrtc.h"
+
+namespace nearby {
+namespace connections {
+namespace mediums {
+namespace {
+
+constexpr char kSocketName[] = "BenchmarkSocket";
+constexpr std::int64_t kBytesPerIteration = 16 * 1024 * 1024;
+
+// Streams kBytesPerIteration from one socket to the other.
+// Args: message size, high watermark. The low watermark is a quarter of the
+// high watermark.
+void BM_WebRtcSocketTransfer(benchmark::State& state) {
+  const std::int64_t message_size = state.range(0);
+  const std::uint64_t high_watermark = state.range(1);
+  const std::int64_t message_count = kBytesPerIteration / message_size;
+
+  auto channels = FakeDataChannel::CreatePair(kSocketName);
+  WebRtcSocket sender(kSocketName, channels.first,
+                      {.high_watermark = high_watermark,
+                       .low_watermark = high_watermark / 4});
+  WebRtcSocket receiver(kSocketName, channels.second);
+  ByteArray message(std::string(message_size, 'x'));
+
+  for (auto _ : state) {
+    std::thread writer([&]() {
+      for (std::int64_t i = 0; i < message_count; ++i) {
+        if (sender.GetOutputStream().Write(message).Raised()) return;
+      }
+    });
+    std::int64_t received = 0;
+    while (received < message_count * message_size) {
+      ExceptionOr<ByteArray> result =
+          receiver.GetInputStream().Read(message_size);
+      if (!result.ok() || result.result().Empty()) break;
+      received += result.result().size();
+    }
+    writer.join();
+    if (received != message_count * message_size) {
+      state.SkipWithError("Transfer was truncated.");
+      break;
+    }
+  }
+
+  state.SetBytesProcessed(state.iterations() * message_count * message_size);
+  sender.Close();
+}
+BENCHMARK(BM_WebRtcSocketTransfer)
+    ->ArgsProduct({{4 * 1024, 64 * 1024, 256 * 1024},
+                   {256 * 1024, kMaxDataSize, 4 * kMaxDataSize}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace mediums
+}  // namespace connections
+}  // namespace nearby
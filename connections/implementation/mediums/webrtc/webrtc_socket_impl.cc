@@ -12,15 +12,15 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <cstddef>
 #include <cstdint>
 #include <string>
-#include <tuple>
 #include <utility>
 
 #include "internal/platform/byte_array.h"
 #include "internal/platform/exception.h"
 #include "internal/platform/input_stream.h"
-#include "internal/platform/pipe.h"
 #ifndef NO_WEBRTC
 
 #include "connections/implementation/mediums/webrtc/webrtc_socket_impl.h"
@@ -31,6 +31,20 @@ namespace nearby {
 namespace connections {
 namespace mediums {
 
+// InputStreamImpl
+ExceptionOr<ByteArray> WebRtcSocket::InputStreamImpl::Read(std::int64_t size) {
+  return socket_->ReadMessage(size);
+}
+
+Exception WebRtcSocket::InputStreamImpl::Close() {
+  MutexLock lock(&socket_->read_mutex_);
+  socket_->input_closed_ = true;
+  socket_->read_queue_.clear();
+  socket_->read_offset_ = 0;
+  socket_->read_variable_.Notify();
+  return {Exception::kSuccess};
+}
+
 // OutputStreamImpl
 Exception WebRtcSocket::OutputStreamImpl::Write(const ByteArray& data) {
   if (data.size() > kMaxDataSize) {
@@ -65,11 +79,11 @@ Exception WebRtcSocket::OutputStreamImpl::Close() {
 // WebRtcSocket
 WebRtcSocket::WebRtcSocket(
     const std::string& name,
-    rtc::scoped_refptr<webrtc::DataChannelInterface> data_channel)
-    : name_(name), data_channel_(std::move(data_channel)) {
+    rtc::scoped_refptr<webrtc::DataChannelInterface> data_channel,
+    const Options& options)
+    : name_(name), data_channel_(std::move(data_channel)), options_(options) {
   NEARBY_LOGS(INFO) << "WebRtcSocket::WebRtcSocket(" << name_
                     << ") this: " << this;
-  std::tie(pipe_input_, pipe_output_) = CreatePipe();
   data_channel_->RegisterObserver(this);
 }
 
@@ -77,16 +91,16 @@ WebRtcSocket::~WebRtcSocket() {
   NEARBY_LOGS(INFO) << "WebRtcSocket::~WebRtcSocket(" << name_
                     << ") this: " << this;
 
-  if (!IsClosed()) {
-    data_channel_->UnregisterObserver();
-    Close();
-  }
+  // Unregister even if the data channel has closed already, so that no
+  // callback can still be running once |this| is gone.
+  data_channel_->UnregisterObserver();
+  Close();
 
   NEARBY_LOGS(INFO) << "WebRtcSocket::~WebRtcSocket(" << name_
                     << ") this: " << this << " done";
 }
 
-InputStream& WebRtcSocket::GetInputStream() { return *pipe_input_; }
+InputStream& WebRtcSocket::GetInputStream() { return input_stream_; }
 
 OutputStream& WebRtcSocket::GetOutputStream() { return output_stream_; }
 
@@ -94,7 +108,7 @@ void WebRtcSocket::Close() {
   NEARBY_LOGS(INFO) << "WebRtcSocket::Close(" << name_ << ") this: " << this;
   if (closed_.Set(true)) return;
 
-  ClosePipe();
+  CloseStreams();
   // NOTE: This call blocks and triggers a state change on the siginaling thread
   // to 'closing' but does not block until 'closed' is sent so the data channel
   // is not fully closed when this call is done.
@@ -127,32 +141,62 @@ void WebRtcSocket::OnStateChange() {
       // the signaling thread so it does not get blocked.
       socket_listener_.socket_closed_cb(this);
 
-      if (!closed_.Set(true)) {
-        OffloadFromSignalingThread([this] { ClosePipe(); });
-      }
+      // Closing the streams only wakes up blocked readers and writers, so it
+      // is safe to do on the signaling thread.
+      if (!closed_.Set(true)) CloseStreams();
       break;
   }
 }
-void WebRtcSocket::OnMessage(const webrtc::DataBuffer& buffer) {
-  // This is a data channel callback on the signaling thread, lets off load so
-  // we don't block signaling.
-  OffloadFromSignalingThread(
-      [this, buffer = ByteArray(buffer.data.data<char>(), buffer.size())] {
-        if (!pipe_output_->Write(buffer).Ok()) {
-          Close();
-          return;
-        }
 
-        if (!pipe_output_->Flush().Ok()) {
-          Close();
-        }
-      });
+void WebRtcSocket::OnMessage(const webrtc::DataBuffer& buffer) {
+  // This is a data channel callback on the signaling thread. The buffer is
+  // queued as is; it shares its storage with |buffer|, so nothing is copied
+  // until the reader asks for the data.
+  if (buffer.size() == 0) return;
+  MutexLock lock(&read_mutex_);
+  if (input_closed_) return;
+  read_queue_.push_back(buffer.data);
+  read_variable_.Notify();
 }
 
 void WebRtcSocket::OnBufferedAmountChange(uint64_t sent_data_size) {
-  // This is a data channel callback on the signaling thread, lets off load so
-  // we don't block signaling.
-  OffloadFromSignalingThread([this] { WakeUpWriter(); });
+  // This is a data channel callback on the signaling thread. It is called each
+  // time buffered data has been sent, so it doubles as the buffered amount low
+  // event once the amount drops to the low watermark.
+  if (!writer_waiting_.load()) return;
+  if (data_channel_->buffered_amount() > options_.low_watermark) return;
+  MutexLock lock(&backpressure_mutex_);
+  drained_ = true;
+  buffer_variable_.Notify();
+}
+
+ExceptionOr<ByteArray> WebRtcSocket::ReadMessage(std::int64_t size) {
+  MutexLock lock(&read_mutex_);
+  while (read_queue_.empty() && !input_closed_) {
+    Exception wait_exception = read_variable_.Wait();
+    if (wait_exception.Raised()) {
+      return ExceptionOr<ByteArray>{wait_exception};
+    }
+  }
+
+  // Messages received before the socket was closed can still be read. After
+  // that, an empty ByteArray serves as an EOF indication to callers.
+  if (read_queue_.empty()) {
+    return ExceptionOr<ByteArray>{ByteArray{}};
+  }
+
+  // Returns at most one message per call, so that a message bigger than
+  // |size| is returned over several calls.
+  const rtc::CopyOnWriteBuffer& message = read_queue_.front();
+  std::size_t length = std::min(message.size() - read_offset_,
+                                static_cast<std::size_t>(size));
+  ByteArray result(message.data<char>() + read_offset_, length);
+  read_offset_ += length;
+  if (read_offset_ == message.size()) {
+    read_queue_.pop_front();
+    read_offset_ = 0;
+  }
+  return ExceptionOr<ByteArray>{std::move(result)};
 }
 
 bool WebRtcSocket::SendMessage(const ByteArray& data) {
@@ -162,20 +206,19 @@ bool WebRtcSocket::SendMessage(const ByteArray& data) {
 
 bool WebRtcSocket::IsClosed() { return closed_.Get(); }
 
-void WebRtcSocket::ClosePipe() {
-  NEARBY_LOGS(INFO) << "WebRtcSocket::ClosePipe(" << name_
+void WebRtcSocket::CloseStreams() {
+  NEARBY_LOGS(INFO) << "WebRtcSocket::CloseStreams(" << name_
                     << ") this: " << this;
-  // This is thread-safe to close these sockets even if a read or write is in
-  // process on another thread, Close will wait for the exclusive mutex before
-  // setting state.
-  pipe_input_->Close();
-  pipe_output_->Close();
+  {
+    MutexLock lock(&read_mutex_);
+    input_closed_ = true;
+    read_variable_.Notify();
+  }
   WakeUpWriter();
-  NEARBY_LOGS(INFO) << "WebRtcSocket::ClosePipe(" << name_ << ") this: " << this
-                    << " done";
+  NEARBY_LOGS(INFO) << "WebRtcSocket::CloseStreams(" << name_
+                    << ") this: " << this << " done";
 }
 
-// Must not be called on signalling thread.
 void WebRtcSocket::WakeUpWriter() {
   MutexLock lock(&backpressure_mutex_);
   buffer_variable_.Notify();
@@ -185,17 +228,30 @@ void WebRtcSocket::SetSocketListener(SocketListener&& listener) {
   socket_listener_ = std::move(listener);
 }
 
-void WebRtcSocket::BlockUntilSufficientSpaceInBuffer(int length) {
-  MutexLock lock(&backpressure_mutex_);
-  while (!IsClosed() &&
-         (data_channel_->buffered_amount() + length > kMaxDataSize)) {
-    // TODO(himanshujaju): Add wait with timeout.
-    buffer_variable_.Wait();
-  }
+bool WebRtcSocket::HasSufficientSpaceInBuffer(int length) {
+  // An empty buffer always takes the write, even one above the high watermark.
+  uint64_t buffered_amount = data_channel_->buffered_amount();
+  return buffered_amount == 0 ||
+         buffered_amount + length <= options_.high_watermark;
 }
 
-void WebRtcSocket::OffloadFromSignalingThread(Runnable runnable) {
-  single_thread_executor_.Execute(std::move(runnable));
+// Must not be called on signalling thread.
+void WebRtcSocket::BlockUntilSufficientSpaceInBuffer(int length) {
+  if (HasSufficientSpaceInBuffer(length)) return;
+
+  // buffered_amount() is queried without holding |backpressure_mutex_|, since
+  // it may have to wait for the signaling thread. |writer_waiting_| is set
+  // before checking again, so a drain in between still sets |drained_|.
+  writer_waiting_ = true;
+  while (!IsClosed() && !HasSufficientSpaceInBuffer(length)) {
+    MutexLock lock(&backpressure_mutex_);
+    while (!IsClosed() && !drained_) {
+      // TODO(himanshujaju): Add wait with timeout.
+      buffer_variable_.Wait();
+    }
+    drained_ = false;
+  }
+  writer_waiting_ = false;
 }
 
 }  // namespace mediums
@@ -17,18 +17,23 @@
 
 #ifndef NO_WEBRTC
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <memory>
+#include <string>
 
+#include "absl/base/thread_annotations.h"
 #include "connections/listeners.h"
 #include "internal/platform/atomic_boolean.h"
 #include "internal/platform/condition_variable.h"
 #include "internal/platform/input_stream.h"
 #include "internal/platform/mutex.h"
 #include "internal/platform/output_stream.h"
-#include "internal/platform/pipe.h"
-#include "internal/platform/single_thread_executor.h"
 #include "internal/platform/socket.h"
 #include "webrtc/api/data_channel_interface.h"
+#include "webrtc/rtc_base/copy_on_write_buffer.h"
 
 namespace nearby {
 namespace connections {
@@ -40,12 +45,26 @@ constexpr int kMaxDataSize = 1 * 1024 * 1024;
 // Defines the Socket implementation specific to WebRTC, which uses the WebRTC
 // data channel to send and receive messages.
 //
-// Messages are buffered here to prevent the data channel from overflowing,
+// Incoming data channel buffers are queued as they are for the reader, without
+// copying them until they are read. Writes block while the data channel holds
+// more than the high watermark, and resume once the channel reports that it has
+// drained to the low watermark, to prevent the data channel from overflowing,
 // which could lead to data loss.
 class WebRtcSocket : public Socket, public webrtc::DataChannelObserver {
  public:
+  struct Options {
+    // Writes block while buffered_amount() plus the write would exceed this.
+    std::uint64_t high_watermark = kMaxDataSize;
+    // Blocked writes resume once buffered_amount() drops to this.
+    std::uint64_t low_watermark = kMaxDataSize / 4;
+  };
+
   WebRtcSocket(const std::string& name,
-               rtc::scoped_refptr<webrtc::DataChannelInterface> data_channel);
+               rtc::scoped_refptr<webrtc::DataChannelInterface> data_channel)
+      : WebRtcSocket(name, std::move(data_channel), Options()) {}
+  WebRtcSocket(const std::string& name,
+               rtc::scoped_refptr<webrtc::DataChannelInterface> data_channel,
+               const Options& options);
   ~WebRtcSocket() override;
 
   WebRtcSocket(const WebRtcSocket& other) = delete;
@@ -72,6 +91,23 @@ class WebRtcSocket : public Socket, public webrtc::DataChannelObserver {
   void SetSocketListener(SocketListener&& listener);
 
  private:
+  class InputStreamImpl : public InputStream {
+   public:
+    explicit InputStreamImpl(WebRtcSocket* const socket) : socket_(socket) {}
+    ~InputStreamImpl() override = default;
+
+    InputStreamImpl(const InputStreamImpl& other) = delete;
+    InputStreamImpl& operator=(const InputStreamImpl& other) = delete;
+
+    // InputStream:
+    ExceptionOr<ByteArray> Read(std::int64_t size) override;
+    Exception Close() override;
+
+   private:
+    // |this| InputStreamImpl is owned by |socket_|.
+    WebRtcSocket* const socket_;
+  };
+
   class OutputStreamImpl : public OutputStream {
    public:
     explicit OutputStreamImpl(WebRtcSocket* const socket) : socket_(socket) {}
@@ -92,28 +128,37 @@ class WebRtcSocket : public Socket, public webrtc::DataChannelObserver {
 
   void WakeUpWriter();
   bool IsClosed();
-  void ClosePipe();
+  void CloseStreams();
+  ExceptionOr<ByteArray> ReadMessage(std::int64_t size);
   bool SendMessage(const ByteArray& data);
   void BlockUntilSufficientSpaceInBuffer(int length);
-  void OffloadFromSignalingThread(Runnable runnable);
+  bool HasSufficientSpaceInBuffer(int length);
 
   std::string name_;
   rtc::scoped_refptr<webrtc::DataChannelInterface> data_channel_;
+  const Options options_;
 
-  std::unique_ptr<InputStream> pipe_input_;
-  std::unique_ptr<OutputStream> pipe_output_;
+  InputStreamImpl input_stream_{this};
   OutputStreamImpl output_stream_{this};
 
   AtomicBoolean closed_{false};
 
   SocketListener socket_listener_;
 
+  // Received buffers not yet read. The first |read_offset_| bytes of the front
+  // buffer have already been returned by Read().
+  Mutex read_mutex_;
+  ConditionVariable read_variable_{&read_mutex_};
+  std::deque<rtc::CopyOnWriteBuffer> read_queue_ ABSL_GUARDED_BY(read_mutex_);
+  std::size_t read_offset_ ABSL_GUARDED_BY(read_mutex_) = 0;
+  bool input_closed_ ABSL_GUARDED_BY(read_mutex_) = false;
+
+  // Set while a writer waits for the data channel to drain, so that
+  // OnBufferedAmountChange() only takes |backpressure_mutex_| when needed.
+  std::atomic<bool> writer_waiting_{false};
   mutable Mutex backpressure_mutex_;
   ConditionVariable buffer_variable_{&backpressure_mutex_};
-
-  // This should be destroyed first to ensure any remaining tasks flushed on
-  // shutdown get run while the other members are still alive.
-  SingleThreadExecutor single_thread_executor_;
+  bool drained_ ABSL_GUARDED_BY(backpressure_mutex_) = false;
 };
 
 }  // namespace mediums
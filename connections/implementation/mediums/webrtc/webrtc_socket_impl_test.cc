@@ -14,12 +14,19 @@
 
 #include "connections/implementation/mediums/webrtc/webrtc_socket_impl.h"
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
+#include <string>
+#include <thread>  // NOLINT
 
 #include "gmock/gmock.h"
 #include "protobuf-matchers/protocol-buffer-matchers.h"
 #include "gtest/gtest.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/time.h"
 #include "internal/platform/byte_array.h"
+#include "internal/test/fake_webrtc.h"
 #include "webrtc/api/data_channel_interface.h"
 
 namespace nearby {
@@ -228,6 +235,127 @@ TEST(WebRtcSocketTest, CloseStateTriggersCallback) {
   EXPECT_EQ(socket_closed_cb_called, 1);
 }
 
+TEST(WebRtcSocketTest, ReadMessageLargerThanRequestedSize) {
+  rtc::scoped_refptr<MockDataChannel> mock_data_channel(new MockDataChannel());
+  WebRtcSocket webrtc_socket(kSocketName, mock_data_channel);
+
+  webrtc_socket.OnMessage(webrtc::DataBuffer{"Message"});
+  webrtc_socket.OnMessage(webrtc::DataBuffer{"!"});
+
+  ExceptionOr<ByteArray> result = webrtc_socket.GetInputStream().Read(3);
+  EXPECT_TRUE(result.ok());
+  EXPECT_EQ(result.result(), ByteArray{"Mes"});
+
+  result = webrtc_socket.GetInputStream().Read(7);
+  EXPECT_TRUE(result.ok());
+  EXPECT_EQ(result.result(), ByteArray{"sage"});
+
+  result = webrtc_socket.GetInputStream().Read(7);
+  EXPECT_TRUE(result.ok());
+  EXPECT_EQ(result.result(), ByteArray{"!"});
+}
+
+TEST(WebRtcSocketTest, ReadMessagesReceivedBeforeDataChannelClosed) {
+  rtc::scoped_refptr<MockDataChannel> mock_data_channel(new MockDataChannel());
+  WebRtcSocket webrtc_socket(kSocketName, mock_data_channel);
+  ON_CALL(*mock_data_channel, state())
+      .WillByDefault(
+          testing::Return(webrtc::DataChannelInterface::DataState::kClosed));
+
+  webrtc_socket.OnMessage(webrtc::DataBuffer{"Message"});
+  webrtc_socket.OnStateChange();
+
+  ExceptionOr<ByteArray> result = webrtc_socket.GetInputStream().Read(7);
+  EXPECT_TRUE(result.ok());
+  EXPECT_EQ(result.result(), ByteArray{"Message"});
+  EXPECT_TRUE(webrtc_socket.GetInputStream().Read(7).GetResult().Empty());
+}
+
+TEST(WebRtcSocketTest, WriteWaitsForBufferToDrainToLowWatermark) {
+  std::atomic<std::uint64_t> buffered_amount = 8;
+  rtc::scoped_refptr<MockDataChannel> mock_data_channel(new MockDataChannel());
+  ON_CALL(*mock_data_channel, buffered_amount())
+      .WillByDefault([&buffered_amount]() { return buffered_amount.load(); });
+  ON_CALL(*mock_data_channel, Send(testing::_))
+      .WillByDefault(testing::Return(true));
+  WebRtcSocket webrtc_socket(kSocketName, mock_data_channel,
+                             {.high_watermark = 10, .low_watermark = 4});
+
+  absl::Notification written;
+  std::thread writer([&]() {
+    EXPECT_TRUE(webrtc_socket.GetOutputStream().Write(ByteArray{"Hello"}).Ok());
+    written.Notify();
+  });
+
+  EXPECT_FALSE(written.WaitForNotificationWithTimeout(absl::Milliseconds(50)));
+
+  // Above the low watermark: the writer keeps waiting.
+  buffered_amount = 6;
+  webrtc_socket.OnBufferedAmountChange(2);
+  EXPECT_FALSE(written.WaitForNotificationWithTimeout(absl::Milliseconds(50)));
+
+  buffered_amount = 4;
+  webrtc_socket.OnBufferedAmountChange(2);
+  EXPECT_TRUE(written.WaitForNotificationWithTimeout(absl::Seconds(5)));
+
+  webrtc_socket.Close();
+  writer.join();
+}
+
+TEST(WebRtcSocketTest, CloseUnblocksWriter) {
+  rtc::scoped_refptr<MockDataChannel> mock_data_channel(new MockDataChannel());
+  ON_CALL(*mock_data_channel, buffered_amount())
+      .WillByDefault(testing::Return(kMaxDataSize));
+  WebRtcSocket webrtc_socket(kSocketName, mock_data_channel);
+
+  EXPECT_CALL(*mock_data_channel, Send(testing::_)).Times(0);
+  std::thread writer([&]() {
+    EXPECT_EQ(webrtc_socket.GetOutputStream().Write(ByteArray{"Message"}),
+              Exception{Exception::kIo});
+  });
+  webrtc_socket.Close();
+  writer.join();
+}
+
+TEST(WebRtcSocketTest, TransferOverFakeDataChannel) {
+  constexpr int kMessageCount = 64;
+  constexpr int kMessageSize = 16 * 1024;
+  auto channels = FakeDataChannel::CreatePair(kSocketName);
+  rtc::scoped_refptr<FakeDataChannel> local_channel = channels.first;
+  rtc::scoped_refptr<FakeDataChannel> remote_channel = channels.second;
+  WebRtcSocket sender(kSocketName, local_channel,
+                      {.high_watermark = 4 * kMessageSize,
+                       .low_watermark = kMessageSize});
+  WebRtcSocket receiver(kSocketName, remote_channel);
+
+  std::string expected;
+  for (int i = 0; i < kMessageCount; ++i) {
+    expected.append(kMessageSize, 'a' + i % 26);
+  }
+  std::thread writer([&]() {
+    for (int i = 0; i < kMessageCount; ++i) {
+      ByteArray message(expected.data() + i * kMessageSize, kMessageSize);
+      EXPECT_TRUE(sender.GetOutputStream().Write(message).Ok());
+      EXPECT_LE(local_channel->buffered_amount(), 4 * kMessageSize);
+    }
+  });
+
+  std::string received;
+  while (received.size() < expected.size()) {
+    ExceptionOr<ByteArray> result =
+        receiver.GetInputStream().Read(kMessageSize / 3);
+    ASSERT_TRUE(result.ok());
+    ASSERT_FALSE(result.result().Empty());
+    received += std::string(result.result());
+  }
+  writer.join();
+  EXPECT_EQ(received, expected);
+
+  // Closing one end closes the other, which then reads EOF.
+  sender.Close();
+  EXPECT_TRUE(receiver.GetInputStream().Read(1).GetResult().Empty());
+}
+
 }  // namespace mediums
 }  // namespace connections
 }  // namespace nearby
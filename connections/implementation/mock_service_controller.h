@@ -116,6 +116,8 @@ class MockServiceController : public ServiceController {
 
   MOCK_METHOD(void, ShutdownBwuManagerExecutors, (), (override));
 
+  MOCK_METHOD(void, ForgetSessions, (ClientProxy * client), (override));
+
   MOCK_METHOD(void, SetCustomSavePath,
               (ClientProxy * client, const std::string& path), (override));
 };
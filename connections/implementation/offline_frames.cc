@@ -189,6 +189,10 @@ ByteArray ForConnectionResponse(
       NearbyFlags::GetInstance().GetInt64Flag(
           config_package_nearby::nearby_connections_feature::
               kSafeToDisconnectVersion));
+  sub_frame->set_supports_session_resumption(
+      NearbyFlags::GetInstance().GetBoolFlag(
+          config_package_nearby::nearby_connections_feature::
+              kEnableSessionResumption));
 
   return ToBytes(std::move(frame));
 }
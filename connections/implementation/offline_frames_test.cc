@@ -270,6 +270,7 @@ TEST(OfflineFramesTest, CanGenerateConnectionResponse) {
         response: REJECT
         os_info { type: LINUX }
         safe_to_disconnect_version: 0
+        supports_session_resumption: false
       >
     >)pb";
 
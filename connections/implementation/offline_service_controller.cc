@@ -199,5 +199,9 @@ void OfflineServiceController::ShutdownBwuManagerExecutors() {
   bwu_manager_.ShutdownExecutors();
 }
 
+void OfflineServiceController::ForgetSessions(ClientProxy* client) {
+  pcp_manager_.ForgetSessions(client);
+}
+
 }  // namespace connections
 }  // namespace nearby
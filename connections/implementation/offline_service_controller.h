@@ -102,6 +102,8 @@ class OfflineServiceController : public ServiceController {
 
   void ShutdownBwuManagerExecutors() override;
 
+  void ForgetSessions(ClientProxy* client) override;
+
  private:
   // Note that the order of declaration of these is crucial, because we depend
   // on the destructors running (strictly) in the reverse order; a deviation
@@ -0,0 +1,467 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Throughput and latency benchmarks for the offline service controller stack,
+// run end-to-end between OfflineSimulationUsers over the simulated mediums of
+// MediumEnvironment.
+//
+// Every benchmark takes a link profile argument, which shapes the simulated
+// sockets (see EnvironmentConfig), so results can be compared against a
+// known-bandwidth, known-latency link rather than an in-memory pipe.
+//
+// Run with:
+//   bazel run -c opt //connections/implementation:offline_simulation_benchmark
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "securegcm/d2d_connection_context_v1.h"
+#include "securegcm/ukey2_handshake.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "connections/implementation/flags/nearby_connections_feature_flags.h"
+#include "connections/implementation/offline_simulation_user.h"
+#include "connections/listeners.h"
+#include "connections/medium_selector.h"
+#include "connections/payload.h"
+#include "internal/flags/nearby_flags.h"
+#include "internal/platform/byte_array.h"
+#include "internal/platform/count_down_latch.h"
+#include "internal/platform/file.h"
+#include "internal/platform/input_stream.h"
+#include "internal/platform/medium_environment.h"
+#include "internal/platform/output_stream.h"
+#include "internal/platform/pipe.h"
+#include "internal/platform/single_thread_executor.h"
+
+namespace nearby {
+namespace connections {
+namespace {
+
+constexpr absl::string_view kServiceId = "benchmark-service-id";
+constexpr absl::Duration kTimeout = absl::Seconds(30);
+constexpr std::int64_t kChunkSize = 64 * 1024;
+
+struct LinkProfile {
+  const char* name;
+  std::int64_t bandwidth_bytes_per_second;
+  absl::Duration latency;
+};
+
+// Indexed by the benchmarks' link profile argument.
+constexpr LinkProfile kLinkProfiles[] = {
+    {"unshaped", 0, absl::ZeroDuration()},
+    {"wifi", 12'500'000, absl::Milliseconds(2)},
+    {"bluetooth", 250'000, absl::Milliseconds(20)},
+};
+constexpr int kUnshaped = 0;
+constexpr int kWifi = 1;
+constexpr int kBluetooth = 2;
+
+// Indexed by the benchmarks' medium argument.
+constexpr BooleanMediumSelector kMediums[] = {
+    BooleanMediumSelector{
+        .bluetooth = true,
+    },
+    BooleanMediumSelector{
+        .wifi_lan = true,
+    },
+};
+constexpr const char* kMediumNames[] = {"bluetooth", "wifi_lan"};
+constexpr int kBluetoothMedium = 0;
+constexpr int kWifiLanMedium = 1;
+
+// Exposes the parts of OfflineSimulationUser needed to connect one user to
+// many others.
+class BenchmarkUser : public OfflineSimulationUser {
+ public:
+  using OfflineSimulationUser::OfflineSimulationUser;
+
+  std::string GetLocalEndpointId() { return client_.GetLocalEndpointId(); }
+
+  void SetDiscoveryMediums(BooleanMediumSelector mediums) {
+    discovery_options_.allowed = mediums;
+  }
+
+  void ExpectInitiated(CountDownLatch* latch) { initiated_latch_ = latch; }
+
+  Status AcceptConnectionFrom(const std::string& endpoint_id,
+                              CountDownLatch* latch) {
+    accept_latch_ = latch;
+    PayloadListener listener = {
+        .payload_cb =
+            [this](absl::string_view endpoint_id, Payload payload) {
+              OnPayload(endpoint_id, std::move(payload));
+            },
+        .payload_progress_cb =
+            [this](absl::string_view endpoint_id,
+                   const PayloadProgressInfo& info) {
+              OnPayloadProgress(endpoint_id, info);
+            },
+    };
+    return ctrl_.AcceptConnection(&client_, endpoint_id, std::move(listener));
+  }
+
+  void SendPayloadTo(const std::vector<std::string>& endpoint_ids,
+                     Payload payload) {
+    ctrl_.SendPayload(&client_, endpoint_ids, std::move(payload));
+  }
+
+  bool WaitForPayloadDone(Payload::Id payload_id) {
+    return WaitForProgress(
+        [payload_id](const PayloadProgressInfo& info) {
+          return info.payload_id == payload_id &&
+                 info.status != PayloadProgressInfo::Status::kInProgress;
+        },
+        kTimeout);
+  }
+};
+
+// Starts MediumEnvironment with the link profile selected by |profile| for the
+// lifetime of the object.
+class ScopedEnvironment {
+ public:
+  ScopedEnvironment(benchmark::State& state, int profile) {
+    const LinkProfile& link = kLinkProfiles[profile];
+    NearbyFlags::GetInstance().OverrideBoolFlagValue(
+        config_package_nearby::nearby_connections_feature::kEnableBleV2, true);
+    MediumEnvironment::Instance().Start({
+        .link_bandwidth_bytes_per_second = link.bandwidth_bytes_per_second,
+        .link_latency = link.latency,
+    });
+    state.SetLabel(link.name);
+  }
+  ~ScopedEnvironment() { MediumEnvironment::Instance().Stop(); }
+};
+
+// Connects |discoverer| to |advertiser|, which must already be advertising.
+bool Connect(BenchmarkUser& advertiser, BenchmarkUser& discoverer) {
+  CountDownLatch found_latch(1);
+  CountDownLatch initiated_latch(2);
+  CountDownLatch accepted_latch(2);
+  advertiser.ExpectInitiated(&initiated_latch);
+  discoverer.StartDiscovery(std::string(kServiceId), &found_latch);
+  if (!found_latch.Await(kTimeout).result()) return false;
+  discoverer.RequestConnection(&initiated_latch);
+  if (!initiated_latch.Await(kTimeout).result()) return false;
+  advertiser.AcceptConnectionFrom(discoverer.GetLocalEndpointId(),
+                                  &accepted_latch);
+  discoverer.AcceptConnection(&accepted_latch);
+  bool accepted = accepted_latch.Await(kTimeout).result();
+  discoverer.StopDiscovery();
+  return accepted && discoverer.IsConnected();
+}
+
+bool Connect(BenchmarkUser& advertiser, BenchmarkUser& discoverer,
+             benchmark::State& state) {
+  advertiser.StartAdvertising(std::string(kServiceId), nullptr);
+  if (!Connect(advertiser, discoverer)) {
+    state.SkipWithError("Failed to connect.");
+    return false;
+  }
+  return true;
+}
+
+void SetThroughputCounters(benchmark::State& state, std::int64_t bytes) {
+  state.SetBytesProcessed(state.iterations() * bytes);
+  state.counters["payload_bytes"] = bytes;
+}
+
+// Time from starting discovery until both sides have accepted the connection.
+// Args: medium, link profile.
+void BM_ConnectionSetup(benchmark::State& state) {
+  ScopedEnvironment env(state, state.range(1));
+  BooleanMediumSelector medium = kMediums[state.range(0)];
+  int connection = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto advertiser = std::make_unique<BenchmarkUser>(
+        absl::StrCat("advertiser-", connection), medium);
+    auto discoverer = std::make_unique<BenchmarkUser>(
+        absl::StrCat("discoverer-", connection), medium);
+    ++connection;
+    advertiser->StartAdvertising(std::string(kServiceId), nullptr);
+    state.ResumeTiming();
+
+    if (!Connect(*advertiser, *discoverer)) {
+      state.SkipWithError("Failed to connect.");
+      break;
+    }
+
+    state.PauseTiming();
+    advertiser->Stop();
+    discoverer->Stop();
+    state.ResumeTiming();
+  }
+  state.SetLabel(absl::StrCat(kMediumNames[state.range(0)], "/",
+                              kLinkProfiles[state.range(1)].name));
+}
+BENCHMARK(BM_ConnectionSetup)
+    ->ArgsProduct({{kBluetoothMedium, kWifiLanMedium}, {kUnshaped, kWifi}})
+    ->Iterations(5)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// Sends a bytes payload and waits until the receiver has all of it.
+// Args: medium, link profile, payload size.
+void BM_BytesPayload(benchmark::State& state) {
+  ScopedEnvironment env(state, state.range(1));
+  BenchmarkUser sender("sender", kMediums[state.range(0)]);
+  BenchmarkUser receiver("receiver", kMediums[state.range(0)]);
+  if (!Connect(sender, receiver, state)) return;
+
+  ByteArray data(std::string(state.range(2), 'x'));
+  for (auto _ : state) {
+    CountDownLatch payload_latch(1);
+    receiver.ExpectPayload(payload_latch);
+    sender.SendPayload(Payload(data));
+    if (!payload_latch.Await(kTimeout).result()) {
+      state.SkipWithError("Payload was not received.");
+      break;
+    }
+  }
+  SetThroughputCounters(state, state.range(2));
+  sender.Stop();
+  receiver.Stop();
+}
+BENCHMARK(BM_BytesPayload)
+    ->ArgsProduct({{kWifiLanMedium}, {kUnshaped, kWifi}, {1024, 64 * 1024}})
+    ->Args({kBluetoothMedium, kBluetooth, 1024})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// Streams a payload through a pipe and drains it on the receiving side.
+// Args: medium, link profile, payload size.
+void BM_StreamPayload(benchmark::State& state) {
+  ScopedEnvironment env(state, state.range(1));
+  BenchmarkUser sender("sender", kMediums[state.range(0)]);
+  BenchmarkUser receiver("receiver", kMediums[state.range(0)]);
+  if (!Connect(sender, receiver, state)) return;
+
+  const std::int64_t size = state.range(2);
+  ByteArray chunk(std::string(kChunkSize, 'x'));
+  SingleThreadExecutor writer;
+  for (auto _ : state) {
+    CountDownLatch payload_latch(1);
+    receiver.ExpectPayload(payload_latch);
+    auto [input, output] = CreatePipe();
+    sender.SendPayload(Payload(std::move(input)));
+    writer.Execute([output = std::move(output), &chunk, size]() mutable {
+      for (std::int64_t written = 0; written < size; written += kChunkSize) {
+        if (output->Write(chunk).Raised()) break;
+      }
+      output->Close();
+    });
+    if (!payload_latch.Await(kTimeout).result()) {
+      state.SkipWithError("Payload was not received.");
+      break;
+    }
+    InputStream* stream = receiver.GetPayload().AsStream();
+    std::int64_t received = 0;
+    while (stream != nullptr && received < size) {
+      ExceptionOr<ByteArray> read = stream->Read(kChunkSize);
+      if (!read.ok() || read.result().Empty()) break;
+      received += read.result().size();
+    }
+    if (received < size) {
+      state.SkipWithError("Stream was truncated.");
+      break;
+    }
+  }
+  SetThroughputCounters(state, size);
+  sender.Stop();
+  receiver.Stop();
+}
+BENCHMARK(BM_StreamPayload)
+    ->ArgsProduct({{kWifiLanMedium}, {kUnshaped, kWifi}, {4 * 1024 * 1024}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// Sends a file payload and waits for the receiver to finish writing it.
+// Args: medium, link profile, file size.
+void BM_FilePayload(benchmark::State& state) {
+  ScopedEnvironment env(state, state.range(1));
+  BenchmarkUser sender("sender", kMediums[state.range(0)]);
+  BenchmarkUser receiver("receiver", kMediums[state.range(0)]);
+  if (!Connect(sender, receiver, state)) return;
+
+  const std::int64_t size = state.range(2);
+  std::string path = absl::StrCat(
+      "/tmp/offline_simulation_benchmark_", absl::ToUnixNanos(absl::Now()));
+  {
+    std::ofstream file(path, std::ios::binary);
+    file << std::string(size, 'x');
+  }
+  for (auto _ : state) {
+    CountDownLatch payload_latch(1);
+    receiver.ExpectPayload(payload_latch);
+    Payload payload(InputFile(path, size));
+    Payload::Id payload_id = payload.GetId();
+    sender.SendPayload(std::move(payload));
+    if (!payload_latch.Await(kTimeout).result() ||
+        !receiver.WaitForPayloadDone(payload_id)) {
+      state.SkipWithError("File was not received.");
+      break;
+    }
+    state.PauseTiming();
+    if (InputFile* received = receiver.GetPayload().AsFile()) {
+      std::remove(received->GetFilePath().c_str());
+    }
+    state.ResumeTiming();
+  }
+  std::remove(path.c_str());
+  SetThroughputCounters(state, size);
+  sender.Stop();
+  receiver.Stop();
+}
+BENCHMARK(BM_FilePayload)
+    ->ArgsProduct({{kWifiLanMedium}, {kUnshaped, kWifi}, {4 * 1024 * 1024}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// Cost of encrypting and decrypting one payload chunk with the UKEY2-derived
+// connection context that EndpointChannels use. Compare against the
+// unshaped payload benchmarks to see the share of time spent in crypto.
+// Args: chunk size.
+void BM_EncryptDecryptChunk(benchmark::State& state) {
+  using securegcm::UKey2Handshake;
+  constexpr UKey2Handshake::HandshakeCipher kCipher =
+      UKey2Handshake::HandshakeCipher::P256_SHA512;
+  std::unique_ptr<UKey2Handshake> client =
+      UKey2Handshake::ForInitiator(kCipher);
+  std::unique_ptr<UKey2Handshake> server =
+      UKey2Handshake::ForResponder(kCipher);
+  server->ParseHandshakeMessage(*client->GetNextHandshakeMessage());
+  client->ParseHandshakeMessage(*server->GetNextHandshakeMessage());
+  server->ParseHandshakeMessage(*client->GetNextHandshakeMessage());
+  client->GetVerificationString(32);
+  server->GetVerificationString(32);
+  if (!client->VerifyHandshake() || !server->VerifyHandshake()) {
+    state.SkipWithError("UKEY2 handshake failed.");
+    return;
+  }
+  std::unique_ptr<securegcm::D2DConnectionContextV1> client_context =
+      client->ToConnectionContext();
+  std::unique_ptr<securegcm::D2DConnectionContextV1> server_context =
+      server->ToConnectionContext();
+
+  std::string chunk(state.range(0), 'x');
+  for (auto _ : state) {
+    std::unique_ptr<std::string> encrypted =
+        client_context->EncodeMessageToPeer(chunk);
+    std::unique_ptr<std::string> decrypted =
+        server_context->DecodeMessageFromPeer(*encrypted);
+    benchmark::DoNotOptimize(decrypted);
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_EncryptDecryptChunk)->Arg(1024)->Arg(kChunkSize);
+
+// Time from accepting a connection over Bluetooth until it has been upgraded
+// to WiFi LAN.
+// Args: link profile.
+void BM_BandwidthUpgrade(benchmark::State& state) {
+  ScopedEnvironment env(state, state.range(0));
+  BooleanMediumSelector mediums{
+      .bluetooth = true,
+      .wifi_lan = true,
+  };
+  int connection = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto advertiser = std::make_unique<BenchmarkUser>(
+        absl::StrCat("advertiser-", connection), mediums);
+    auto discoverer = std::make_unique<BenchmarkUser>(
+        absl::StrCat("discoverer-", connection), mediums);
+    ++connection;
+    // Only discovering over Bluetooth forces the initial connection onto it.
+    discoverer->SetDiscoveryMediums(kMediums[kBluetoothMedium]);
+    CountDownLatch upgraded_latch(2);
+    advertiser->ExpectBandwidthChanged(upgraded_latch);
+    discoverer->ExpectBandwidthChanged(upgraded_latch);
+    advertiser->StartAdvertising(std::string(kServiceId), nullptr);
+    if (!Connect(*advertiser, *discoverer)) {
+      state.SkipWithError("Failed to connect.");
+      break;
+    }
+    state.ResumeTiming();
+
+    if (!upgraded_latch.Await(kTimeout).result()) {
+      state.SkipWithError("Bandwidth upgrade did not complete.");
+      break;
+    }
+
+    state.PauseTiming();
+    advertiser->Stop();
+    discoverer->Stop();
+    state.ResumeTiming();
+  }
+}
+BENCHMARK(BM_BandwidthUpgrade)
+    ->Arg(kUnshaped)
+    ->Arg(kWifi)
+    ->Iterations(3)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// One sender delivering the same bytes payload to N connected receivers.
+// Args: link profile, number of receivers.
+void BM_FanOut(benchmark::State& state) {
+  ScopedEnvironment env(state, state.range(0));
+  const int receiver_count = state.range(1);
+  BooleanMediumSelector medium = kMediums[kWifiLanMedium];
+  BenchmarkUser sender("sender", medium);
+  sender.StartAdvertising(std::string(kServiceId), nullptr);
+  std::vector<std::unique_ptr<BenchmarkUser>> receivers;
+  std::vector<std::string> receiver_ids;
+  for (int i = 0; i < receiver_count; ++i) {
+    receivers.push_back(
+        std::make_unique<BenchmarkUser>(absl::StrCat("receiver-", i), medium));
+    if (!Connect(sender, *receivers.back())) {
+      state.SkipWithError("Failed to connect.");
+      return;
+    }
+    receiver_ids.push_back(receivers.back()->GetLocalEndpointId());
+  }
+
+  ByteArray data(std::string(kChunkSize, 'x'));
+  for (auto _ : state) {
+    CountDownLatch payload_latch(receiver_count);
+    for (auto& receiver : receivers) receiver->ExpectPayload(payload_latch);
+    sender.SendPayloadTo(receiver_ids, Payload(data));
+    if (!payload_latch.Await(kTimeout).result()) {
+      state.SkipWithError("Payload was not received by every receiver.");
+      break;
+    }
+  }
+  SetThroughputCounters(state, kChunkSize * receiver_count);
+  sender.Stop();
+  for (auto& receiver : receivers) receiver->Stop();
+}
+BENCHMARK(BM_FanOut)
+    ->ArgsProduct({{kUnshaped, kWifi}, {1, 4, 8}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace connections
+}  // namespace nearby
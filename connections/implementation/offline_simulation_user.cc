@@ -58,6 +58,13 @@ void OfflineSimulationUser::OnEndpointDisconnect(
   if (disconnect_latch_) disconnect_latch_->CountDown();
 }
 
+void OfflineSimulationUser::OnBandwidthChanged(const std::string& endpoint_id,
+                                               Medium medium) {
+  NEARBY_LOGS(INFO) << "OnBandwidthChanged: self=" << this
+                    << "; id=" << endpoint_id << "; medium=" << medium;
+  if (bandwidth_changed_latch_) bandwidth_changed_latch_->CountDown();
+}
+
 void OfflineSimulationUser::OnEndpointFound(const std::string& endpoint_id,
                                             const ByteArray& endpoint_info,
                                             const std::string& service_id) {
@@ -120,6 +127,8 @@ Status OfflineSimulationUser::StartAdvertising(const std::string& service_id,
           absl::bind_front(&OfflineSimulationUser::OnConnectionRejected, this),
       .disconnected_cb =
           absl::bind_front(&OfflineSimulationUser::OnEndpointDisconnect, this),
+      .bandwidth_changed_cb =
+          absl::bind_front(&OfflineSimulationUser::OnBandwidthChanged, this),
   };
   return ctrl_.StartAdvertising(&client_, service_id_, advertising_options_,
                                 {
@@ -177,6 +186,8 @@ Status OfflineSimulationUser::RequestConnection(CountDownLatch* latch) {
           absl::bind_front(&OfflineSimulationUser::OnConnectionRejected, this),
       .disconnected_cb =
           absl::bind_front(&OfflineSimulationUser::OnEndpointDisconnect, this),
+      .bandwidth_changed_cb =
+          absl::bind_front(&OfflineSimulationUser::OnBandwidthChanged, this),
   };
   client_.AddCancellationFlag(discovered_.endpoint_id);
   return ctrl_.RequestConnection(&client_, discovered_.endpoint_id,
@@ -200,6 +211,8 @@ Status OfflineSimulationUser::RequestConnectionV3(
           absl::bind_front(&OfflineSimulationUser::OnConnectionRejected, this),
       .disconnected_cb =
           absl::bind_front(&OfflineSimulationUser::OnEndpointDisconnect, this),
+      .bandwidth_changed_cb =
+          absl::bind_front(&OfflineSimulationUser::OnBandwidthChanged, this),
   };
   client_.AddCancellationFlag(remote_device.GetEndpointId());
   return ctrl_.RequestConnectionV3(
@@ -135,6 +135,9 @@ class OfflineSimulationUser {
 
   void ExpectPayload(CountDownLatch& latch) { payload_latch_ = &latch; }
   void ExpectDisconnect(CountDownLatch& latch) { disconnect_latch_ = &latch; }
+  void ExpectBandwidthChanged(CountDownLatch& latch) {
+    bandwidth_changed_latch_ = &latch;
+  }
 
   const DiscoveredInfo& GetDiscovered() const { return discovered_; }
   ByteArray GetInfo() const { return info_; }
@@ -181,6 +184,7 @@ class OfflineSimulationUser {
   void OnConnectionAccepted(const std::string& endpoint_id);
   void OnConnectionRejected(const std::string& endpoint_id, Status status);
   void OnEndpointDisconnect(const std::string& endpoint_id);
+  void OnBandwidthChanged(const std::string& endpoint_id, Medium medium);
 
   // DiscoveryListener callbacks
   void OnEndpointFound(const std::string& endpoint_id,
@@ -211,6 +215,7 @@ class OfflineSimulationUser {
   CountDownLatch* lost_latch_ = nullptr;
   CountDownLatch* payload_latch_ = nullptr;
   CountDownLatch* disconnect_latch_ = nullptr;
+  CountDownLatch* bandwidth_changed_latch_ = nullptr;
   Future<bool>* future_ = nullptr;
   absl::AnyInvocable<bool(const PayloadProgressInfo&)> predicate_;
   ClientProxy client_;
@@ -22,6 +22,8 @@
 
 #include "absl/functional/bind_front.h"
 #include "absl/strings/escaping.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
 #include "connections/implementation/base_pcp_handler.h"
 #include "connections/implementation/ble_advertisement.h"
 #include "connections/implementation/ble_endpoint_channel.h"
@@ -43,6 +45,19 @@
 
 namespace nearby {
 namespace connections {
+namespace {
+
+// The key under which the found and lost reports about one device are
+// coalesced; see BasePcpHandler::RunOnPcpHandlerThreadCoalesced().
+std::string GetDiscoveryReportKey(ClientProxy* client,
+                                  const std::string& service_id,
+                                  absl::string_view medium,
+                                  absl::string_view device_id) {
+  return absl::StrCat(client->GetClientId(), "/", service_id, "/", medium, "/",
+                      device_id);
+}
+
+}  // namespace
 
 ByteArray P2pClusterPcpHandler::GenerateHash(const std::string& source,
                                              size_t size) {
@@ -251,8 +266,9 @@ bool P2pClusterPcpHandler::IsRecognizedBluetoothEndpoint(
 void P2pClusterPcpHandler::BluetoothDeviceDiscoveredHandler(
     ClientProxy* client, const std::string& service_id,
     BluetoothDevice device) {
-  RunOnPcpHandlerThread(
+  RunOnPcpHandlerThreadCoalesced(
       "p2p-bt-device-discovered",
+      GetDiscoveryReportKey(client, service_id, "bt", device.GetMacAddress()),
       [this, client, service_id, device]()
           RUN_ON_PCP_HANDLER_THREAD() {
             // Make sure we are still discovering before proceeding.
@@ -375,9 +391,11 @@ void P2pClusterPcpHandler::BluetoothDeviceLostHandler(
     ClientProxy* client, const std::string& service_id,
     BluetoothDevice& device) {
   const std::string& device_name_string = device.GetName();
-  RunOnPcpHandlerThread(
-      "p2p-bt-device-lost", [this, client, service_id,
-                             device_name_string]() RUN_ON_PCP_HANDLER_THREAD() {
+  RunOnPcpHandlerThreadCoalesced(
+      "p2p-bt-device-lost",
+      GetDiscoveryReportKey(client, service_id, "bt", device.GetMacAddress()),
+      [this, client, service_id,
+       device_name_string]() RUN_ON_PCP_HANDLER_THREAD() {
         // Make sure we are still discovering before proceeding.
         if (!client->IsDiscovering()) {
           NEARBY_LOGS(WARNING)
@@ -454,8 +472,9 @@ void P2pClusterPcpHandler::BlePeripheralDiscoveredHandler(
     ClientProxy* client, BlePeripheral& peripheral,
     const std::string& service_id, const ByteArray& advertisement_bytes,
     bool fast_advertisement) {
-  RunOnPcpHandlerThread(
+  RunOnPcpHandlerThreadCoalesced(
       "p2p-ble-device-discovered",
+      GetDiscoveryReportKey(client, service_id, "ble", peripheral.GetName()),
       [this, client, &peripheral, service_id, advertisement_bytes,
        fast_advertisement]() RUN_ON_PCP_HANDLER_THREAD() {
         // Make sure we are still discovering before proceeding.
@@ -543,8 +562,9 @@ void P2pClusterPcpHandler::BlePeripheralLostHandler(
   std::string peripheral_name = peripheral.GetName();
   NEARBY_LOG(INFO, "Ble: [LOST, SCHED] peripheral_name=%s",
              peripheral_name.c_str());
-  RunOnPcpHandlerThread(
+  RunOnPcpHandlerThreadCoalesced(
       "p2p-ble-device-lost",
+      GetDiscoveryReportKey(client, service_id, "ble", peripheral_name),
       [this, client, service_id, &peripheral]() RUN_ON_PCP_HANDLER_THREAD() {
         // Make sure we are still discovering before proceeding.
         if (!client->IsDiscovering() || stop_.Get()) {
@@ -626,8 +646,12 @@ void P2pClusterPcpHandler::BleV2PeripheralDiscoveredHandler(
     const std::string& service_id, const ByteArray& advertisement_bytes,
     bool fast_advertisement) {
   // TODO(edwinwu): Move the lambda to a named function.
-  RunOnPcpHandlerThread(
-      "p2p-ble-peripheral-discovered",
+  std::string report_key = GetDiscoveryReportKey(
+      client, service_id, "ble2",
+      absl::StrCat(peripheral.GetId().AsStringView(), "/",
+                   advertisement_bytes.AsStringView()));
+  RunOnPcpHandlerThreadCoalesced(
+      "p2p-ble-peripheral-discovered", std::move(report_key),
       [this, client, peripheral = std::move(peripheral), service_id,
        advertisement_bytes, fast_advertisement]() RUN_ON_PCP_HANDLER_THREAD() {
         // Make sure we are still discovering before proceeding.
@@ -716,8 +740,12 @@ void P2pClusterPcpHandler::BleV2PeripheralLostHandler(
     ClientProxy* client, BleV2Peripheral peripheral,
     const std::string& service_id, const ByteArray& advertisement_bytes,
     bool fast_advertisement) {
-  RunOnPcpHandlerThread(
-      "p2p-ble-peripheral-lost",
+  std::string report_key = GetDiscoveryReportKey(
+      client, service_id, "ble2",
+      absl::StrCat(peripheral.GetId().AsStringView(), "/",
+                   advertisement_bytes.AsStringView()));
+  RunOnPcpHandlerThreadCoalesced(
+      "p2p-ble-peripheral-lost", std::move(report_key),
       [this, client, service_id, peripheral = std::move(peripheral),
        advertisement_bytes, fast_advertisement]() RUN_ON_PCP_HANDLER_THREAD() {
         // Make sure we are still discovering before proceeding.
@@ -819,8 +847,10 @@ bool P2pClusterPcpHandler::IsRecognizedWifiLanEndpoint(
 void P2pClusterPcpHandler::WifiLanServiceDiscoveredHandler(
     ClientProxy* client, NsdServiceInfo service_info,
     const std::string& service_id) {
-  RunOnPcpHandlerThread(
+  RunOnPcpHandlerThreadCoalesced(
       "p2p-wifi-service-discovered",
+      GetDiscoveryReportKey(client, service_id, "wifi_lan",
+                            service_info.GetServiceName()),
       [this, client, service_id, service_info]() RUN_ON_PCP_HANDLER_THREAD() {
         // Make sure we are still discovering before proceeding.
         if (!client->IsDiscovering()) {
@@ -868,8 +898,10 @@ void P2pClusterPcpHandler::WifiLanServiceLostHandler(
     const std::string& service_id) {
   NEARBY_LOGS(INFO) << "WifiLan: [LOST, SCHED] service_info=" << &service_info
                     << ", service_name=" << service_info.GetServiceName();
-  RunOnPcpHandlerThread(
+  RunOnPcpHandlerThreadCoalesced(
       "p2p-wifi-service-lost",
+      GetDiscoveryReportKey(client, service_id, "wifi_lan",
+                            service_info.GetServiceName()),
       [this, client, service_id, service_info]() RUN_ON_PCP_HANDLER_THREAD() {
         // Make sure we are still discovering before proceeding.
         if (!client->IsDiscovering()) {
@@ -1027,7 +1059,8 @@ Status P2pClusterPcpHandler::InjectEndpointImpl(
 }
 
 BasePcpHandler::ConnectImplResult P2pClusterPcpHandler::ConnectImpl(
-    ClientProxy* client, BasePcpHandler::DiscoveredEndpoint* endpoint) {
+    ClientProxy* client, BasePcpHandler::DiscoveredEndpoint* endpoint,
+    CancellationFlag* cancellation_flag) {
   if (!endpoint) {
     return BasePcpHandler::ConnectImplResult{
         .status = {Status::kError},
@@ -1037,7 +1070,8 @@ BasePcpHandler::ConnectImplResult P2pClusterPcpHandler::ConnectImpl(
     case Medium::BLUETOOTH: {
       auto* bluetooth_endpoint = down_cast<BluetoothEndpoint*>(endpoint);
       if (bluetooth_endpoint) {
-        return BluetoothConnectImpl(client, bluetooth_endpoint);
+        return BluetoothConnectImpl(client, bluetooth_endpoint,
+                                    cancellation_flag);
       }
       break;
     }
@@ -1047,13 +1081,13 @@ BasePcpHandler::ConnectImplResult P2pClusterPcpHandler::ConnectImpl(
                   kEnableBleV2)) {
         auto* ble_v2_endpoint = down_cast<BleV2Endpoint*>(endpoint);
         if (ble_v2_endpoint) {
-          return BleV2ConnectImpl(client, ble_v2_endpoint);
+          return BleV2ConnectImpl(client, ble_v2_endpoint, cancellation_flag);
         }
 
       } else {
         auto* ble_endpoint = down_cast<BleEndpoint*>(endpoint);
         if (ble_endpoint) {
-          return BleConnectImpl(client, ble_endpoint);
+          return BleConnectImpl(client, ble_endpoint, cancellation_flag);
         }
       }
       break;
@@ -1061,7 +1095,8 @@ BasePcpHandler::ConnectImplResult P2pClusterPcpHandler::ConnectImpl(
     case Medium::WIFI_LAN: {
       auto* wifi_lan_endpoint = down_cast<WifiLanEndpoint*>(endpoint);
       if (wifi_lan_endpoint) {
-        return WifiLanConnectImpl(client, wifi_lan_endpoint);
+        return WifiLanConnectImpl(client, wifi_lan_endpoint,
+                                  cancellation_flag);
       }
       break;
     }
@@ -1557,15 +1592,15 @@ Medium P2pClusterPcpHandler::StartBluetoothDiscovery(
 }
 
 BasePcpHandler::ConnectImplResult P2pClusterPcpHandler::BluetoothConnectImpl(
-    ClientProxy* client, BluetoothEndpoint* endpoint) {
+    ClientProxy* client, BluetoothEndpoint* endpoint,
+    CancellationFlag* cancellation_flag) {
   NEARBY_LOGS(VERBOSE) << "Client " << client->GetClientId()
                        << " is attempting to connect to endpoint(id="
                        << endpoint->endpoint_id << ") over Bluetooth Classic.";
   BluetoothDevice& device = endpoint->bluetooth_device;
 
   BluetoothSocket bluetooth_socket = bluetooth_medium_.Connect(
-      device, endpoint->service_id,
-      client->GetCancellationFlag(endpoint->endpoint_id));
+      device, endpoint->service_id, cancellation_flag);
   if (!bluetooth_socket.IsValid()) {
     NEARBY_LOGS(ERROR)
         << "In BluetoothConnectImpl(), failed to connect to Bluetooth device "
@@ -1777,7 +1812,8 @@ Medium P2pClusterPcpHandler::StartBleScanning(
 }
 
 BasePcpHandler::ConnectImplResult P2pClusterPcpHandler::BleConnectImpl(
-    ClientProxy* client, BleEndpoint* endpoint) {
+    ClientProxy* client, BleEndpoint* endpoint,
+    CancellationFlag* cancellation_flag) {
   NEARBY_LOGS(VERBOSE) << "Client " << client->GetClientId()
                        << " is attempting to connect to endpoint(id="
                        << endpoint->endpoint_id << ") over BLE.";
@@ -1785,8 +1821,7 @@ BasePcpHandler::ConnectImplResult P2pClusterPcpHandler::BleConnectImpl(
   BlePeripheral& peripheral = endpoint->ble_peripheral;
 
   BleSocket ble_socket =
-      ble_medium_.Connect(peripheral, endpoint->service_id,
-                          client->GetCancellationFlag(endpoint->endpoint_id));
+      ble_medium_.Connect(peripheral, endpoint->service_id, cancellation_flag);
   if (!ble_socket.IsValid()) {
     NEARBY_LOGS(ERROR)
         << "In BleConnectImpl(), failed to connect to BLE device "
@@ -1991,7 +2026,8 @@ Medium P2pClusterPcpHandler::StartBleV2Scanning(
 }
 
 BasePcpHandler::ConnectImplResult P2pClusterPcpHandler::BleV2ConnectImpl(
-    ClientProxy* client, BleV2Endpoint* endpoint) {
+    ClientProxy* client, BleV2Endpoint* endpoint,
+    CancellationFlag* cancellation_flag) {
   NEARBY_LOGS(VERBOSE) << "Client " << client->GetClientId()
                        << " is attempting to connect to endpoint(id="
                        << endpoint->endpoint_id << ") over BLE.";
@@ -1999,8 +2035,7 @@ BasePcpHandler::ConnectImplResult P2pClusterPcpHandler::BleV2ConnectImpl(
   BleV2Peripheral& peripheral = endpoint->ble_peripheral;
 
   BleV2Socket ble_socket = ble_v2_medium_.Connect(
-      endpoint->service_id, peripheral,
-      client->GetCancellationFlag(endpoint->endpoint_id));
+      endpoint->service_id, peripheral, cancellation_flag);
   if (!ble_socket.IsValid()) {
     NEARBY_LOGS(ERROR)
         << "In BleConnectImpl(), failed to connect to BLE device "
@@ -2156,13 +2191,13 @@ Medium P2pClusterPcpHandler::StartWifiLanDiscovery(
 }
 
 BasePcpHandler::ConnectImplResult P2pClusterPcpHandler::WifiLanConnectImpl(
-    ClientProxy* client, WifiLanEndpoint* endpoint) {
+    ClientProxy* client, WifiLanEndpoint* endpoint,
+    CancellationFlag* cancellation_flag) {
   NEARBY_LOGS(INFO) << "Client " << client->GetClientId()
                     << " is attempting to connect to endpoint(id="
                     << endpoint->endpoint_id << ") over WifiLan.";
   WifiLanSocket socket = wifi_lan_medium_.Connect(
-      endpoint->service_id, endpoint->service_info,
-      client->GetCancellationFlag(endpoint->endpoint_id));
+      endpoint->service_id, endpoint->service_info, cancellation_flag);
   if (!socket.IsValid()) {
     NEARBY_LOGS(ERROR)
         << "In WifiLanConnectImpl(), failed to connect to service "
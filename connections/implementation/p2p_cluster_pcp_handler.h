@@ -38,6 +38,7 @@
 #include "connections/implementation/pcp.h"
 #include "connections/implementation/wifi_lan_service_info.h"
 #include "internal/platform/byte_array.h"
+#include "internal/platform/cancellation_flag.h"
 
 namespace nearby {
 namespace connections {
@@ -87,10 +88,11 @@ class P2pClusterPcpHandler : public BasePcpHandler {
       ClientProxy* client, const std::string& service_id,
       const OutOfBandConnectionMetadata& metadata) override;
 
-  // @PCPHandlerThread
+  // @PCPHandlerThread. When the mediums are raced, runs on BasePcpHandler's
+  // connect executor instead, concurrently for different mediums.
   BasePcpHandler::ConnectImplResult ConnectImpl(
-      ClientProxy* client,
-      BasePcpHandler::DiscoveredEndpoint* endpoint) override;
+      ClientProxy* client, BasePcpHandler::DiscoveredEndpoint* endpoint,
+      CancellationFlag* cancellation_flag) override;
 
   // @PCPHandlerThread
   BasePcpHandler::StartOperationResult StartListeningForIncomingConnectionsImpl(
@@ -179,7 +181,8 @@ class P2pClusterPcpHandler : public BasePcpHandler {
   location::nearby::proto::connections::Medium StartBluetoothDiscovery(
       ClientProxy* client, const std::string& service_id);
   BasePcpHandler::ConnectImplResult BluetoothConnectImpl(
-      ClientProxy* client, BluetoothEndpoint* endpoint);
+      ClientProxy* client, BluetoothEndpoint* endpoint,
+      CancellationFlag* cancellation_flag);
 
   // Ble
   bool IsRecognizedBleEndpoint(const std::string& service_id,
@@ -204,8 +207,9 @@ class P2pClusterPcpHandler : public BasePcpHandler {
   location::nearby::proto::connections::Medium StartBleScanning(
       ClientProxy* client, const std::string& service_id,
       const std::string& fast_advertisement_service_uuid);
-  BasePcpHandler::ConnectImplResult BleConnectImpl(ClientProxy* client,
-                                                   BleEndpoint* endpoint);
+  BasePcpHandler::ConnectImplResult BleConnectImpl(
+      ClientProxy* client, BleEndpoint* endpoint,
+      CancellationFlag* cancellation_flag);
 
   // BleV2
   bool IsRecognizedBleV2Endpoint(absl::string_view service_id,
@@ -233,8 +237,9 @@ class P2pClusterPcpHandler : public BasePcpHandler {
   location::nearby::proto::connections::Medium StartBleV2Scanning(
       ClientProxy* client, const std::string& service_id,
       const DiscoveryOptions& discovery_options);
-  BasePcpHandler::ConnectImplResult BleV2ConnectImpl(ClientProxy* client,
-                                                     BleV2Endpoint* endpoint);
+  BasePcpHandler::ConnectImplResult BleV2ConnectImpl(
+      ClientProxy* client, BleV2Endpoint* endpoint,
+      CancellationFlag* cancellation_flag);
 
   // WifiLan
   bool IsRecognizedWifiLanEndpoint(
@@ -259,7 +264,8 @@ class P2pClusterPcpHandler : public BasePcpHandler {
   location::nearby::proto::connections::Medium StartWifiLanDiscovery(
       ClientProxy* client, const std::string& service_id);
   BasePcpHandler::ConnectImplResult WifiLanConnectImpl(
-      ClientProxy* client, WifiLanEndpoint* endpoint);
+      ClientProxy* client, WifiLanEndpoint* endpoint,
+      CancellationFlag* cancellation_flag);
 
   BluetoothRadio& bluetooth_radio_;
   BluetoothClassic& bluetooth_medium_;
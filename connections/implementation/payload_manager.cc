@@ -27,6 +27,7 @@
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
 #include "absl/time/time.h"
+#include "connections/implementation/analytics/payload_pipeline_profiler.h"
 #include "connections/implementation/analytics/throughput_recorder.h"
 #include "connections/implementation/client_proxy.h"
 #include "connections/implementation/endpoint_channel_manager.h"
@@ -40,6 +41,7 @@
 #include "internal/platform/logging.h"
 #include "internal/platform/mutex_lock.h"
 #include "internal/platform/single_thread_executor.h"
+#include "internal/platform/system_clock.h"
 #include "proto/connections_enums.pb.h"
 
 namespace nearby {
@@ -49,6 +51,7 @@ using ::location::nearby::connections::OfflineFrame;
 using ::location::nearby::connections::V1Frame;
 using ::location::nearby::proto::connections::PayloadStatus;
 using ::nearby::analytics::PacketMetaData;
+using ::nearby::analytics::PayloadPipelineProfiler;
 using ::nearby::analytics::ThroughputRecorderContainer;
 using ::nearby::connections::PayloadDirection;
 
@@ -153,7 +156,8 @@ bool PayloadManager::SendPayloadLoop(
   PayloadTransferFrame::PayloadChunk payload_chunk(CreatePayloadChunk(
       next_chunk_offset - resume_offset, std::move(next_chunk)));
   const EndpointIds& failed_endpoint_ids = endpoint_manager_->SendPayloadChunk(
-      payload_header, payload_chunk, available_endpoint_ids, packet_meta_data);
+      payload_header, payload_chunk, available_endpoint_ids, packet_meta_data,
+      pending_payload.GetThroughputRecorder());
   // Check whether at least one endpoint failed.
   if (!failed_endpoint_ids.empty()) {
     NEARBY_LOGS(INFO) << "Payload xfer: endpoints failed: payload_id="
@@ -183,9 +187,9 @@ bool PayloadManager::SendPayloadLoop(
             payload_chunk.offset(), payload_chunk.body().size());
       }
     }
-    NEARBY_LOGS(VERBOSE) << "PayloadManager done sending chunk at offset "
-                         << next_chunk_offset << " of payload_id="
-                         << pending_payload.GetInternalPayload()->GetId();
+    NEARBY_LOGS_EVERY_N_SEC(VERBOSE, 1)
+        << "PayloadManager done sending chunk at offset " << next_chunk_offset
+        << " of payload_id=" << pending_payload.GetInternalPayload()->GetId();
     next_chunk_offset += next_chunk_size;
 
     if (!next_chunk_size) {
@@ -193,10 +197,7 @@ bool PayloadManager::SendPayloadLoop(
       NEARBY_LOGS(INFO) << "Payload xfer done: payload_id="
                         << pending_payload.GetInternalPayload()->GetId()
                         << "; size=" << next_chunk_offset;
-      ThroughputRecorderContainer::GetInstance()
-          .GetTPRecorder(pending_payload.GetInternalPayload()->GetId(),
-                         PayloadDirection::OUTGOING_PAYLOAD)
-          ->MarkAsSuccess();
+      pending_payload.GetThroughputRecorder()->MarkAsSuccess();
       return false;
     }
   }
@@ -460,9 +461,8 @@ void PayloadManager::SendPayload(ClientProxy* client,
         bool should_continue = true;
         std::int64_t next_chunk_offset = 0;
 
-        ThroughputRecorderContainer::GetInstance()
-            .GetTPRecorder(payload_id, PayloadDirection::OUTGOING_PAYLOAD)
-            ->Start(payload_type, PayloadDirection::OUTGOING_PAYLOAD);
+        pending_payload->GetThroughputRecorder()->Start(
+            payload_type, PayloadDirection::OUTGOING_PAYLOAD);
         while (should_continue && !shutdown_.Get()) {
           should_continue =
               SendPayloadLoop(client, *pending_payload, payload_header,
@@ -500,6 +500,14 @@ Status PayloadManager::CancelPayload(ClientProxy* client,
                     << (canceled_payload->IsIncoming() ? "incoming"
                                                        : "outgoing")
                     << " payload_id=" << payload_id << " at request of client.";
+  // The reader thread may be waiting in AttachNextChunk() for the client to
+  // read more of an incoming stream; closing the stream wakes it up. File
+  // payloads are left to the reader thread, which owns their file.
+  if (canceled_payload->IsIncoming() &&
+      canceled_payload->GetInternalPayload()->GetType() ==
+          PayloadTransferFrame::PayloadHeader::STREAM) {
+    canceled_payload->GetInternalPayload()->Close();
+  }
 
   // Return SUCCESS immediately. Remaining cleanup and updates will be sent
   // in SendPayload() or OnIncomingFrame()
@@ -861,6 +869,7 @@ bool PayloadManager::WaitForReceivedAck(
   NEARBY_LOGS(INFO) << "[safe-to-disconnect] Last Chunk, sender wait for "
                        "PAYLOAD_RECEIVED_ACK frame from: "
                     << endpoint_id;
+  absl::Time ack_wait_start_time = SystemClock::ElapsedRealtime();
   while (true) {
     PendingPayloadHandle latest_pending_payload =
         GetPayload(payload_header.id());
@@ -894,6 +903,8 @@ bool PayloadManager::WaitForReceivedAck(
       MutexLock lock(&endpoint_info->payload_received_ack_mutex);
       if (endpoint_info->is_payload_received_ack) {
         endpoint_info->is_payload_received_ack = false;
+        PayloadPipelineProfiler::GetInstance().OnAckWait(
+            endpoint_id, SystemClock::ElapsedRealtime() - ack_wait_start_time);
         return true;
       }
       Exception wait_exception = endpoint_info->payload_received_ack_cond.Wait(
@@ -901,6 +912,8 @@ bool PayloadManager::WaitForReceivedAck(
               .GetFlags()
               .wait_payload_received_ack_millis);
       endpoint_info->is_payload_received_ack = false;
+      PayloadPipelineProfiler::GetInstance().OnAckWait(
+          endpoint_id, SystemClock::ElapsedRealtime() - ack_wait_start_time);
       if (!wait_exception.Ok()) {
         return false;
       }
@@ -1166,10 +1179,6 @@ void PayloadManager::ProcessDataPacket(
   Payload::Id payload_id = payload_header.id();
   PendingPayloadHandle pending_payload;
   if (payload_chunk.offset() == 0) {
-    ThroughputRecorderContainer::GetInstance()
-        .GetTPRecorder(payload_id, PayloadDirection::INCOMING_PAYLOAD)
-        ->Start((PayloadType)payload_header.type(),
-                PayloadDirection::INCOMING_PAYLOAD);
     packet_meta_data.Reset();
     RunOnStatusUpdateThread(
         "process-data-packet", [to_client, from_endpoint_id, payload_header,
@@ -1196,6 +1205,8 @@ void PayloadManager::ProcessDataPacket(
                          PayloadTransferFrame::ControlMessage::PAYLOAD_ERROR);
       return;
     }
+    pending_payload->GetThroughputRecorder()->Start(
+        (PayloadType)payload_header.type(), PayloadDirection::INCOMING_PAYLOAD);
     // Also, let the client know of this new incoming payload.
     RunOnStatusUpdateThread(
         "process-data-packet",
@@ -1249,6 +1260,18 @@ void PayloadManager::ProcessDataPacket(
   if (pending_payload->GetInternalPayload()
           ->AttachNextChunk(ByteArray(std::move(*payload_chunk.mutable_body())))
           .Raised()) {
+    // CancelPayload() closes incoming streams, failing the chunk they were
+    // waiting to write.
+    if (pending_payload->IsLocallyCanceled()) {
+      NEARBY_LOGS(INFO) << "ProcessDataPacket: [cancel] endpoint_id="
+                        << from_endpoint_id
+                        << "; payload_id=" << pending_payload->GetId();
+      HandleFinishedIncomingPayload(to_client, from_endpoint_id,
+                                    payload_header, payload_chunk.offset(),
+                                    location::nearby::proto::connections::
+                                        PayloadStatus::LOCAL_CANCELLATION);
+      return;
+    }
     NEARBY_LOGS(ERROR) << "ProcessDataPacket: [data: error] endpoint_id="
                        << from_endpoint_id
                        << "; payload_id=" << pending_payload->GetId();
@@ -1268,13 +1291,12 @@ void PayloadManager::ProcessDataPacket(
                                 payload_chunk.flags(), payload_chunk.offset(),
                                 payload_body_size);
 
-  ThroughputRecorderContainer::GetInstance()
-      .GetTPRecorder(payload_header.id(), PayloadDirection::INCOMING_PAYLOAD)
-      ->OnFrameReceived(medium, packet_meta_data);
+  pending_payload->GetThroughputRecorder()->OnFrameReceived(medium,
+                                                            packet_meta_data);
+  PayloadPipelineProfiler::GetInstance().OnChunkReceived(
+      from_endpoint_id, medium, packet_meta_data);
   if (is_last_chunk) {
-    ThroughputRecorderContainer::GetInstance()
-        .GetTPRecorder(payload_header.id(), PayloadDirection::INCOMING_PAYLOAD)
-        ->MarkAsSuccess();
+    pending_payload->GetThroughputRecorder()->MarkAsSuccess();
   }
 }
 
@@ -1452,6 +1474,11 @@ PayloadManager::PendingPayload::PendingPayload(
     DestroyCallback destroy_callback)
     : is_incoming_(is_incoming),
       internal_payload_(std::move(internal_payload)),
+      throughput_recorder_(
+          ThroughputRecorderContainer::GetInstance().GetTPRecorder(
+              internal_payload_->GetId(),
+              is_incoming ? PayloadDirection::INCOMING_PAYLOAD
+                          : PayloadDirection::OUTGOING_PAYLOAD)),
       destroy_callback_(std::move(destroy_callback)) {
   // Initially we mark all endpoints as available.
   // Later on some may become canceled, some may experience data transfer
@@ -1470,6 +1497,11 @@ Payload::Id PayloadManager::PendingPayload::GetId() const {
   return internal_payload_->GetId();
 }
 
+analytics::ThroughputRecorder*
+PayloadManager::PendingPayload::GetThroughputRecorder() const {
+  return throughput_recorder_.get();
+}
+
 InternalPayload* PayloadManager::PendingPayload::GetInternalPayload() {
   return internal_payload_.get();
 }
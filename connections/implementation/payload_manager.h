@@ -26,6 +26,7 @@
 #include "absl/container/flat_hash_map.h"
 #include "absl/functional/any_invocable.h"
 #include "connections/implementation/analytics/packet_meta_data.h"
+#include "connections/implementation/analytics/throughput_recorder.h"
 #include "connections/implementation/client_proxy.h"
 #include "connections/implementation/endpoint_manager.h"
 #include "connections/implementation/internal_payload.h"
@@ -133,6 +134,10 @@ class PayloadManager : public EndpointManager::FrameProcessor {
     void MarkReceivedAckFromEndpoint(const std::string& from_endpoint_id);
     bool IsIncoming() const;
 
+    // The throughput recorder of this payload, held for as long as the
+    // payload is pending.
+    analytics::ThroughputRecorder* GetThroughputRecorder() const;
+
     // Gets the EndpointInfo objects for the endpoints (still) associated with
     // this payload.
     std::vector<const EndpointInfo*> GetEndpoints() const
@@ -174,6 +179,7 @@ class PayloadManager : public EndpointManager::FrameProcessor {
     AtomicBoolean is_locally_canceled_{false};
     AtomicBoolean is_closed_;
     std::unique_ptr<InternalPayload> internal_payload_;
+    std::shared_ptr<analytics::ThroughputRecorder> throughput_recorder_;
     DestroyCallback destroy_callback_;
     absl::flat_hash_map<std::string, EndpointInfo> endpoints_
         ABSL_GUARDED_BY(mutex_);
@@ -49,6 +49,13 @@ void PcpManager::DisconnectFromEndpointManager() {
   }
 }
 
+void PcpManager::ForgetSessions(ClientProxy* client) {
+  for (auto& item : handlers_) {
+    if (!item.second) continue;
+    item.second->ForgetSessions(client);
+  }
+}
+
 PcpManager::~PcpManager() {
   NEARBY_LOGS(INFO) << "Initiating shutdown of PcpManager.";
   DisconnectFromEndpointManager();
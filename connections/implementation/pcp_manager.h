@@ -90,6 +90,7 @@ class PcpManager {
 
   location::nearby::proto::connections::Medium GetBandwidthUpgradeMedium();
   void DisconnectFromEndpointManager();
+  void ForgetSessions(ClientProxy* client);
 
  private:
   bool SetCurrentPcpHandler(Strategy strategy);
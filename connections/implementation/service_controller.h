@@ -63,6 +63,9 @@ class ServiceController {
   // running on or posted to BwuManager.
   virtual void ShutdownBwuManagerExecutors() = 0;
 
+  // Drops the sessions `client` remembered for resumption with any endpoint.
+  virtual void ForgetSessions(ClientProxy* client) = 0;
+
   // Starts advertising an endpoint for a local app.
   virtual Status StartAdvertising(ClientProxy* client,
                                   const std::string& service_id,
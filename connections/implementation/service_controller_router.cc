@@ -29,7 +29,9 @@
 #include "connections/v3/connection_result.h"
 #include "connections/v3/connections_device.h"
 #include "connections/v3/listening_result.h"
+#include "internal/platform/count_down_latch.h"
 #include "internal/platform/logging.h"
+#include "internal/platform/mutex_lock.h"
 
 // TODO(b/285657711): Add tests for uncovered logic, even if trivial.
 namespace nearby {
@@ -88,8 +90,19 @@ ServiceControllerRouter::ServiceControllerRouter() {
 ServiceControllerRouter::~ServiceControllerRouter() {
   NEARBY_LOGS(INFO) << "ServiceControllerRouter going down.";
 
-  if (service_controller_) {
-    service_controller_->Stop();
+  {
+    MutexLock lock(&service_controller_mutex_);
+    if (service_controller_) {
+      service_controller_->Stop();
+    }
+  }
+  absl::flat_hash_map<std::int64_t, DataLane> data_lanes;
+  {
+    MutexLock lock(&data_lanes_mutex_);
+    data_lanes = std::move(data_lanes_);
+  }
+  for (auto& [client_id, lane] : data_lanes) {
+    lane.executor->Shutdown();
   }
   // And make sure that cleanup is the last thing we do.
   serializer_.Shutdown();
@@ -222,8 +235,8 @@ void ServiceControllerRouter::AcceptConnection(ClientProxy* client,
                                                absl::string_view endpoint_id,
                                                PayloadListener listener,
                                                ResultCallback callback) {
-  RouteToServiceController(
-      "scr-accept-connection",
+  RouteToServiceControllerInOrder(
+      client, "scr-accept-connection",
       [this, client, endpoint_id = std::string(endpoint_id),
        listener = std::move(listener),
        callback = std::move(callback)]() mutable {
@@ -252,8 +265,8 @@ void ServiceControllerRouter::RejectConnection(ClientProxy* client,
                                                ResultCallback callback) {
   client->CancelEndpoint(std::string(endpoint_id));
 
-  RouteToServiceController(
-      "scr-reject-connection",
+  RouteToServiceControllerInOrder(
+      client, "scr-reject-connection",
       [this, client, endpoint_id = std::string(endpoint_id),
        callback = std::move(callback)]() mutable {
         if (client->IsConnectedToEndpoint(endpoint_id)) {
@@ -300,8 +313,8 @@ void ServiceControllerRouter::SendPayload(
   const std::vector<std::string> endpoints =
       std::vector<std::string>(endpoint_ids.begin(), endpoint_ids.end());
 
-  RouteToServiceController(
-      "scr-send-payload",
+  RouteToDataLane(
+      client, "scr-send-payload",
       [this, client, payload = std::move(payload), endpoints,
        callback = std::move(callback)]() mutable {
         if (!ClientHasConnectionToAtLeastOneEndpoint(client, endpoints)) {
@@ -323,8 +336,8 @@ void ServiceControllerRouter::SendPayload(
 void ServiceControllerRouter::CancelPayload(ClientProxy* client,
                                             std::uint64_t payload_id,
                                             ResultCallback callback) {
-  RouteToServiceController(
-      "scr-cancel-payload",
+  RouteToDataLane(
+      client, "scr-cancel-payload",
       [this, client, payload_id, callback = std::move(callback)]() mutable {
         callback(GetServiceController()->CancelPayload(client, payload_id));
       });
@@ -337,8 +350,8 @@ void ServiceControllerRouter::DisconnectFromEndpoint(
   // without further posting it.
   client->CancelEndpoint(std::string(endpoint_id));
 
-  RouteToServiceController(
-      "scr-disconnect-endpoint",
+  RouteToServiceControllerInOrder(
+      client, "scr-disconnect-endpoint",
       [this, client, endpoint_id = std::string(endpoint_id),
        callback = std::move(callback)]() mutable {
         if (!client->IsConnectedToEndpoint(endpoint_id) &&
@@ -484,8 +497,8 @@ void ServiceControllerRouter::RequestConnectionV3(
 void ServiceControllerRouter::AcceptConnectionV3(
     ClientProxy* client, const NearbyDevice& remote_device,
     v3::PayloadListener listener, ResultCallback callback) {
-  RouteToServiceController(
-      "scr-accept-connection",
+  RouteToServiceControllerInOrder(
+      client, "scr-accept-connection",
       [this, client, endpoint_id = remote_device.GetEndpointId(),
        v3_listener = std::move(listener),
        callback = std::move(callback)]() mutable {
@@ -528,8 +541,8 @@ void ServiceControllerRouter::RejectConnectionV3(
     ResultCallback callback) {
   client->CancelEndpoint(remote_device.GetEndpointId());
 
-  RouteToServiceController(
-      "scr-reject-connection",
+  RouteToServiceControllerInOrder(
+      client, "scr-reject-connection",
       [this, client, endpoint_id = remote_device.GetEndpointId(),
        callback = std::move(callback)]() mutable {
         if (client->IsConnectedToEndpoint(endpoint_id)) {
@@ -574,10 +587,11 @@ void ServiceControllerRouter::InitiateBandwidthUpgradeV3(
 void ServiceControllerRouter::SendPayloadV3(
     ClientProxy* client, const NearbyDevice& recipient_device, Payload payload,
     ResultCallback callback) {
-  RouteToServiceController(
-      "scr-send-payload", [this, client, payload = std::move(payload),
-                           endpoint_id = recipient_device.GetEndpointId(),
-                           callback = std::move(callback)]() mutable {
+  RouteToDataLane(
+      client, "scr-send-payload",
+      [this, client, payload = std::move(payload),
+       endpoint_id = recipient_device.GetEndpointId(),
+       callback = std::move(callback)]() mutable {
         if (!client->IsConnectedToEndpoint(endpoint_id)) {
           callback({Status::kEndpointUnknown});
           return;
@@ -597,8 +611,8 @@ void ServiceControllerRouter::SendPayloadV3(
 void ServiceControllerRouter::CancelPayloadV3(
     ClientProxy* client, const NearbyDevice& recipient_device,
     uint64_t payload_id, ResultCallback callback) {
-  RouteToServiceController(
-      "scr-cancel-payload",
+  RouteToDataLane(
+      client, "scr-cancel-payload",
       [this, client, payload_id, callback = std::move(callback)]() mutable {
         callback(GetServiceController()->CancelPayload(client, payload_id));
       });
@@ -611,8 +625,8 @@ void ServiceControllerRouter::DisconnectFromDeviceV3(
   // without further posting it.
   client->CancelEndpoint(remote_device.GetEndpointId());
 
-  RouteToServiceController(
-      "scr-disconnect-endpoint",
+  RouteToServiceControllerInOrder(
+      client, "scr-disconnect-endpoint",
       [this, client, endpoint_id = remote_device.GetEndpointId(),
        callback = std::move(callback)]() mutable {
         if (!client->IsConnectedToEndpoint(endpoint_id) &&
@@ -656,13 +670,14 @@ void ServiceControllerRouter::StopAllEndpoints(ClientProxy* client,
   // without further posting it.
   client->CancelAllEndpoints();
 
-  RouteToServiceController(
-      "scr-stop-all-endpoints",
+  RouteToServiceControllerInOrder(
+      client, "scr-stop-all-endpoints",
       [this, client, callback = std::move(callback)]() mutable {
         NEARBY_LOGS(INFO) << "Client " << client->GetClientId()
                           << " has requested us to stop all endpoints. We will "
                              "now reset the client.";
         FinishClientSession(client);
+        RetireDataLane(client);
         callback({Status::kSuccess});
       });
 }
@@ -683,16 +698,23 @@ void ServiceControllerRouter::SetCustomSavePath(ClientProxy* client,
 
 void ServiceControllerRouter::SetServiceControllerForTesting(
     std::unique_ptr<ServiceController> service_controller) {
+  MutexLock lock(&service_controller_mutex_);
   service_controller_ = std::move(service_controller);
 }
 
 ServiceController* ServiceControllerRouter::GetServiceController() {
+  MutexLock lock(&service_controller_mutex_);
   if (!service_controller_) {
     service_controller_ = std::make_unique<OfflineServiceController>();
   }
   return service_controller_.get();
 }
 
+int ServiceControllerRouter::GetDataLaneCountForTesting() {
+  MutexLock lock(&data_lanes_mutex_);
+  return data_lanes_.size() + retired_lanes_;
+}
+
 void ServiceControllerRouter::FinishClientSession(ClientProxy* client) {
   // Disconnect from all the connected endpoints tied to this clientProxy.
   for (auto& endpoint_id : client->GetPendingConnectedEndpoints()) {
@@ -707,6 +729,8 @@ void ServiceControllerRouter::FinishClientSession(ClientProxy* client) {
   GetServiceController()->StopAdvertising(client);
   GetServiceController()->StopDiscovery(client);
   GetServiceController()->ShutdownBwuManagerExecutors();
+  // The client's sessions are not to be resumed after it was reset.
+  GetServiceController()->ForgetSessions(client);
 
   // Finally, clear all state maintained by this client.
   client->Reset();
@@ -717,5 +741,69 @@ void ServiceControllerRouter::RouteToServiceController(const std::string& name,
   serializer_.Execute(name, std::move(runnable));
 }
 
+void ServiceControllerRouter::RouteToDataLane(ClientProxy* client,
+                                              const std::string& name,
+                                              Runnable runnable) {
+  std::int64_t client_id = client->GetClientId();
+  MutexLock lock(&data_lanes_mutex_);
+  DataLane& lane = data_lanes_[client_id];
+  if (!lane.executor) {
+    lane.executor = std::make_unique<SingleThreadExecutor>();
+  }
+  lane.retiring = false;
+  ++lane.pending;
+  lane.executor->Execute(
+      name, [this, client_id, runnable = std::move(runnable)]() mutable {
+        runnable();
+        MutexLock lock(&data_lanes_mutex_);
+        auto it = data_lanes_.find(client_id);
+        if (it == data_lanes_.end()) return;
+        if (--it->second.pending == 0 && it->second.retiring) {
+          RemoveDataLaneLocked(client_id);
+        }
+      });
+}
+
+void ServiceControllerRouter::RetireDataLane(ClientProxy* client) {
+  MutexLock lock(&data_lanes_mutex_);
+  auto it = data_lanes_.find(client->GetClientId());
+  if (it == data_lanes_.end()) return;
+  // Called from a call on the lane itself, so this usually waits for that
+  // call to finish.
+  it->second.retiring = true;
+  if (it->second.pending == 0) {
+    RemoveDataLaneLocked(client->GetClientId());
+  }
+}
+
+void ServiceControllerRouter::RemoveDataLaneLocked(std::int64_t client_id) {
+  auto it = data_lanes_.find(client_id);
+  std::shared_ptr<SingleThreadExecutor> lane = std::move(it->second.executor);
+  data_lanes_.erase(it);
+  ++retired_lanes_;
+  // Nothing can be queued on the lane any more, and the call that got here is
+  // about to return, so joining it from the serializer can't deadlock.
+  RouteToServiceController("scr-retire-data-lane", [this, lane]() {
+    lane->Shutdown();
+    MutexLock lock(&data_lanes_mutex_);
+    --retired_lanes_;
+  });
+}
+
+void ServiceControllerRouter::RouteToServiceControllerInOrder(
+    ClientProxy* client, const std::string& name, Runnable runnable) {
+  // The lane waits for the call to finish on the serializer, so the client's
+  // payload calls on either side of it can't overtake it.
+  RouteToDataLane(client, name,
+                  [this, name, runnable = std::move(runnable)]() mutable {
+                    CountDownLatch latch(1);
+                    RouteToServiceController(name, [&runnable, &latch]() {
+                      runnable();
+                      latch.CountDown();
+                    });
+                    latch.Await();
+                  });
+}
+
 }  // namespace connections
 }  // namespace nearby
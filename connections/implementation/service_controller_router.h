@@ -15,10 +15,13 @@
 #ifndef CORE_INTERNAL_SERVICE_CONTROLLER_ROUTER_H_
 #define CORE_INTERNAL_SERVICE_CONTROLLER_ROUTER_H_
 
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
 
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
 #include "absl/strings/string_view.h"
 #include "absl/types/span.h"
@@ -31,6 +34,7 @@
 #include "connections/v3/listening_result.h"
 #include "connections/v3/params.h"
 #include "internal/interop/device.h"
+#include "internal/platform/mutex.h"
 #include "internal/platform/runnable.h"
 #include "internal/platform/single_thread_executor.h"
 
@@ -173,15 +177,58 @@ class ServiceControllerRouter {
   void SetServiceControllerForTesting(
       std::unique_ptr<ServiceController> service_controller);
 
+  // Number of per-client data lanes alive, retired or not yet shut down.
+  int GetDataLaneCountForTesting() ABSL_LOCKS_EXCLUDED(data_lanes_mutex_);
+
  private:
   // Lazily create ServiceController.
-  ServiceController* GetServiceController();
+  ServiceController* GetServiceController()
+      ABSL_LOCKS_EXCLUDED(service_controller_mutex_);
 
+  // Control-plane calls (advertising, discovery, connection life cycle) all
+  // share one lane: PcpManager keeps state across clients, and the PCP handler
+  // runs them one at a time anyway.
   void RouteToServiceController(const std::string& name, Runnable runnable);
+  // Data-plane calls (sending and cancelling payloads) get a lane per client,
+  // so they keep their order and only wait behind the control-plane calls of
+  // the same client that change its connections.
+  void RouteToDataLane(ClientProxy* client, const std::string& name,
+                       Runnable runnable) ABSL_LOCKS_EXCLUDED(data_lanes_mutex_);
+  // Control-plane calls that change the client's connections (accept, reject,
+  // disconnect, stop) still run on the serializer, but in order with the
+  // client's data-plane calls: they wait for the payload calls made before
+  // them, and payload calls made after them wait for them.
+  void RouteToServiceControllerInOrder(ClientProxy* client,
+                                       const std::string& name,
+                                       Runnable runnable)
+      ABSL_LOCKS_EXCLUDED(data_lanes_mutex_);
+  // Shuts down the client's data lane once the calls queued on it so far have
+  // run. A call routed to the lane after this keeps it.
+  void RetireDataLane(ClientProxy* client)
+      ABSL_LOCKS_EXCLUDED(data_lanes_mutex_);
+  // Removes the lane of `client_id` and shuts it down from the serializer, as
+  // a lane can't join its own thread.
+  void RemoveDataLaneLocked(std::int64_t client_id)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(data_lanes_mutex_);
   void FinishClientSession(ClientProxy* client);
 
-  std::unique_ptr<ServiceController> service_controller_;
+  struct DataLane {
+    std::unique_ptr<SingleThreadExecutor> executor;
+    // Calls queued or running on the lane.
+    int pending = 0;
+    bool retiring = false;
+  };
+
+  Mutex service_controller_mutex_;
+  std::unique_ptr<ServiceController> service_controller_
+      ABSL_GUARDED_BY(service_controller_mutex_);
   SingleThreadExecutor serializer_;
+  Mutex data_lanes_mutex_;
+  // Keyed by client id.
+  absl::flat_hash_map<std::int64_t, DataLane> data_lanes_
+      ABSL_GUARDED_BY(data_lanes_mutex_);
+  // Lanes removed from `data_lanes_` whose shutdown hasn't run yet.
+  int retired_lanes_ ABSL_GUARDED_BY(data_lanes_mutex_) = 0;
 };
 
 }  // namespace connections
@@ -20,10 +20,13 @@
 #include <optional>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "gmock/gmock.h"
 #include "protobuf-matchers/protocol-buffer-matchers.h"
 #include "gtest/gtest.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "absl/types/span.h"
 #include "connections/implementation/client_proxy.h"
 #include "connections/implementation/mock_service_controller.h"
@@ -45,6 +48,7 @@ namespace nearby {
 namespace connections {
 
 namespace {
+using ::testing::InvokeWithoutArgs;
 using ::testing::Return;
 constexpr std::array<char, 6> kFakeMacAddress = {'a', 'b', 'c', 'd', 'e', 'f'};
 constexpr std::array<char, 6> kFakeInjectedEndpointInfo = {'g', 'h', 'i'};
@@ -1240,6 +1244,185 @@ TEST_F(ServiceControllerRouterTest,
       /*expecting_call=*/false);
 }
 
+TEST_F(ServiceControllerRouterTest, CancelPayloadDoesNotWaitForDiscovery) {
+  CountDownLatch discovery_started(1);
+  CountDownLatch finish_discovery(1);
+  EXPECT_CALL(*mock_, StartDiscovery).WillOnce(InvokeWithoutArgs([&]() {
+    discovery_started.CountDown();
+    finish_discovery.Await();
+    return Status{Status::kSuccess};
+  }));
+  EXPECT_CALL(*mock_, CancelPayload)
+      .WillOnce(Return(Status{Status::kSuccess}));
+
+  CountDownLatch discovery_done(1);
+  router_.StartDiscovery(&client_, kServiceId, kDiscoveryOptions,
+                         discovery_listener_,
+                         [&](Status status) { discovery_done.CountDown(); });
+  ASSERT_TRUE(discovery_started.Await(absl::Seconds(1)).result());
+
+  // StartDiscovery() is still running, but the payload call goes through.
+  CountDownLatch cancel_done(1);
+  router_.CancelPayload(&client_, kPayloadId, [&](Status status) {
+    EXPECT_TRUE(status.Ok());
+    cancel_done.CountDown();
+  });
+  EXPECT_TRUE(cancel_done.Await(absl::Seconds(1)).result());
+
+  finish_discovery.CountDown();
+  EXPECT_TRUE(discovery_done.Await(absl::Seconds(1)).result());
+}
+
+TEST_F(ServiceControllerRouterTest, StopAllEndpointsWaitsForPayloadCalls) {
+  CountDownLatch cancel_started(1);
+  CountDownLatch finish_cancel(1);
+  EXPECT_CALL(*mock_, CancelPayload).WillOnce(InvokeWithoutArgs([&]() {
+    cancel_started.CountDown();
+    finish_cancel.Await();
+    return Status{Status::kSuccess};
+  }));
+
+  CountDownLatch cancel_done(1);
+  router_.CancelPayload(&client_, kPayloadId,
+                        [&](Status status) { cancel_done.CountDown(); });
+  ASSERT_TRUE(cancel_started.Await(absl::Seconds(1)).result());
+  CountDownLatch stop_done(1);
+  router_.StopAllEndpoints(&client_,
+                           [&](Status status) { stop_done.CountDown(); });
+
+  EXPECT_FALSE(stop_done.Await(absl::Milliseconds(100)).result());
+  finish_cancel.CountDown();
+  EXPECT_TRUE(cancel_done.Await(absl::Seconds(1)).result());
+  EXPECT_TRUE(stop_done.Await(absl::Seconds(1)).result());
+}
+
+TEST_F(ServiceControllerRouterTest, DisconnectWaitsForEarlierSendPayload) {
+  auto on_result = [this](Status status) {
+    MutexLock lock(&mutex_);
+    result_ = status;
+    complete_ = true;
+    cond_.Notify();
+  };
+  StartDiscovery(&client_, kServiceId, kDiscoveryOptions, discovery_listener_,
+                 on_result);
+  RequestConnection(&client_, kRemoteEndpointId, kConnectionRequestInfo,
+                    on_result);
+  AcceptConnection(&client_, kRemoteEndpointId, on_result);
+
+  Mutex calls_mutex;
+  std::vector<std::string> calls;
+  CountDownLatch send_started(1);
+  CountDownLatch finish_send(1);
+  EXPECT_CALL(*mock_, SendPayload).WillOnce(InvokeWithoutArgs([&]() {
+    send_started.CountDown();
+    finish_send.Await();
+    MutexLock lock(&calls_mutex);
+    calls.push_back("send");
+  }));
+  EXPECT_CALL(*mock_, DisconnectFromEndpoint)
+      .WillOnce(InvokeWithoutArgs([&]() {
+        MutexLock lock(&calls_mutex);
+        calls.push_back("disconnect");
+      }));
+
+  CountDownLatch send_done(1);
+  CountDownLatch disconnect_done(1);
+  router_.SendPayload(&client_, std::vector<std::string>{kRemoteEndpointId},
+                      Payload{ByteArray("data")}, [&](Status status) {
+                        EXPECT_TRUE(status.Ok());
+                        send_done.CountDown();
+                      });
+  router_.DisconnectFromEndpoint(&client_, kRemoteEndpointId,
+                                 [&](Status status) {
+                                   EXPECT_TRUE(status.Ok());
+                                   disconnect_done.CountDown();
+                                 });
+  ASSERT_TRUE(send_started.Await(absl::Seconds(1)).result());
+
+  EXPECT_FALSE(disconnect_done.Await(absl::Milliseconds(100)).result());
+  finish_send.CountDown();
+  EXPECT_TRUE(send_done.Await(absl::Seconds(1)).result());
+  EXPECT_TRUE(disconnect_done.Await(absl::Seconds(1)).result());
+  MutexLock lock(&calls_mutex);
+  EXPECT_EQ(calls, std::vector<std::string>({"send", "disconnect"}));
+}
+
+TEST_F(ServiceControllerRouterTest, SendPayloadWaitsForEarlierAccept) {
+  auto on_result = [this](Status status) {
+    MutexLock lock(&mutex_);
+    result_ = status;
+    complete_ = true;
+    cond_.Notify();
+  };
+  StartDiscovery(&client_, kServiceId, kDiscoveryOptions, discovery_listener_,
+                 on_result);
+  RequestConnection(&client_, kRemoteEndpointId, kConnectionRequestInfo,
+                    on_result);
+
+  Mutex calls_mutex;
+  std::vector<std::string> calls;
+  CountDownLatch accept_started(1);
+  CountDownLatch finish_accept(1);
+  EXPECT_CALL(*mock_, AcceptConnection).WillOnce(InvokeWithoutArgs([&]() {
+    accept_started.CountDown();
+    finish_accept.Await();
+    // The remote endpoint accepts as well, completing the connection.
+    client_.LocalEndpointAcceptedConnection(kRemoteEndpointId, {});
+    client_.RemoteEndpointAcceptedConnection(kRemoteEndpointId);
+    client_.OnConnectionAccepted(kRemoteEndpointId);
+    MutexLock lock(&calls_mutex);
+    calls.push_back("accept");
+    return Status{Status::kSuccess};
+  }));
+  EXPECT_CALL(*mock_, SendPayload).WillOnce(InvokeWithoutArgs([&]() {
+    MutexLock lock(&calls_mutex);
+    calls.push_back("send");
+  }));
+
+  CountDownLatch accept_done(1);
+  CountDownLatch send_done(1);
+  router_.AcceptConnection(&client_, kRemoteEndpointId, {},
+                           [&](Status status) {
+                             EXPECT_TRUE(status.Ok());
+                             accept_done.CountDown();
+                           });
+  router_.SendPayload(&client_, std::vector<std::string>{kRemoteEndpointId},
+                      Payload{ByteArray("data")}, [&](Status status) {
+                        EXPECT_TRUE(status.Ok());
+                        send_done.CountDown();
+                      });
+  ASSERT_TRUE(accept_started.Await(absl::Seconds(1)).result());
+
+  EXPECT_FALSE(send_done.Await(absl::Milliseconds(100)).result());
+  finish_accept.CountDown();
+  EXPECT_TRUE(accept_done.Await(absl::Seconds(1)).result());
+  EXPECT_TRUE(send_done.Await(absl::Seconds(1)).result());
+  MutexLock lock(&calls_mutex);
+  EXPECT_EQ(calls, std::vector<std::string>({"accept", "send"}));
+}
+
+TEST_F(ServiceControllerRouterTest, StopAllEndpointsRetiresDataLanes) {
+  constexpr int kClients = 50;
+  EXPECT_CALL(*mock_, CancelPayload)
+      .WillRepeatedly(Return(Status{Status::kSuccess}));
+
+  for (int i = 0; i < kClients; ++i) {
+    ClientProxy client;
+    CountDownLatch done(2);
+    router_.CancelPayload(&client, kPayloadId,
+                          [&](Status status) { done.CountDown(); });
+    router_.StopAllEndpoints(&client,
+                             [&](Status status) { done.CountDown(); });
+    ASSERT_TRUE(done.Await(absl::Seconds(1)).result());
+  }
+
+  // Lanes are shut down from the serializer after their last call returns.
+  for (int i = 0; i < 100 && router_.GetDataLaneCountForTesting() > 0; ++i) {
+    absl::SleepFor(absl::Milliseconds(10));
+  }
+  EXPECT_EQ(router_.GetDataLaneCountForTesting(), 0);
+}
+
 }  // namespace
 }  // namespace connections
 }  // namespace nearby
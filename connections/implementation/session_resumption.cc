@@ -0,0 +1,310 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "connections/implementation/session_resumption.h"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include "securegcm/d2d_connection_context_v1.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "internal/crypto_cros/hkdf.h"
+#include "internal/crypto_cros/random.h"
+#include "internal/crypto_cros/secure_util.h"
+#include "internal/platform/byte_array.h"
+#include "internal/platform/mutex_lock.h"
+#include "internal/platform/system_clock.h"
+
+namespace nearby {
+namespace connections {
+namespace {
+
+constexpr size_t kTicketIdSize = 16;
+constexpr size_t kSecretSize = 32;
+constexpr size_t kNonceSize = 32;
+constexpr size_t kMacSize = 32;
+constexpr size_t kKeySize = 32;
+constexpr size_t kAuthTokenSize = 32;
+
+constexpr char kHkdfSalt[] = "Nearby Connections Session Resumption";
+constexpr char kTicketIdInfo[] = "ticket id";
+constexpr char kTicketSecretInfo[] = "ticket secret";
+constexpr char kRequestMacInfo[] = "request";
+constexpr char kAcceptMacInfo[] = "accept";
+constexpr char kClientKeyInfo[] = "client to server key";
+constexpr char kServerKeyInfo[] = "server to client key";
+constexpr char kAuthTokenInfo[] = "auth token";
+
+// A serialized protobuf never starts with a zero byte (field number 0 is
+// invalid), so this prefix can't be mistaken for a UKEY2 message.
+constexpr absl::string_view kMagic("\x00NCR", 4);
+
+enum MessageType : char {
+  kRequest = 1,
+  kAccept = 2,
+  kReject = 3,
+};
+
+constexpr size_t kHeaderSize = kMagic.size() + 1;
+constexpr size_t kRequestSize =
+    kHeaderSize + kTicketIdSize + kNonceSize + kMacSize;
+constexpr size_t kAcceptSize = kHeaderSize + kNonceSize + kMacSize;
+
+// Layout of D2DConnectionContextV1::SaveSession(): protocol version, encode
+// and decode sequence numbers (big endian), encode key, decode key.
+constexpr char kSavedSessionVersion = 1;
+
+std::string LengthPrefixed(absl::string_view value) {
+  return absl::StrCat(value.size(), ":", value);
+}
+
+std::string Header(MessageType type) {
+  return absl::StrCat(kMagic, std::string(1, type));
+}
+
+bool HasHeader(absl::string_view message, MessageType type) {
+  return message.size() >= kHeaderSize &&
+         message.substr(0, kMagic.size()) == kMagic &&
+         message[kMagic.size()] == type;
+}
+
+std::string RandomNonce() {
+  std::string nonce(kNonceSize, 0);
+  crypto::RandBytes(nonce.data(), nonce.size());
+  return nonce;
+}
+
+bool SecureEquals(absl::string_view a, absl::string_view b) {
+  return a.size() == b.size() &&
+         crypto::SecureMemEqual(a.data(), b.data(), a.size());
+}
+
+}  // namespace
+
+std::optional<ResumptionTicket> CreateResumptionTicket(
+    securegcm::D2DConnectionContextV1& context) {
+  // The session unique is a digest of both session keys that is the same on
+  // both sides, and it never leaves the device.
+  std::unique_ptr<std::string> session_unique = context.GetSessionUnique();
+  if (session_unique == nullptr || session_unique->empty()) {
+    return std::nullopt;
+  }
+  return ResumptionTicket{
+      .id = crypto::HkdfSha256(*session_unique, kHkdfSalt, kTicketIdInfo,
+                               kTicketIdSize),
+      .secret = crypto::HkdfSha256(*session_unique, kHkdfSalt,
+                                   kTicketSecretInfo, kSecretSize),
+  };
+}
+
+///////////////////////////// SessionResumptionCache ///////////////////////////
+
+SessionResumptionCache::SessionResumptionCache(absl::Duration lifetime,
+                                               int max_entries)
+    : lifetime_(lifetime), max_entries_(max_entries) {}
+
+void SessionResumptionCache::Store(const std::string& local_endpoint_id,
+                                   const std::string& remote_endpoint_id,
+                                   ResumptionTicket ticket) {
+  MutexLock lock(&mutex_);
+  if (max_entries_ <= 0) return;
+  absl::Time now = SystemClock::ElapsedRealtime();
+  RemoveExpired(now);
+
+  EndpointPair key{local_endpoint_id, remote_endpoint_id};
+  if (!entries_.contains(key) &&
+      static_cast<int>(entries_.size()) >= max_entries_) {
+    auto oldest = entries_.begin();
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+      if (it->second.expires_at < oldest->second.expires_at) oldest = it;
+    }
+    entries_.erase(oldest);
+  }
+  entries_.insert_or_assign(
+      std::move(key), Entry{.ticket = std::move(ticket),
+                            .expires_at = absl::InfiniteFuture()});
+}
+
+std::optional<ResumptionTicket> SessionResumptionCache::Take(
+    const std::string& local_endpoint_id,
+    const std::string& remote_endpoint_id) {
+  MutexLock lock(&mutex_);
+  auto node = entries_.extract(EndpointPair{local_endpoint_id,
+                                            remote_endpoint_id});
+  if (node.empty() ||
+      node.mapped().expires_at <= SystemClock::ElapsedRealtime()) {
+    return std::nullopt;
+  }
+  return std::move(node.mapped().ticket);
+}
+
+void SessionResumptionCache::StartExpiry(
+    const std::string& local_endpoint_id,
+    const std::string& remote_endpoint_id) {
+  MutexLock lock(&mutex_);
+  auto it = entries_.find(EndpointPair{local_endpoint_id, remote_endpoint_id});
+  if (it == entries_.end() || it->second.expires_at != absl::InfiniteFuture()) {
+    return;
+  }
+  it->second.expires_at = SystemClock::ElapsedRealtime() + lifetime_;
+}
+
+void SessionResumptionCache::Revoke(const std::string& local_endpoint_id,
+                                    const std::string& remote_endpoint_id) {
+  MutexLock lock(&mutex_);
+  entries_.erase(EndpointPair{local_endpoint_id, remote_endpoint_id});
+}
+
+void SessionResumptionCache::RevokeAllFor(
+    const std::string& local_endpoint_id) {
+  MutexLock lock(&mutex_);
+  absl::erase_if(entries_, [&local_endpoint_id](const auto& entry) {
+    return entry.first.first == local_endpoint_id;
+  });
+}
+
+void SessionResumptionCache::RevokeAll() {
+  MutexLock lock(&mutex_);
+  entries_.clear();
+}
+
+int SessionResumptionCache::GetSize() const {
+  MutexLock lock(&mutex_);
+  return entries_.size();
+}
+
+void SessionResumptionCache::RemoveExpired(absl::Time now) {
+  for (auto it = entries_.begin(); it != entries_.end();) {
+    if (it->second.expires_at <= now) {
+      entries_.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+}
+
+/////////////////////////////// SessionResumption //////////////////////////////
+
+SessionResumption::SessionResumption(Role role, ResumptionTicket ticket,
+                                     const std::string& client_endpoint_id,
+                                     const std::string& server_endpoint_id)
+    : role_(role),
+      ticket_(std::move(ticket)),
+      binding_(absl::StrCat(LengthPrefixed(client_endpoint_id),
+                            LengthPrefixed(server_endpoint_id),
+                            LengthPrefixed(ticket_.id))) {}
+
+bool SessionResumption::IsResumptionMessage(const ByteArray& message) {
+  absl::string_view bytes = message.AsStringView();
+  return bytes.size() >= kMagic.size() &&
+         bytes.substr(0, kMagic.size()) == kMagic;
+}
+
+bool SessionResumption::IsReject(const ByteArray& message) {
+  return HasHeader(message.AsStringView(), kReject);
+}
+
+ByteArray SessionResumption::CreateReject() {
+  return ByteArray(Header(kReject));
+}
+
+ByteArray SessionResumption::CreateRequest() {
+  client_nonce_ = RandomNonce();
+  return ByteArray(absl::StrCat(Header(kRequest), ticket_.id, client_nonce_,
+                                Derive(client_nonce_, kRequestMacInfo,
+                                       kMacSize)));
+}
+
+bool SessionResumption::ParseAccept(const ByteArray& message) {
+  absl::string_view bytes = message.AsStringView();
+  if (role_ != Role::kClient || client_nonce_.empty() ||
+      bytes.size() != kAcceptSize || !HasHeader(bytes, kAccept)) {
+    return false;
+  }
+  std::string server_nonce(bytes.substr(kHeaderSize, kNonceSize));
+  absl::string_view mac = bytes.substr(kHeaderSize + kNonceSize, kMacSize);
+  if (!SecureEquals(mac, Derive(absl::StrCat(client_nonce_, server_nonce),
+                                kAcceptMacInfo, kMacSize))) {
+    return false;
+  }
+  server_nonce_ = std::move(server_nonce);
+  return true;
+}
+
+bool SessionResumption::ParseRequest(const ByteArray& message) {
+  absl::string_view bytes = message.AsStringView();
+  if (role_ != Role::kServer || bytes.size() != kRequestSize ||
+      !HasHeader(bytes, kRequest)) {
+    return false;
+  }
+  absl::string_view ticket_id = bytes.substr(kHeaderSize, kTicketIdSize);
+  std::string client_nonce(
+      bytes.substr(kHeaderSize + kTicketIdSize, kNonceSize));
+  absl::string_view mac =
+      bytes.substr(kHeaderSize + kTicketIdSize + kNonceSize, kMacSize);
+  if (!SecureEquals(ticket_id, ticket_.id) ||
+      !SecureEquals(mac, Derive(client_nonce, kRequestMacInfo, kMacSize))) {
+    return false;
+  }
+  client_nonce_ = std::move(client_nonce);
+  return true;
+}
+
+ByteArray SessionResumption::CreateAccept() {
+  server_nonce_ = RandomNonce();
+  return ByteArray(absl::StrCat(
+      Header(kAccept), server_nonce_,
+      Derive(absl::StrCat(client_nonce_, server_nonce_), kAcceptMacInfo,
+             kMacSize)));
+}
+
+std::unique_ptr<securegcm::D2DConnectionContextV1>
+SessionResumption::CreateContext() const {
+  if (!IsComplete()) return nullptr;
+  std::string salt = absl::StrCat(client_nonce_, server_nonce_);
+  std::string client_key = Derive(salt, kClientKeyInfo, kKeySize);
+  std::string server_key = Derive(salt, kServerKeyInfo, kKeySize);
+  bool is_client = role_ == Role::kClient;
+  // Both sequence numbers start at zero, as they do after UKEY2.
+  std::string saved_session =
+      absl::StrCat(std::string(1, kSavedSessionVersion), std::string(8, 0),
+                   is_client ? client_key : server_key,
+                   is_client ? server_key : client_key);
+  return securegcm::D2DConnectionContextV1::FromSavedSession(saved_session);
+}
+
+ByteArray SessionResumption::GetRawAuthToken() const {
+  if (!IsComplete()) return {};
+  return ByteArray(Derive(absl::StrCat(client_nonce_, server_nonce_),
+                          kAuthTokenInfo, kAuthTokenSize));
+}
+
+std::string SessionResumption::Derive(const std::string& salt,
+                                      const std::string& label,
+                                      size_t size) const {
+  return crypto::HkdfSha256(ticket_.secret, salt,
+                            absl::StrCat(label, binding_), size);
+}
+
+bool SessionResumption::IsComplete() const {
+  return !client_nonce_.empty() && !server_nonce_.empty();
+}
+
+}  // namespace connections
+}  // namespace nearby
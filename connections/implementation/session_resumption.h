@@ -0,0 +1,171 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CORE_INTERNAL_SESSION_RESUMPTION_H_
+#define CORE_INTERNAL_SESSION_RESUMPTION_H_
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include "securegcm/d2d_connection_context_v1.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/time/time.h"
+#include "internal/platform/byte_array.h"
+#include "internal/platform/mutex.h"
+
+namespace nearby {
+namespace connections {
+
+// A short-lived secret shared by two endpoints that recently encrypted a
+// connection with UKEY2. Both sides derive the same ticket from the session
+// keys, so the secret itself never crosses the wire.
+struct ResumptionTicket {
+  std::string id;
+  std::string secret;
+};
+
+// Derives the ticket that both sides keep after encrypting a connection with
+// `context`. Returns std::nullopt if the context has no session keys.
+std::optional<ResumptionTicket> CreateResumptionTicket(
+    securegcm::D2DConnectionContextV1& context);
+
+// Keeps one resumption ticket per (local endpoint, remote endpoint) pair.
+//
+// A ticket is stored while its connection is up and doesn't expire until
+// StartExpiry() is called for it, once the connection is gone; from then on
+// it is good for `lifetime`. Tickets are single use: Take() removes the
+// ticket, whether or not the resumption it is used for succeeds. A resumed
+// connection stores a fresh ticket derived from its own session keys.
+class SessionResumptionCache {
+ public:
+  static constexpr absl::Duration kDefaultLifetime = absl::Seconds(60);
+  static constexpr int kDefaultMaxEntries = 32;
+
+  explicit SessionResumptionCache(absl::Duration lifetime = kDefaultLifetime,
+                                  int max_entries = kDefaultMaxEntries);
+
+  // Stores `ticket` for the endpoint pair, replacing any older one. When the
+  // cache is full, the ticket closest to expiring is dropped; tickets whose
+  // expiry hasn't started go last.
+  void Store(const std::string& local_endpoint_id,
+             const std::string& remote_endpoint_id, ResumptionTicket ticket)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Removes and returns the ticket for the endpoint pair, or std::nullopt if
+  // there is none or it has expired.
+  std::optional<ResumptionTicket> Take(const std::string& local_endpoint_id,
+                                       const std::string& remote_endpoint_id)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Starts the lifetime of the ticket for the endpoint pair, if it hasn't
+  // started yet.
+  void StartExpiry(const std::string& local_endpoint_id,
+                   const std::string& remote_endpoint_id)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Drops the ticket for the endpoint pair, if any.
+  void Revoke(const std::string& local_endpoint_id,
+              const std::string& remote_endpoint_id)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Drops every ticket of `local_endpoint_id`.
+  void RevokeAllFor(const std::string& local_endpoint_id)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Drops every ticket.
+  void RevokeAll() ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Test only.
+  int GetSize() const ABSL_LOCKS_EXCLUDED(mutex_);
+
+ private:
+  using EndpointPair = std::pair<std::string, std::string>;
+  struct Entry {
+    ResumptionTicket ticket;
+    absl::Time expires_at;
+  };
+
+  void RemoveExpired(absl::Time now) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  const absl::Duration lifetime_;
+  const int max_entries_;
+  mutable Mutex mutex_;
+  absl::flat_hash_map<EndpointPair, Entry> entries_ ABSL_GUARDED_BY(mutex_);
+};
+
+// One side of a session resumption exchange, which replaces the UKEY2
+// handshake when both sides still hold a ticket for each other.
+//
+// The client sends a request that names its ticket and carries a fresh nonce,
+// and the server answers with an accept carrying its own nonce, or a reject.
+// Both messages are authenticated with the ticket secret and bound to the two
+// endpoint ids. The session keys and the authentication token are derived
+// from the secret and both nonces, so every resumed connection gets new keys.
+//
+// All resumption messages start with a zero byte, which never starts a
+// serialized UKEY2 message, so a server can tell them apart from a UKEY2
+// ClientInit.
+class SessionResumption {
+ public:
+  enum class Role {
+    kClient,
+    kServer,
+  };
+
+  SessionResumption(Role role, ResumptionTicket ticket,
+                    const std::string& client_endpoint_id,
+                    const std::string& server_endpoint_id);
+
+  static bool IsResumptionMessage(const ByteArray& message);
+  static bool IsReject(const ByteArray& message);
+  static ByteArray CreateReject();
+
+  // Client: builds the request. Call once, before ParseAccept().
+  ByteArray CreateRequest();
+  // Client: returns true if `message` is a valid accept for our request.
+  bool ParseAccept(const ByteArray& message);
+
+  // Server: returns true if `message` is a valid request for our ticket.
+  bool ParseRequest(const ByteArray& message);
+  // Server: builds the accept. Call once, after ParseRequest() succeeds.
+  ByteArray CreateAccept();
+
+  // Returns the connection context for the resumed session, or nullptr if the
+  // exchange has not completed.
+  std::unique_ptr<securegcm::D2DConnectionContextV1> CreateContext() const;
+  // Returns the raw authentication token for the resumed session; it takes
+  // the place of the UKEY2 verification string.
+  ByteArray GetRawAuthToken() const;
+
+ private:
+  std::string Derive(const std::string& salt, const std::string& label,
+                     size_t size) const;
+  bool IsComplete() const;
+
+  const Role role_;
+  const ResumptionTicket ticket_;
+  // Length-prefixed client id, server id and ticket id. Mixed into every
+  // derivation so that a ticket is only good for its endpoint pair.
+  const std::string binding_;
+  std::string client_nonce_;
+  std::string server_nonce_;
+};
+
+}  // namespace connections
+}  // namespace nearby
+
+#endif  // CORE_INTERNAL_SESSION_RESUMPTION_H_
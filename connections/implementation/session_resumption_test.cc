@@ -0,0 +1,252 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "connections/implementation/session_resumption.h"
+
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "securegcm/d2d_connection_context_v1.h"
+#include "securegcm/ukey2_handshake.h"
+#include "gtest/gtest.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "internal/platform/byte_array.h"
+
+namespace nearby {
+namespace connections {
+namespace {
+
+using ::securegcm::D2DConnectionContextV1;
+using ::securegcm::UKey2Handshake;
+
+constexpr char kClientId[] = "ABCD";
+constexpr char kServerId[] = "WXYZ";
+
+ResumptionTicket MakeTicket(const std::string& secret = "secret") {
+  return {.id = std::string(16, 'i'), .secret = std::string(32, secret[0])};
+}
+
+struct Contexts {
+  std::unique_ptr<D2DConnectionContextV1> client;
+  std::unique_ptr<D2DConnectionContextV1> server;
+};
+
+Contexts RunUkey2() {
+  std::unique_ptr<UKey2Handshake> client = UKey2Handshake::ForInitiator(
+      UKey2Handshake::HandshakeCipher::P256_SHA512);
+  std::unique_ptr<UKey2Handshake> server = UKey2Handshake::ForResponder(
+      UKey2Handshake::HandshakeCipher::P256_SHA512);
+  server->ParseHandshakeMessage(*client->GetNextHandshakeMessage());
+  client->ParseHandshakeMessage(*server->GetNextHandshakeMessage());
+  server->ParseHandshakeMessage(*client->GetNextHandshakeMessage());
+  client->VerifyHandshake();
+  server->VerifyHandshake();
+  return {.client = client->ToConnectionContext(),
+          .server = server->ToConnectionContext()};
+}
+
+// Runs a full exchange; returns false if either side rejects it.
+bool Resume(SessionResumption& client, SessionResumption& server) {
+  return server.ParseRequest(client.CreateRequest()) &&
+         client.ParseAccept(server.CreateAccept());
+}
+
+TEST(SessionResumptionCacheTest, TakeReturnsTicketOnce) {
+  SessionResumptionCache cache;
+  cache.Store(kClientId, kServerId, MakeTicket());
+
+  std::optional<ResumptionTicket> ticket = cache.Take(kClientId, kServerId);
+
+  ASSERT_TRUE(ticket.has_value());
+  EXPECT_EQ(ticket->secret, MakeTicket().secret);
+  EXPECT_FALSE(cache.Take(kClientId, kServerId).has_value());
+}
+
+TEST(SessionResumptionCacheTest, TicketIsBoundToEndpointPair) {
+  SessionResumptionCache cache;
+  cache.Store(kClientId, kServerId, MakeTicket());
+
+  EXPECT_FALSE(cache.Take(kServerId, kClientId).has_value());
+  EXPECT_FALSE(cache.Take(kClientId, "OTHR").has_value());
+  EXPECT_TRUE(cache.Take(kClientId, kServerId).has_value());
+}
+
+TEST(SessionResumptionCacheTest, TicketDoesNotExpireWhileSessionIsUp) {
+  SessionResumptionCache cache(absl::Milliseconds(10));
+  cache.Store(kClientId, kServerId, MakeTicket());
+
+  absl::SleepFor(absl::Milliseconds(50));
+
+  EXPECT_TRUE(cache.Take(kClientId, kServerId).has_value());
+}
+
+TEST(SessionResumptionCacheTest, TicketExpiresAfterSessionEnds) {
+  SessionResumptionCache cache(absl::Milliseconds(10));
+  cache.Store(kClientId, kServerId, MakeTicket());
+
+  cache.StartExpiry(kClientId, kServerId);
+  absl::SleepFor(absl::Milliseconds(50));
+
+  EXPECT_FALSE(cache.Take(kClientId, kServerId).has_value());
+}
+
+TEST(SessionResumptionCacheTest, RevokeDropsTicket) {
+  SessionResumptionCache cache;
+  cache.Store(kClientId, kServerId, MakeTicket());
+  cache.Store(kClientId, "OTHR", MakeTicket());
+
+  cache.Revoke(kClientId, kServerId);
+
+  EXPECT_FALSE(cache.Take(kClientId, kServerId).has_value());
+  EXPECT_EQ(cache.GetSize(), 1);
+  cache.RevokeAll();
+  EXPECT_EQ(cache.GetSize(), 0);
+}
+
+TEST(SessionResumptionCacheTest, RevokeAllForDropsOnlyThatLocalEndpoint) {
+  SessionResumptionCache cache;
+  cache.Store(kClientId, kServerId, MakeTicket());
+  cache.Store(kClientId, "OTHR", MakeTicket());
+  cache.Store(kServerId, kClientId, MakeTicket());
+
+  cache.RevokeAllFor(kClientId);
+
+  EXPECT_EQ(cache.GetSize(), 1);
+  EXPECT_TRUE(cache.Take(kServerId, kClientId).has_value());
+}
+
+TEST(SessionResumptionCacheTest, FullCacheDropsTicketClosestToExpiring) {
+  SessionResumptionCache cache(SessionResumptionCache::kDefaultLifetime,
+                               /*max_entries=*/2);
+  cache.Store(kClientId, "AAAA", MakeTicket());
+  cache.Store(kClientId, "BBBB", MakeTicket());
+  cache.StartExpiry(kClientId, "BBBB");
+  cache.Store(kClientId, "CCCC", MakeTicket());
+
+  EXPECT_EQ(cache.GetSize(), 2);
+  EXPECT_TRUE(cache.Take(kClientId, "AAAA").has_value());
+  EXPECT_FALSE(cache.Take(kClientId, "BBBB").has_value());
+  EXPECT_TRUE(cache.Take(kClientId, "CCCC").has_value());
+}
+
+TEST(SessionResumptionTest, BothSidesOfHandshakeDeriveSameTicket) {
+  Contexts contexts = RunUkey2();
+  ASSERT_NE(contexts.client, nullptr);
+  ASSERT_NE(contexts.server, nullptr);
+
+  std::optional<ResumptionTicket> client_ticket =
+      CreateResumptionTicket(*contexts.client);
+  std::optional<ResumptionTicket> server_ticket =
+      CreateResumptionTicket(*contexts.server);
+
+  ASSERT_TRUE(client_ticket.has_value());
+  ASSERT_TRUE(server_ticket.has_value());
+  EXPECT_EQ(client_ticket->id, server_ticket->id);
+  EXPECT_EQ(client_ticket->secret, server_ticket->secret);
+}
+
+TEST(SessionResumptionTest, ResumedSessionsCanTalk) {
+  SessionResumption client(SessionResumption::Role::kClient, MakeTicket(),
+                           kClientId, kServerId);
+  SessionResumption server(SessionResumption::Role::kServer, MakeTicket(),
+                           kClientId, kServerId);
+  ASSERT_TRUE(Resume(client, server));
+
+  std::unique_ptr<D2DConnectionContextV1> client_context =
+      client.CreateContext();
+  std::unique_ptr<D2DConnectionContextV1> server_context =
+      server.CreateContext();
+  ASSERT_NE(client_context, nullptr);
+  ASSERT_NE(server_context, nullptr);
+
+  std::unique_ptr<std::string> to_server =
+      client_context->EncodeMessageToPeer("ping");
+  std::unique_ptr<std::string> to_client =
+      server_context->EncodeMessageToPeer("pong");
+  ASSERT_NE(to_server, nullptr);
+  ASSERT_NE(to_client, nullptr);
+  EXPECT_EQ(*server_context->DecodeMessageFromPeer(*to_server), "ping");
+  EXPECT_EQ(*client_context->DecodeMessageFromPeer(*to_client), "pong");
+  EXPECT_EQ(client.GetRawAuthToken(), server.GetRawAuthToken());
+  EXPECT_FALSE(client.GetRawAuthToken().Empty());
+}
+
+TEST(SessionResumptionTest, EveryResumptionGetsNewKeys) {
+  SessionResumption first_client(SessionResumption::Role::kClient,
+                                 MakeTicket(), kClientId, kServerId);
+  SessionResumption first_server(SessionResumption::Role::kServer,
+                                 MakeTicket(), kClientId, kServerId);
+  SessionResumption second_client(SessionResumption::Role::kClient,
+                                  MakeTicket(), kClientId, kServerId);
+  SessionResumption second_server(SessionResumption::Role::kServer,
+                                  MakeTicket(), kClientId, kServerId);
+  ASSERT_TRUE(Resume(first_client, first_server));
+  ASSERT_TRUE(Resume(second_client, second_server));
+
+  EXPECT_NE(first_client.GetRawAuthToken(), second_client.GetRawAuthToken());
+  EXPECT_NE(*first_client.CreateContext()->GetSessionUnique(),
+            *second_client.CreateContext()->GetSessionUnique());
+}
+
+TEST(SessionResumptionTest, ServerRejectsWrongSecret) {
+  SessionResumption client(SessionResumption::Role::kClient,
+                           MakeTicket("a"), kClientId, kServerId);
+  SessionResumption server(SessionResumption::Role::kServer,
+                           MakeTicket("b"), kClientId, kServerId);
+
+  EXPECT_FALSE(server.ParseRequest(client.CreateRequest()));
+  EXPECT_EQ(server.CreateContext(), nullptr);
+}
+
+TEST(SessionResumptionTest, ServerRejectsOtherEndpointPair) {
+  SessionResumption client(SessionResumption::Role::kClient, MakeTicket(),
+                           kClientId, kServerId);
+  SessionResumption server(SessionResumption::Role::kServer, MakeTicket(),
+                           "OTHR", kServerId);
+
+  EXPECT_FALSE(server.ParseRequest(client.CreateRequest()));
+}
+
+TEST(SessionResumptionTest, ClientRejectsTamperedAccept) {
+  SessionResumption client(SessionResumption::Role::kClient, MakeTicket(),
+                           kClientId, kServerId);
+  SessionResumption server(SessionResumption::Role::kServer, MakeTicket(),
+                           kClientId, kServerId);
+  ASSERT_TRUE(server.ParseRequest(client.CreateRequest()));
+  std::string accept(server.CreateAccept());
+  accept.back() ^= 1;
+
+  EXPECT_FALSE(client.ParseAccept(ByteArray(accept)));
+  EXPECT_EQ(client.CreateContext(), nullptr);
+}
+
+TEST(SessionResumptionTest, RecognizesResumptionMessages) {
+  SessionResumption client(SessionResumption::Role::kClient, MakeTicket(),
+                           kClientId, kServerId);
+  std::unique_ptr<UKey2Handshake> ukey2 = UKey2Handshake::ForInitiator(
+      UKey2Handshake::HandshakeCipher::P256_SHA512);
+
+  EXPECT_TRUE(SessionResumption::IsResumptionMessage(client.CreateRequest()));
+  EXPECT_TRUE(
+      SessionResumption::IsResumptionMessage(SessionResumption::CreateReject()));
+  EXPECT_TRUE(SessionResumption::IsReject(SessionResumption::CreateReject()));
+  EXPECT_FALSE(SessionResumption::IsResumptionMessage(
+      ByteArray(*ukey2->GetNextHandshakeMessage())));
+}
+
+}  // namespace
+}  // namespace connections
+}  // namespace nearby
@@ -0,0 +1,154 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "connections/implementation/stream_memory_budget.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "internal/platform/logging.h"
+
+namespace nearby {
+namespace connections {
+
+StreamMemoryBudget::Stream::Stream(StreamMemoryBudget* budget)
+    : budget_(budget) {
+  absl::MutexLock lock(&budget_->mutex_);
+  budget_->stats_.streams++;
+}
+
+StreamMemoryBudget::Stream::~Stream() {
+  absl::MutexLock lock(&budget_->mutex_);
+  budget_->ReleaseLocked(*this, buffered_bytes_);
+  budget_->stats_.streams--;
+}
+
+bool StreamMemoryBudget::Stream::Acquire(std::int64_t size) {
+  absl::MutexLock lock(&budget_->mutex_);
+  const absl::Time deadline = absl::Now() + budget_->max_wait_;
+  bool throttled = false;
+  while (!writer_closed_ && !reader_closed_ &&
+         !budget_->FitsLocked(*this, size)) {
+    if (!throttled) {
+      budget_->stats_.throttled_chunks++;
+      throttled = true;
+    }
+    // Keep waiting as long as the client reads something every `max_stall`,
+    // but not past `max_wait` in total.
+    absl::Duration timeout =
+        std::min(budget_->max_stall_, deadline - absl::Now());
+    std::int64_t released_bytes = released_bytes_;
+    auto progress = [this, released_bytes, size]() {
+      budget_->mutex_.AssertHeld();
+      return writer_closed_ || reader_closed_ ||
+             released_bytes_ != released_bytes ||
+             budget_->FitsLocked(*this, size);
+    };
+    if (timeout <= absl::ZeroDuration() ||
+        !budget_->mutex_.AwaitWithTimeout(absl::Condition(&progress),
+                                          timeout)) {
+      if (absl::Now() < deadline) {
+        NEARBY_LOGS(WARNING)
+            << "Incoming stream " << this << " not read for "
+            << budget_->max_stall_ << " with " << buffered_bytes_
+            << " bytes buffered, failing it.";
+      } else {
+        NEARBY_LOGS(WARNING)
+            << "Incoming stream " << this << " read too slowly to take "
+            << size << " more bytes within " << budget_->max_wait_ << " with "
+            << buffered_bytes_ << " bytes buffered, failing it.";
+      }
+      budget_->stats_.stalled_streams++;
+      return false;
+    }
+  }
+  if (writer_closed_ || reader_closed_) return false;
+
+  buffered_bytes_ += size;
+  Stats& stats = budget_->stats_;
+  stats.buffered_bytes += size;
+  stats.peak_buffered_bytes =
+      std::max(stats.peak_buffered_bytes, stats.buffered_bytes);
+  return true;
+}
+
+void StreamMemoryBudget::Stream::Release(std::int64_t size) {
+  absl::MutexLock lock(&budget_->mutex_);
+  budget_->ReleaseLocked(*this, size);
+}
+
+void StreamMemoryBudget::Stream::CloseWriter() {
+  absl::MutexLock lock(&budget_->mutex_);
+  writer_closed_ = true;
+}
+
+void StreamMemoryBudget::Stream::CloseReader() {
+  absl::MutexLock lock(&budget_->mutex_);
+  reader_closed_ = true;
+  budget_->ReleaseLocked(*this, buffered_bytes_);
+}
+
+std::int64_t StreamMemoryBudget::Stream::GetBufferedBytes() const {
+  absl::MutexLock lock(&budget_->mutex_);
+  return buffered_bytes_;
+}
+
+StreamMemoryBudget& StreamMemoryBudget::GetInstance() {
+  static std::aligned_storage_t<sizeof(StreamMemoryBudget),
+                                alignof(StreamMemoryBudget)>
+      storage;
+  static StreamMemoryBudget* instance = new (&storage) StreamMemoryBudget();
+  return *instance;
+}
+
+StreamMemoryBudget::StreamMemoryBudget(std::int64_t max_bytes_per_stream,
+                                       std::int64_t max_bytes,
+                                       absl::Duration max_stall,
+                                       absl::Duration max_wait)
+    : max_bytes_per_stream_(max_bytes_per_stream),
+      max_bytes_(max_bytes),
+      max_stall_(max_stall),
+      max_wait_(max_wait) {}
+
+std::shared_ptr<StreamMemoryBudget::Stream> StreamMemoryBudget::OpenStream() {
+  return std::make_shared<Stream>(this);
+}
+
+StreamMemoryBudget::Stats StreamMemoryBudget::GetStats() const {
+  absl::MutexLock lock(&mutex_);
+  return stats_;
+}
+
+bool StreamMemoryBudget::FitsLocked(const Stream& stream,
+                                    std::int64_t size) const {
+  if (stream.buffered_bytes_ == 0) return true;
+  return stream.buffered_bytes_ + size <= max_bytes_per_stream_ &&
+         stats_.buffered_bytes + size <= max_bytes_;
+}
+
+void StreamMemoryBudget::ReleaseLocked(Stream& stream, std::int64_t size) {
+  size = std::min(size, stream.buffered_bytes_);
+  stream.buffered_bytes_ -= size;
+  stream.released_bytes_ += size;
+  stats_.buffered_bytes -= size;
+}
+
+}  // namespace connections
+}  // namespace nearby
@@ -0,0 +1,137 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CORE_INTERNAL_STREAM_MEMORY_BUDGET_H_
+#define CORE_INTERNAL_STREAM_MEMORY_BUDGET_H_
+
+#include <cstdint>
+#include <memory>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+
+namespace nearby {
+namespace connections {
+
+// Bounds the memory held by incoming stream payloads, i.e. the chunks received
+// from the remote endpoint that the client has not read from the payload's
+// InputStream yet.
+//
+// Each stream may buffer up to `max_bytes_per_stream`, and all streams
+// together up to `max_bytes`. A stream with nothing buffered may always take
+// one more chunk, so a stream whose client keeps reading is never held up by
+// the others. Taking a chunk past the budget waits for the client to read;
+// since chunks are received on the endpoint's reader thread, this stops
+// reading from the medium and the sender gets throttled by the medium's own
+// flow control. A stream whose client reads nothing for `max_stall` is failed
+// rather than allowed to block the reader thread for good.
+//
+// While Acquire() waits, the reader thread reads no frames, KeepAlive frames
+// included, and the endpoint is dropped once nothing was read for its
+// keep-alive timeout (30s by default). So a chunk never waits longer than
+// `max_wait` in total, even if the client keeps reading a little: a stream
+// whose client can't make room for one chunk within `max_wait` is failed too.
+class StreamMemoryBudget {
+ public:
+  static constexpr std::int64_t kDefaultMaxBytesPerStream = 4 * 1024 * 1024;
+  static constexpr std::int64_t kDefaultMaxBytes = 32 * 1024 * 1024;
+  static constexpr absl::Duration kDefaultMaxStall = absl::Seconds(5);
+  static constexpr absl::Duration kDefaultMaxWait = absl::Seconds(10);
+
+  struct Stats {
+    // Bytes received but not read by the client yet, over all streams.
+    std::int64_t buffered_bytes = 0;
+    // The highest `buffered_bytes` seen.
+    std::int64_t peak_buffered_bytes = 0;
+    // Incoming streams currently open.
+    int streams = 0;
+    // Chunks that had to wait for the client to read.
+    std::int64_t throttled_chunks = 0;
+    // Streams failed because their client stopped reading, or read too slowly
+    // to make room for a chunk within `max_wait`.
+    std::int64_t stalled_streams = 0;
+  };
+
+  // The share of the budget used by one incoming stream. The receiving side
+  // calls Acquire() before writing a chunk to the stream and CloseWriter()
+  // once it won't write any more; the client's side calls Release() for the
+  // bytes it read and CloseReader() when it goes away.
+  class Stream {
+   public:
+    explicit Stream(StreamMemoryBudget* budget);
+    ~Stream();
+
+    Stream(const Stream&) = delete;
+    Stream& operator=(const Stream&) = delete;
+
+    // Waits until `size` more bytes fit the budget. Returns false if either
+    // side was closed, the client read nothing for `max_stall`, or the bytes
+    // still didn't fit after `max_wait`; the chunk must not be written then.
+    bool Acquire(std::int64_t size);
+    void Release(std::int64_t size);
+    // Wakes up Acquire(). Bytes already buffered stay accounted for until the
+    // client reads them.
+    void CloseWriter();
+    // Returns all buffered bytes to the budget and wakes up Acquire().
+    void CloseReader();
+
+    std::int64_t GetBufferedBytes() const;
+
+   private:
+    friend class StreamMemoryBudget;
+
+    StreamMemoryBudget* const budget_;
+    std::int64_t buffered_bytes_ ABSL_GUARDED_BY(budget_->mutex_) = 0;
+    // Total bytes released, to tell whether the client is still reading.
+    std::int64_t released_bytes_ ABSL_GUARDED_BY(budget_->mutex_) = 0;
+    bool writer_closed_ ABSL_GUARDED_BY(budget_->mutex_) = false;
+    bool reader_closed_ ABSL_GUARDED_BY(budget_->mutex_) = false;
+  };
+
+  static StreamMemoryBudget& GetInstance();
+
+  explicit StreamMemoryBudget(
+      std::int64_t max_bytes_per_stream = kDefaultMaxBytesPerStream,
+      std::int64_t max_bytes = kDefaultMaxBytes,
+      absl::Duration max_stall = kDefaultMaxStall,
+      absl::Duration max_wait = kDefaultMaxWait);
+  StreamMemoryBudget(const StreamMemoryBudget&) = delete;
+  StreamMemoryBudget& operator=(const StreamMemoryBudget&) = delete;
+
+  // Opens the account of a new incoming stream. Streams must not outlive the
+  // budget.
+  std::shared_ptr<Stream> OpenStream() ABSL_LOCKS_EXCLUDED(mutex_);
+
+  Stats GetStats() const ABSL_LOCKS_EXCLUDED(mutex_);
+
+ private:
+  bool FitsLocked(const Stream& stream, std::int64_t size) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void ReleaseLocked(Stream& stream, std::int64_t size)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  const std::int64_t max_bytes_per_stream_;
+  const std::int64_t max_bytes_;
+  const absl::Duration max_stall_;
+  const absl::Duration max_wait_;
+
+  mutable absl::Mutex mutex_;
+  Stats stats_ ABSL_GUARDED_BY(mutex_);
+};
+
+}  // namespace connections
+}  // namespace nearby
+
+#endif  // CORE_INTERNAL_STREAM_MEMORY_BUDGET_H_
@@ -0,0 +1,186 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "connections/implementation/stream_memory_budget.h"
+
+#include <cstdint>
+#include <memory>
+#include <thread>  // NOLINT
+
+#include "gtest/gtest.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+
+namespace nearby {
+namespace connections {
+namespace {
+
+constexpr std::int64_t kChunkSize = 100;
+constexpr absl::Duration kWaitTime = absl::Milliseconds(100);
+
+TEST(StreamMemoryBudgetTest, AcquireWithinBudgetDoesNotWait) {
+  StreamMemoryBudget budget(/*max_bytes_per_stream=*/2 * kChunkSize,
+                            /*max_bytes=*/4 * kChunkSize);
+  std::shared_ptr<StreamMemoryBudget::Stream> stream = budget.OpenStream();
+
+  EXPECT_TRUE(stream->Acquire(kChunkSize));
+  EXPECT_TRUE(stream->Acquire(kChunkSize));
+
+  StreamMemoryBudget::Stats stats = budget.GetStats();
+  EXPECT_EQ(stream->GetBufferedBytes(), 2 * kChunkSize);
+  EXPECT_EQ(stats.buffered_bytes, 2 * kChunkSize);
+  EXPECT_EQ(stats.peak_buffered_bytes, 2 * kChunkSize);
+  EXPECT_EQ(stats.streams, 1);
+  EXPECT_EQ(stats.throttled_chunks, 0);
+}
+
+TEST(StreamMemoryBudgetTest, EmptyStreamTakesChunkLargerThanBudget) {
+  StreamMemoryBudget budget(/*max_bytes_per_stream=*/kChunkSize,
+                            /*max_bytes=*/kChunkSize);
+  std::shared_ptr<StreamMemoryBudget::Stream> stream = budget.OpenStream();
+
+  EXPECT_TRUE(stream->Acquire(3 * kChunkSize));
+}
+
+TEST(StreamMemoryBudgetTest, AcquireWaitsForClientToRead) {
+  StreamMemoryBudget budget(/*max_bytes_per_stream=*/kChunkSize,
+                            /*max_bytes=*/4 * kChunkSize);
+  std::shared_ptr<StreamMemoryBudget::Stream> stream = budget.OpenStream();
+  ASSERT_TRUE(stream->Acquire(kChunkSize));
+
+  absl::Notification acquired;
+  std::thread writer([&]() {
+    EXPECT_TRUE(stream->Acquire(kChunkSize));
+    acquired.Notify();
+  });
+  EXPECT_FALSE(acquired.WaitForNotificationWithTimeout(kWaitTime));
+
+  stream->Release(kChunkSize);
+
+  EXPECT_TRUE(acquired.WaitForNotificationWithTimeout(absl::Seconds(5)));
+  writer.join();
+  EXPECT_EQ(budget.GetStats().throttled_chunks, 1);
+  EXPECT_EQ(stream->GetBufferedBytes(), kChunkSize);
+}
+
+TEST(StreamMemoryBudgetTest, TotalBudgetIsSharedByStreams) {
+  StreamMemoryBudget budget(/*max_bytes_per_stream=*/4 * kChunkSize,
+                            /*max_bytes=*/2 * kChunkSize);
+  std::shared_ptr<StreamMemoryBudget::Stream> stream_1 = budget.OpenStream();
+  std::shared_ptr<StreamMemoryBudget::Stream> stream_2 = budget.OpenStream();
+  ASSERT_TRUE(stream_1->Acquire(kChunkSize));
+  ASSERT_TRUE(stream_2->Acquire(kChunkSize));
+
+  absl::Notification acquired;
+  std::thread writer([&]() {
+    EXPECT_TRUE(stream_2->Acquire(kChunkSize));
+    acquired.Notify();
+  });
+  EXPECT_FALSE(acquired.WaitForNotificationWithTimeout(kWaitTime));
+
+  // Another stream going away makes room too.
+  stream_1->CloseReader();
+
+  EXPECT_TRUE(acquired.WaitForNotificationWithTimeout(absl::Seconds(5)));
+  writer.join();
+  EXPECT_EQ(budget.GetStats().buffered_bytes, 2 * kChunkSize);
+}
+
+TEST(StreamMemoryBudgetTest, AcquireFailsWhenClientStopsReading) {
+  StreamMemoryBudget budget(/*max_bytes_per_stream=*/kChunkSize,
+                            /*max_bytes=*/4 * kChunkSize,
+                            /*max_stall=*/kWaitTime);
+  std::shared_ptr<StreamMemoryBudget::Stream> stream = budget.OpenStream();
+  ASSERT_TRUE(stream->Acquire(kChunkSize));
+
+  absl::Time start = absl::Now();
+  EXPECT_FALSE(stream->Acquire(kChunkSize));
+
+  EXPECT_GE(absl::Now() - start, kWaitTime);
+  EXPECT_EQ(budget.GetStats().stalled_streams, 1);
+  EXPECT_EQ(stream->GetBufferedBytes(), kChunkSize);
+}
+
+TEST(StreamMemoryBudgetTest, AcquireFailsWhenClientReadsTooSlowly) {
+  const absl::Duration kMaxWait = 5 * kWaitTime;
+  StreamMemoryBudget budget(/*max_bytes_per_stream=*/kChunkSize,
+                            /*max_bytes=*/4 * kChunkSize,
+                            /*max_stall=*/2 * kWaitTime,
+                            /*max_wait=*/kMaxWait);
+  std::shared_ptr<StreamMemoryBudget::Stream> stream = budget.OpenStream();
+  ASSERT_TRUE(stream->Acquire(kChunkSize));
+
+  // The client keeps reading, one byte at a time, well within `max_stall`.
+  absl::Notification done;
+  std::thread reader([&]() {
+    while (!done.WaitForNotificationWithTimeout(kWaitTime / 2)) {
+      stream->Release(1);
+    }
+  });
+  absl::Time start = absl::Now();
+  bool acquired = stream->Acquire(kChunkSize);
+  absl::Duration waited = absl::Now() - start;
+  done.Notify();
+  reader.join();
+
+  // The reader thread must not be held for longer than `max_wait`, or the
+  // endpoint's keep-alive timeout would drop the connection.
+  EXPECT_FALSE(acquired);
+  EXPECT_GE(waited, kMaxWait);
+  EXPECT_LT(waited, kMaxWait + 2 * kWaitTime);
+  EXPECT_EQ(budget.GetStats().stalled_streams, 1);
+}
+
+TEST(StreamMemoryBudgetTest, CloseWriterWakesUpAcquire) {
+  StreamMemoryBudget budget(/*max_bytes_per_stream=*/kChunkSize,
+                            /*max_bytes=*/4 * kChunkSize);
+  std::shared_ptr<StreamMemoryBudget::Stream> stream = budget.OpenStream();
+  ASSERT_TRUE(stream->Acquire(kChunkSize));
+
+  absl::Notification failed;
+  std::thread writer([&]() {
+    EXPECT_FALSE(stream->Acquire(kChunkSize));
+    failed.Notify();
+  });
+  EXPECT_FALSE(failed.WaitForNotificationWithTimeout(kWaitTime));
+
+  stream->CloseWriter();
+
+  EXPECT_TRUE(failed.WaitForNotificationWithTimeout(absl::Seconds(5)));
+  writer.join();
+  // The client can still read what was buffered.
+  EXPECT_EQ(stream->GetBufferedBytes(), kChunkSize);
+}
+
+TEST(StreamMemoryBudgetTest, ClosedStreamsReturnTheirBytes) {
+  StreamMemoryBudget budget;
+  std::shared_ptr<StreamMemoryBudget::Stream> stream_1 = budget.OpenStream();
+  std::shared_ptr<StreamMemoryBudget::Stream> stream_2 = budget.OpenStream();
+  ASSERT_TRUE(stream_1->Acquire(kChunkSize));
+  ASSERT_TRUE(stream_2->Acquire(kChunkSize));
+
+  stream_1->CloseReader();
+  EXPECT_FALSE(stream_1->Acquire(kChunkSize));
+  stream_2.reset();
+
+  StreamMemoryBudget::Stats stats = budget.GetStats();
+  EXPECT_EQ(stats.buffered_bytes, 0);
+  EXPECT_EQ(stats.peak_buffered_bytes, 2 * kChunkSize);
+  EXPECT_EQ(stats.streams, 1);
+}
+
+}  // namespace
+}  // namespace connections
+}  // namespace nearby
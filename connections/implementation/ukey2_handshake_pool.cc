@@ -0,0 +1,103 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "connections/implementation/ukey2_handshake_pool.h"
+
+#include <memory>
+#include <utility>
+
+#include "securegcm/ukey2_handshake.h"
+#include "internal/platform/logging.h"
+#include "internal/platform/mutex_lock.h"
+
+namespace nearby {
+namespace connections {
+
+Ukey2HandshakePool::Ukey2HandshakePool(int size) : size_(size) {
+  MutexLock lock(&mutex_);
+  ScheduleRefill();
+}
+
+Ukey2HandshakePool::~Ukey2HandshakePool() { executor_.Shutdown(); }
+
+std::unique_ptr<securegcm::UKey2Handshake> Ukey2HandshakePool::TakeInitiator() {
+  return Take(/*initiator=*/true);
+}
+
+std::unique_ptr<securegcm::UKey2Handshake> Ukey2HandshakePool::TakeResponder() {
+  return Take(/*initiator=*/false);
+}
+
+int Ukey2HandshakePool::GetReadyCount() const {
+  MutexLock lock(&mutex_);
+  return initiators_.size() + responders_.size();
+}
+
+std::unique_ptr<securegcm::UKey2Handshake> Ukey2HandshakePool::Take(
+    bool initiator) {
+  {
+    MutexLock lock(&mutex_);
+    Handshakes& handshakes = initiator ? initiators_ : responders_;
+    if (!handshakes.empty()) {
+      std::unique_ptr<securegcm::UKey2Handshake> handshake =
+          std::move(handshakes.front());
+      handshakes.pop_front();
+      ScheduleRefill();
+      return handshake;
+    }
+    ScheduleRefill();
+  }
+  NEARBY_LOGS(INFO) << "No UKEY2 handshake ready; creating one inline.";
+  return initiator ? securegcm::UKey2Handshake::ForInitiator(kCipher)
+                   : securegcm::UKey2Handshake::ForResponder(kCipher);
+}
+
+void Ukey2HandshakePool::ScheduleRefill() {
+  if (size_ <= 0 || refill_scheduled_) return;
+  refill_scheduled_ = true;
+  executor_.Execute("ukey2-handshake-pool", [this]() { Refill(); });
+}
+
+void Ukey2HandshakePool::Refill() {
+  while (true) {
+    bool initiator;
+    {
+      MutexLock lock(&mutex_);
+      if (static_cast<int>(initiators_.size()) < size_) {
+        initiator = true;
+      } else if (static_cast<int>(responders_.size()) < size_) {
+        initiator = false;
+      } else {
+        refill_scheduled_ = false;
+        return;
+      }
+    }
+
+    // Generating the key pair is the expensive part, so don't hold the lock.
+    std::unique_ptr<securegcm::UKey2Handshake> handshake =
+        initiator ? securegcm::UKey2Handshake::ForInitiator(kCipher)
+                  : securegcm::UKey2Handshake::ForResponder(kCipher);
+
+    MutexLock lock(&mutex_);
+    if (handshake == nullptr) {
+      NEARBY_LOGS(WARNING) << "Failed to create a UKEY2 handshake for the pool.";
+      refill_scheduled_ = false;
+      return;
+    }
+    (initiator ? initiators_ : responders_).push_back(std::move(handshake));
+  }
+}
+
+}  // namespace connections
+}  // namespace nearby
@@ -0,0 +1,79 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CORE_INTERNAL_UKEY2_HANDSHAKE_POOL_H_
+#define CORE_INTERNAL_UKEY2_HANDSHAKE_POOL_H_
+
+#include <deque>
+#include <memory>
+
+#include "securegcm/ukey2_handshake.h"
+#include "absl/base/thread_annotations.h"
+#include "internal/platform/mutex.h"
+#include "internal/platform/single_thread_executor.h"
+
+namespace nearby {
+namespace connections {
+
+// Keeps unused UKEY2 handshakes ready for EncryptionRunner, so that new
+// connections don't pay for ephemeral key generation on the connection setup
+// path.
+//
+// Creating a UKey2Handshake generates its P-256 key pair, so the pool creates
+// handshakes on a background thread and hands each one out exactly once. Every
+// connection still gets its own single-use key pair, which keeps forward
+// secrecy. When the pool is empty, a handshake is created inline as before.
+class Ukey2HandshakePool {
+ public:
+  static constexpr securegcm::UKey2Handshake::HandshakeCipher kCipher =
+      securegcm::UKey2Handshake::HandshakeCipher::P256_SHA512;
+  static constexpr int kDefaultSize = 1;
+
+  // Keeps up to `size` handshakes of each role ready. Starts filling the pool
+  // right away.
+  explicit Ukey2HandshakePool(int size = kDefaultSize);
+  ~Ukey2HandshakePool();
+  Ukey2HandshakePool(const Ukey2HandshakePool&) = delete;
+  Ukey2HandshakePool& operator=(const Ukey2HandshakePool&) = delete;
+
+  // Returns a handshake that has not been used, or nullptr if UKEY2 failed to
+  // create one.
+  std::unique_ptr<securegcm::UKey2Handshake> TakeInitiator()
+      ABSL_LOCKS_EXCLUDED(mutex_);
+  std::unique_ptr<securegcm::UKey2Handshake> TakeResponder()
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Test only.
+  int GetReadyCount() const ABSL_LOCKS_EXCLUDED(mutex_);
+
+ private:
+  using Handshakes = std::deque<std::unique_ptr<securegcm::UKey2Handshake>>;
+
+  std::unique_ptr<securegcm::UKey2Handshake> Take(bool initiator)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+  void ScheduleRefill() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void Refill() ABSL_LOCKS_EXCLUDED(mutex_);
+
+  const int size_;
+  mutable Mutex mutex_;
+  Handshakes initiators_ ABSL_GUARDED_BY(mutex_);
+  Handshakes responders_ ABSL_GUARDED_BY(mutex_);
+  bool refill_scheduled_ ABSL_GUARDED_BY(mutex_) = false;
+  SingleThreadExecutor executor_;
+};
+
+}  // namespace connections
+}  // namespace nearby
+
+#endif  // CORE_INTERNAL_UKEY2_HANDSHAKE_POOL_H_
@@ -0,0 +1,113 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "connections/implementation/ukey2_handshake_pool.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "securegcm/ukey2_handshake.h"
+#include "gtest/gtest.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+
+namespace nearby {
+namespace connections {
+namespace {
+
+constexpr int kVerificationStringLength = 32;
+
+bool WaitForReadyCount(const Ukey2HandshakePool& pool, int count) {
+  absl::Time deadline = absl::Now() + absl::Seconds(5);
+  while (pool.GetReadyCount() < count) {
+    if (absl::Now() > deadline) return false;
+    absl::SleepFor(absl::Milliseconds(10));
+  }
+  return true;
+}
+
+TEST(Ukey2HandshakePoolTest, FillsInBackground) {
+  Ukey2HandshakePool pool(2);
+
+  EXPECT_TRUE(WaitForReadyCount(pool, 4));
+}
+
+TEST(Ukey2HandshakePoolTest, RefillsAfterTake) {
+  Ukey2HandshakePool pool(1);
+  ASSERT_TRUE(WaitForReadyCount(pool, 2));
+
+  EXPECT_NE(pool.TakeInitiator(), nullptr);
+  EXPECT_NE(pool.TakeResponder(), nullptr);
+
+  EXPECT_TRUE(WaitForReadyCount(pool, 2));
+}
+
+TEST(Ukey2HandshakePoolTest, PooledHandshakesCompleteHandshake) {
+  Ukey2HandshakePool pool(1);
+  ASSERT_TRUE(WaitForReadyCount(pool, 2));
+  std::unique_ptr<securegcm::UKey2Handshake> client = pool.TakeInitiator();
+  std::unique_ptr<securegcm::UKey2Handshake> server = pool.TakeResponder();
+  ASSERT_NE(client, nullptr);
+  ASSERT_NE(server, nullptr);
+
+  std::unique_ptr<std::string> client_init = client->GetNextHandshakeMessage();
+  ASSERT_NE(client_init, nullptr);
+  ASSERT_TRUE(server->ParseHandshakeMessage(*client_init).success);
+  std::unique_ptr<std::string> server_init = server->GetNextHandshakeMessage();
+  ASSERT_NE(server_init, nullptr);
+  ASSERT_TRUE(client->ParseHandshakeMessage(*server_init).success);
+  std::unique_ptr<std::string> client_finish =
+      client->GetNextHandshakeMessage();
+  ASSERT_NE(client_finish, nullptr);
+  ASSERT_TRUE(server->ParseHandshakeMessage(*client_finish).success);
+
+  std::unique_ptr<std::string> client_token =
+      client->GetVerificationString(kVerificationStringLength);
+  std::unique_ptr<std::string> server_token =
+      server->GetVerificationString(kVerificationStringLength);
+  ASSERT_NE(client_token, nullptr);
+  ASSERT_NE(server_token, nullptr);
+  EXPECT_EQ(*client_token, *server_token);
+}
+
+TEST(Ukey2HandshakePoolTest, EveryHandshakeIsHandedOutOnce) {
+  constexpr int kTakes = 5;
+  Ukey2HandshakePool pool(1);
+  std::vector<std::unique_ptr<securegcm::UKey2Handshake>> taken;
+  absl::flat_hash_set<securegcm::UKey2Handshake*> distinct;
+
+  // Takes more than the pool holds, so some come from the pool and some are
+  // created inline.
+  for (int i = 0; i < kTakes; ++i) {
+    taken.push_back(pool.TakeInitiator());
+    ASSERT_NE(taken.back(), nullptr);
+    distinct.insert(taken.back().get());
+  }
+
+  EXPECT_EQ(static_cast<int>(distinct.size()), kTakes);
+}
+
+TEST(Ukey2HandshakePoolTest, EmptyPoolCreatesInline) {
+  Ukey2HandshakePool pool(0);
+
+  EXPECT_NE(pool.TakeInitiator(), nullptr);
+  EXPECT_NE(pool.TakeResponder(), nullptr);
+  EXPECT_EQ(pool.GetReadyCount(), 0);
+}
+
+}  // namespace
+}  // namespace connections
+}  // namespace nearby
@@ -19,6 +19,7 @@
 #include <functional>
 #include <memory>
 #include <string>
+#include <vector>
 
 // This file defines all the protocol listeners and their parameter structures.
 // Listeners are defined as collections of std::function<T> instances, which is
@@ -130,6 +131,21 @@ struct ConnectionListener {
       bandwidth_changed_cb = [](const std::string&, Medium) {};
 };
 
+// A remote endpoint that was found or lost, as delivered in batches to
+// DiscoveryListener::endpoints_changed_cb.
+struct DiscoveryEvent {
+  enum class Type {
+    kFound = 0,
+    kLost = 1,
+  };
+
+  Type type = Type::kFound;
+  std::string endpoint_id;
+  // Only set for kFound.
+  ByteArray endpoint_info;
+  std::string service_id;
+};
+
 struct DiscoveryListener {
   // Called when a remote endpoint is discovered.
   //
@@ -157,6 +173,15 @@ struct DiscoveryListener {
   //   info        - The distance info, encoded as enum value.
   std::function<void(const std::string& endpoint_id, DistanceInfo info)>
       endpoint_distance_changed_cb = [](const std::string&, DistanceInfo) {};
+
+  // Called instead of endpoint_found_cb and endpoint_lost_cb when
+  // DiscoveryOptions::batch_interval_millis is set, with the events of one
+  // batch in the order they happened. If unset, the events of a batch are
+  // passed to endpoint_found_cb and endpoint_lost_cb one by one.
+  //
+  // events - The endpoints found and lost since the previous batch.
+  std::function<void(const std::vector<DiscoveryEvent>& events)>
+      endpoints_changed_cb;
 };
 
 struct PayloadListener {
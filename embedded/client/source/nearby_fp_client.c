@@ -665,13 +665,12 @@ static nearby_platform_status OnWriteKeyBasedPairing(uint64_t peer_address,
     account_key_info.peer_address = peer_address;
 #endif /* NEARBY_FP_ENABLE_SASS */
   } else if (length == ENCRYPTED_REQUEST_LENGTH) {
-    // try each key in the persisted Account Key List
-    int num_keys = nearby_fp_GetAccountKeyCount();
+    // try each key in the persisted Account Key List. A key shared by several
+    // seekers is stored once per seeker, but only needs to be tried once.
     int i;
-    for (i = 0; i < num_keys; i++) {
-      const nearby_platform_AccountKeyInfo* key = nearby_fp_GetAccountKey(i);
-      status = nearby_platform_Aes128Decrypt(request, decrypted_request,
-                                             key->account_key);
+    for (i = nearby_fp_GetNextUniqueAccountKeyIndex(0); i != -1;
+         i = nearby_fp_GetNextUniqueAccountKeyIndex(i + 1)) {
+      status = nearby_fp_DecryptWithAccountKey(i, request, decrypted_request);
       if (status != kNearbyStatusOK) {
         NEARBY_TRACE(ERROR, "Failed to decrypt request, error: %d", status);
         return status;
@@ -692,7 +691,7 @@ static nearby_platform_status OnWriteKeyBasedPairing(uint64_t peer_address,
         break;
       }
     }
-    if (i == num_keys) {
+    if (i == -1) {
       NEARBY_TRACE(VERBOSE, "No key matched");
       AccountKeyRejected();
       return kNearbyStatusOK;
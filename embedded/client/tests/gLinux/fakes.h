@@ -50,6 +50,9 @@ nearby_platform_status nearby_test_fakes_Aes128Encrypt(
     const uint8_t input[AES_MESSAGE_SIZE_BYTES],
     uint8_t output[AES_MESSAGE_SIZE_BYTES],
     const uint8_t key[AES_MESSAGE_SIZE_BYTES]);
+// Returns how many times nearby_platform_Aes128ExpandDecryptKey() has expanded
+// a key.
+unsigned int nearby_test_fakes_GetAesKeyExpansionCount();
 
 std::vector<uint8_t>& nearby_test_fakes_GetAdvertisement();
 
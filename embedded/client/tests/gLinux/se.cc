@@ -35,6 +35,8 @@ static std::queue<uint8_t> random_sequence;
 
 static uint8_t private_key_store[32];
 
+static unsigned int aes_key_expansion_count = 0;
+
 static std::unique_ptr<EVP_PKEY, void (*)(EVP_PKEY *)> anti_spoofing_key(
     NULL, EVP_PKEY_free);
 
@@ -115,6 +117,35 @@ nearby_platform_status nearby_platform_Aes128Decrypt(const uint8_t input[16],
   EVP_CIPHER_CTX_free(ctx);
   return kNearbyStatusOK;
 }
+
+// Decryption contexts with an expanded key, one per account key slot.
+static EVP_CIPHER_CTX *key_schedules[NEARBY_MAX_ACCOUNT_KEYS];
+
+nearby_platform_status nearby_platform_Aes128ExpandDecryptKey(
+    unsigned slot, const uint8_t key[16]) {
+  if (slot >= NEARBY_MAX_ACCOUNT_KEYS) return kNearbyStatusInvalidInput;
+  if (key_schedules[slot] == NULL) key_schedules[slot] = EVP_CIPHER_CTX_new();
+  EVP_CIPHER_CTX *ctx = key_schedules[slot];
+  if (1 != EVP_DecryptInit(ctx, EVP_aes_128_ecb(), key, NULL)) {
+    return kNearbyStatusError;
+  }
+  EVP_CIPHER_CTX_set_padding(ctx, 0);
+  aes_key_expansion_count++;
+  return kNearbyStatusOK;
+}
+
+nearby_platform_status nearby_platform_Aes128DecryptWithExpandedKey(
+    unsigned slot, const uint8_t input[16], uint8_t output[16]) {
+  if (slot >= NEARBY_MAX_ACCOUNT_KEYS || key_schedules[slot] == NULL) {
+    return kNearbyStatusInvalidInput;
+  }
+  int output_length = 16;
+  if (1 != EVP_DecryptUpdate(key_schedules[slot], output, &output_length,
+                             input, 16)) {
+    return kNearbyStatusError;
+  }
+  return kNearbyStatusOK;
+}
 #endif /* NEARBY_PLATFORM_USE_MBEDTLS */
 
 static EC_POINT *load_public_key(const uint8_t public_key[64]) {
@@ -250,6 +281,10 @@ nearby_platform_status nearby_test_fakes_Aes128Encrypt(
   return nearby_platform_Aes128Encrypt(input, output, key);
 }
 
+unsigned int nearby_test_fakes_GetAesKeyExpansionCount() {
+  return aes_key_expansion_count;
+}
+
 const uint8_t *nearby_platform_GetAntiSpoofingPrivateKey() {
   return private_key_store;
 }
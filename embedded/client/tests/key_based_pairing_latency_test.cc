@@ -0,0 +1,140 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "fakes.h"
+#include "gtest/gtest.h"
+#include "nearby.h"
+#include "nearby_fp_client.h"
+#include "nearby_fp_library.h"
+#include "nearby_platform_ble.h"
+
+constexpr uint64_t kRemoteDevice = 0xB0B1B2B3B4B5;
+constexpr int kIterations = 200;
+
+// Returns a distinct account key for every |index|.
+static std::vector<uint8_t> MakeAccountKey(uint8_t index) {
+  std::vector<uint8_t> key(ACCOUNT_KEY_SIZE_BYTES);
+  for (size_t i = 0; i < key.size(); i++) {
+    key[i] = (index << 4) | i;
+  }
+  return key;
+}
+
+static void SetAccountKeys(size_t count) {
+  std::vector<AccountKeyPair> account_keys;
+  for (size_t i = 0; i < count; i++) {
+    account_keys.emplace_back(kRemoteDevice, MakeAccountKey(i));
+  }
+  nearby_test_fakes_SetAccountKeys(account_keys);
+  ASSERT_EQ(kNearbyStatusOK, nearby_fp_LoadAccountKeys());
+}
+
+// Returns a key-based pairing request for the provider, encrypted with |key|.
+static std::vector<uint8_t> MakeRequest(const std::vector<uint8_t>& key) {
+  uint8_t request[16] = {
+      0x00,  // key-based pairing request
+      0x00,
+      // Provider's public address
+      0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5,
+      // Seeker's address
+      0xB0, 0xB1, 0xB2, 0xB3, 0xB4, 0xB5,
+      // salt
+      0xCD, 0xEF};
+  std::vector<uint8_t> encrypted(sizeof(request));
+  nearby_test_fakes_Aes128Encrypt(request, encrypted.data(), key.data());
+  return encrypted;
+}
+
+// Returns true if the provider answered the last request with a key-based
+// pairing response encrypted with |key|.
+static bool Responded(const std::vector<uint8_t>& key) {
+  auto& notifications = nearby_test_fakes_GetGattNotifications();
+  auto response = notifications.find(kKeyBasedPairing);
+  if (response == notifications.end()) return false;
+  uint8_t decrypted[16];
+  nearby_test_fakes_Aes128Decrypt(response->second.data(), decrypted,
+                                  key.data());
+  return decrypted[0] == 0x01;
+}
+
+// Measures the worst case, where the request matches the last key on the list.
+TEST(KeyBasedPairingLatency, LatencyPerAccountKeyCount) {
+  for (size_t count = 1; count <= NEARBY_MAX_ACCOUNT_KEYS; count++) {
+    std::vector<uint8_t> key = MakeAccountKey(count - 1);
+    std::vector<uint8_t> request = MakeRequest(key);
+    std::chrono::nanoseconds total(0);
+    for (int i = 0; i < kIterations; i++) {
+      ASSERT_EQ(kNearbyStatusOK, nearby_fp_client_Init(NULL));
+      SetAccountKeys(count);
+
+      auto start = std::chrono::steady_clock::now();
+      ASSERT_EQ(kNearbyStatusOK, nearby_fp_fakes_ReceiveKeyBasedPairingRequest(
+                                     request.data(), request.size()));
+      total += std::chrono::steady_clock::now() - start;
+
+      ASSERT_TRUE(Responded(key));
+    }
+    std::cout << count << " account keys: "
+              << std::chrono::duration_cast<std::chrono::microseconds>(total)
+                         .count() /
+                     static_cast<double>(kIterations)
+              << " us per request" << std::endl;
+  }
+}
+
+TEST(KeyBasedPairingLatency, KeySchedulesAreNotExpandedPerRequest) {
+  ASSERT_EQ(kNearbyStatusOK, nearby_fp_client_Init(NULL));
+  SetAccountKeys(NEARBY_MAX_ACCOUNT_KEYS);
+  unsigned int expansions = nearby_test_fakes_GetAesKeyExpansionCount();
+
+  for (int i = 0; i < NEARBY_MAX_ACCOUNT_KEYS; i++) {
+    std::vector<uint8_t> key = MakeAccountKey(i);
+    std::vector<uint8_t> request = MakeRequest(key);
+    nearby_test_fakes_GetGattNotifications().clear();
+    ASSERT_EQ(kNearbyStatusOK, nearby_fp_fakes_ReceiveKeyBasedPairingRequest(
+                                   request.data(), request.size()));
+    ASSERT_TRUE(Responded(key));
+  }
+
+  ASSERT_EQ(expansions, nearby_test_fakes_GetAesKeyExpansionCount());
+}
+
+TEST(KeyBasedPairingLatency, KeyPushedOffTheListIsRejected) {
+  ASSERT_EQ(kNearbyStatusOK, nearby_fp_client_Init(NULL));
+  SetAccountKeys(NEARBY_MAX_ACCOUNT_KEYS);
+  std::vector<uint8_t> oldest_key = MakeAccountKey(NEARBY_MAX_ACCOUNT_KEYS - 1);
+  std::vector<uint8_t> new_key = MakeAccountKey(NEARBY_MAX_ACCOUNT_KEYS);
+  nearby_platform_AccountKeyInfo account_key_info = {};
+  memcpy(account_key_info.account_key, new_key.data(), new_key.size());
+  nearby_fp_AddAccountKey(&account_key_info);
+
+  std::vector<uint8_t> request = MakeRequest(oldest_key);
+  ASSERT_EQ(kNearbyStatusOK, nearby_fp_fakes_ReceiveKeyBasedPairingRequest(
+                                 request.data(), request.size()));
+  ASSERT_FALSE(Responded(oldest_key));
+
+  request = MakeRequest(new_key);
+  ASSERT_EQ(kNearbyStatusOK, nearby_fp_fakes_ReceiveKeyBasedPairingRequest(
+                                 request.data(), request.size()));
+  ASSERT_TRUE(Responded(new_key));
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
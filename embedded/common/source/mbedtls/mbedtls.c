@@ -33,6 +33,12 @@
 //
 //     Encrypt and decrypt a block of data with a given key.
 //
+// nearby_platform_Aes128ExpandDecryptKey(),
+// nearby_platform_Aes128DecryptWithExpandedKey()
+//
+//     Decrypt with a key schedule expanded once per account key. Only built
+//     with NEARBY_FP_CACHE_AES_KEY_SCHEDULES.
+//
 // Note that the required function nearby_platform_GenSec256r1Secret() is in a
 // separate file, gen_secret.c.
 //
@@ -119,3 +125,33 @@ exit:
   mbedtls_aes_free(&ctx);
   return status;
 }
+
+#if NEARBY_FP_CACHE_AES_KEY_SCHEDULES
+static mbedtls_aes_context key_schedules[NEARBY_MAX_ACCOUNT_KEYS];
+
+/**
+ * Expands a decryption key schedule into the given slot.
+ */
+nearby_platform_status nearby_platform_Aes128ExpandDecryptKey(
+    unsigned slot, const uint8_t key[AES_MESSAGE_SIZE_BYTES]) {
+  if (slot >= NEARBY_MAX_ACCOUNT_KEYS) return kNearbyStatusInvalidInput;
+  mbedtls_aes_free(&key_schedules[slot]);
+  mbedtls_aes_init(&key_schedules[slot]);
+  if (mbedtls_aes_setkey_dec(&key_schedules[slot], key, 128) != 0)
+    return kNearbyStatusError;
+  return kNearbyStatusOK;
+}
+
+/**
+ * Decrypts a data block with AES128 in ECB mode using an expanded key.
+ */
+nearby_platform_status nearby_platform_Aes128DecryptWithExpandedKey(
+    unsigned slot, const uint8_t input[AES_MESSAGE_SIZE_BYTES],
+    uint8_t output[AES_MESSAGE_SIZE_BYTES]) {
+  if (slot >= NEARBY_MAX_ACCOUNT_KEYS) return kNearbyStatusInvalidInput;
+  if (mbedtls_aes_crypt_ecb(&key_schedules[slot], MBEDTLS_AES_DECRYPT, input,
+                            output) != 0)
+    return kNearbyStatusError;
+  return kNearbyStatusOK;
+}
+#endif /* NEARBY_FP_CACHE_AES_KEY_SCHEDULES */
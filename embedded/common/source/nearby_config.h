@@ -76,4 +76,13 @@
 
 // The maximum number of account keys that can be stored on the device.
 #define NEARBY_MAX_ACCOUNT_KEYS 5
+
+// Keep the expanded AES key schedule of every stored account key, so that
+// key-based pairing doesn't expand each key again for every request. Costs one
+// platform key schedule per account key and requires the platform to implement
+// nearby_platform_Aes128ExpandDecryptKey() and
+// nearby_platform_Aes128DecryptWithExpandedKey().
+#ifndef NEARBY_FP_CACHE_AES_KEY_SCHEDULES
+#define NEARBY_FP_CACHE_AES_KEY_SCHEDULES 0
+#endif /* NEARBY_FP_CACHE_AES_KEY_SCHEDULES */
 #endif /* NEARBY_CONFIG_H */
@@ -97,6 +97,17 @@ static AccountKeyList account_key_list;
 
 static uint8_t sha_buffer[32];
 
+#if NEARBY_FP_CACHE_AES_KEY_SCHEDULES
+// Tracks which account key has its AES key schedule expanded into the
+// platform slot of the same index.
+typedef struct {
+  bool valid;
+  uint8_t account_key[ACCOUNT_KEY_SIZE_BYTES];
+} KeyScheduleSlot;
+
+static KeyScheduleSlot key_schedule_slots[NEARBY_MAX_ACCOUNT_KEYS];
+#endif /* NEARBY_FP_CACHE_AES_KEY_SCHEDULES */
+
 #define RETURN_IF_ERROR(X)                        \
   do {                                            \
     nearby_platform_status status = X;            \
@@ -137,6 +148,57 @@ static bool IsAccountKeyInRange(const uint8_t* account_key, size_t end_offset) {
 
 size_t nearby_fp_GetAccountKeyCount() { return account_key_list.num_keys; }
 
+#if NEARBY_FP_CACHE_AES_KEY_SCHEDULES
+// Returns the slot holding the key schedule for |account_key|, or -1.
+static int FindKeyScheduleSlot(const uint8_t* account_key) {
+  for (int i = 0; i < NEARBY_MAX_ACCOUNT_KEYS; i++) {
+    if (key_schedule_slots[i].valid &&
+        !memcmp(account_key, key_schedule_slots[i].account_key,
+                ACCOUNT_KEY_SIZE_BYTES)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Expands |account_key| into a free slot. Returns the slot, or -1 on failure.
+static int AddKeySchedule(const uint8_t* account_key) {
+  for (int i = 0; i < NEARBY_MAX_ACCOUNT_KEYS; i++) {
+    if (key_schedule_slots[i].valid) continue;
+    if (kNearbyStatusOK !=
+        nearby_platform_Aes128ExpandDecryptKey(i, account_key)) {
+      NEARBY_TRACE(WARNING, "Failed to expand account key schedule");
+      return -1;
+    }
+    memcpy(key_schedule_slots[i].account_key, account_key,
+           ACCOUNT_KEY_SIZE_BYTES);
+    key_schedule_slots[i].valid = true;
+    return i;
+  }
+  return -1;
+}
+
+// Drops the key schedules of keys that are no longer on the account key list
+// and expands the keys that don't have one yet. There are as many slots as
+// account keys, so every unique key gets a slot.
+static void UpdateKeySchedules() {
+  size_t key_count = nearby_fp_GetAccountKeyCount();
+  for (int i = 0; i < NEARBY_MAX_ACCOUNT_KEYS; i++) {
+    if (key_schedule_slots[i].valid &&
+        !IsAccountKeyInRange(key_schedule_slots[i].account_key, key_count)) {
+      key_schedule_slots[i].valid = false;
+    }
+  }
+  for (int i = nearby_fp_GetNextUniqueAccountKeyIndex(0); i != -1;
+       i = nearby_fp_GetNextUniqueAccountKeyIndex(i + 1)) {
+    const uint8_t* account_key = nearby_fp_GetAccountKey(i)->account_key;
+    if (FindKeyScheduleSlot(account_key) == -1) {
+      AddKeySchedule(account_key);
+    }
+  }
+}
+#endif /* NEARBY_FP_CACHE_AES_KEY_SCHEDULES */
+
 size_t nearby_fp_GetUniqueAccountKeyCount() {
   size_t count = 0;
   int offset = 0;
@@ -223,6 +285,23 @@ void nearby_fp_AddAccountKey(const nearby_platform_AccountKeyInfo* key) {
   if (key_count < NEARBY_MAX_ACCOUNT_KEYS) {
     account_key_list.num_keys++;
   }
+#if NEARBY_FP_CACHE_AES_KEY_SCHEDULES
+  UpdateKeySchedules();
+#endif /* NEARBY_FP_CACHE_AES_KEY_SCHEDULES */
+}
+
+nearby_platform_status nearby_fp_DecryptWithAccountKey(
+    unsigned key_number, const uint8_t input[AES_MESSAGE_SIZE_BYTES],
+    uint8_t output[AES_MESSAGE_SIZE_BYTES]) {
+  const uint8_t* account_key = nearby_fp_GetAccountKey(key_number)->account_key;
+#if NEARBY_FP_CACHE_AES_KEY_SCHEDULES
+  int slot = FindKeyScheduleSlot(account_key);
+  if (slot == -1) slot = AddKeySchedule(account_key);
+  if (slot != -1) {
+    return nearby_platform_Aes128DecryptWithExpandedKey(slot, input, output);
+  }
+#endif /* NEARBY_FP_CACHE_AES_KEY_SCHEDULES */
+  return nearby_platform_Aes128Decrypt(input, output, account_key);
 }
 size_t nearby_fp_CreateDiscoverableAdvertisement(uint8_t* output,
                                                  size_t length) {
@@ -461,8 +540,16 @@ size_t nearby_fp_AppendTxPower(uint8_t* advertisement, size_t length,
 nearby_platform_status nearby_fp_LoadAccountKeys() {
   size_t length = sizeof(account_key_list);
   memset(&account_key_list, 0, length);
+#if NEARBY_FP_CACHE_AES_KEY_SCHEDULES
+  memset(key_schedule_slots, 0, sizeof(key_schedule_slots));
+  RETURN_IF_ERROR(nearby_platform_LoadValue(
+      kStoredKeyAccountKeyList, (uint8_t*)&account_key_list, &length));
+  UpdateKeySchedules();
+  return kNearbyStatusOK;
+#else
   return nearby_platform_LoadValue(kStoredKeyAccountKeyList,
                                    (uint8_t*)&account_key_list, &length);
+#endif /* NEARBY_FP_CACHE_AES_KEY_SCHEDULES */
 }
 
 nearby_platform_status nearby_fp_SaveAccountKeys() {
@@ -137,6 +137,16 @@ void nearby_fp_MarkAccountKeyAsActive(unsigned key_number);
 // key - Buffer containing key to insert.
 void nearby_fp_AddAccountKey(const nearby_platform_AccountKeyInfo* key);
 
+// Decrypts a block with the account key at |key_number|. Uses the cached key
+// schedule of that key when NEARBY_FP_CACHE_AES_KEY_SCHEDULES is enabled.
+//
+// key_number - Ordinal number of key to decrypt with.
+// input      - Encrypted block.
+// output     - Resulting decrypted block.
+nearby_platform_status nearby_fp_DecryptWithAccountKey(
+    unsigned key_number, const uint8_t input[AES_MESSAGE_SIZE_BYTES],
+    uint8_t output[AES_MESSAGE_SIZE_BYTES]);
+
 // Computes the account bloom filter and stores it in the Account Key Filter
 // field in the advertisement. Returns the bloom filter size.
 //
@@ -62,6 +62,26 @@ nearby_platform_status nearby_platform_Aes128Decrypt(
     uint8_t output[AES_MESSAGE_SIZE_BYTES],
     const uint8_t key[AES_MESSAGE_SIZE_BYTES]);
 
+// Expands `key` into the AES128 decryption key schedule kept in `slot`,
+// replacing whatever the slot held before. There are NEARBY_MAX_ACCOUNT_KEYS
+// slots. Only needed if NEARBY_FP_CACHE_AES_KEY_SCHEDULES is enabled.
+//
+// slot - Key schedule slot to fill, in [0..NEARBY_MAX_ACCOUNT_KEYS).
+// key  - 128 bit key to expand.
+nearby_platform_status nearby_platform_Aes128ExpandDecryptKey(
+    unsigned slot, const uint8_t key[AES_MESSAGE_SIZE_BYTES]);
+
+// Decrypts a data block with AES128 in ECB mode, using the key schedule
+// expanded into `slot` by nearby_platform_Aes128ExpandDecryptKey(). Only
+// needed if NEARBY_FP_CACHE_AES_KEY_SCHEDULES is enabled.
+//
+// slot   - Key schedule slot to use.
+// input  - Input data block to be decrypted.
+// output - Resulting decrypted block.
+nearby_platform_status nearby_platform_Aes128DecryptWithExpandedKey(
+    unsigned slot, const uint8_t input[AES_MESSAGE_SIZE_BYTES],
+    uint8_t output[AES_MESSAGE_SIZE_BYTES]);
+
 // Generates a shared sec256p1 secret using remote party public key and this
 // device's private key.
 //
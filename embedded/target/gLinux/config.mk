@@ -4,6 +4,8 @@ NEARBY_PLATFORM_USE_MBEDTLS ?= 0
 # Use the hardware SE to generate the secp256r1 secret. Alternatively, generate
 # the secret in software.
 NEARBY_PLATFORM_HAS_SE ?= 1
+# Cache the expanded AES key schedules of stored account keys.
+NEARBY_FP_CACHE_AES_KEY_SCHEDULES ?= 1
 
 CFLAGS_EXTRA ?=
 CFLAGS += -g \
@@ -15,11 +15,25 @@
 #ifndef THIRD_PARTY_NEARBY_INTERNAL_FLAGS_FLAG_H_
 #define THIRD_PARTY_NEARBY_INTERNAL_FLAGS_FLAG_H_
 
+#include <cstddef>
+#include <cstdint>
+
 #include "absl/strings/string_view.h"
 
 namespace nearby {
 namespace flags {
 
+// Returns the 64-bit FNV-1a hash of `name`. Used to identify flags by a
+// number computed at compile time rather than by comparing names.
+constexpr uint64_t FlagId(absl::string_view name) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < name.size(); ++i) {
+    hash ^= static_cast<uint8_t>(name[i]);
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
 template <typename T>
 class Flag {
  public:
@@ -27,15 +41,19 @@ class Flag {
                  const absl::string_view name, const T default_value)
       : config_package_name_(config_package_name),
         name_(name),
+        id_(FlagId(name)),
         default_value_(default_value) {}
 
   absl::string_view config_package_name() const { return config_package_name_; }
   absl::string_view name() const { return name_; }
+  // Identifies the flag by its name.
+  constexpr uint64_t id() const { return id_; }
   T default_value() const { return default_value_; }
 
  private:
   const absl::string_view config_package_name_;
   const absl::string_view name_;
+  const uint64_t id_;
   const T default_value_;
 };
 
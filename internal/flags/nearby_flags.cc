@@ -14,8 +14,15 @@
 
 #include "internal/flags/nearby_flags.h"
 
+#include <atomic>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <utility>
 
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "internal/platform/logging.h"
 #include "internal/platform/mutex.h"
 #include "internal/platform/mutex_lock.h"
 
@@ -26,98 +33,158 @@ NearbyFlags& NearbyFlags::GetInstance() {
   return *sharing_flags;
 }
 
-bool NearbyFlags::GetBoolFlag(const flags::Flag<bool>& flag) {
+NearbyFlags::NearbyFlags() {
   MutexLock lock(&mutex_);
+  PublishOverrides();
+}
 
-  const auto& it = overrided_bool_flag_values_.find(flag.name());
-  if (it != overrided_bool_flag_values_.end()) {
-    return it->second;
-  }
-
-  if (flag_reader_ != nullptr) {
-    return flag_reader_->GetBoolFlag(flag);
+bool NearbyFlags::GetBoolFlag(const flags::Flag<bool>& flag) {
+  const Snapshot& snapshot = GetSnapshot();
+  const auto& it = snapshot.bool_values.find(flag.id());
+  if (it != snapshot.bool_values.end() && it->second.name == flag.name()) {
+    return it->second.value;
   }
-  return default_flag_reader_.GetBoolFlag(flag);
+  return ResolveFlag(flag, &Snapshot::bool_values,
+                     &flags::FlagReader::GetBoolFlag);
 }
 
 int64_t NearbyFlags::GetInt64Flag(const flags::Flag<int64_t>& flag) {
-  MutexLock lock(&mutex_);
-
-  const auto& it = overrided_int64_flag_values_.find(flag.name());
-  if (it != overrided_int64_flag_values_.end()) {
-    return it->second;
-  }
-
-  if (flag_reader_ != nullptr) {
-    return flag_reader_->GetInt64Flag(flag);
+  const Snapshot& snapshot = GetSnapshot();
+  const auto& it = snapshot.int64_values.find(flag.id());
+  if (it != snapshot.int64_values.end() && it->second.name == flag.name()) {
+    return it->second.value;
   }
-  return default_flag_reader_.GetInt64Flag(flag);
+  return ResolveFlag(flag, &Snapshot::int64_values,
+                     &flags::FlagReader::GetInt64Flag);
 }
 
 double NearbyFlags::GetDoubleFlag(const flags::Flag<double>& flag) {
-  MutexLock lock(&mutex_);
-
-  const auto& it = overrided_double_flag_values_.find(flag.name());
-  if (it != overrided_double_flag_values_.end()) {
-    return it->second;
+  const Snapshot& snapshot = GetSnapshot();
+  const auto& it = snapshot.double_values.find(flag.id());
+  if (it != snapshot.double_values.end() && it->second.name == flag.name()) {
+    return it->second.value;
   }
-
-  if (flag_reader_ != nullptr) {
-    return flag_reader_->GetDoubleFlag(flag);
-  }
-  return default_flag_reader_.GetDoubleFlag(flag);
+  return ResolveFlag(flag, &Snapshot::double_values,
+                     &flags::FlagReader::GetDoubleFlag);
 }
 
 std::string NearbyFlags::GetStringFlag(
     const flags::Flag<absl::string_view>& flag) {
-  MutexLock lock(&mutex_);
-
-  const auto& it = overrided_string_flag_values_.find(flag.name());
-  if (it != overrided_string_flag_values_.end()) {
-    return it->second;
-  }
-
-  if (flag_reader_ != nullptr) {
-    return flag_reader_->GetStringFlag(flag);
+  const Snapshot& snapshot = GetSnapshot();
+  const auto& it = snapshot.string_values.find(flag.id());
+  if (it != snapshot.string_values.end() && it->second.name == flag.name()) {
+    return it->second.value;
   }
-  return default_flag_reader_.GetStringFlag(flag);
+  return ResolveFlag(flag, &Snapshot::string_values,
+                     &flags::FlagReader::GetStringFlag);
 }
 
 void NearbyFlags::SetFlagReader(flags::FlagReader& flag_reader) {
   MutexLock lock(&mutex_);
   flag_reader_ = &flag_reader;
+  PublishOverrides();
+}
+
+void NearbyFlags::ResetFlagReader() {
+  MutexLock lock(&mutex_);
+  flag_reader_ = nullptr;
+  PublishOverrides();
 }
 
 void NearbyFlags::OverrideBoolFlagValue(const flags::Flag<bool>& flag,
                                         bool new_value) {
   MutexLock lock(&mutex_);
-  overrided_bool_flag_values_[flag.name()] = new_value;
+  RegisterFlag(flag);
+  overrided_values_.bool_values[flag.id()] = {std::string(flag.name()),
+                                              new_value};
+  PublishOverrides();
 }
 
 void NearbyFlags::OverrideInt64FlagValue(const flags::Flag<int64_t>& flag,
                                          int64_t new_value) {
   MutexLock lock(&mutex_);
-  overrided_int64_flag_values_[flag.name()] = new_value;
+  RegisterFlag(flag);
+  overrided_values_.int64_values[flag.id()] = {std::string(flag.name()),
+                                               new_value};
+  PublishOverrides();
 }
 
 void NearbyFlags::OverrideDoubleFlagValue(const flags::Flag<double>& flag,
                                           double new_value) {
   MutexLock lock(&mutex_);
-  overrided_double_flag_values_[flag.name()] = new_value;
+  RegisterFlag(flag);
+  overrided_values_.double_values[flag.id()] = {std::string(flag.name()),
+                                                new_value};
+  PublishOverrides();
 }
 
 void NearbyFlags::OverrideStringFlagValue(
     const flags::Flag<absl::string_view>& flag, absl::string_view new_value) {
   MutexLock lock(&mutex_);
-  overrided_string_flag_values_[flag.name()] = std::string(new_value);
+  RegisterFlag(flag);
+  overrided_values_.string_values[flag.id()] = {std::string(flag.name()),
+                                                std::string(new_value)};
+  PublishOverrides();
 }
 
 void NearbyFlags::ResetOverridedValues() {
   MutexLock lock(&mutex_);
-  overrided_bool_flag_values_.clear();
-  overrided_int64_flag_values_.clear();
-  overrided_double_flag_values_.clear();
-  overrided_string_flag_values_.clear();
+  overrided_values_ = Snapshot();
+  PublishOverrides();
+}
+
+const NearbyFlags::Snapshot& NearbyFlags::GetSnapshot() {
+  // NearbyFlags is a singleton, so one cached snapshot per thread suffices.
+  thread_local std::shared_ptr<const Snapshot> cached_snapshot;
+  uint64_t generation = generation_.load(std::memory_order_acquire);
+  if (cached_snapshot == nullptr ||
+      cached_snapshot->generation != generation) {
+    MutexLock lock(&mutex_);
+    cached_snapshot = snapshot_;
+  }
+  return *cached_snapshot;
+}
+
+template <typename T, typename V>
+V NearbyFlags::ResolveFlag(
+    const flags::Flag<T>& flag,
+    absl::flat_hash_map<uint64_t, Entry<V>> Snapshot::*values,
+    V (flags::FlagReader::*read)(const flags::Flag<T>&)) {
+  MutexLock lock(&mutex_);
+  RegisterFlag(flag);
+  // Another thread may have resolved the flag in the meantime.
+  const auto& it = ((*snapshot_).*values).find(flag.id());
+  if (it != ((*snapshot_).*values).end()) {
+    return it->second.value;
+  }
+
+  flags::FlagReader& flag_reader =
+      flag_reader_ != nullptr ? *flag_reader_ : default_flag_reader_;
+  V value = (flag_reader.*read)(flag);
+  auto snapshot = std::make_shared<Snapshot>(*snapshot_);
+  ((*snapshot).*values)[flag.id()] = {std::string(flag.name()), value};
+  Publish(std::move(snapshot));
+  return value;
+}
+
+template <typename T>
+void NearbyFlags::RegisterFlag(const flags::Flag<T>& flag) {
+  auto [it, inserted] = flag_names_.emplace(flag.id(), flag.name());
+  if (!inserted && it->second != flag.name()) {
+    NEARBY_LOGS(FATAL) << "Flags " << it->second << " and " << flag.name()
+                       << " have the same id " << flag.id()
+                       << "; rename one of them.";
+  }
+}
+
+void NearbyFlags::PublishOverrides() {
+  Publish(std::make_shared<Snapshot>(overrided_values_));
+}
+
+void NearbyFlags::Publish(std::shared_ptr<Snapshot> snapshot) {
+  snapshot->generation = generation_.load(std::memory_order_relaxed) + 1;
+  snapshot_ = std::move(snapshot);
+  generation_.store(snapshot_->generation, std::memory_order_release);
 }
 
 }  // namespace nearby
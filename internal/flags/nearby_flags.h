@@ -15,6 +15,9 @@
 #ifndef THIRD_PARTY_NEARBY_INTERNAL_FLAGS_NEARBY_FLAGS_H_
 #define THIRD_PARTY_NEARBY_INTERNAL_FLAGS_NEARBY_FLAGS_H_
 
+#include <atomic>
+#include <cstdint>
+#include <memory>
 #include <string>
 
 #include "absl/container/flat_hash_map.h"
@@ -25,6 +28,15 @@
 
 namespace nearby {
 
+// Resolved flag values are published as immutable snapshots, keyed by flag id.
+// Reads go to a snapshot cached per thread, and only take the lock when a new
+// snapshot has been published or the flag has not been resolved yet. Values
+// read from the flag reader are kept until the reader is replaced or the
+// overrides change.
+//
+// Flag ids are hashes of the flag names. The first read or override of a flag
+// registers its name under its id, and two different names with the same id
+// are a fatal error.
 class NearbyFlags final : public nearby::flags::FlagReader {
  public:
   ~NearbyFlags() override = default;
@@ -47,9 +59,14 @@ class NearbyFlags final : public nearby::flags::FlagReader {
   std::string GetStringFlag(const flags::Flag<absl::string_view>& flag) override
       ABSL_LOCKS_EXCLUDED(mutex_);
 
+  // Replaces the flag reader. Flag values are read from it again.
   void SetFlagReader(flags::FlagReader& flag_reader)
       ABSL_LOCKS_EXCLUDED(mutex_);
 
+  // Goes back to the default flag reader. The major purpose of the method is
+  // for test, so that a reader set by one test doesn't outlive it.
+  void ResetFlagReader() ABSL_LOCKS_EXCLUDED(mutex_);
+
   // Override the default value of the flags. The major purpose of the method is
   // for test.
   void OverrideBoolFlagValue(const flags::Flag<bool>& flag, bool new_value)
@@ -69,23 +86,59 @@ class NearbyFlags final : public nearby::flags::FlagReader {
   void ResetOverridedValues() ABSL_LOCKS_EXCLUDED(mutex_);
 
  private:
-  NearbyFlags() = default;
+  // A resolved value, with the name of the flag it belongs to. A read only
+  // uses the value if the names match.
+  template <typename V>
+  struct Entry {
+    std::string name;
+    V value;
+  };
+
+  // Resolved values of the flags, keyed by flag id.
+  struct Snapshot {
+    uint64_t generation = 0;
+    absl::flat_hash_map<uint64_t, Entry<bool>> bool_values;
+    absl::flat_hash_map<uint64_t, Entry<int64_t>> int64_values;
+    absl::flat_hash_map<uint64_t, Entry<double>> double_values;
+    absl::flat_hash_map<uint64_t, Entry<std::string>> string_values;
+  };
+
+  NearbyFlags();
+
+  // Returns the latest snapshot. The reference stays valid until the calling
+  // thread calls this again.
+  const Snapshot& GetSnapshot() ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Reads a flag missing from the latest snapshot from the flag reader, and
+  // publishes a snapshot that includes it.
+  template <typename T, typename V>
+  V ResolveFlag(const flags::Flag<T>& flag,
+                absl::flat_hash_map<uint64_t, Entry<V>> Snapshot::*values,
+                V (flags::FlagReader::*read)(const flags::Flag<T>&))
+      ABSL_LOCKS_EXCLUDED(mutex_);
 
-  flags::FlagReader* flag_reader_ = nullptr;
-  flags::DefaultFlagReader default_flag_reader_;
+  // Records the name of the flag under its id. Crashes if another flag
+  // already has that id.
+  template <typename T>
+  void RegisterFlag(const flags::Flag<T>& flag)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  mutable Mutex mutex_;
-  absl::flat_hash_map<std::string, bool> overrided_bool_flag_values_
-      ABSL_GUARDED_BY(mutex_);
+  // Publishes a snapshot holding only the overridden values.
+  void PublishOverrides() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void Publish(std::shared_ptr<Snapshot> snapshot)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  absl::flat_hash_map<std::string, int64_t> overrided_int64_flag_values_
-      ABSL_GUARDED_BY(mutex_);
-
-  absl::flat_hash_map<std::string, double> overrided_double_flag_values_
-      ABSL_GUARDED_BY(mutex_);
+  flags::FlagReader* flag_reader_ ABSL_GUARDED_BY(mutex_) = nullptr;
+  flags::DefaultFlagReader default_flag_reader_;
 
-  absl::flat_hash_map<std::string, std::string> overrided_string_flag_values_
+  mutable Mutex mutex_;
+  Snapshot overrided_values_ ABSL_GUARDED_BY(mutex_);
+  // Names of the flags read or overridden so far, keyed by flag id.
+  absl::flat_hash_map<uint64_t, std::string> flag_names_
       ABSL_GUARDED_BY(mutex_);
+  std::shared_ptr<const Snapshot> snapshot_ ABSL_GUARDED_BY(mutex_);
+  // Generation of `snapshot_`, readable without the lock.
+  std::atomic<uint64_t> generation_{0};
 };
 
 }  // namespace nearby
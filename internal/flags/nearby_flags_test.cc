@@ -18,6 +18,8 @@
 #include <memory>
 #include <string>
 #include <string_view>
+#include <thread>  // NOLINT
+#include <vector>
 
 #include "gmock/gmock.h"
 #include "protobuf-matchers/protocol-buffer-matchers.h"
@@ -54,6 +56,16 @@ class MockFlagReader : public flags::FlagReader {
               (const flags::Flag<absl::string_view>& flag), (override));
 };
 
+// Puts the default flag reader back after each test, so that no test leaves a
+// reader it owns in the NearbyFlags singleton.
+class NearbyFlagsReaderTest : public ::testing::Test {
+ protected:
+  void TearDown() override {
+    NearbyFlags::GetInstance().ResetFlagReader();
+    NearbyFlags::GetInstance().ResetOverridedValues();
+  }
+};
+
 TEST(NearbyFlags, GetDefaultValues) {
   EXPECT_EQ(NearbyFlags::GetInstance().GetBoolFlag(kTestBoolFlag),
             kTestBoolFlag.default_value());
@@ -85,7 +97,58 @@ TEST(NearbyFlags, OverrideDefaultValues) {
   NearbyFlags::GetInstance().ResetOverridedValues();
 }
 
-TEST(NearbyFlags, SetFlagReader) {
+TEST(NearbyFlags, FlagIdIsComputedAtCompileTime) {
+  static_assert(kTestBoolFlag.id() == flags::FlagId("45401515"));
+  static_assert(kTestBoolFlag.id() != kTestInt64Flag.id());
+  // Flags are identified by name alone, so reading the same name through
+  // another flag is not an id collision.
+  constexpr auto kSameNameFlag =
+      flags::Flag<bool>("other_package", "45401515", true);
+  EXPECT_EQ(kSameNameFlag.id(), kTestBoolFlag.id());
+  EXPECT_EQ(NearbyFlags::GetInstance().GetBoolFlag(kTestBoolFlag),
+            NearbyFlags::GetInstance().GetBoolFlag(kSameNameFlag));
+}
+
+TEST(NearbyFlags, OverrideAfterReadIsVisibleToOtherThreads) {
+  EXPECT_EQ(NearbyFlags::GetInstance().GetInt64Flag(kTestInt64Flag),
+            kTestInt64Flag.default_value());
+  NearbyFlags::GetInstance().OverrideInt64FlagValue(kTestInt64Flag, 1);
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([]() {
+      for (int j = 0; j < 1000; ++j) {
+        EXPECT_EQ(NearbyFlags::GetInstance().GetInt64Flag(kTestInt64Flag), 1);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  NearbyFlags::GetInstance().ResetOverridedValues();
+  EXPECT_EQ(NearbyFlags::GetInstance().GetInt64Flag(kTestInt64Flag),
+            kTestInt64Flag.default_value());
+}
+
+TEST_F(NearbyFlagsReaderTest, FlagReaderIsReadOncePerSnapshot) {
+  ::testing::NiceMock<MockFlagReader> flag_reader;
+  EXPECT_CALL(flag_reader, GetBoolFlag(::testing::_))
+      .Times(2)
+      .WillRepeatedly(::testing::Return(kTestBoolFlagTestValue));
+  NearbyFlags::GetInstance().SetFlagReader(flag_reader);
+
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(NearbyFlags::GetInstance().GetBoolFlag(kTestBoolFlag),
+              kTestBoolFlagTestValue);
+  }
+  // Changing the overrides publishes a new snapshot, so the reader is
+  // consulted again.
+  NearbyFlags::GetInstance().ResetOverridedValues();
+  EXPECT_EQ(NearbyFlags::GetInstance().GetBoolFlag(kTestBoolFlag),
+            kTestBoolFlagTestValue);
+}
+
+TEST_F(NearbyFlagsReaderTest, SetFlagReader) {
   auto flag_reader = std::make_unique<::testing::NiceMock<MockFlagReader>>();
   NearbyFlags::GetInstance().SetFlagReader(*flag_reader.get());
   EXPECT_CALL(*flag_reader, GetBoolFlag(::testing::_))
@@ -115,5 +178,18 @@ TEST(NearbyFlags, SetFlagReader) {
             kTestStringFlagTestValue);
 }
 
+TEST_F(NearbyFlagsReaderTest, ResetFlagReaderGoesBackToDefaults) {
+  ::testing::NiceMock<MockFlagReader> flag_reader;
+  ON_CALL(flag_reader, GetInt64Flag(::testing::_))
+      .WillByDefault(::testing::Return(1));
+  NearbyFlags::GetInstance().SetFlagReader(flag_reader);
+  EXPECT_EQ(NearbyFlags::GetInstance().GetInt64Flag(kTestInt64Flag), 1);
+
+  NearbyFlags::GetInstance().ResetFlagReader();
+
+  EXPECT_EQ(NearbyFlags::GetInstance().GetInt64Flag(kTestInt64Flag),
+            kTestInt64Flag.default_value());
+}
+
 }  // namespace
 }  // namespace nearby
@@ -65,6 +65,16 @@ constexpr auto kWifiHotspotConnectionIntervalMillis =
 constexpr auto kWifiHotspotConnectionTimeoutMillis =
     flags::Flag<int64_t>(kConfigPackage, "45415888", 10000);
 
+// Linux only. SO_RCVLOWAT for sockets read through linux::InputStream; 0 keeps
+// the kernel default.
+constexpr auto kLinuxSocketReceiveLowWatermark =
+    flags::Flag<int64_t>(kConfigPackage, "45416001", 0);
+
+// Linux only. SO_BUSY_POLL in microseconds for sockets read through
+// linux::InputStream; 0 disables busy polling.
+constexpr auto kLinuxSocketBusyPollMicros =
+    flags::Flag<int64_t>(kConfigPackage, "45416002", 0);
+
 }  // namespace nearby_platform_feature
 }  // namespace config_package_nearby
 }  // namespace platform
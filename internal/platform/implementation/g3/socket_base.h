@@ -15,6 +15,7 @@
 #ifndef THIRD_PARTY_NEARBY_INTERNAL_PLATFORM_IMPLEMENTATION_G3_SOCKET_BASE_H_
 #define THIRD_PARTY_NEARBY_INTERNAL_PLATFORM_IMPLEMENTATION_G3_SOCKET_BASE_H_
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <memory>
@@ -23,11 +24,15 @@
 
 #include "absl/base/thread_annotations.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
 #include "internal/platform/byte_array.h"
 #include "internal/platform/exception.h"
+#include "internal/platform/implementation/system_clock.h"
 #include "internal/platform/input_stream.h"
+#include "internal/platform/medium_environment.h"
 #include "internal/platform/output_stream.h"
 #include "internal/platform/pipe.h"
+#include "internal/platform/single_thread_executor.h"
 
 namespace nearby {
 namespace g3 {
@@ -35,7 +40,17 @@ namespace g3 {
 // Common base for BT, BLE and Wifi socket implementations.
 class SocketBase {
  public:
-  SocketBase() { std::tie(input_for_remote_, output_) = CreatePipe(); }
+  SocketBase() {
+    std::tie(input_for_remote_, output_) = CreatePipe();
+    const EnvironmentConfig& config =
+        MediumEnvironment::Instance().GetEnvironmentConfig();
+    if (config.link_bandwidth_bytes_per_second > 0 ||
+        config.link_latency > absl::ZeroDuration()) {
+      output_ = std::make_unique<ShapedOutputStream>(
+          std::move(output_), config.link_bandwidth_bytes_per_second,
+          config.link_latency);
+    }
+  }
   virtual ~SocketBase() {
     absl::MutexLock lock(&mutex_);
     DoClose();
@@ -137,6 +152,73 @@ class SocketBase {
   };
   InputProxyStream input_proxy_{this};
 
+  // Emulates the link configured in EnvironmentConfig. A write blocks the
+  // writer for as long as it would take to transmit, and the data is handed to
+  // the pipe once it would have arrived at the remote side. Deliveries run in
+  // order on |delivery_|, so consecutive writes overlap their latency. Since
+  // a write returns before its data is delivered, the first delivery error is
+  // returned by the next Write(), Flush() or Close() instead.
+  class ShapedOutputStream : public OutputStream {
+   public:
+    ShapedOutputStream(std::unique_ptr<OutputStream> output,
+                       std::int64_t bandwidth_bytes_per_second,
+                       absl::Duration latency)
+        : output_(std::move(output)),
+          bandwidth_bytes_per_second_(bandwidth_bytes_per_second),
+          latency_(latency) {}
+
+    Exception Write(const ByteArray& data) override {
+      absl::Time sent;
+      {
+        absl::MutexLock lock(&mutex_);
+        if (!delivery_error_.Ok()) return delivery_error_;
+        absl::Duration transmission =
+            bandwidth_bytes_per_second_ > 0
+                ? absl::Seconds(static_cast<double>(data.size()) /
+                                bandwidth_bytes_per_second_)
+                : absl::ZeroDuration();
+        sent = std::max(SystemClock::ElapsedRealtime(), link_busy_until_) +
+               transmission;
+        link_busy_until_ = sent;
+      }
+      delivery_.Execute([this, data, arrival = sent + latency_]() {
+        SleepUntil(arrival);
+        Exception result = output_->Write(data);
+        if (!result.Ok()) {
+          absl::MutexLock lock(&mutex_);
+          if (delivery_error_.Ok()) delivery_error_ = result;
+        }
+      });
+      SleepUntil(sent);
+      return {Exception::kSuccess};
+    }
+    Exception Flush() override {
+      absl::MutexLock lock(&mutex_);
+      return delivery_error_;
+    }
+    // Queued behind pending deliveries, so no data is lost on close.
+    Exception Close() override {
+      delivery_.Execute([this]() { output_->Close(); });
+      absl::MutexLock lock(&mutex_);
+      return delivery_error_;
+    }
+
+   private:
+    static void SleepUntil(absl::Time time) {
+      absl::Duration duration = time - SystemClock::ElapsedRealtime();
+      if (duration > absl::ZeroDuration()) SystemClock::Sleep(duration);
+    }
+
+    std::unique_ptr<OutputStream> output_;
+    const std::int64_t bandwidth_bytes_per_second_;
+    const absl::Duration latency_;
+    absl::Mutex mutex_;
+    absl::Time link_busy_until_ ABSL_GUARDED_BY(mutex_) = absl::InfinitePast();
+    Exception delivery_error_ ABSL_GUARDED_BY(mutex_) = {Exception::kSuccess};
+    // Declared last so pending deliveries finish before |output_| goes away.
+    SingleThreadExecutor delivery_;
+  };
+
   // Output stream is initialized by constructor, it remains always valid. It
   // represents output part of a local socket. Input stream of a local socket
   // comes from the peer socket, after connection.
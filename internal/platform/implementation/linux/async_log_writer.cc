@@ -0,0 +1,178 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "internal/platform/implementation/linux/async_log_writer.h"
+
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT
+#include <utility>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "internal/platform/implementation/log_message.h"
+
+namespace nearby {
+namespace linux {
+namespace {
+
+static_assert((AsyncLogWriter::kCapacity & (AsyncLogWriter::kCapacity - 1)) ==
+                  0,
+              "kCapacity must be a power of two");
+constexpr size_t kIndexMask = AsyncLogWriter::kCapacity - 1;
+
+// Upper bound on how long a queued record waits if a wakeup is missed.
+constexpr absl::Duration kMaxWriterSleep = absl::Milliseconds(100);
+
+pid_t GetThreadId() {
+  thread_local pid_t thread_id = static_cast<pid_t>(syscall(SYS_gettid));
+  return thread_id;
+}
+
+}  // namespace
+
+AsyncLogWriter::AsyncLogWriter(Sink sink)
+    : sink_(std::move(sink)), slots_(std::make_unique<Slot[]>(kCapacity)) {
+  for (size_t i = 0; i < kCapacity; ++i) {
+    slots_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  thread_ = std::thread([this]() { Run(); });
+}
+
+AsyncLogWriter::~AsyncLogWriter() {
+  {
+    absl::MutexLock lock(&mutex_);
+    stopped_ = true;
+    writer_cond_.Signal();
+  }
+  thread_.join();
+}
+
+bool AsyncLogWriter::TryWrite(api::LogMessage::Severity severity,
+                              const char* file, int line,
+                              absl::string_view text) {
+  if (text.size() > kMaxTextSize) return false;
+  absl::Time now = absl::Now();
+
+  size_t position = enqueue_position_.load(std::memory_order_relaxed);
+  Slot* slot;
+  while (true) {
+    slot = &slots_[position & kIndexMask];
+    size_t sequence = slot->sequence.load(std::memory_order_acquire);
+    auto diff = static_cast<intptr_t>(sequence) -
+                static_cast<intptr_t>(position);
+    if (diff == 0) {
+      if (enqueue_position_.compare_exchange_weak(
+              position, position + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // The writer hasn't freed this slot yet; the ring is full.
+      return false;
+    } else {
+      position = enqueue_position_.load(std::memory_order_relaxed);
+    }
+  }
+
+  Record& record = slot->record;
+  record.severity = severity;
+  record.file = file;
+  record.line = line;
+  record.time = now;
+  record.thread_id = GetThreadId();
+  record.size = text.size();
+  std::memcpy(record.text, text.data(), text.size());
+  slot->sequence.store(position + 1, std::memory_order_release);
+
+  if (writer_sleeping_.load(std::memory_order_seq_cst)) {
+    WakeWriter();
+  }
+  return true;
+}
+
+void AsyncLogWriter::Flush() {
+  size_t target = enqueue_position_.load(std::memory_order_acquire);
+  absl::MutexLock lock(&mutex_);
+  while (dequeue_position_.load(std::memory_order_acquire) < target &&
+         !stopped_) {
+    writer_cond_.Signal();
+    drained_cond_.WaitWithTimeout(&mutex_, kMaxWriterSleep);
+  }
+}
+
+void AsyncLogWriter::Run() {
+  while (true) {
+    if (Drain()) continue;
+
+    absl::MutexLock lock(&mutex_);
+    drained_cond_.SignalAll();
+    if (stopped_) return;
+    writer_sleeping_.store(true, std::memory_order_seq_cst);
+    // Check again now that producers can see that we're going to sleep.
+    size_t position = dequeue_position_.load(std::memory_order_relaxed);
+    if (slots_[position & kIndexMask].sequence.load(
+            std::memory_order_seq_cst) != position + 1) {
+      writer_cond_.WaitWithTimeout(&mutex_, kMaxWriterSleep);
+    }
+    writer_sleeping_.store(false, std::memory_order_relaxed);
+  }
+}
+
+bool AsyncLogWriter::Drain() {
+  bool drained_any = false;
+  size_t position = dequeue_position_.load(std::memory_order_relaxed);
+  while (true) {
+    Slot& slot = slots_[position & kIndexMask];
+    if (slot.sequence.load(std::memory_order_acquire) != position + 1) break;
+    sink_(slot.record);
+    slot.sequence.store(position + kCapacity, std::memory_order_release);
+    ++position;
+    dequeue_position_.store(position, std::memory_order_release);
+    drained_any = true;
+  }
+
+  int64_t dropped = dropped_.exchange(0, std::memory_order_relaxed);
+  if (dropped > 0) {
+    Record record;
+    record.severity = api::LogMessage::Severity::kWarning;
+    record.file = __FILE__;
+    record.line = __LINE__;
+    record.time = absl::Now();
+    record.thread_id = GetThreadId();
+    std::string text =
+        absl::StrCat("Dropped ", dropped, " log messages, log queue full.");
+    record.size = text.copy(record.text, kMaxTextSize);
+    sink_(record);
+  }
+  return drained_any;
+}
+
+void AsyncLogWriter::WakeWriter() {
+  absl::MutexLock lock(&mutex_);
+  writer_cond_.Signal();
+}
+
+}  // namespace linux
+}  // namespace nearby
@@ -0,0 +1,119 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PLATFORM_IMPL_LINUX_ASYNC_LOG_WRITER_H_
+#define PLATFORM_IMPL_LINUX_ASYNC_LOG_WRITER_H_
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>  // NOLINT
+
+#include "absl/base/thread_annotations.h"
+#include "absl/functional/any_invocable.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "internal/platform/implementation/log_message.h"
+
+namespace nearby {
+namespace linux {
+
+// Hands log records from any thread to a single background thread that
+// writes them out. Records are copied into a fixed ring of slots. Producers
+// claim slots with a compare-and-swap and never block, so logging from hot
+// paths only costs a copy of the text.
+class AsyncLogWriter {
+ public:
+  // Longest text a record can hold. Longer messages must be written
+  // synchronously by the caller.
+  static constexpr size_t kMaxTextSize = 480;
+  // Number of slots in the ring. Must be a power of two.
+  static constexpr size_t kCapacity = 1024;
+
+  struct Record {
+    api::LogMessage::Severity severity;
+    // A string literal such as __FILE__.
+    const char* file;
+    int line;
+    // When the record was queued, and the id of the queueing thread as
+    // returned by gettid(), so that the sink can stamp the record with them
+    // rather than with the time and thread it is written on.
+    absl::Time time;
+    pid_t thread_id;
+    size_t size;
+    char text[kMaxTextSize];
+
+    absl::string_view GetText() const { return absl::string_view(text, size); }
+  };
+
+  using Sink = absl::AnyInvocable<void(const Record&)>;
+
+  // Starts the writer thread, which passes every record to `sink` in the
+  // order the records were queued.
+  explicit AsyncLogWriter(Sink sink);
+  ~AsyncLogWriter();
+
+  AsyncLogWriter(const AsyncLogWriter&) = delete;
+  AsyncLogWriter& operator=(const AsyncLogWriter&) = delete;
+
+  // Queues a record. Returns false, without queueing anything, if `text` is
+  // longer than kMaxTextSize or the ring is full.
+  bool TryWrite(api::LogMessage::Severity severity, const char* file, int line,
+                absl::string_view text);
+
+  // Counts a record the caller dropped because TryWrite() failed. The writer
+  // reports the number of dropped records the next time it runs.
+  void RecordDropped() { dropped_.fetch_add(1, std::memory_order_relaxed); }
+
+  // Blocks until every record queued before the call has been passed to the
+  // sink.
+  void Flush() ABSL_LOCKS_EXCLUDED(mutex_);
+
+ private:
+  struct Slot {
+    // Vyukov's bounded queue: a slot is free for the producer claiming
+    // position `pos` when sequence == pos, and holds that producer's record
+    // once sequence == pos + 1.
+    std::atomic<size_t> sequence;
+    Record record;
+  };
+
+  void Run() ABSL_LOCKS_EXCLUDED(mutex_);
+  // Passes queued records to the sink. Returns false if there were none.
+  bool Drain();
+  void WakeWriter() ABSL_LOCKS_EXCLUDED(mutex_);
+
+  Sink sink_;
+  std::unique_ptr<Slot[]> slots_;
+  std::atomic<size_t> enqueue_position_{0};
+  // Only touched by the writer thread, and read by Flush().
+  std::atomic<size_t> dequeue_position_{0};
+  std::atomic<int64_t> dropped_{0};
+  std::atomic<bool> writer_sleeping_{false};
+
+  absl::Mutex mutex_;
+  absl::CondVar writer_cond_;
+  absl::CondVar drained_cond_;
+  bool stopped_ ABSL_GUARDED_BY(mutex_) = false;
+  std::thread thread_;
+};
+
+}  // namespace linux
+}  // namespace nearby
+
+#endif  // PLATFORM_IMPL_LINUX_ASYNC_LOG_WRITER_H_
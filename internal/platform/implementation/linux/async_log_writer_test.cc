@@ -0,0 +1,174 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "internal/platform/implementation/linux/async_log_writer.h"
+
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "internal/platform/implementation/log_message.h"
+
+namespace nearby {
+namespace linux {
+namespace {
+
+using Severity = api::LogMessage::Severity;
+
+class RecordingSink {
+ public:
+  void Add(const AsyncLogWriter::Record& record) {
+    absl::MutexLock lock(&mutex_);
+    texts_.push_back(std::string(record.GetText()));
+  }
+
+  std::vector<std::string> texts() {
+    absl::MutexLock lock(&mutex_);
+    return texts_;
+  }
+
+ private:
+  absl::Mutex mutex_;
+  std::vector<std::string> texts_;
+};
+
+TEST(AsyncLogWriterTest, WritesRecordsInOrder) {
+  RecordingSink sink;
+  AsyncLogWriter writer(
+      [&sink](const AsyncLogWriter::Record& record) { sink.Add(record); });
+
+  for (size_t i = 0; i < 3 * AsyncLogWriter::kCapacity; ++i) {
+    while (!writer.TryWrite(Severity::kInfo, __FILE__, __LINE__,
+                            absl::StrCat(i))) {
+      writer.Flush();
+    }
+  }
+  writer.Flush();
+
+  std::vector<std::string> texts = sink.texts();
+  ASSERT_EQ(texts.size(), 3 * AsyncLogWriter::kCapacity);
+  for (size_t i = 0; i < texts.size(); ++i) {
+    EXPECT_EQ(texts[i], absl::StrCat(i));
+  }
+}
+
+TEST(AsyncLogWriterTest, KeepsTimeAndThreadOfProducer) {
+  absl::Mutex mutex;
+  absl::Time record_time;
+  pid_t record_thread_id = 0;
+  AsyncLogWriter writer([&](const AsyncLogWriter::Record& record) {
+    absl::MutexLock lock(&mutex);
+    record_time = record.time;
+    record_thread_id = record.thread_id;
+  });
+
+  absl::Time start = absl::Now();
+  pid_t producer_thread_id = 0;
+  std::thread producer([&]() {
+    producer_thread_id = static_cast<pid_t>(syscall(SYS_gettid));
+    EXPECT_TRUE(writer.TryWrite(Severity::kInfo, __FILE__, __LINE__, "text"));
+  });
+  producer.join();
+  absl::Time end = absl::Now();
+  writer.Flush();
+
+  absl::MutexLock lock(&mutex);
+  EXPECT_GE(record_time, start);
+  EXPECT_LE(record_time, end);
+  EXPECT_EQ(record_thread_id, producer_thread_id);
+}
+
+TEST(AsyncLogWriterTest, RejectsLongRecords) {
+  RecordingSink sink;
+  AsyncLogWriter writer(
+      [&sink](const AsyncLogWriter::Record& record) { sink.Add(record); });
+
+  EXPECT_FALSE(writer.TryWrite(Severity::kInfo, __FILE__, __LINE__,
+                               std::string(AsyncLogWriter::kMaxTextSize + 1,
+                                           'x')));
+  EXPECT_TRUE(writer.TryWrite(Severity::kInfo, __FILE__, __LINE__,
+                              std::string(AsyncLogWriter::kMaxTextSize, 'x')));
+  writer.Flush();
+  EXPECT_EQ(sink.texts().size(), 1);
+}
+
+TEST(AsyncLogWriterTest, ReportsDroppedRecordsWhenFull) {
+  absl::Notification release_sink;
+  RecordingSink sink;
+  AsyncLogWriter writer([&](const AsyncLogWriter::Record& record) {
+    release_sink.WaitForNotification();
+    sink.Add(record);
+  });
+
+  // The writer is stuck on the first record, so the ring fills up.
+  size_t written = 0;
+  while (writer.TryWrite(Severity::kInfo, __FILE__, __LINE__, "record")) {
+    ++written;
+  }
+  EXPECT_GE(written, AsyncLogWriter::kCapacity);
+  writer.RecordDropped();
+  release_sink.Notify();
+  writer.Flush();
+
+  std::vector<std::string> texts = sink.texts();
+  ASSERT_EQ(texts.size(), written + 1);
+  EXPECT_EQ(texts.back(), "Dropped 1 log messages, log queue full.");
+}
+
+TEST(AsyncLogWriterTest, ConcurrentProducers) {
+  constexpr int kThreads = 4;
+  constexpr int kRecordsPerThread = 5000;
+  RecordingSink sink;
+  AsyncLogWriter writer(
+      [&sink](const AsyncLogWriter::Record& record) { sink.Add(record); });
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&writer, t]() {
+      for (int i = 0; i < kRecordsPerThread; ++i) {
+        while (!writer.TryWrite(Severity::kInfo, __FILE__, __LINE__,
+                                absl::StrCat(t, ":", i))) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  writer.Flush();
+
+  // Records from each thread keep their order.
+  std::vector<int> next(kThreads, 0);
+  std::vector<std::string> texts = sink.texts();
+  ASSERT_EQ(texts.size(), kThreads * kRecordsPerThread);
+  for (const std::string& text : texts) {
+    int t = text[0] - '0';
+    EXPECT_EQ(text, absl::StrCat(t, ":", next[t]++));
+  }
+}
+
+}  // namespace
+}  // namespace linux
+}  // namespace nearby
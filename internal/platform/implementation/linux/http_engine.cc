@@ -0,0 +1,378 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "internal/platform/implementation/linux/http_engine.h"
+
+#include <curl/curl.h>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/base/call_once.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/synchronization/notification.h"
+#include "internal/platform/logging.h"
+
+namespace nearby {
+namespace linux {
+namespace {
+
+// Upper bound on how long the engine thread sleeps in curl_multi_poll().
+// curl_multi_wakeup() interrupts it as soon as a request is queued.
+constexpr int kPollTimeoutMillis = 1000;
+
+CURLM *CreateMultiHandle() {
+  static absl::once_flag curl_initialized;
+  absl::call_once(curl_initialized,
+                  []() { curl_global_init(CURL_GLOBAL_DEFAULT); });
+  return curl_multi_init();
+}
+
+CURLSH *CreateShareHandle() {
+  // Only the engine thread touches the shared data, so no lock callbacks are
+  // needed.
+  CURLSH *share = curl_share_init();
+  curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+  return share;
+}
+
+absl::Status CurlCodeToStatus(CURLcode code, const char *error) {
+  std::string message = absl::StrCat(
+      curl_easy_strerror(code), error[0] != '\0' ? ": " : "", error);
+  switch (code) {
+    case CURLE_OK:
+      return absl::OkStatus();
+    case CURLE_URL_MALFORMAT:
+    case CURLE_UNSUPPORTED_PROTOCOL:
+      return absl::InvalidArgumentError(message);
+    case CURLE_COULDNT_RESOLVE_HOST:
+    case CURLE_COULDNT_RESOLVE_PROXY:
+    case CURLE_COULDNT_CONNECT:
+    case CURLE_SEND_ERROR:
+    case CURLE_RECV_ERROR:
+    case CURLE_GOT_NOTHING:
+      return absl::UnavailableError(message);
+    case CURLE_OPERATION_TIMEDOUT:
+      return absl::DeadlineExceededError(message);
+    case CURLE_OUT_OF_MEMORY:
+      return absl::ResourceExhaustedError(message);
+    default:
+      return absl::UnknownError(message);
+  }
+}
+
+size_t OnResponseHeader(char *data, size_t size, size_t count,
+                        void *userdata) {
+  auto *response = static_cast<api::WebResponse *>(userdata);
+  absl::string_view line =
+      absl::StripTrailingAsciiWhitespace(absl::string_view(data, size * count));
+  if (absl::StartsWith(line, "HTTP/")) {
+    // A status line starts a new response, e.g. after following a redirect.
+    // HTTP/2 status lines carry no reason phrase.
+    std::vector<absl::string_view> parts =
+        absl::StrSplit(line, absl::MaxSplits(' ', 2));
+    response->status_text = parts.size() > 2 ? std::string(parts[2]) : "";
+    response->headers.clear();
+  } else if (size_t colon = line.find(':');
+             colon != absl::string_view::npos) {
+    response->headers.emplace(
+        std::string(absl::StripAsciiWhitespace(line.substr(0, colon))),
+        std::string(absl::StripAsciiWhitespace(line.substr(colon + 1))));
+  }
+  return size * count;
+}
+
+size_t OnResponseBody(char *data, size_t size, size_t count, void *userdata) {
+  static_cast<std::string *>(userdata)->append(data, size * count);
+  return size * count;
+}
+
+}  // namespace
+
+struct HttpEngine::Transfer {
+  ~Transfer() { curl_slist_free_all(headers); }
+
+  api::WebRequest request;
+  ResponseCallback callback;
+  api::WebResponse response{};
+  CURL *easy = nullptr;
+  curl_slist *headers = nullptr;
+  char error[CURL_ERROR_SIZE] = {};
+};
+
+HttpEngine &HttpEngine::GetDefault() {
+  static HttpEngine *engine = new HttpEngine();
+  return *engine;
+}
+
+HttpEngine::HttpEngine(const Options &options)
+    : options_(options),
+      multi_(CreateMultiHandle()),
+      share_(CreateShareHandle()) {
+  curl_multi_setopt(multi_, CURLMOPT_PIPELINING,
+                    static_cast<long>(CURLPIPE_MULTIPLEX));
+  curl_multi_setopt(multi_, CURLMOPT_MAX_HOST_CONNECTIONS,
+                    static_cast<long>(options_.max_connections_per_host));
+  curl_multi_setopt(multi_, CURLMOPT_MAX_TOTAL_CONNECTIONS,
+                    static_cast<long>(options_.max_total_connections));
+  curl_multi_setopt(multi_, CURLMOPT_MAXCONNECTS,
+                    static_cast<long>(options_.max_idle_connections));
+  thread_ = std::thread([this]() { Run(); });
+}
+
+HttpEngine::~HttpEngine() {
+  {
+    absl::MutexLock lock(&mutex_);
+    stopped_ = true;
+  }
+  curl_multi_wakeup(multi_);
+  thread_.join();
+
+  std::deque<std::unique_ptr<Transfer>> pending;
+  {
+    absl::MutexLock lock(&mutex_);
+    pending.swap(pending_);
+  }
+  for (auto &transfer : pending) {
+    std::move(transfer->callback)(
+        absl::CancelledError("HTTP engine shut down"));
+  }
+  while (!active_.empty()) {
+    FinishTransfer(active_.begin()->first,
+                   absl::CancelledError("HTTP engine shut down"));
+  }
+  for (CURL *easy : idle_easy_handles_) {
+    curl_easy_cleanup(easy);
+  }
+  curl_multi_cleanup(multi_);
+  curl_share_cleanup(share_);
+}
+
+void HttpEngine::SendRequest(const api::WebRequest &request,
+                             ResponseCallback callback) {
+  auto transfer = std::make_unique<Transfer>();
+  transfer->request = request;
+  transfer->callback = std::move(callback);
+  {
+    absl::MutexLock lock(&mutex_);
+    if (!stopped_) {
+      pending_.push_back(std::move(transfer));
+    }
+  }
+  if (transfer != nullptr) {
+    std::move(transfer->callback)(
+        absl::CancelledError("HTTP engine shut down"));
+    return;
+  }
+  curl_multi_wakeup(multi_);
+}
+
+absl::StatusOr<api::WebResponse> HttpEngine::SendRequest(
+    const api::WebRequest &request) {
+  if (std::this_thread::get_id() == thread_.get_id()) {
+    return absl::FailedPreconditionError(
+        "Synchronous requests cannot be sent from a response callback");
+  }
+  absl::StatusOr<api::WebResponse> result;
+  absl::Notification done;
+  SendRequest(request,
+              [&result, &done](absl::StatusOr<api::WebResponse> response) {
+                result = std::move(response);
+                done.Notify();
+              });
+  done.WaitForNotification();
+  return result;
+}
+
+HttpEngine::Stats HttpEngine::GetStats() const {
+  absl::MutexLock lock(&mutex_);
+  return stats_;
+}
+
+void HttpEngine::Run() {
+  while (StartPendingTransfers()) {
+    int running_transfers = 0;
+    CURLMcode code = curl_multi_perform(multi_, &running_transfers);
+    if (code != CURLM_OK) {
+      NEARBY_LOGS(ERROR) << __func__ << ": curl_multi_perform failed: "
+                         << curl_multi_strerror(code);
+    }
+    FinishCompletedTransfers();
+    curl_multi_poll(multi_, nullptr, 0, kPollTimeoutMillis, nullptr);
+  }
+}
+
+bool HttpEngine::StartPendingTransfers() {
+  std::deque<std::unique_ptr<Transfer>> pending;
+  {
+    absl::MutexLock lock(&mutex_);
+    if (stopped_) return false;
+    pending.swap(pending_);
+  }
+  for (auto &transfer : pending) {
+    absl::Status status = StartTransfer(*transfer);
+    if (!status.ok()) {
+      NEARBY_LOGS(ERROR) << __func__ << ": Failed to start request to "
+                         << transfer->request.url << ": " << status;
+      std::move(transfer->callback)(status);
+      continue;
+    }
+    CURL *easy = transfer->easy;
+    active_.emplace(easy, std::move(transfer));
+  }
+  return true;
+}
+
+absl::Status HttpEngine::StartTransfer(Transfer &transfer) {
+  const api::WebRequest &request = transfer.request;
+  for (const auto &[key, value] : request.headers) {
+    curl_slist *headers = curl_slist_append(
+        transfer.headers, absl::StrCat(key, ": ", value).c_str());
+    if (headers == nullptr) {
+      return absl::ResourceExhaustedError("Failed to append request header");
+    }
+    transfer.headers = headers;
+  }
+  if (request.headers.count("Expect") == 0) {
+    // Don't wait a round trip for "100 Continue" before sending a body.
+    curl_slist *headers = curl_slist_append(transfer.headers, "Expect:");
+    if (headers == nullptr) {
+      return absl::ResourceExhaustedError("Failed to append request header");
+    }
+    transfer.headers = headers;
+  }
+
+  CURL *easy = AcquireEasyHandle();
+  if (easy == nullptr) {
+    return absl::ResourceExhaustedError("Failed to create a curl handle");
+  }
+  curl_easy_setopt(easy, CURLOPT_URL, request.url.c_str());
+  curl_easy_setopt(easy, CURLOPT_SHARE, share_);
+  curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(easy, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt(easy, CURLOPT_ACCEPT_ENCODING, "");
+  curl_easy_setopt(easy, CURLOPT_TCP_KEEPALIVE, 1L);
+  curl_easy_setopt(easy, CURLOPT_HTTP_VERSION,
+                   static_cast<long>(CURL_HTTP_VERSION_2TLS));
+  if (absl::StartsWith(request.url, "https://")) {
+    // Prefer waiting for a connection that may turn out to be HTTP/2 over
+    // opening another one to the same host. Plain HTTP is never multiplexed.
+    curl_easy_setopt(easy, CURLOPT_PIPEWAIT, 1L);
+  }
+  curl_easy_setopt(easy, CURLOPT_CONNECTTIMEOUT_MS,
+                   static_cast<long>(
+                       absl::ToInt64Milliseconds(options_.connect_timeout)));
+  curl_easy_setopt(easy, CURLOPT_TIMEOUT_MS,
+                   static_cast<long>(
+                       absl::ToInt64Milliseconds(options_.request_timeout)));
+  curl_easy_setopt(easy, CURLOPT_ERRORBUFFER, transfer.error);
+  curl_easy_setopt(easy, CURLOPT_HTTPHEADER, transfer.headers);
+  curl_easy_setopt(easy, CURLOPT_HEADERFUNCTION, OnResponseHeader);
+  curl_easy_setopt(easy, CURLOPT_HEADERDATA, &transfer.response);
+  curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, OnResponseBody);
+  curl_easy_setopt(easy, CURLOPT_WRITEDATA, &transfer.response.body);
+
+  if (request.method == "GET") {
+    curl_easy_setopt(easy, CURLOPT_HTTPGET, 1L);
+  } else if (request.method == "HEAD") {
+    curl_easy_setopt(easy, CURLOPT_NOBODY, 1L);
+  } else {
+    if (request.method == "POST" || !request.body.empty()) {
+      curl_easy_setopt(easy, CURLOPT_POSTFIELDSIZE_LARGE,
+                       static_cast<curl_off_t>(request.body.size()));
+      curl_easy_setopt(easy, CURLOPT_POSTFIELDS, request.body.data());
+    }
+    if (request.method != "POST") {
+      curl_easy_setopt(easy, CURLOPT_CUSTOMREQUEST, request.method.c_str());
+    }
+  }
+
+  CURLMcode code = curl_multi_add_handle(multi_, easy);
+  if (code != CURLM_OK) {
+    ReleaseEasyHandle(easy);
+    return absl::InternalError(curl_multi_strerror(code));
+  }
+  transfer.easy = easy;
+  return absl::OkStatus();
+}
+
+void HttpEngine::FinishCompletedTransfers() {
+  int queued_messages = 0;
+  while (CURLMsg *message = curl_multi_info_read(multi_, &queued_messages)) {
+    if (message->msg != CURLMSG_DONE) continue;
+    // The message is invalidated once its handle is removed.
+    CURL *easy = message->easy_handle;
+    CURLcode result = message->data.result;
+    auto it = active_.find(easy);
+    if (it == active_.end()) continue;
+    Transfer &transfer = *it->second;
+    if (result != CURLE_OK) {
+      FinishTransfer(easy, CurlCodeToStatus(result, transfer.error));
+      continue;
+    }
+    long status_code = 0;
+    curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &status_code);
+    transfer.response.status_code = static_cast<int>(status_code);
+    FinishTransfer(easy, std::move(transfer.response));
+  }
+}
+
+void HttpEngine::FinishTransfer(CURL *easy,
+                                absl::StatusOr<api::WebResponse> result) {
+  auto node = active_.extract(easy);
+  std::unique_ptr<Transfer> transfer = std::move(node.mapped());
+  long connections_opened = 0;
+  curl_easy_getinfo(easy, CURLINFO_NUM_CONNECTS, &connections_opened);
+  curl_multi_remove_handle(multi_, easy);
+  ReleaseEasyHandle(easy);
+  {
+    absl::MutexLock lock(&mutex_);
+    stats_.connections_opened += connections_opened;
+    if (result.ok()) ++stats_.requests_completed;
+  }
+  std::move(transfer->callback)(std::move(result));
+}
+
+CURL *HttpEngine::AcquireEasyHandle() {
+  if (idle_easy_handles_.empty()) return curl_easy_init();
+  CURL *easy = idle_easy_handles_.back();
+  idle_easy_handles_.pop_back();
+  return easy;
+}
+
+void HttpEngine::ReleaseEasyHandle(CURL *easy) {
+  if (idle_easy_handles_.size() >=
+      static_cast<size_t>(options_.max_idle_connections)) {
+    curl_easy_cleanup(easy);
+    return;
+  }
+  // Drops the options pointing into the finished transfer. Live connections
+  // stay in the multi handle's cache.
+  curl_easy_reset(easy);
+  idle_easy_handles_.push_back(easy);
+}
+
+}  // namespace linux
+}  // namespace nearby
@@ -0,0 +1,124 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PLATFORM_IMPL_LINUX_HTTP_ENGINE_H_
+#define PLATFORM_IMPL_LINUX_HTTP_ENGINE_H_
+
+#include <curl/curl.h>
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/functional/any_invocable.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "internal/platform/implementation/http_loader.h"
+
+namespace nearby {
+namespace linux {
+
+// Sends HTTP requests through a single libcurl multi handle driven by one
+// background thread.
+//
+// All requests share the multi handle's connection cache, so connections are
+// kept alive and reused, and requests to the same HTTP/2 host are multiplexed
+// over one connection. TLS sessions and DNS results are shared as well. Any
+// number of requests may be in flight at once; the per-host and total
+// connection limits decide how many sockets they use.
+class HttpEngine {
+ public:
+  struct Options {
+    // Connections to a single host. Requests beyond this wait for a free
+    // connection, or share one if the host speaks HTTP/2.
+    int max_connections_per_host = 6;
+    // Connections across all hosts.
+    int max_total_connections = 16;
+    // Idle connections kept open for reuse.
+    int max_idle_connections = 8;
+    absl::Duration connect_timeout = absl::Seconds(15);
+    absl::Duration request_timeout = absl::Seconds(60);
+  };
+
+  struct Stats {
+    // New connections opened, as opposed to reused from the cache.
+    std::int64_t connections_opened = 0;
+    std::int64_t requests_completed = 0;
+  };
+
+  using ResponseCallback =
+      absl::AnyInvocable<void(absl::StatusOr<api::WebResponse>) &&>;
+
+  // The engine used by ImplementationPlatform::SendRequest. Never destroyed.
+  static HttpEngine &GetDefault();
+
+  HttpEngine() : HttpEngine(Options()) {}
+  explicit HttpEngine(const Options &options);
+  HttpEngine(const HttpEngine &) = delete;
+  HttpEngine &operator=(const HttpEngine &) = delete;
+
+  // Fails requests that have not completed yet with a CancelledError.
+  ~HttpEngine();
+
+  // Starts `request` and returns immediately. `callback` runs on the engine
+  // thread once the response is complete, so it must not block or call the
+  // synchronous SendRequest().
+  void SendRequest(const api::WebRequest &request, ResponseCallback callback)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Sends `request` and blocks until the response is complete.
+  absl::StatusOr<api::WebResponse> SendRequest(const api::WebRequest &request)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  Stats GetStats() const ABSL_LOCKS_EXCLUDED(mutex_);
+
+ private:
+  struct Transfer;
+
+  void Run() ABSL_LOCKS_EXCLUDED(mutex_);
+  // Moves queued requests onto the multi handle. Returns false once the engine
+  // is stopping.
+  bool StartPendingTransfers() ABSL_LOCKS_EXCLUDED(mutex_);
+  absl::Status StartTransfer(Transfer &transfer);
+  void FinishCompletedTransfers() ABSL_LOCKS_EXCLUDED(mutex_);
+  void FinishTransfer(CURL *easy, absl::StatusOr<api::WebResponse> result);
+
+  CURL *AcquireEasyHandle();
+  void ReleaseEasyHandle(CURL *easy);
+
+  const Options options_;
+  CURLM *const multi_;
+  CURLSH *const share_;
+
+  // Only touched by the engine thread.
+  absl::flat_hash_map<CURL *, std::unique_ptr<Transfer>> active_;
+  std::vector<CURL *> idle_easy_handles_;
+
+  mutable absl::Mutex mutex_;
+  std::deque<std::unique_ptr<Transfer>> pending_ ABSL_GUARDED_BY(mutex_);
+  bool stopped_ ABSL_GUARDED_BY(mutex_) = false;
+  Stats stats_ ABSL_GUARDED_BY(mutex_);
+
+  std::thread thread_;
+};
+
+}  // namespace linux
+}  // namespace nearby
+
+#endif  // PLATFORM_IMPL_LINUX_HTTP_ENGINE_H_
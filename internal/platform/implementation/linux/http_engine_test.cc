@@ -0,0 +1,308 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "internal/platform/implementation/linux/http_engine.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <thread>  // NOLINT
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/blocking_counter.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "internal/platform/implementation/http_loader.h"
+
+namespace nearby {
+namespace linux {
+namespace {
+
+constexpr absl::Duration kSlowResponseDelay = absl::Milliseconds(200);
+
+// A minimal HTTP/1.1 server on 127.0.0.1 that keeps connections alive. Each
+// response body echoes the request method, path and body. Requests for
+// "/slow" are answered after kSlowResponseDelay.
+class LocalHttpServer {
+ public:
+  LocalHttpServer() {
+    listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(listen_fd_, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+    listen(listen_fd_, 16);
+    socklen_t length = sizeof(address);
+    getsockname(listen_fd_, reinterpret_cast<sockaddr *>(&address), &length);
+    port_ = ntohs(address.sin_port);
+    accept_thread_ = std::thread([this]() { AcceptLoop(); });
+  }
+
+  ~LocalHttpServer() {
+    shutdown(listen_fd_, SHUT_RDWR);
+    close(listen_fd_);
+    accept_thread_.join();
+    {
+      // Only the connections still open; the numbers of closed ones may have
+      // been reused already.
+      absl::MutexLock lock(&mutex_);
+      for (int fd : connection_fds_) shutdown(fd, SHUT_RDWR);
+    }
+    for (auto &thread : connection_threads_) thread.join();
+  }
+
+  std::string Url(absl::string_view path) const {
+    return absl::StrCat("http://127.0.0.1:", port_, path);
+  }
+  int port() const { return port_; }
+
+  int connections_accepted() const { return connections_accepted_; }
+  int max_concurrent_requests() const { return max_concurrent_requests_; }
+
+ private:
+  void AcceptLoop() {
+    while (true) {
+      int fd = accept(listen_fd_, nullptr, nullptr);
+      if (fd < 0) return;
+      ++connections_accepted_;
+      absl::MutexLock lock(&mutex_);
+      connection_fds_.insert(fd);
+      connection_threads_.emplace_back([this, fd]() { Serve(fd); });
+    }
+  }
+
+  void CloseConnection(int fd) {
+    absl::MutexLock lock(&mutex_);
+    connection_fds_.erase(fd);
+    close(fd);
+  }
+
+  void Serve(int fd) {
+    std::string buffer;
+    char chunk[4096];
+    while (true) {
+      size_t header_end;
+      while ((header_end = buffer.find("\r\n\r\n")) == std::string::npos) {
+        ssize_t n = read(fd, chunk, sizeof(chunk));
+        if (n <= 0) {
+          CloseConnection(fd);
+          return;
+        }
+        buffer.append(chunk, n);
+      }
+      std::string head = buffer.substr(0, header_end);
+      size_t content_length = 0;
+      size_t pos = head.find("Content-Length:");
+      if (pos != std::string::npos) {
+        absl::string_view value = absl::string_view(head).substr(pos + 15);
+        value = value.substr(0, value.find("\r\n"));
+        (void)absl::SimpleAtoi(absl::StripAsciiWhitespace(value),
+                               &content_length);
+      }
+      while (buffer.size() < header_end + 4 + content_length) {
+        ssize_t n = read(fd, chunk, sizeof(chunk));
+        if (n <= 0) {
+          CloseConnection(fd);
+          return;
+        }
+        buffer.append(chunk, n);
+      }
+      absl::string_view request_line =
+          absl::string_view(head).substr(0, head.find("\r\n"));
+      size_t method_end = request_line.find(' ');
+      absl::string_view method = request_line.substr(0, method_end);
+      absl::string_view path = request_line.substr(method_end + 1);
+      path = path.substr(0, path.find(' '));
+      std::string body =
+          absl::StrCat(method, " ", path, " ",
+                       buffer.substr(header_end + 4, content_length));
+      buffer.erase(0, header_end + 4 + content_length);
+
+      int concurrent = ++concurrent_requests_;
+      int max = max_concurrent_requests_;
+      while (concurrent > max &&
+             !max_concurrent_requests_.compare_exchange_weak(max, concurrent)) {
+      }
+      if (path == "/slow") absl::SleepFor(kSlowResponseDelay);
+      --concurrent_requests_;
+
+      std::string response = absl::StrCat(
+          "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: ",
+          body.size(), "\r\n\r\n", body);
+      if (write(fd, response.data(), response.size()) < 0) {
+        CloseConnection(fd);
+        return;
+      }
+    }
+  }
+
+  int listen_fd_;
+  int port_;
+  std::thread accept_thread_;
+  std::atomic<int> connections_accepted_ = 0;
+  std::atomic<int> concurrent_requests_ = 0;
+  std::atomic<int> max_concurrent_requests_ = 0;
+  absl::Mutex mutex_;
+  // Connections accepted and not closed yet.
+  absl::flat_hash_set<int> connection_fds_ ABSL_GUARDED_BY(mutex_);
+  std::vector<std::thread> connection_threads_ ABSL_GUARDED_BY(mutex_);
+};
+
+api::WebRequest MakeRequest(std::string url, std::string method = "GET",
+                            std::string body = "") {
+  api::WebRequest request;
+  request.url = std::move(url);
+  request.method = std::move(method);
+  request.body = std::move(body);
+  return request;
+}
+
+TEST(HttpEngineTest, GetReturnsStatusHeadersAndBody) {
+  LocalHttpServer server;
+  HttpEngine engine;
+
+  absl::StatusOr<api::WebResponse> response =
+      engine.SendRequest(MakeRequest(server.Url("/index")));
+
+  ASSERT_TRUE(response.ok()) << response.status();
+  EXPECT_EQ(response->status_code, 200);
+  EXPECT_EQ(response->status_text, "OK");
+  auto content_type = response->headers.find("Content-Type");
+  ASSERT_NE(content_type, response->headers.end());
+  EXPECT_EQ(content_type->second, "text/plain");
+  EXPECT_EQ(response->body, "GET /index ");
+}
+
+TEST(HttpEngineTest, SendsRequestBody) {
+  LocalHttpServer server;
+  HttpEngine engine;
+  std::string body(64 * 1024, 'x');
+
+  absl::StatusOr<api::WebResponse> post =
+      engine.SendRequest(MakeRequest(server.Url("/upload"), "POST", body));
+  absl::StatusOr<api::WebResponse> put =
+      engine.SendRequest(MakeRequest(server.Url("/upload"), "PUT", "abc"));
+
+  ASSERT_TRUE(post.ok()) << post.status();
+  EXPECT_EQ(post->body, absl::StrCat("POST /upload ", body));
+  ASSERT_TRUE(put.ok()) << put.status();
+  EXPECT_EQ(put->body, "PUT /upload abc");
+}
+
+TEST(HttpEngineTest, SequentialRequestsReuseConnection) {
+  LocalHttpServer server;
+  HttpEngine engine;
+
+  for (int i = 0; i < 5; ++i) {
+    absl::StatusOr<api::WebResponse> response =
+        engine.SendRequest(MakeRequest(server.Url(absl::StrCat("/", i))));
+    ASSERT_TRUE(response.ok()) << response.status();
+  }
+
+  EXPECT_EQ(server.connections_accepted(), 1);
+  HttpEngine::Stats stats = engine.GetStats();
+  EXPECT_EQ(stats.connections_opened, 1);
+  EXPECT_EQ(stats.requests_completed, 5);
+}
+
+TEST(HttpEngineTest, RequestsRunConcurrently) {
+  constexpr int kRequests = 4;
+  LocalHttpServer server;
+  HttpEngine engine;
+  absl::BlockingCounter done(kRequests);
+  std::atomic<int> succeeded = 0;
+
+  absl::Time start = absl::Now();
+  for (int i = 0; i < kRequests; ++i) {
+    engine.SendRequest(MakeRequest(server.Url("/slow")),
+                       [&](absl::StatusOr<api::WebResponse> response) {
+                         if (response.ok()) ++succeeded;
+                         done.DecrementCount();
+                       });
+  }
+  done.Wait();
+
+  EXPECT_EQ(succeeded, kRequests);
+  EXPECT_EQ(server.max_concurrent_requests(), kRequests);
+  EXPECT_LT(absl::Now() - start, kSlowResponseDelay * kRequests);
+}
+
+TEST(HttpEngineTest, PerHostConnectionLimit) {
+  constexpr int kRequests = 3;
+  LocalHttpServer server;
+  HttpEngine engine({.max_connections_per_host = 1});
+  absl::BlockingCounter done(kRequests);
+  std::atomic<int> succeeded = 0;
+
+  for (int i = 0; i < kRequests; ++i) {
+    engine.SendRequest(MakeRequest(server.Url("/slow")),
+                       [&](absl::StatusOr<api::WebResponse> response) {
+                         if (response.ok()) ++succeeded;
+                         done.DecrementCount();
+                       });
+  }
+  done.Wait();
+
+  EXPECT_EQ(succeeded, kRequests);
+  EXPECT_EQ(server.connections_accepted(), 1);
+  EXPECT_EQ(server.max_concurrent_requests(), 1);
+}
+
+TEST(HttpEngineTest, ConnectionFailure) {
+  int port;
+  {
+    LocalHttpServer server;
+    port = server.port();
+  }
+  HttpEngine engine;
+
+  absl::StatusOr<api::WebResponse> response = engine.SendRequest(
+      MakeRequest(absl::StrCat("http://127.0.0.1:", port, "/")));
+
+  EXPECT_TRUE(absl::IsUnavailable(response.status())) << response.status();
+}
+
+TEST(HttpEngineTest, PendingRequestsAreCancelledOnDestruction) {
+  LocalHttpServer server;
+  absl::StatusOr<api::WebResponse> result;
+  {
+    HttpEngine engine;
+    engine.SendRequest(MakeRequest(server.Url("/slow")),
+                       [&result](absl::StatusOr<api::WebResponse> response) {
+                         result = std::move(response);
+                       });
+  }
+
+  EXPECT_TRUE(absl::IsCancelled(result.status())) << result.status();
+}
+
+}  // namespace
+}  // namespace linux
+}  // namespace nearby
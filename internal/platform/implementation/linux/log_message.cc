@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include <sys/syslog.h>
+#include <algorithm>
 #include <cassert>
 #include <cstdarg>
 #include <cstddef>
@@ -20,12 +21,21 @@
 #include <cstdlib>
 #include <ctime>
 #include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
 
 #define SD_JOURNAL_SUPPRESS_LOCATION true
 #include <systemd/sd-journal.h>
 
 #include "absl/base/call_once.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "glog/logging.h"
+#include "internal/platform/implementation/linux/async_log_writer.h"
 #include "internal/platform/implementation/linux/dbus.h"
 #include "internal/platform/implementation/linux/log_message.h"
 
@@ -50,23 +60,152 @@ inline google::LogSeverity ConvertSeverity(api::LogMessage::Severity severity) {
   }
 }
 
+// A reusable ostream writing into a growable string.
+class LogBuffer : public std::streambuf {
+ public:
+  LogBuffer() : stream_(this) {}
+
+  std::ostream &stream() { return stream_; }
+  std::string &text() { return text_; }
+
+  // Empties the buffer and undoes formatting changes left behind by the
+  // previous message.
+  void Reset() {
+    // Don't hold on to memory used by an unusually long message.
+    if (text_.capacity() > kMaxRetainedCapacity) {
+      std::string().swap(text_);
+    }
+    text_.clear();
+    stream_.clear();
+    stream_.flags(std::ios_base::dec | std::ios_base::skipws);
+    stream_.fill(' ');
+    stream_.precision(6);
+    stream_.width(0);
+  }
+
+ protected:
+  int_type overflow(int_type c) override {
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+      text_.push_back(traits_type::to_char_type(c));
+    }
+    return traits_type::not_eof(c);
+  }
+
+  std::streamsize xsputn(const char *s, std::streamsize n) override {
+    text_.append(s, n);
+    return n;
+  }
+
+ private:
+  static constexpr size_t kMaxRetainedCapacity = 16 * 1024;
+
+  std::string text_;
+  std::ostream stream_;
+};
+
+namespace {
+
+// Buffers of the calling thread, one per level of nesting, since a value
+// being logged may itself log while it is formatted.
+thread_local std::vector<std::unique_ptr<LogBuffer>> log_buffers;
+thread_local size_t log_buffers_in_use = 0;
+
+LogBuffer &AcquireLogBuffer() {
+  if (log_buffers_in_use == log_buffers.size()) {
+    log_buffers.push_back(std::make_unique<LogBuffer>());
+  }
+  LogBuffer &buffer = *log_buffers[log_buffers_in_use++];
+  buffer.Reset();
+  return buffer;
+}
+
+void ReleaseLogBuffer() { --log_buffers_in_use; }
+
+void WriteToGlog(const char *file, int line, api::LogMessage::Severity severity,
+                 absl::string_view text) {
+  google::LogMessage(file, line, ConvertSeverity(severity)).stream() << text;
+}
+
+// Writes a queued record. glog would stamp it with the time and thread it is
+// written on, so the record goes out without glog's prefix, and with the
+// same prefix built from the time and thread it was logged on instead.
+void WriteToGlog(const AsyncLogWriter::Record &record) {
+  google::LogSeverity severity = ConvertSeverity(record.severity);
+  google::LogMessage message(record.file, google::LogMessage::kNoLogPrefix,
+                             severity);
+  if (FLAGS_log_prefix) {
+    absl::string_view file = record.file;
+    file.remove_prefix(file.rfind('/') + 1);
+    message.stream() << absl::StrFormat(
+        "%c%s %5u %s:%d] ", google::GetLogSeverityName(severity)[0],
+        absl::FormatTime("%m%d %H:%M:%E6S", record.time,
+                         absl::LocalTimeZone()),
+        static_cast<unsigned int>(record.thread_id), file, record.line);
+  }
+  message.stream() << record.GetText();
+}
+
+AsyncLogWriter &GetAsyncLogWriter() {
+  static AsyncLogWriter *writer = []() {
+    auto *writer = new AsyncLogWriter(
+        [](const AsyncLogWriter::Record &record) { WriteToGlog(record); });
+    // Don't lose queued messages when the process exits normally.
+    std::atexit([]() { LogMessage::Flush(); });
+    return writer;
+  }();
+  return *writer;
+}
+
+}  // namespace
+
 LogMessage::LogMessage(const char *file, int line, Severity severity)
-    : log_streamer_(file, line, ConvertSeverity(severity)) {}
+    : file_(file), line_(line), severity_(severity),
+      buffer_(AcquireLogBuffer()) {}
+
+LogMessage::~LogMessage() {
+  const std::string &text = buffer_.text();
+  AsyncLogWriter &writer = GetAsyncLogWriter();
+  if (severity_ == Severity::kFatal ||
+      text.size() > AsyncLogWriter::kMaxTextSize) {
+    // Keep the order of messages, and make sure everything is out before a
+    // FATAL message terminates the process.
+    writer.Flush();
+    WriteToGlog(file_, line_, severity_, text);
+  } else if (!writer.TryWrite(severity_, file_, line_, text)) {
+    if (severity_ >= Severity::kWarning) {
+      writer.Flush();
+      WriteToGlog(file_, line_, severity_, text);
+    } else {
+      writer.RecordDropped();
+    }
+  }
+  ReleaseLogBuffer();
+}
 
 void LogMessage::Print(const char *format, ...) {
-  char *buf = nullptr;
+  std::string &text = buffer_.text();
+  size_t offset = text.size();
 
   va_list ap;
   va_start(ap, format);
-  auto ret = vasprintf(&buf, format, ap);
-  if (ret > 0) {
-    log_streamer_.stream() << std::string(buf, ret);
+  va_list ap_copy;
+  va_copy(ap_copy, ap);
+  // Try formatting into the capacity the buffer already has first.
+  text.resize(text.capacity());
+  int ret = vsnprintf(text.data() + offset, text.size() - offset + 1, format,
+                      ap);
+  if (ret > 0 && offset + ret > text.size()) {
+    text.resize(offset + ret);
+    vsnprintf(text.data() + offset, ret + 1, format, ap_copy);
   }
-  if (buf != nullptr) free(buf);
+  text.resize(offset + std::max(ret, 0));
+  va_end(ap_copy);
   va_end(ap);
 }
 
-std::ostream &LogMessage::Stream() { return log_streamer_.stream(); }
+std::ostream &LogMessage::Stream() { return buffer_.stream(); }
+
+void LogMessage::Flush() { GetAsyncLogWriter().Flush(); }
 
 }  // namespace linux
 
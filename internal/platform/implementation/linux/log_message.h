@@ -18,26 +18,39 @@
 #include <sdbus-c++/AdaptorInterfaces.h>
 #include <sdbus-c++/IConnection.h>
 #include <atomic>
+#include <ostream>
 
-#include "glog/logging.h"
 #include "internal/platform/implementation/log_message.h"
 
 namespace nearby {
 namespace linux {
 
+class LogBuffer;
+
 // See documentation in
 // cpp/platform/api/log_message.h
+//
+// Messages are formatted into a buffer owned by the calling thread and, when
+// the message is destroyed, queued on an AsyncLogWriter that passes them to
+// glog on a background thread. FATAL messages, and messages too long for the
+// queue, are written synchronously after the queue has been flushed.
 class LogMessage : public api::LogMessage {
  public:
   LogMessage(const char *file, int line, Severity severity);
-  ~LogMessage() override{};
+  ~LogMessage() override;
 
   void Print(const char *format, ...) override;
 
   std::ostream &Stream() override;
 
+  // Blocks until all queued messages have been written.
+  static void Flush();
+
  private:
-  google::LogMessage log_streamer_;
+  const char *file_;
+  int line_;
+  Severity severity_;
+  LogBuffer &buffer_;
 };
 }  // namespace linux
 }  // namespace nearby
@@ -0,0 +1,188 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "internal/platform/implementation/linux/loopback_wifi_lan.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "internal/platform/implementation/linux/tcp_server_socket.h"
+#include "internal/platform/implementation/linux/wifi_lan_socket.h"
+#include "internal/platform/logging.h"
+
+namespace nearby {
+namespace linux {
+namespace {
+
+// Same as WifiLanServerSocket, except that it reports the loopback address
+// rather than asking NetworkManager for one.
+class LoopbackWifiLanServerSocket : public api::WifiLanServerSocket {
+ public:
+  explicit LoopbackWifiLanServerSocket(TCPServerSocket socket)
+      : server_socket_(std::move(socket)) {}
+
+  std::string GetIPAddress() const override {
+    return LoopbackWifiLanMedium::kLoopbackAddress;
+  }
+  int GetPort() const override { return server_socket_.GetPort(); }
+
+  std::unique_ptr<api::WifiLanSocket> Accept() override {
+    auto sock = server_socket_.Accept();
+    if (!sock.has_value()) return nullptr;
+    return std::make_unique<WifiLanSocket>(std::move(*sock));
+  }
+  Exception Close() override { return server_socket_.Close(); }
+
+ private:
+  TCPServerSocket server_socket_;
+};
+
+}  // namespace
+
+bool LoopbackServiceRegistry::Register(const NsdServiceInfo &service_info) {
+  {
+    absl::MutexLock lock(&mutex_);
+    ServiceKey key(service_info.GetServiceName(),
+                   service_info.GetServiceType());
+    if (!services_.emplace(key, service_info).second) {
+      NEARBY_LOGS(ERROR) << __func__
+                         << ": advertising is already active for this service";
+      return false;
+    }
+  }
+  Notify(service_info, /*discovered=*/true);
+  return true;
+}
+
+bool LoopbackServiceRegistry::Unregister(const NsdServiceInfo &service_info) {
+  NsdServiceInfo removed;
+  {
+    absl::MutexLock lock(&mutex_);
+    auto it = services_.find(ServiceKey(service_info.GetServiceName(),
+                                        service_info.GetServiceType()));
+    if (it == services_.end()) return false;
+    removed = std::move(it->second);
+    services_.erase(it);
+  }
+  Notify(removed, /*discovered=*/false);
+  return true;
+}
+
+int LoopbackServiceRegistry::AddBrowser(const std::string &service_type,
+                                        DiscoveredServiceCallback callback) {
+  auto browser = std::make_shared<Browser>();
+  browser->service_type = service_type;
+  browser->callback = std::move(callback);
+  std::vector<NsdServiceInfo> existing;
+  int browser_id;
+  {
+    absl::MutexLock lock(&mutex_);
+    browser_id = next_browser_id_++;
+    browsers_.emplace(browser_id, browser);
+    for (const auto &[key, service_info] : services_) {
+      if (key.second == service_type) existing.push_back(service_info);
+    }
+  }
+  for (auto &service_info : existing) {
+    browser->callback.service_discovered_cb(std::move(service_info));
+  }
+  return browser_id;
+}
+
+void LoopbackServiceRegistry::RemoveBrowser(int browser_id) {
+  absl::MutexLock lock(&mutex_);
+  browsers_.erase(browser_id);
+}
+
+void LoopbackServiceRegistry::Notify(const NsdServiceInfo &service_info,
+                                     bool discovered) {
+  // Callbacks run without the lock held, so they may call back into the
+  // registry.
+  std::vector<std::shared_ptr<Browser>> browsers;
+  {
+    absl::MutexLock lock(&mutex_);
+    for (const auto &[id, browser] : browsers_) {
+      if (browser->service_type == service_info.GetServiceType()) {
+        browsers.push_back(browser);
+      }
+    }
+  }
+  for (const auto &browser : browsers) {
+    if (discovered) {
+      browser->callback.service_discovered_cb(service_info);
+    } else {
+      browser->callback.service_lost_cb(service_info);
+    }
+  }
+}
+
+bool LoopbackWifiLanMedium::StartAdvertising(
+    const NsdServiceInfo &nsd_service_info) {
+  NsdServiceInfo service_info = nsd_service_info;
+  service_info.SetIPAddress(kLoopbackAddress);
+  return registry_->Register(service_info);
+}
+
+bool LoopbackWifiLanMedium::StopAdvertising(
+    const NsdServiceInfo &nsd_service_info) {
+  return registry_->Unregister(nsd_service_info);
+}
+
+bool LoopbackWifiLanMedium::StartDiscovery(const std::string &service_type,
+                                           DiscoveredServiceCallback callback) {
+  absl::MutexLock lock(&mutex_);
+  if (browser_ids_.contains(service_type)) {
+    NEARBY_LOGS(ERROR) << __func__ << ": A service browser for service type "
+                       << service_type << " already exists";
+    return false;
+  }
+  browser_ids_[service_type] =
+      registry_->AddBrowser(service_type, std::move(callback));
+  return true;
+}
+
+bool LoopbackWifiLanMedium::StopDiscovery(const std::string &service_type) {
+  absl::MutexLock lock(&mutex_);
+  auto it = browser_ids_.find(service_type);
+  if (it == browser_ids_.end()) {
+    NEARBY_LOGS(ERROR) << __func__ << ": Service type " << service_type
+                       << " has not been registered for discovery";
+    return false;
+  }
+  registry_->RemoveBrowser(it->second);
+  browser_ids_.erase(it);
+  return true;
+}
+
+std::unique_ptr<api::WifiLanSocket> LoopbackWifiLanMedium::ConnectToService(
+    const std::string &ip_address, int port,
+    CancellationFlag *cancellation_flag) {
+  auto socket = TCPSocket::Connect(ip_address, port);
+  if (!socket.has_value()) return nullptr;
+  return std::make_unique<WifiLanSocket>(std::move(*socket));
+}
+
+std::unique_ptr<api::WifiLanServerSocket>
+LoopbackWifiLanMedium::ListenForService(int port) {
+  std::string address = kLoopbackAddress;
+  auto socket = TCPServerSocket::Listen(std::ref(address), port);
+  if (!socket.has_value()) return nullptr;
+  return std::make_unique<LoopbackWifiLanServerSocket>(std::move(*socket));
+}
+
+}  // namespace linux
+}  // namespace nearby
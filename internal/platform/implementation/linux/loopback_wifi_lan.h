@@ -0,0 +1,121 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PLATFORM_IMPL_LINUX_LOOPBACK_WIFI_LAN_H_
+#define PLATFORM_IMPL_LINUX_LOOPBACK_WIFI_LAN_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/optional.h"
+#include "internal/platform/implementation/linux/tcp_server_socket.h"
+#include "internal/platform/implementation/wifi_lan.h"
+#include "internal/platform/nsd_service_info.h"
+
+namespace nearby {
+namespace linux {
+
+// In-process stand-in for Avahi. Services registered by one
+// LoopbackWifiLanMedium are reported to the discovery callbacks of every other
+// medium sharing the registry.
+class LoopbackServiceRegistry {
+ public:
+  using DiscoveredServiceCallback =
+      api::WifiLanMedium::DiscoveredServiceCallback;
+
+  bool Register(const NsdServiceInfo &service_info)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+  bool Unregister(const NsdServiceInfo &service_info)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Reports all services of |service_type| registered so far, and any
+  // registered or unregistered later, to |callback|. Returns an id for
+  // RemoveBrowser().
+  int AddBrowser(const std::string &service_type,
+                 DiscoveredServiceCallback callback)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+  void RemoveBrowser(int browser_id) ABSL_LOCKS_EXCLUDED(mutex_);
+
+ private:
+  struct Browser {
+    std::string service_type;
+    DiscoveredServiceCallback callback;
+  };
+  using ServiceKey = std::pair<std::string, std::string>;
+
+  void Notify(const NsdServiceInfo &service_info, bool discovered)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  absl::Mutex mutex_;
+  absl::flat_hash_map<ServiceKey, NsdServiceInfo> services_
+      ABSL_GUARDED_BY(mutex_);
+  absl::flat_hash_map<int, std::shared_ptr<Browser>> browsers_
+      ABSL_GUARDED_BY(mutex_);
+  int next_browser_id_ ABSL_GUARDED_BY(mutex_) = 0;
+};
+
+// A WifiLanMedium that uses the production TCP sockets and streams, bound to
+// 127.0.0.1, with service discovery going through a LoopbackServiceRegistry
+// instead of Avahi. It needs neither D-Bus nor NetworkManager, so two
+// instances can exchange data in a single process.
+class LoopbackWifiLanMedium : public api::WifiLanMedium {
+ public:
+  static constexpr char kLoopbackAddress[] = "127.0.0.1";
+
+  explicit LoopbackWifiLanMedium(
+      std::shared_ptr<LoopbackServiceRegistry> registry)
+      : registry_(std::move(registry)) {}
+
+  bool IsNetworkConnected() const override { return true; }
+
+  bool StartAdvertising(const NsdServiceInfo &nsd_service_info) override;
+  bool StopAdvertising(const NsdServiceInfo &nsd_service_info) override;
+
+  bool StartDiscovery(const std::string &service_type,
+                      DiscoveredServiceCallback callback) override
+      ABSL_LOCKS_EXCLUDED(mutex_);
+  bool StopDiscovery(const std::string &service_type) override
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  std::unique_ptr<api::WifiLanSocket> ConnectToService(
+      const NsdServiceInfo &remote_service_info,
+      CancellationFlag *cancellation_flag) override {
+    return ConnectToService(remote_service_info.GetIPAddress(),
+                            remote_service_info.GetPort(), cancellation_flag);
+  }
+  std::unique_ptr<api::WifiLanSocket> ConnectToService(
+      const std::string &ip_address, int port,
+      CancellationFlag *cancellation_flag) override;
+  std::unique_ptr<api::WifiLanServerSocket> ListenForService(
+      int port = 0) override;
+  absl::optional<std::pair<std::int32_t, std::int32_t>> GetDynamicPortRange()
+      override {
+    return absl::nullopt;
+  }
+
+ private:
+  std::shared_ptr<LoopbackServiceRegistry> registry_;
+  absl::Mutex mutex_;
+  absl::flat_hash_map<std::string, int> browser_ids_ ABSL_GUARDED_BY(mutex_);
+};
+
+}  // namespace linux
+}  // namespace nearby
+
+#endif  // PLATFORM_IMPL_LINUX_LOOPBACK_WIFI_LAN_H_
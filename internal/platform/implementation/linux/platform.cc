@@ -16,7 +16,6 @@
 #include <memory>
 #include <string>
 
-#include <curl/curl.h>
 #include <sdbus-c++/Error.h>
 #include <sdbus-c++/Types.h>
 
@@ -36,6 +35,7 @@
 #include "internal/platform/implementation/linux/condition_variable.h"
 #include "internal/platform/implementation/linux/dbus.h"
 #include "internal/platform/implementation/linux/generated/dbus/bluez/adapter_client.h"
+#include "internal/platform/implementation/linux/http_engine.h"
 #include "internal/platform/implementation/linux/mutex.h"
 #include "internal/platform/implementation/linux/preferences_manager.h"
 #include "internal/platform/implementation/linux/submittable_executor.h"
@@ -304,66 +304,7 @@ absl::StatusOr<api::WebResponse> ImplementationPlatform::SendRequest(
                         "request body too large");
   }
 
-  CURL *handle = curl_easy_init();
-  char errbuf[CURL_ERROR_SIZE];
-  errbuf[0] = '\0';
-
-  curl_easy_setopt(handle, CURLOPT_URL, request.url.c_str());
-  curl_easy_setopt(handle, CURLOPT_ERRORBUFFER, errbuf);
-
-  if (request.method == "GET")
-    curl_easy_setopt(handle, CURLOPT_HTTPGET, 1L);
-  else if (request.method == "POST")
-    curl_easy_setopt(handle, CURLOPT_POST, 1L);
-  else
-    curl_easy_setopt(handle, CURLOPT_CUSTOMREQUEST, request.method.c_str());
-
-  curl_easy_setopt(handle, CURLOPT_UPLOAD, request.body.c_str());
-
-  struct curl_slist *headers_slist = nullptr;
-
-  for (auto &[key, value] : request.headers) {
-    auto hdr = absl::StrCat(key, ": ", value);
-    auto temp = curl_slist_append(headers_slist, hdr.c_str());
-    if (temp == nullptr) {
-      if (headers_slist != nullptr) {
-        curl_slist_free_all(headers_slist);
-      }
-      return absl::Status(absl::StatusCode::kResourceExhausted,
-                          "failed to append header to slist");
-    }
-  }
-
-  curl_easy_setopt(handle, CURLOPT_HTTPHEADER, headers_slist);
-
-  api::WebResponse response;
-
-  if (curl_easy_perform(handle) != CURLE_OK) {
-    NEARBY_LOGS(ERROR) << __func__
-                       << ": Error performing HTTP request: " << errbuf;
-    return absl::Status(absl::StatusCode::kUnknown, errbuf);
-  }
-
-  struct curl_header *prev = nullptr;
-  struct curl_header *h;
-
-  h = curl_easy_nextheader(handle, CURLH_HEADER, 0, prev);
-  while (h != nullptr) {
-    response.headers.emplace(h->name, h->value);
-  }
-
-  auto writefn = [](char *ptr, size_t size, size_t nmemb, void *userdata) {
-    std::string *body = static_cast<std::string *>(userdata);
-    body->append(ptr, size * nmemb);
-  };
-
-  curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, writefn);
-  curl_easy_setopt(handle, CURLOPT_WRITEDATA,
-                   static_cast<void *>(&response.body));
-  long status;
-  curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &status);
-  response.status_code = status;
-  return response;
+  return linux::HttpEngine::GetDefault().SendRequest(request);
 }
 
 #ifndef NEARBY_CHROMIUM
@@ -12,11 +12,13 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <filesystem>  // NOLINT(build/c++17)
 #include <memory>
 #include <optional>
 #include <ostream>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "absl/strings/string_view.h"
@@ -47,6 +49,16 @@ PreferencesManager::PreferencesManager(absl::string_view file_path)
   value_ = preferences_repository_->LoadPreferences();
 }
 
+PreferencesManager::~PreferencesManager() {
+  {
+    absl::MutexLock lock(&mutex_);
+    shutting_down_ = true;
+  }
+  retry_executor_.Shutdown();
+  commit_executor_.Shutdown();
+  Commit();
+}
+
 bool PreferencesManager::Set(absl::string_view key, const json& value) {
   absl::MutexLock lock(&mutex_);
   return SetValue(key, value);
@@ -101,12 +113,14 @@ bool PreferencesManager::SetTime(absl::string_view key, absl::Time value) {
   // Save time as nanos
   absl::MutexLock lock(&mutex_);
   int64_t tt = absl::ToUnixNanos(value);
-  if (value_[absl::StrCat(key)] == tt) {
+  auto it = value_.find(absl::StrCat(key));
+  if (it != value_.end() && *it == tt) {
     return false;
   }
 
   value_[absl::StrCat(key)] = tt;
-  return Commit();
+  MarkDirty(key);
+  return true;
 }
 
 // Get JSON value.
@@ -178,18 +192,79 @@ absl::Time PreferencesManager::GetTime(absl::string_view key,
 // Removes preferences
 void PreferencesManager::Remove(absl::string_view key) {
   absl::MutexLock lock(&mutex_);
-  value_.erase(absl::StrCat(key));
+  if (value_.is_object() && value_.erase(absl::StrCat(key)) > 0) {
+    MarkDirty(key);
+  }
 }
 
+bool PreferencesManager::Flush() { return Commit(); }
+
 // Private methods
 
 // Writes data to storage.
 bool PreferencesManager::Commit() {
-  if (!preferences_repository_->SavePreferences(value_)) {
+  absl::MutexLock commit_lock(&commit_mutex_);
+  // Once the journal is large, fold it into a fresh snapshot instead.
+  bool compact = preferences_repository_->ShouldCompact();
+  std::vector<std::string> keys;
+  std::vector<PreferencesRepository::Update> updates;
+  json snapshot;
+  {
+    absl::MutexLock lock(&mutex_);
+    commit_scheduled_ = false;
+    if (dirty_keys_.empty()) {
+      return true;
+    }
+    keys.assign(dirty_keys_.begin(), dirty_keys_.end());
+    dirty_keys_.clear();
+    if (compact) {
+      snapshot = value_;
+    } else {
+      updates.reserve(keys.size());
+      for (const std::string& key : keys) {
+        auto it = value_.find(key);
+        std::optional<json> value;
+        if (it != value_.end()) value = *it;
+        updates.push_back({key, std::move(value)});
+      }
+    }
+  }
+
+  bool saved = compact ? preferences_repository_->SavePreferences(snapshot)
+                       : preferences_repository_->AppendUpdates(updates);
+  absl::MutexLock lock(&mutex_);
+  if (!saved) {
     NEARBY_LOGS(ERROR) << "Failed to save preference." << std::endl;
-    return false;
+    dirty_keys_.insert(std::make_move_iterator(keys.begin()),
+                       std::make_move_iterator(keys.end()));
+    ScheduleRetry();
+  } else {
+    retry_delay_ = kInitialRetryDelay;
   }
-  return true;
+  return saved;
+}
+
+void PreferencesManager::ScheduleRetry() {
+  if (retry_scheduled_ || shutting_down_) return;
+  NEARBY_LOGS(INFO) << "Retrying to save preferences in " << retry_delay_;
+  retry_scheduled_ = true;
+  retry_executor_.Schedule(
+      [this]() {
+        {
+          absl::MutexLock lock(&mutex_);
+          retry_scheduled_ = false;
+        }
+        Commit();
+      },
+      retry_delay_);
+  retry_delay_ = std::min(2 * retry_delay_, kMaxRetryDelay);
+}
+
+void PreferencesManager::MarkDirty(absl::string_view key) {
+  dirty_keys_.emplace(key);
+  if (commit_scheduled_) return;
+  commit_scheduled_ = true;
+  commit_executor_.Execute([this]() { Commit(); });
 }
 
 bool PreferencesManager::SetValue(absl::string_view key, const json& value) {
@@ -199,12 +274,15 @@ bool PreferencesManager::SetValue(absl::string_view key, const json& value) {
     value_ = json::object();
   }
 
-  if (value_[absl::StrCat(key)] == value) {
+  // Looked up with find(), as operator[] would add a null value.
+  auto it = value_.find(absl::StrCat(key));
+  if (it != value_.end() && *it == value) {
     return false;
   }
 
   value_[absl::StrCat(key)] = value;
-  return Commit();
+  MarkDirty(key);
+  return true;
 }
 
 template <typename T>
@@ -237,12 +315,14 @@ bool PreferencesManager::SetArrayValue(absl::string_view key,
     array_value.push_back(item_value);
   }
 
-  if (value_[absl::StrCat(key)] == array_value) {
+  auto it = value_.find(absl::StrCat(key));
+  if (it != value_.end() && *it == array_value) {
     return false;
   }
 
   value_[absl::StrCat(key)] = array_value;
-  return Commit();
+  MarkDirty(key);
+  return true;
 }
 
 template <typename T>
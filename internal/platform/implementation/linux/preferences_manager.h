@@ -22,11 +22,14 @@
 #include <vector>
 
 #include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_set.h"
 #include "absl/strings/string_view.h"
 #include "absl/synchronization/mutex.h"
 #include "absl/time/time.h"
 #include "absl/types/span.h"
+#include "internal/platform/implementation/linux/executor.h"
 #include "internal/platform/implementation/linux/preferences_repository.h"
+#include "internal/platform/implementation/linux/scheduled_executor.h"
 #include "internal/platform/implementation/preferences_manager.h"
 #include "nlohmann/json.hpp"
 #include "nlohmann/json_fwd.hpp"
@@ -38,11 +41,21 @@ namespace linux {
 // Preferences are persistent storage for application settings, it is key/value
 // based settings. Application components can observe the interested preference
 // change by the observer.
+//
+// Changes are written behind: setters update the in-memory values and return
+// right away, and a background task appends the changed keys to the
+// repository's journal. Changes made while a write is in progress are
+// coalesced into the next one. A failed write is retried with exponential
+// backoff.
 class PreferencesManager : public api::PreferencesManager {
  public:
   explicit PreferencesManager(absl::string_view path);
+  // Writes any pending changes before returning.
+  ~PreferencesManager() override;
 
-  // Sets values
+  // Sets values. These return false, and write nothing, if `key` already holds
+  // `value`. Otherwise they schedule the new value to be written and return
+  // true; whether the write succeeds is reported by Flush().
 
   bool Set(absl::string_view key, const nlohmann::json& value) override
       ABSL_LOCKS_EXCLUDED(mutex_);
@@ -108,9 +121,22 @@ class PreferencesManager : public api::PreferencesManager {
   // Removes preferences
   void Remove(absl::string_view key) override ABSL_LOCKS_EXCLUDED(mutex_);
 
+  // Writes all changes made so far to storage, returning false if that failed.
+  // Changes that failed to be written are retried on the next write.
+  bool Flush() ABSL_LOCKS_EXCLUDED(mutex_, commit_mutex_);
+
  private:
-  // Writes data to storage.
-  bool Commit() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  static constexpr absl::Duration kInitialRetryDelay = absl::Seconds(1);
+  static constexpr absl::Duration kMaxRetryDelay = absl::Minutes(5);
+
+  // Writes pending changes to storage, scheduling a retry if that failed.
+  bool Commit() ABSL_LOCKS_EXCLUDED(mutex_, commit_mutex_);
+
+  // Schedules a commit after the current retry delay, and doubles the delay.
+  void ScheduleRetry() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Records that `key` changed, and schedules a commit if none is pending.
+  void MarkDirty(absl::string_view key) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   bool SetValue(absl::string_view key, const nlohmann::json& value)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
@@ -129,10 +155,21 @@ class PreferencesManager : public api::PreferencesManager {
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   nlohmann::json value_ ABSL_GUARDED_BY(mutex_);
-  std::unique_ptr<PreferencesRepository> preferences_repository_
-      ABSL_GUARDED_BY(mutex_);
+  // Keys changed since the last commit.
+  absl::flat_hash_set<std::string> dirty_keys_ ABSL_GUARDED_BY(mutex_);
+  bool commit_scheduled_ ABSL_GUARDED_BY(mutex_) = false;
+  bool retry_scheduled_ ABSL_GUARDED_BY(mutex_) = false;
+  absl::Duration retry_delay_ ABSL_GUARDED_BY(mutex_) = kInitialRetryDelay;
+  // Set by the destructor, which writes pending changes itself.
+  bool shutting_down_ ABSL_GUARDED_BY(mutex_) = false;
+  // Internally synchronized.
+  std::unique_ptr<PreferencesRepository> preferences_repository_;
 
   mutable absl::Mutex mutex_;
+  // Serializes commits, so that they reach the journal in order.
+  absl::Mutex commit_mutex_ ABSL_ACQUIRED_BEFORE(mutex_);
+  Executor commit_executor_;
+  ScheduledExecutor retry_executor_;
 };
 
 }  // namespace linux
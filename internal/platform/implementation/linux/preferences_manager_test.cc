@@ -181,5 +181,58 @@ TEST(PreferencesManager, RemoveKey) {
   EXPECT_EQ(result, "default key");
 }
 
+TEST(PreferencesManager, SetReturnsWhetherValueChanged) {
+  std::string bool_key = "changed_bool_key";
+  std::string array_key = "changed_array_key";
+  PreferencesManager pm(kPreferencesFilePath);
+  pm.Remove(bool_key);
+  pm.Remove(array_key);
+
+  EXPECT_TRUE(pm.SetBoolean(bool_key, false));
+  EXPECT_FALSE(pm.SetBoolean(bool_key, false));
+  EXPECT_TRUE(pm.SetBoolean(bool_key, true));
+  std::vector<int> array = {1, 2};
+  EXPECT_TRUE(pm.SetIntegerArray(array_key, absl::MakeSpan(array)));
+  EXPECT_FALSE(pm.SetIntegerArray(array_key, absl::MakeSpan(array)));
+  // Setting a missing key to null still adds it.
+  EXPECT_TRUE(pm.Set("changed_null_key", nullptr));
+  pm.Remove(bool_key);
+  pm.Remove(array_key);
+  pm.Remove("changed_null_key");
+}
+
+TEST(PreferencesManager, FlushPersistsChanges) {
+  std::string int_key = "flush_int_key";
+  std::string string_key = "flush_string_key";
+  {
+    PreferencesManager pm(kPreferencesFilePath);
+    pm.SetString(string_key, "to be removed");
+    EXPECT_TRUE(pm.Flush());
+    for (int i = 0; i < 100; ++i) {
+      pm.SetInteger(int_key, i);
+    }
+    pm.Remove(string_key);
+    EXPECT_TRUE(pm.Flush());
+    EXPECT_TRUE(pm.Flush());
+  }
+
+  PreferencesManager pm(kPreferencesFilePath);
+  EXPECT_EQ(pm.GetInteger(int_key, 0), 99);
+  EXPECT_EQ(pm.GetString(string_key, "default"), "default");
+}
+
+TEST(PreferencesManager, DestructorWritesPendingChanges) {
+  std::string bool_key = "destructor_bool_key";
+  {
+    PreferencesManager pm(kPreferencesFilePath);
+    pm.SetBoolean(bool_key, false);
+    pm.SetBoolean(bool_key, true);
+  }
+
+  PreferencesManager pm(kPreferencesFilePath);
+  EXPECT_TRUE(pm.GetBoolean(bool_key, false));
+  pm.Remove(bool_key);
+}
+
 }  // namespace linux
 }  // namespace nearby
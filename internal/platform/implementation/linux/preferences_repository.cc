@@ -11,11 +11,23 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
 #include <exception>
 #include <filesystem>  // NOLINT(build/c++17)
 #include <fstream>
 #include <optional>
+#include <string>
+#include <system_error>  // NOLINT(build/c++11)
+#include <vector>
 
+#include "absl/strings/string_view.h"
 #include "internal/platform/implementation/linux/preferences_repository.h"
 #include "internal/platform/logging.h"
 #include "nlohmann/json.hpp"
@@ -28,12 +40,35 @@ using json = ::nlohmann::json;
 
 constexpr char kPreferencesFileName[] = "preferences.json";
 constexpr char kPreferencesBackupFileName[] = "preferences_bak.json";
+constexpr char kPreferencesTempFileName[] = "preferences.json.tmp";
+constexpr char kJournalFileName[] = "preferences.journal";
+// Snapshot key holding the sequence number of the last journal record folded
+// into it. Not a preference; it's removed when the snapshot is loaded.
+constexpr char kSequenceKey[] = "__journal_sequence";
 
-}  // namespace
+bool WriteFully(int fd, absl::string_view data) {
+  while (!data.empty()) {
+    ssize_t written = write(fd, data.data(), data.size());
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    data.remove_prefix(written);
+  }
+  return true;
+}
 
-json PreferencesRepository::LoadPreferences() {
-  absl::MutexLock lock(&mutex_);
-  std::optional<json> preferences = AttemptLoad();
+// Makes a rename within `path` durable.
+void SyncDirectory(const std::filesystem::path& path) {
+  int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) return;
+  fsync(fd);
+  close(fd);
+}
+
+json LoadSnapshot(PreferencesRepository& repository, uint64_t& sequence) {
+  sequence = 0;
+  std::optional<json> preferences = repository.AttemptLoad(&sequence);
   if (preferences.has_value()) {
     // The top level root should be an object, if it's not then something went
     // wrong or the file was corrupted.
@@ -49,9 +84,7 @@ json PreferencesRepository::LoadPreferences() {
 
   NEARBY_LOGS(ERROR) << "Could not load preferences file, trying backup.";
 
-  // In the future we should switch to using a transaction log or another
-  // stable method which doesn't pose a risk of losing settings
-  preferences = RestoreFromBackup();
+  preferences = repository.RestoreFromBackup(&sequence);
   if (preferences.has_value()) {
     NEARBY_LOGS(ERROR) << "Successfully recovered from backup.";
     return preferences.value();
@@ -62,48 +95,85 @@ json PreferencesRepository::LoadPreferences() {
   return json::object();
 }
 
+}  // namespace
+
+PreferencesRepository::~PreferencesRepository() {
+  absl::MutexLock lock(&mutex_);
+  if (journal_fd_ >= 0) close(journal_fd_);
+}
+
+json PreferencesRepository::LoadPreferences() {
+  absl::MutexLock lock(&mutex_);
+  json preferences = LoadSnapshot(*this, sequence_);
+  // Fold whatever the journal holds into the snapshot, so that it starts out
+  // empty. This also drops a record torn by a crash, which would otherwise
+  // hide every record appended after it.
+  if (ReplayJournal(preferences) > 0 || journal_size_ > 0) {
+    try {
+      if (WriteSnapshot(preferences)) ClearJournal();
+    } catch (const std::exception& e) {
+      NEARBY_LOGS(ERROR) << "Failed to compact preferences journal: "
+                         << e.what();
+    }
+  }
+  return preferences;
+}
+
 bool PreferencesRepository::SavePreferences(json preferences) {
   absl::MutexLock lock(&mutex_);
   try {
-    std::filesystem::path path = path_;
-    if (!std::filesystem::exists(path) &&
-        !std::filesystem::create_directories(path)) {
-      NEARBY_LOGS(ERROR) << "Failed to create preferences path.";
-      return false;
-    }
+    return WriteSnapshot(preferences) && ClearJournal();
+  } catch (const std::exception& e) {
+    NEARBY_LOGS(ERROR) << "Failed to save preferences file: " << e.what();
+    return false;
+  }
+}
 
-    std::filesystem::path full_name = path / kPreferencesFileName;
-    std::filesystem::path full_name_backup = path / kPreferencesBackupFileName;
+bool PreferencesRepository::AppendUpdates(const std::vector<Update>& updates) {
+  absl::MutexLock lock(&mutex_);
+  if (updates.empty()) return true;
+  try {
+    if (!OpenJournal()) return false;
+  } catch (const std::exception& e) {
+    NEARBY_LOGS(ERROR) << "Failed to open preferences journal: " << e.what();
+    return false;
+  }
 
-    // Create a backup without moving the bytes on disk
-    if (std::filesystem::exists(full_name)) {
-      NEARBY_LOGS(INFO) << "Making backup of preferences file.";
-      std::filesystem::rename(full_name, full_name_backup);
+  std::string records;
+  uint64_t sequence = sequence_;
+  for (const Update& update : updates) {
+    json record;
+    record["seq"] = ++sequence;
+    record["key"] = update.key;
+    if (update.value.has_value()) {
+      record["value"] = *update.value;
     }
+    records += record.dump();
+    records += '\n';
+  }
 
-    std::ofstream preferences_file(full_name.c_str());
-    preferences_file << preferences;
-    preferences_file.close();
-
-    // Make sure the file wasn't saved in a corrupted state
-    if (!AttemptLoad().has_value()) {
-      NEARBY_LOGS(ERROR) << "Preferences saved to disk in corrupted state. "
-                            "Restoring from backup.";
-
-      if (!RestoreFromBackup().has_value()) {
-        NEARBY_LOGS(ERROR) << "Failed to restore preferences file.";
-        return false;
-      }
+  if (!WriteFully(journal_fd_, records) || fdatasync(journal_fd_) != 0) {
+    NEARBY_LOGS(ERROR) << "Failed to append to preferences journal: "
+                       << std::strerror(errno);
+    // Drop the partial record, so that it doesn't end replay early for
+    // records appended later.
+    if (ftruncate(journal_fd_, journal_size_) != 0) {
+      NEARBY_LOGS(ERROR) << "Failed to truncate preferences journal: "
+                         << std::strerror(errno);
     }
-  } catch (const std::exception& e) {
-    NEARBY_LOGS(ERROR) << "Failed to save preferences file: " << e.what();
     return false;
   }
-
+  journal_size_ += records.size();
+  sequence_ = sequence;
   return true;
 }
 
-std::optional<json> PreferencesRepository::AttemptLoad() {
+bool PreferencesRepository::ShouldCompact() {
+  absl::MutexLock lock(&mutex_);
+  return journal_size_ > kMaxJournalSize;
+}
+
+std::optional<json> PreferencesRepository::AttemptLoad(uint64_t* sequence) {
   std::filesystem::path path = path_;
   std::filesystem::path full_name = path / kPreferencesFileName;
   if (!std::filesystem::exists(path) || !std::filesystem::exists(full_name)) {
@@ -124,6 +194,15 @@ std::optional<json> PreferencesRepository::AttemptLoad() {
       return std::nullopt;
     }
 
+    if (preferences.is_object()) {
+      auto it = preferences.find(kSequenceKey);
+      if (it != preferences.end()) {
+        if (sequence != nullptr && it->is_number_unsigned()) {
+          *sequence = it->get<uint64_t>();
+        }
+        preferences.erase(it);
+      }
+    }
     return preferences;
   } catch (const std::exception& e) {
     NEARBY_LOGS(ERROR) << "Exception while loading preferences: " << e.what();
@@ -131,7 +210,8 @@ std::optional<json> PreferencesRepository::AttemptLoad() {
   }
 }
 
-std::optional<json> PreferencesRepository::RestoreFromBackup() {
+std::optional<json> PreferencesRepository::RestoreFromBackup(
+    uint64_t* sequence) {
   std::filesystem::path path = path_;
   std::filesystem::path full_name = path / kPreferencesFileName;
   std::filesystem::path full_name_backup = path / kPreferencesBackupFileName;
@@ -145,7 +225,143 @@ std::optional<json> PreferencesRepository::RestoreFromBackup() {
   std::filesystem::rename(full_name_backup, full_name);
 
   NEARBY_LOGS(INFO) << "Attempting load from backup preferences.";
-  return AttemptLoad();
+  return AttemptLoad(sequence);
+}
+
+int PreferencesRepository::ReplayJournal(json& preferences) {
+  std::filesystem::path full_name =
+      std::filesystem::path(path_) / kJournalFileName;
+  std::error_code error;
+  journal_size_ = std::filesystem::exists(full_name, error)
+                      ? std::filesystem::file_size(full_name, error)
+                      : 0;
+  if (error || journal_size_ == 0) {
+    journal_size_ = 0;
+    return 0;
+  }
+
+  std::ifstream journal_file(full_name.c_str());
+  if (!journal_file.good()) return 0;
+  if (!preferences.is_object()) preferences = json::object();
+
+  uint64_t snapshot_sequence = sequence_;
+  int replayed = 0;
+  std::string line;
+  while (std::getline(journal_file, line)) {
+    json record = json::parse(line, nullptr, false);
+    if (record.is_discarded() || !record.is_object() ||
+        !record.contains("key") || !record["key"].is_string()) {
+      NEARBY_LOGS(ERROR) << "Preferences journal corrupted after " << replayed
+                         << " records, dropping the rest.";
+      break;
+    }
+    // Records written before sequence numbers count as 0, and so are only
+    // replayed over a snapshot that predates them too.
+    auto seq = record.find("seq");
+    uint64_t record_sequence =
+        seq != record.end() && seq->is_number_unsigned() ? seq->get<uint64_t>()
+                                                         : 0;
+    if (snapshot_sequence != 0 && record_sequence <= snapshot_sequence) {
+      continue;
+    }
+    sequence_ = std::max(sequence_, record_sequence);
+    std::string key = record["key"].get<std::string>();
+    auto value = record.find("value");
+    if (value != record.end()) {
+      preferences[key] = *value;
+    } else {
+      preferences.erase(key);
+    }
+    ++replayed;
+  }
+  return replayed;
+}
+
+bool PreferencesRepository::WriteSnapshot(const json& preferences) {
+  std::filesystem::path path = path_;
+  if (!std::filesystem::exists(path) &&
+      !std::filesystem::create_directories(path)) {
+    NEARBY_LOGS(ERROR) << "Failed to create preferences path.";
+    return false;
+  }
+
+  // Write to a temporary file first and rename it over the snapshot, so that
+  // a crash leaves either the old or the new snapshot in place.
+  std::filesystem::path full_name = path / kPreferencesFileName;
+  std::filesystem::path temp_name = path / kPreferencesTempFileName;
+  int fd = open(temp_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                S_IRUSR | S_IWUSR);
+  if (fd < 0) {
+    NEARBY_LOGS(ERROR) << "Failed to create preferences file: "
+                       << std::strerror(errno);
+    return false;
+  }
+  json snapshot = preferences;
+  snapshot[kSequenceKey] = sequence_;
+  bool written = WriteFully(fd, snapshot.dump()) && fsync(fd) == 0;
+  close(fd);
+  if (!written) {
+    NEARBY_LOGS(ERROR) << "Failed to write preferences file: "
+                       << std::strerror(errno);
+    std::filesystem::remove(temp_name);
+    return false;
+  }
+
+  // Keep the snapshot being replaced as the backup.
+  std::filesystem::path backup_name = path / kPreferencesBackupFileName;
+  std::error_code error;
+  std::filesystem::remove(backup_name, error);
+  if (std::filesystem::exists(full_name, error)) {
+    std::filesystem::create_hard_link(full_name, backup_name, error);
+    if (error) {
+      NEARBY_LOGS(WARNING) << "Failed to back up preferences file: "
+                           << error.message();
+    }
+  }
+  std::filesystem::rename(temp_name, full_name);
+  SyncDirectory(path);
+  return true;
+}
+
+bool PreferencesRepository::ClearJournal() {
+  if (journal_fd_ >= 0) {
+    if (ftruncate(journal_fd_, 0) != 0) {
+      NEARBY_LOGS(ERROR) << "Failed to clear preferences journal: "
+                         << std::strerror(errno);
+      return false;
+    }
+  } else {
+    std::error_code error;
+    std::filesystem::remove(std::filesystem::path(path_) / kJournalFileName,
+                            error);
+  }
+  journal_size_ = 0;
+  return true;
+}
+
+bool PreferencesRepository::OpenJournal() {
+  if (journal_fd_ >= 0) return true;
+
+  std::filesystem::path path = path_;
+  if (!std::filesystem::exists(path) &&
+      !std::filesystem::create_directories(path)) {
+    NEARBY_LOGS(ERROR) << "Failed to create preferences path.";
+    return false;
+  }
+  std::filesystem::path full_name = path / kJournalFileName;
+  journal_fd_ = open(full_name.c_str(),
+                     O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                     S_IRUSR | S_IWUSR);
+  if (journal_fd_ < 0) {
+    NEARBY_LOGS(ERROR) << "Failed to open preferences journal: "
+                       << std::strerror(errno);
+    return false;
+  }
+  struct stat journal_stat;
+  journal_size_ = fstat(journal_fd_, &journal_stat) == 0
+                      ? static_cast<size_t>(journal_stat.st_size)
+                      : 0;
+  return true;
 }
 
 }  // namespace linux
@@ -15,8 +15,11 @@
 #ifndef PLATFORM_IMPLEMENTATION_LINUX_PREFERENCES_REPOSITORY_H_
 #define PLATFORM_IMPLEMENTATION_LINUX_PREFERENCES_REPOSITORY_H_
 
+#include <cstddef>
+#include <cstdint>
 #include <optional>
 #include <string>
+#include <vector>
 
 #include "absl/base/thread_annotations.h"
 #include "absl/strings/string_view.h"
@@ -27,19 +30,65 @@
 namespace nearby {
 namespace linux {
 
+// Stores preferences as a JSON snapshot plus an append-only journal of the
+// changes made since. Small updates only append a line to the journal. The
+// journal is folded back into the snapshot once it grows past
+// kMaxJournalSize, and whenever preferences are loaded.
+//
+// Every journal record carries a sequence number, and the snapshot records
+// the number of the last record folded into it. Replay skips records the
+// snapshot already covers, so a journal left behind by a crash or a failed
+// truncation can't revert keys saved after it. The previous snapshot is kept
+// as a backup, for when the current one can't be read.
 class PreferencesRepository {
  public:
+  // A change to a single preference. A missing value removes the key.
+  struct Update {
+    std::string key;
+    std::optional<nlohmann::json> value;
+  };
+
+  // The journal size, in bytes, above which ShouldCompact() returns true.
+  static constexpr size_t kMaxJournalSize = 64 * 1024;
+
   explicit PreferencesRepository(absl::string_view path) : path_(path) {}
+  ~PreferencesRepository();
 
+  // Loads the snapshot and replays the journal over it.
   nlohmann::json LoadPreferences() ABSL_LOCKS_EXCLUDED(&mutex_);
+  // Replaces the snapshot with `preferences` and clears the journal.
   bool SavePreferences(nlohmann::json preferences) ABSL_LOCKS_EXCLUDED(&mutex_);
+  // Appends `updates` to the journal and syncs it to disk. Numbers the records
+  // after those seen by LoadPreferences(), which should be called first.
+  bool AppendUpdates(const std::vector<Update>& updates)
+      ABSL_LOCKS_EXCLUDED(&mutex_);
+  // Whether the journal has grown enough that the next write should be a full
+  // SavePreferences() instead.
+  bool ShouldCompact() ABSL_LOCKS_EXCLUDED(&mutex_);
 
-  std::optional<nlohmann::json> AttemptLoad();
-  std::optional<nlohmann::json> RestoreFromBackup();
+  // Read the snapshot, or the backup. If `sequence` isn't null, it's set to
+  // the sequence number of the last journal record the snapshot covers.
+  std::optional<nlohmann::json> AttemptLoad(uint64_t* sequence = nullptr);
+  std::optional<nlohmann::json> RestoreFromBackup(
+      uint64_t* sequence = nullptr);
 
  private:
+  // Applies the journal records numbered above `sequence_` to `preferences`.
+  // Returns the number of records replayed; a torn or corrupted record ends
+  // the replay.
+  int ReplayJournal(nlohmann::json& preferences)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(&mutex_);
+  bool WriteSnapshot(const nlohmann::json& preferences)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(&mutex_);
+  bool ClearJournal() ABSL_EXCLUSIVE_LOCKS_REQUIRED(&mutex_);
+  bool OpenJournal() ABSL_EXCLUSIVE_LOCKS_REQUIRED(&mutex_);
+
   absl::Mutex mutex_;
   const std::string path_;
+  int journal_fd_ ABSL_GUARDED_BY(mutex_) = -1;
+  size_t journal_size_ ABSL_GUARDED_BY(mutex_) = 0;
+  // The sequence number of the last journal record written or replayed.
+  uint64_t sequence_ ABSL_GUARDED_BY(mutex_) = 0;
 };
 
 }  // namespace linux
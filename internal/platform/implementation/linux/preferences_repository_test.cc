@@ -15,6 +15,8 @@
 #include <filesystem>  // NOLINT(build/c++17)
 #include <fstream>
 #include <optional>
+#include <string>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "internal/platform/implementation/device_info.h"
@@ -31,6 +33,7 @@ using json = ::nlohmann::json;
 
 constexpr char kPreferencesFileName[] = "preferences.json";
 constexpr char kPreferencesBackupFileName[] = "preferences_bak.json";
+constexpr char kPreferencesJournalFileName[] = "preferences.journal";
 constexpr char kPreferencesPath[] = "Google/Nearby/Sharing";
 
 TEST(PreferencesRepository, LoadWithBadPath) {
@@ -155,6 +158,149 @@ TEST(PreferencesRepository, RecoverFromCorruption) {
   EXPECT_FALSE(std::filesystem::exists(full_name_backup));
 }
 
+TEST(PreferencesRepository, AppendUpdatesAndLoad) {
+  std::optional<std::filesystem::path> app_data_path =
+      api::ImplementationPlatform::CreateDeviceInfo()->GetLocalAppDataPath();
+  ASSERT_TRUE(app_data_path.has_value());
+  std::filesystem::path full_path = *app_data_path / kPreferencesPath;
+  std::filesystem::path full_name = full_path / kPreferencesFileName;
+  std::filesystem::path full_name_journal =
+      full_path / kPreferencesJournalFileName;
+
+  json data;
+  data["key1"] = "value1";
+  data["key2"] = "value2";
+  {
+    PreferencesRepository preferences_repository{full_path.string()};
+    EXPECT_TRUE(preferences_repository.SavePreferences(data));
+    EXPECT_TRUE(preferences_repository.AppendUpdates(
+        {{"key1", json("updated")}, {"key2", std::nullopt}}));
+    EXPECT_TRUE(preferences_repository.AppendUpdates({{"key3", json(3)}}));
+    EXPECT_FALSE(preferences_repository.ShouldCompact());
+  }
+  EXPECT_GT(std::filesystem::file_size(full_name_journal), 0);
+
+  PreferencesRepository preferences_repository{full_path.string()};
+  json result = preferences_repository.LoadPreferences();
+  EXPECT_EQ(result.size(), 2);
+  EXPECT_EQ(result["key1"], "updated");
+  EXPECT_EQ(result["key3"], 3);
+  // Loading folds the journal into the snapshot.
+  EXPECT_FALSE(std::filesystem::exists(full_name_journal));
+  EXPECT_EQ(preferences_repository.AttemptLoad(), result);
+  std::filesystem::remove(full_name);
+}
+
+TEST(PreferencesRepository, TornJournalRecordIsDropped) {
+  std::optional<std::filesystem::path> app_data_path =
+      api::ImplementationPlatform::CreateDeviceInfo()->GetLocalAppDataPath();
+  ASSERT_TRUE(app_data_path.has_value());
+  std::filesystem::path full_path = *app_data_path / kPreferencesPath;
+  std::filesystem::path full_name = full_path / kPreferencesFileName;
+  std::filesystem::path full_name_journal =
+      full_path / kPreferencesJournalFileName;
+
+  {
+    PreferencesRepository preferences_repository{full_path.string()};
+    EXPECT_TRUE(preferences_repository.SavePreferences(json::object()));
+    EXPECT_TRUE(preferences_repository.AppendUpdates({{"key1", json(1)}}));
+  }
+  // Simulate a crash in the middle of appending a record.
+  std::ofstream journal_file(full_name_journal.c_str(), std::ios::app);
+  journal_file << "{\"key\":\"key2\",\"val";
+  journal_file.close();
+
+  PreferencesRepository preferences_repository{full_path.string()};
+  json result = preferences_repository.LoadPreferences();
+  EXPECT_EQ(result.size(), 1);
+  EXPECT_EQ(result["key1"], 1);
+
+  // Records appended after recovery are not hidden by the torn one.
+  EXPECT_TRUE(preferences_repository.AppendUpdates({{"key2", json(2)}}));
+  result = PreferencesRepository{full_path.string()}.LoadPreferences();
+  EXPECT_EQ(result.size(), 2);
+  EXPECT_EQ(result["key2"], 2);
+  std::filesystem::remove(full_name);
+}
+
+TEST(PreferencesRepository, StaleJournalDoesNotRevertSnapshot) {
+  std::optional<std::filesystem::path> app_data_path =
+      api::ImplementationPlatform::CreateDeviceInfo()->GetLocalAppDataPath();
+  ASSERT_TRUE(app_data_path.has_value());
+  std::filesystem::path full_path = *app_data_path / kPreferencesPath;
+  std::filesystem::path full_name = full_path / kPreferencesFileName;
+  std::filesystem::path full_name_journal =
+      full_path / kPreferencesJournalFileName;
+  std::filesystem::path stale_journal =
+      full_path / (std::string(kPreferencesJournalFileName) + ".stale");
+
+  {
+    PreferencesRepository preferences_repository{full_path.string()};
+    preferences_repository.LoadPreferences();
+    EXPECT_TRUE(preferences_repository.AppendUpdates({{"key1", json("old")}}));
+    std::filesystem::copy_file(
+        full_name_journal, stale_journal,
+        std::filesystem::copy_options::overwrite_existing);
+    json data;
+    data["key1"] = "new";
+    EXPECT_TRUE(preferences_repository.SavePreferences(data));
+  }
+  // Simulate a crash between writing the snapshot and clearing the journal.
+  std::filesystem::rename(stale_journal, full_name_journal);
+
+  PreferencesRepository preferences_repository{full_path.string()};
+  json result = preferences_repository.LoadPreferences();
+  EXPECT_EQ(result.size(), 1);
+  EXPECT_EQ(result["key1"], "new");
+
+  // Records appended afterwards are still replayed.
+  EXPECT_TRUE(preferences_repository.AppendUpdates({{"key1", json("newer")}}));
+  result = PreferencesRepository{full_path.string()}.LoadPreferences();
+  EXPECT_EQ(result["key1"], "newer");
+  std::filesystem::remove(full_name);
+}
+
+TEST(PreferencesRepository, SaveKeepsPreviousSnapshotAsBackup) {
+  std::optional<std::filesystem::path> app_data_path =
+      api::ImplementationPlatform::CreateDeviceInfo()->GetLocalAppDataPath();
+  ASSERT_TRUE(app_data_path.has_value());
+  std::filesystem::path full_path = *app_data_path / kPreferencesPath;
+  std::filesystem::path full_name = full_path / kPreferencesFileName;
+  std::filesystem::path full_name_backup =
+      full_path / kPreferencesBackupFileName;
+
+  PreferencesRepository preferences_repository{full_path.string()};
+  json data;
+  data["key1"] = "value1";
+  EXPECT_TRUE(preferences_repository.SavePreferences(data));
+  data["key1"] = "value2";
+  EXPECT_TRUE(preferences_repository.SavePreferences(data));
+
+  std::optional<json> result = preferences_repository.RestoreFromBackup();
+  ASSERT_TRUE(result.has_value());
+  EXPECT_EQ(result.value()["key1"], "value1");
+  std::filesystem::remove(full_name);
+  std::filesystem::remove(full_name_backup);
+}
+
+TEST(PreferencesRepository, ShouldCompactLargeJournal) {
+  std::optional<std::filesystem::path> app_data_path =
+      api::ImplementationPlatform::CreateDeviceInfo()->GetLocalAppDataPath();
+  ASSERT_TRUE(app_data_path.has_value());
+  std::filesystem::path full_path = *app_data_path / kPreferencesPath;
+  std::filesystem::path full_name = full_path / kPreferencesFileName;
+
+  PreferencesRepository preferences_repository{full_path.string()};
+  EXPECT_TRUE(preferences_repository.SavePreferences(json::object()));
+  std::string value(1024, 'x');
+  while (!preferences_repository.ShouldCompact()) {
+    ASSERT_TRUE(preferences_repository.AppendUpdates({{"key", json(value)}}));
+  }
+  EXPECT_TRUE(preferences_repository.SavePreferences(json::object()));
+  EXPECT_FALSE(preferences_repository.ShouldCompact());
+  std::filesystem::remove(full_name);
+}
+
 }  // namespace
 }  // namespace linux
 }  // namespace nearby
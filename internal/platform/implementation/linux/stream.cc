@@ -14,40 +14,126 @@
 
 #include <sys/socket.h>
 #include <unistd.h>
+
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cerrno>
 #include <cstdint>
+#include <cstring>
+#include <string>
 
+#include "internal/flags/nearby_flags.h"
 #include "internal/platform/byte_array.h"
 #include "internal/platform/exception.h"
+#include "internal/platform/flags/nearby_platform_feature_flags.h"
 #include "internal/platform/implementation/linux/stream.h"
 #include "internal/platform/logging.h"
 
 namespace nearby {
 namespace linux {
+namespace {
+
+std::atomic<std::int64_t> read_syscalls{0};
+std::atomic<std::int64_t> write_syscalls{0};
+
+}  // namespace
+
+StreamSyscallCounts GetStreamSyscallCounts() {
+  return {
+      .reads = read_syscalls.load(std::memory_order_relaxed),
+      .writes = write_syscalls.load(std::memory_order_relaxed),
+  };
+}
+
+InputStream::Options InputStream::DefaultOptions() {
+  Options options;
+  options.receive_low_watermark = static_cast<int>(
+      NearbyFlags::GetInstance().GetInt64Flag(
+          platform::config_package_nearby::nearby_platform_feature::
+              kLinuxSocketReceiveLowWatermark));
+  options.busy_poll_micros =
+      static_cast<int>(NearbyFlags::GetInstance().GetInt64Flag(
+          platform::config_package_nearby::nearby_platform_feature::
+              kLinuxSocketBusyPollMicros));
+  return options;
+}
+
+InputStream::InputStream(sdbus::UnixFd fd, Options options)
+    : fd_(std::move(fd)), options_(options) {
+  if (!fd_.isValid()) return;
+  if (options_.receive_low_watermark > 0 &&
+      setsockopt(fd_.get(), SOL_SOCKET, SO_RCVLOWAT,
+                 &options_.receive_low_watermark,
+                 sizeof(options_.receive_low_watermark)) < 0) {
+    NEARBY_LOGS(WARNING) << __func__ << ": couldn't set SO_RCVLOWAT: "
+                         << std::strerror(errno);
+    options_.receive_low_watermark = 0;
+  }
+  if (options_.busy_poll_micros > 0 &&
+      setsockopt(fd_.get(), SOL_SOCKET, SO_BUSY_POLL,
+                 &options_.busy_poll_micros,
+                 sizeof(options_.busy_poll_micros)) < 0) {
+    NEARBY_LOGS(WARNING) << __func__ << ": couldn't set SO_BUSY_POLL: "
+                         << std::strerror(errno);
+  }
+}
+
+std::size_t InputStream::TakeBuffered(char *out, std::size_t size) {
+  std::size_t count = std::min(size, buffer_end_ - buffer_begin_);
+  std::memcpy(out, buffer_.data() + buffer_begin_, count);
+  buffer_begin_ += count;
+  return count;
+}
 
 ExceptionOr<ByteArray> InputStream::Read(std::int64_t size) {
   if (!fd_.isValid()) return {Exception::kIo};
+  if (size <= 0) return ExceptionOr(ByteArray());
 
-  std::string buffer;
-  buffer.resize(size);
-  ssize_t ret = recv(fd_.get(), buffer.data(), buffer.size(), MSG_WAITALL);
-  if (ret == 0) {
-    return ExceptionOr(ByteArray());
-  }
-  if (ret < 0) {
-    NEARBY_LOGS(ERROR) << __func__
-                       << ": error reading from fd: " << std::strerror(errno);
-    return {Exception::kIo};
+  std::string result;
+  result.resize(size);
+  std::size_t copied = TakeBuffered(result.data(), result.size());
+  while (copied < result.size()) {
+    std::size_t needed = result.size() - copied;
+    ssize_t ret;
+    if (needed >= options_.buffer_size) {
+      // Nothing to gain from buffering a read this large.
+      ret = recv(fd_.get(), result.data() + copied, needed, MSG_WAITALL);
+    } else {
+      if (buffer_.empty()) buffer_.resize(options_.buffer_size);
+      // recv() blocks until min(SO_RCVLOWAT, length) bytes are queued. Only
+      // ask for what is needed when that is below the watermark, otherwise
+      // the tail of a small message could wait forever.
+      std::size_t length = buffer_.size();
+      if (needed < static_cast<std::size_t>(options_.receive_low_watermark)) {
+        length = needed;
+      }
+      ret = recv(fd_.get(), buffer_.data(), length, 0);
+      if (ret > 0) {
+        buffer_begin_ = 0;
+        buffer_end_ = ret;
+        ret = TakeBuffered(result.data() + copied, needed);
+      }
+    }
+    read_syscalls.fetch_add(1, std::memory_order_relaxed);
+    if (ret == 0) break;
+    if (ret < 0) {
+      if (errno == EINTR) continue;
+      NEARBY_LOGS(ERROR) << __func__
+                         << ": error reading from fd: " << std::strerror(errno);
+      return {Exception::kIo};
+    }
+    copied += ret;
   }
-  buffer.resize(ret);
+  result.resize(copied);
 
-  return ExceptionOr(ByteArray(std::move(buffer)));
+  return ExceptionOr(ByteArray(std::move(result)));
 }
 
 Exception InputStream::Close() {
   if (!fd_.isValid()) return Exception{Exception::kIo};
   fd_.reset();
+  buffer_begin_ = buffer_end_ = 0;
   return {};
 }
 
@@ -56,7 +142,9 @@ Exception OutputStream::Write(const ByteArray &data) {
 
   size_t written = 0;
   while (written < data.size()) {
-    ssize_t ret = write(fd_.get(), data.data(), data.size());
+    ssize_t ret =
+        write(fd_.get(), data.data() + written, data.size() - written);
+    write_syscalls.fetch_add(1, std::memory_order_relaxed);
     if (ret < 0) {
       NEARBY_LOGS(ERROR) << __func__
                          << ": error writing to fd: " << std::strerror(errno);
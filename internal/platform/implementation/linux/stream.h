@@ -15,7 +15,10 @@
 #ifndef PLATFORM_IMPL_LINUX_STREAM_H_
 #define PLATFORM_IMPL_LINUX_STREAM_H_
 
+#include <cstddef>
+#include <cstdint>
 #include <optional>
+#include <vector>
 
 #include <sdbus-c++/Types.h>
 
@@ -24,16 +27,52 @@
 
 namespace nearby {
 namespace linux {
+
+// Number of read and write system calls issued by all linux::InputStream and
+// linux::OutputStream instances in this process. Benchmarks use it to report
+// syscalls per byte transferred.
+struct StreamSyscallCounts {
+  std::int64_t reads = 0;
+  std::int64_t writes = 0;
+};
+StreamSyscallCounts GetStreamSyscallCounts();
+
+// Reads from a stream socket through a receive buffer that is reused across
+// calls. Each refill pulls as much as the kernel has queued, so the length
+// prefix and body of a frame usually come out of a single recv().
 class InputStream : public nearby::InputStream {
  public:
-  explicit InputStream(sdbus::UnixFd fd) : fd_(std::move(fd)){};
+  struct Options {
+    // Reads smaller than this are served from the receive buffer; larger ones
+    // go straight into the returned ByteArray.
+    std::size_t buffer_size = 64 * 1024;
+    // If positive, SO_RCVLOWAT for the socket.
+    int receive_low_watermark = 0;
+    // If positive, SO_BUSY_POLL for the socket, in microseconds.
+    int busy_poll_micros = 0;
+  };
+
+  // Reads the socket options from the platform feature flags.
+  static Options DefaultOptions();
+
+  explicit InputStream(sdbus::UnixFd fd)
+      : InputStream(std::move(fd), DefaultOptions()) {}
+  InputStream(sdbus::UnixFd fd, Options options);
 
   ExceptionOr<ByteArray> Read(std::int64_t size) override;
 
   Exception Close() override;
 
  private:
+  // Copies up to |size| buffered bytes to |out|, returns the number copied.
+  std::size_t TakeBuffered(char *out, std::size_t size);
+
   sdbus::UnixFd fd_;
+  Options options_;
+  // Allocated on the first buffered read.
+  std::vector<char> buffer_;
+  std::size_t buffer_begin_ = 0;
+  std::size_t buffer_end_ = 0;
 };
 
 class OutputStream : public nearby::OutputStream {
@@ -0,0 +1,109 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "internal/platform/implementation/linux/stream.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "internal/platform/byte_array.h"
+
+namespace nearby {
+namespace linux {
+namespace {
+
+class InputStreamTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    reader_fd_ = sdbus::UnixFd(fds[0], sdbus::adopt_fd);
+    writer_fd_ = fds[1];
+  }
+
+  void TearDown() override {
+    if (writer_fd_ >= 0) close(writer_fd_);
+  }
+
+  void WriteString(const std::string &data) {
+    ASSERT_EQ(write(writer_fd_, data.data(), data.size()),
+              static_cast<ssize_t>(data.size()));
+  }
+
+  void CloseWriter() {
+    close(writer_fd_);
+    writer_fd_ = -1;
+  }
+
+  std::string ReadString(InputStream &stream, std::int64_t size) {
+    ExceptionOr<ByteArray> bytes = stream.Read(size);
+    EXPECT_TRUE(bytes.ok());
+    return std::string(bytes.result());
+  }
+
+  sdbus::UnixFd reader_fd_;
+  int writer_fd_ = -1;
+};
+
+TEST_F(InputStreamTest, SmallReadsShareOneSyscall) {
+  InputStream stream(reader_fd_, InputStream::Options());
+  WriteString(std::string("\x00\x00\x00\x05hello", 9));
+
+  std::int64_t reads_before = GetStreamSyscallCounts().reads;
+  EXPECT_EQ(ReadString(stream, 4), std::string("\x00\x00\x00\x05", 4));
+  EXPECT_EQ(ReadString(stream, 5), "hello");
+  EXPECT_EQ(GetStreamSyscallCounts().reads - reads_before, 1);
+}
+
+TEST_F(InputStreamTest, ReadSpansBufferedAndNewData) {
+  InputStream stream(reader_fd_, {.buffer_size = 8});
+  WriteString("abcdef");
+  EXPECT_EQ(ReadString(stream, 2), "ab");
+
+  WriteString("ghijklmnop");
+  // Larger than the buffer: the buffered "cdef" is followed by a direct read.
+  EXPECT_EQ(ReadString(stream, 12), "cdefghijklmn");
+  EXPECT_EQ(ReadString(stream, 2), "op");
+}
+
+TEST_F(InputStreamTest, ShortReadAtEndOfStream) {
+  InputStream stream(reader_fd_, InputStream::Options());
+  WriteString("abc");
+  CloseWriter();
+
+  EXPECT_EQ(ReadString(stream, 8), "abc");
+  EXPECT_EQ(ReadString(stream, 8), "");
+}
+
+TEST_F(InputStreamTest, ReadBelowLowWatermarkDoesNotBlock) {
+  InputStream stream(reader_fd_, {.receive_low_watermark = 1024});
+  WriteString("abc");
+
+  EXPECT_EQ(ReadString(stream, 3), "abc");
+}
+
+TEST_F(InputStreamTest, ReadAfterCloseFails) {
+  InputStream stream(reader_fd_, InputStream::Options());
+  EXPECT_FALSE(stream.Close().Raised());
+
+  EXPECT_FALSE(stream.Read(1).ok());
+}
+
+}  // namespace
+}  // namespace linux
+}  // namespace nearby
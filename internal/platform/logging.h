@@ -39,6 +39,11 @@
 #else
 #include "glog/logging.h"
 #endif
+#include <atomic>
+#include <cstdint>
+
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "internal/platform/implementation/log_message.h"
 #include "internal/platform/implementation/platform.h"
 
@@ -55,6 +60,36 @@ class LogMessageVoidify {
   void operator&(std::ostream&) {}
 };
 
+// Per-callsite state for NEARBY_LOGS_EVERY_N.
+class LogEveryNState {
+ public:
+  // Returns true for the first call and every n-th call after it.
+  bool ShouldLog(int n) {
+    uint32_t count = counter_.fetch_add(1, std::memory_order_relaxed);
+    return n <= 1 || count % n == 0;
+  }
+
+ private:
+  std::atomic<uint32_t> counter_{0};
+};
+
+// Per-callsite state for NEARBY_LOGS_EVERY_N_SEC.
+class LogEveryNSecState {
+ public:
+  // Returns true if at least `seconds` have passed since it last did.
+  bool ShouldLog(double seconds) {
+    int64_t now = absl::GetCurrentTimeNanos();
+    int64_t next = next_log_time_nanos_.load(std::memory_order_relaxed);
+    return now >= next &&
+           next_log_time_nanos_.compare_exchange_strong(
+               next, now + absl::ToInt64Nanoseconds(absl::Seconds(seconds)),
+               std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<int64_t> next_log_time_nanos_{0};
+};
+
 }  // namespace nearby
 
 // Severity enum conversion
@@ -71,9 +106,22 @@ class LogMessageVoidify {
 #endif  // defined(_WIN32)
 #define NEARBY_SEVERITY(severity) NEARBY_SEVERITY_##severity
 
+// Logs below this level are compiled out, so they cost nothing at runtime.
+// Levels follow api::LogMessage::Severity: -1 is VERBOSE, 0 INFO, 1 WARNING,
+// 2 ERROR. FATAL logs are always kept. For example, build with
+// --copt=-DNEARBY_MIN_LOG_LEVEL=0 to drop VERBOSE logs.
+#ifndef NEARBY_MIN_LOG_LEVEL
+#define NEARBY_MIN_LOG_LEVEL -1
+#endif
+
 // Log enabling
-#define NEARBY_LOG_IS_ON(severity) \
-  nearby::api::LogMessage::ShouldCreateLogMessage(NEARBY_SEVERITY(severity))
+#define NEARBY_LOG_IS_COMPILED_IN(severity)                               \
+  (static_cast<int>(NEARBY_SEVERITY(severity)) >= NEARBY_MIN_LOG_LEVEL || \
+   NEARBY_SEVERITY(severity) == NEARBY_SEVERITY_FATAL)
+
+#define NEARBY_LOG_IS_ON(severity)        \
+  (NEARBY_LOG_IS_COMPILED_IN(severity) && \
+   nearby::api::LogMessage::ShouldCreateLogMessage(NEARBY_SEVERITY(severity)))
 
 #define NEARBY_LOG_SET_SEVERITY(severity) \
   nearby::api::LogMessage::SetMinLogSeverity(NEARBY_SEVERITY(severity))
@@ -94,6 +142,29 @@ class LogMessageVoidify {
   NEARBY_LOG_IS_ON(severity)      \
   ? NEARBY_LOG_MESSAGE(severity)->Print(__VA_ARGS__) : (void)0
 
+// Returns state private to the call site, shared by all threads.
+#define NEARBY_LOG_CALLSITE_STATE(type) \
+  ([]() -> type& {                      \
+    static type state;                  \
+    return state;                       \
+  }())
+
+// Like NEARBY_LOGS, but only logs the first and then every n-th time the call
+// site is reached. Use in loops that run per packet or per chunk.
+#define NEARBY_LOGS_EVERY_N(severity, n)                             \
+  !(NEARBY_LOG_IS_ON(severity) &&                                    \
+    NEARBY_LOG_CALLSITE_STATE(nearby::LogEveryNState).ShouldLog(n)) \
+      ? (void)0                                                      \
+      : nearby::LogMessageVoidify() & NEARBY_LOG_MESSAGE(severity)->Stream()
+
+// Like NEARBY_LOGS, but logs at most once every `seconds` per call site.
+#define NEARBY_LOGS_EVERY_N_SEC(severity, seconds)        \
+  !(NEARBY_LOG_IS_ON(severity) &&                         \
+    NEARBY_LOG_CALLSITE_STATE(nearby::LogEveryNSecState)  \
+        .ShouldLog(seconds))                              \
+      ? (void)0                                           \
+      : nearby::LogMessageVoidify() & NEARBY_LOG_MESSAGE(severity)->Stream()
+
 #ifdef NEARBY_SWIFTPM
 #define LOG(severity) NEARBY_LOGS(severity)
 #endif
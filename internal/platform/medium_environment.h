@@ -16,6 +16,7 @@
 #define PLATFORM_BASE_MEDIUM_ENVIRONMENT_H_
 
 #include <atomic>
+#include <cstdint>
 #include <memory>
 #include <optional>
 #include <string>
@@ -25,6 +26,7 @@
 #include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
 #include "absl/strings/string_view.h"
+#include "absl/time/time.h"
 #include "absl/types/optional.h"
 #include "internal/base/observer_list.h"
 #include "internal/platform/borrowable.h"
@@ -61,6 +63,14 @@ struct EnvironmentConfig {
   // The simulated clock is automatically picked up by SystemClock, Timer and
   // ScheduledExecutor implementations.
   bool use_simulated_clock = false;
+
+  // Shapes the data link of every simulated socket created while the
+  // environment is running, so that transfers behave more like a real radio.
+  // Writes are paced to |link_bandwidth_bytes_per_second| (0 means unlimited),
+  // and a write that starts on an idle link is delayed by |link_latency|.
+  // Back-to-back writes are pipelined and only pay the bandwidth cost.
+  std::int64_t link_bandwidth_bytes_per_second = 0;
+  absl::Duration link_latency = absl::ZeroDuration();
 };
 
 // MediumEnvironment is a simulated environment which allows multiple instances
@@ -14,7 +14,17 @@
 
 #include "internal/test/fake_webrtc.h"
 
+#include <deque>
 #include <memory>
+#include <string>
+#include <thread>  // NOLINT
+#include <utility>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/functional/any_invocable.h"
+#include "absl/synchronization/mutex.h"
+#include "webrtc/api/data_channel_interface.h"
+#include "webrtc/api/scoped_refptr.h"
 
 namespace nearby {
 
@@ -34,4 +44,173 @@ FakeWebRtcMedium::GetSignalingMessenger(
   return WebRtcMedium::GetSignalingMessenger(self_id, location_hint);
 }
 
+// Runs the deliveries of a channel pair, in order, on one thread. The queue is
+// shared with the thread so that the last reference to a channel may be
+// dropped by a delivery.
+class FakeDataChannel::Link {
+ public:
+  Link() : queue_(std::make_shared<Queue>()) {
+    thread_ = std::thread([queue = queue_]() { queue->Run(); });
+  }
+  ~Link() {
+    {
+      absl::MutexLock lock(&queue_->mutex);
+      queue_->stopped = true;
+    }
+    if (thread_.get_id() == std::this_thread::get_id()) {
+      thread_.detach();
+    } else {
+      thread_.join();
+    }
+  }
+
+  void Post(absl::AnyInvocable<void() &&> task) {
+    absl::MutexLock lock(&queue_->mutex);
+    queue_->tasks.push_back(std::move(task));
+  }
+
+ private:
+  struct Queue {
+    void Run() {
+      while (true) {
+        absl::AnyInvocable<void() &&> task;
+        {
+          absl::MutexLock lock(&mutex);
+          mutex.Await(absl::Condition(
+              +[](Queue* queue) ABSL_EXCLUSIVE_LOCKS_REQUIRED(queue->mutex) {
+                return queue->stopped || !queue->tasks.empty();
+              },
+              this));
+          if (stopped) return;
+          task = std::move(tasks.front());
+          tasks.pop_front();
+        }
+        std::move(task)();
+      }
+    }
+
+    absl::Mutex mutex;
+    std::deque<absl::AnyInvocable<void() &&>> tasks ABSL_GUARDED_BY(mutex);
+    bool stopped ABSL_GUARDED_BY(mutex) = false;
+  };
+
+  std::shared_ptr<Queue> queue_;
+  std::thread thread_;
+};
+
+std::pair<rtc::scoped_refptr<FakeDataChannel>,
+          rtc::scoped_refptr<FakeDataChannel>>
+FakeDataChannel::CreatePair(const std::string& label) {
+  auto link = std::make_shared<Link>();
+  rtc::scoped_refptr<FakeDataChannel> first(
+      new FakeDataChannel(label, /*id=*/0, link));
+  rtc::scoped_refptr<FakeDataChannel> second(
+      new FakeDataChannel(label, /*id=*/1, link));
+  {
+    absl::MutexLock lock(&first->mutex_);
+    first->peer_ = second;
+  }
+  {
+    absl::MutexLock lock(&second->mutex_);
+    second->peer_ = first;
+  }
+  return {first, second};
+}
+
+void FakeDataChannel::RegisterObserver(webrtc::DataChannelObserver* observer) {
+  absl::MutexLock lock(&observer_mutex_);
+  observer_ = observer;
+}
+
+void FakeDataChannel::UnregisterObserver() {
+  absl::MutexLock lock(&observer_mutex_);
+  observer_ = nullptr;
+}
+
+webrtc::DataChannelInterface::DataState FakeDataChannel::state() const {
+  absl::MutexLock lock(&mutex_);
+  return state_;
+}
+
+uint32_t FakeDataChannel::messages_sent() const {
+  absl::MutexLock lock(&mutex_);
+  return messages_sent_;
+}
+
+uint64_t FakeDataChannel::bytes_sent() const {
+  absl::MutexLock lock(&mutex_);
+  return bytes_sent_;
+}
+
+uint32_t FakeDataChannel::messages_received() const {
+  absl::MutexLock lock(&mutex_);
+  return messages_received_;
+}
+
+uint64_t FakeDataChannel::bytes_received() const {
+  absl::MutexLock lock(&mutex_);
+  return bytes_received_;
+}
+
+uint64_t FakeDataChannel::buffered_amount() const {
+  absl::MutexLock lock(&mutex_);
+  return buffered_amount_;
+}
+
+bool FakeDataChannel::Send(const webrtc::DataBuffer& buffer) {
+  rtc::scoped_refptr<FakeDataChannel> peer;
+  {
+    absl::MutexLock lock(&mutex_);
+    if (state_ != kOpen || peer_ == nullptr) return false;
+    peer = peer_;
+    buffered_amount_ += buffer.size();
+  }
+  rtc::scoped_refptr<FakeDataChannel> self(this);
+  link_->Post([self, peer, buffer]() {
+    {
+      absl::MutexLock lock(&peer->mutex_);
+      peer->messages_received_++;
+      peer->bytes_received_ += buffer.size();
+    }
+    {
+      absl::MutexLock lock(&peer->observer_mutex_);
+      if (peer->observer_ != nullptr) peer->observer_->OnMessage(buffer);
+    }
+    {
+      absl::MutexLock lock(&self->mutex_);
+      self->buffered_amount_ -= buffer.size();
+      self->messages_sent_++;
+      self->bytes_sent_ += buffer.size();
+    }
+    absl::MutexLock lock(&self->observer_mutex_);
+    if (self->observer_ != nullptr) {
+      self->observer_->OnBufferedAmountChange(buffer.size());
+    }
+  });
+  return true;
+}
+
+void FakeDataChannel::Close() {
+  rtc::scoped_refptr<FakeDataChannel> peer;
+  {
+    absl::MutexLock lock(&mutex_);
+    if (state_ != kOpen) return;
+    state_ = kClosing;
+    peer = peer_;
+  }
+  rtc::scoped_refptr<FakeDataChannel> self(this);
+  link_->Post([self, peer]() {
+    for (const auto& channel : {self, peer}) {
+      if (channel == nullptr) continue;
+      {
+        absl::MutexLock lock(&channel->mutex_);
+        channel->state_ = kClosed;
+        channel->peer_ = nullptr;
+      }
+      absl::MutexLock lock(&channel->observer_mutex_);
+      if (channel->observer_ != nullptr) channel->observer_->OnStateChange();
+    }
+  });
+}
+
 }  // namespace nearby
@@ -15,9 +15,19 @@
 #ifndef THIRD_PARTY_NEARBY_INTERNAL_TEST_FAKE_WEBRTC_H_
 #define THIRD_PARTY_NEARBY_INTERNAL_TEST_FAKE_WEBRTC_H_
 
+#include <cstdint>
+#include <deque>
 #include <memory>
+#include <string>
+#include <thread>  // NOLINT
+#include <utility>
 
+#include "absl/base/thread_annotations.h"
+#include "absl/functional/any_invocable.h"
+#include "absl/synchronization/mutex.h"
 #include "internal/platform/webrtc.h"
+#include "webrtc/api/data_channel_interface.h"
+#include "webrtc/api/scoped_refptr.h"
 
 namespace nearby {
 
@@ -48,6 +58,61 @@ class FakeWebRtcMedium : public WebRtcMedium {
   bool cancel_during_get_signaling_messenger_ = false;
 };
 
+// One end of an in-process data channel. Messages sent on one end are
+// delivered to the other end's observer on a background thread, in order, the
+// way SCTP delivers them on the network thread. A sent message counts towards
+// buffered_amount() until it has been delivered, after which the sender's
+// observer gets OnBufferedAmountChange(). The two ends keep each other alive
+// until one of them is closed.
+class FakeDataChannel
+    : public rtc::RefCountedObject<webrtc::DataChannelInterface> {
+ public:
+  // Returns two connected ends, both already open.
+  static std::pair<rtc::scoped_refptr<FakeDataChannel>,
+                   rtc::scoped_refptr<FakeDataChannel>>
+  CreatePair(const std::string& label);
+
+  // webrtc::DataChannelInterface:
+  void RegisterObserver(webrtc::DataChannelObserver* observer) override;
+  void UnregisterObserver() override;
+  std::string label() const override { return label_; }
+  bool reliable() const override { return true; }
+  int id() const override { return id_; }
+  DataState state() const override;
+  uint32_t messages_sent() const override;
+  uint64_t bytes_sent() const override;
+  uint32_t messages_received() const override;
+  uint64_t bytes_received() const override;
+  uint64_t buffered_amount() const override;
+  // Closes both ends once the messages sent so far have been delivered.
+  void Close() override;
+  bool Send(const webrtc::DataBuffer& buffer) override;
+
+ private:
+  class Link;
+
+  FakeDataChannel(std::string label, int id, std::shared_ptr<Link> link)
+      : label_(std::move(label)), id_(id), link_(std::move(link)) {}
+
+  const std::string label_;
+  const int id_;
+  const std::shared_ptr<Link> link_;
+  // Held while calling the observer, so that it is never called concurrently
+  // or after UnregisterObserver() has returned, as on the signaling thread.
+  absl::Mutex observer_mutex_;
+  webrtc::DataChannelObserver* observer_ ABSL_GUARDED_BY(observer_mutex_) =
+      nullptr;
+
+  mutable absl::Mutex mutex_;
+  rtc::scoped_refptr<FakeDataChannel> peer_ ABSL_GUARDED_BY(mutex_);
+  DataState state_ ABSL_GUARDED_BY(mutex_) = kOpen;
+  uint32_t messages_sent_ ABSL_GUARDED_BY(mutex_) = 0;
+  uint64_t bytes_sent_ ABSL_GUARDED_BY(mutex_) = 0;
+  uint32_t messages_received_ ABSL_GUARDED_BY(mutex_) = 0;
+  uint64_t bytes_received_ ABSL_GUARDED_BY(mutex_) = 0;
+  uint64_t buffered_amount_ ABSL_GUARDED_BY(mutex_) = 0;
+};
+
 }  // namespace nearby
 
 #endif  // THIRD_PARTY_NEARBY_INTERNAL_TEST_FAKE_WEBRTC_H_
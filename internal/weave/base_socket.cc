@@ -14,6 +14,7 @@
 
 #include "internal/weave/base_socket.h"
 
+#include <algorithm>
 #include <deque>
 #include <string>
 #include <utility>
@@ -54,7 +55,7 @@ BaseSocket::BaseSocket(const Connection& connection, SocketCallback&& callback)
                return;
              }
              absl::StatusOr<Packet> packet{
-                 Packet::FromBytes(ByteArray(message))};
+                 Packet::FromBytes(ByteArray(std::move(message)))};
              if (!packet.ok()) {
                DisconnectInternal(packet.status());
                return;
@@ -77,6 +78,8 @@ BaseSocket::BaseSocket(const Connection& connection, SocketCallback&& callback)
            },
        .on_disconnected_cb = [this]() { DisconnectQuietly(); }});
   max_packet_size_ = connection_.GetMaxPacketSize();
+  max_packets_in_flight_ = std::clamp(connection_.GetMaxPacketsInFlight(), 1,
+                                      Packet::kMaxPacketCounter);
 }
 
 BaseSocket::~BaseSocket() {
@@ -104,9 +107,11 @@ void BaseSocket::TryWriteNextControl() {
   // one of three packets. ConnectionRequest, ConnectionConfirm, or Error.
   // In any case, we should not have any messages in the queue from the previous
   // connection.
-  current_message_ = nullptr;
-  message_request_queue_.clear();
-  WritePacket(current_control_->NextPacket(max_packet_size_));
+  ClearMessageQueue();
+  // Control packets don't wait for credit, the connection needs to see them
+  // right away.
+  WritePacket(current_control_->NextPacket(max_packet_size_),
+              {.is_control = true});
 }
 
 void BaseSocket::TryWriteNextMessage() {
@@ -122,26 +127,57 @@ void BaseSocket::TryWriteNextMessage() {
   }
   bool connected = IsConnected();
   MutexLock lock(&mutex_);
-  if (current_message_ == nullptr) {
-    if (!message_request_queue_.empty()) {
-      current_message_ = &message_request_queue_.front();
-    }
-  }
-  if (current_message_ == nullptr || current_message_->IsFinished() ||
-      !connected) {
+  if (!connected) {
     return;
   }
-  WritePacket(current_message_->NextPacket(max_packet_size_));
+  // Use up the available credit, moving on to the next message as soon as
+  // all packets of the current one are written.
+  while (in_flight_packets_.size() <
+         static_cast<size_t>(max_packets_in_flight_)) {
+    if (current_message_ == nullptr) {
+      if (static_cast<size_t>(written_messages_) >=
+          message_request_queue_.size()) {
+        return;
+      }
+      current_message_ = &message_request_queue_[written_messages_];
+    }
+    if (current_message_->IsFinished()) {
+      return;
+    }
+    absl::StatusOr<Packet> packet =
+        current_message_->NextPacket(max_packet_size_);
+    if (!packet.ok()) {
+      NEARBY_LOGS(WARNING) << "Packet status:" << packet.status();
+      return;
+    }
+    bool completes_message = current_message_->IsFinished();
+    if (completes_message) {
+      written_messages_++;
+      current_message_ = nullptr;
+    }
+    WritePacket(std::move(packet), {.completes_message = completes_message});
+  }
 }
 
-void BaseSocket::WritePacket(absl::StatusOr<Packet> packet) {
+void BaseSocket::WritePacket(absl::StatusOr<Packet> packet,
+                             InFlightPacket in_flight) {
   if (!packet.ok()) {
     NEARBY_LOGS(WARNING) << "Packet status:" << packet.status();
     return;
   }
   CHECK(packet->SetPacketCounter(packet_counter_generator_.Next()).ok());
+  in_flight_packets_.push_back(in_flight);
   NEARBY_LOGS(INFO) << "transmitting packet";
-  connection_.Transmit(packet->GetBytes());
+  connection_.Transmit(std::move(*packet).TakeBytes());
+}
+
+void BaseSocket::ClearMessageQueue() {
+  current_message_ = nullptr;
+  message_request_queue_.clear();
+  written_messages_ = 0;
+  for (InFlightPacket& in_flight : in_flight_packets_) {
+    in_flight.completes_message = false;
+  }
 }
 
 void BaseSocket::OnWriteRequestWriteComplete(absl::Status status) {
@@ -151,20 +187,22 @@ void BaseSocket::OnWriteRequestWriteComplete(absl::Status status) {
           ABSL_LOCKS_EXCLUDED(mutex_) mutable {
             {
               MutexLock lock(&mutex_);
-              if (current_control_ != nullptr) {
-                current_control_ = nullptr;
-                control_request_queue_.pop_front();
-              } else if (current_message_ != nullptr) {
-                NEARBY_LOGS(INFO) << "OnWriteResult current is not null";
-                if (current_message_->IsFinished()) {
-                  NEARBY_LOGS(INFO) << "OnWriteResult current finished";
-                  current_message_->SetWriteStatus(status);
-                  if (!message_request_queue_.empty() &&
-                      current_message_ == &message_request_queue_.front()) {
-                    NEARBY_LOGS(INFO) << "remove message";
-                    message_request_queue_.pop_front();
-                    current_message_ = nullptr;
+              if (in_flight_packets_.empty()) {
+                NEARBY_LOGS(WARNING)
+                    << "OnWriteResult without packets in flight";
+              } else {
+                InFlightPacket in_flight = in_flight_packets_.front();
+                in_flight_packets_.pop_front();
+                if (in_flight.is_control) {
+                  if (current_control_ != nullptr) {
+                    current_control_ = nullptr;
+                    control_request_queue_.pop_front();
                   }
+                } else if (in_flight.completes_message) {
+                  NEARBY_LOGS(INFO) << "remove message";
+                  message_request_queue_.front().SetWriteStatus(status);
+                  message_request_queue_.pop_front();
+                  written_messages_--;
                 }
               }
             }
@@ -196,8 +234,7 @@ void BaseSocket::Disconnect() {
       WriteControlPacket(Packet::CreateErrorPacket());
       {
         MutexLock lock(&mutex_);
-        current_message_ = nullptr;
-        message_request_queue_.clear();
+        ClearMessageQueue();
         state_ = SocketConnectionState::kDisconnecting;
       }
       DisconnectQuietly();
@@ -225,10 +262,12 @@ void BaseSocket::DisconnectQuietly() {
                           // Dump message and control queue.
                           {
                             MutexLock lock(&mutex_);
-                            message_request_queue_.clear();
+                            ClearMessageQueue();
                             control_request_queue_.clear();
                             current_control_ = nullptr;
-                            current_message_ = nullptr;
+                            // The connection may never report packets still
+                            // in flight, don't let them hold on to credit.
+                            in_flight_packets_.clear();
                             state_ = SocketConnectionState::kDisconnected;
                           }
                           NEARBY_LOGS(INFO) << "Socket now disconnected.";
@@ -237,17 +276,19 @@ void BaseSocket::DisconnectQuietly() {
 }
 
 void BaseSocket::OnReceiveDataPacket(Packet packet) {
+  bool is_last_packet = packet.IsLastPacket();
   absl::Status packet_status = packetizer_.AddPacket(std::move(packet));
   if (!packet_status.ok()) {
     DisconnectInternal(packet_status);
     return;
   }
+  if (!is_last_packet) return;
   absl::StatusOr<ByteArray> message = packetizer_.TakeMessage();
   if (!message.ok()) {
     DisconnectInternal(message.status());
     return;
   }
-  socket_callback_.on_receive_cb(message->string_data());
+  socket_callback_.on_receive_cb(std::string(std::move(*message)));
 }
 
 nearby::Future<absl::Status> BaseSocket::Write(ByteArray message) {
@@ -298,6 +339,9 @@ void BaseSocket::OnConnected(int new_max_packet_size) {
                     [this, new_max_packet_size]()
                         ABSL_EXCLUSIVE_LOCKS_REQUIRED(executor_) {
                           max_packet_size_ = new_max_packet_size;
+                          max_packets_in_flight_ = std::clamp(
+                              connection_.GetMaxPacketsInFlight(), 1,
+                              Packet::kMaxPacketCounter);
                           bool was_connected = IsConnected();
                           if (!was_connected) {
                             {
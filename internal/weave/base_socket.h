@@ -79,6 +79,16 @@ class BaseSocket {
     kConnected
   };
 
+  // Bookkeeping for a packet passed to the connection but not reported as sent
+  // yet. `completes_message` is cleared when the message queue is dropped, so
+  // that the completion only returns the credit.
+  struct InFlightPacket {
+    bool is_control = false;
+    // Whether this is the last packet of the oldest message in
+    // `message_request_queue_`.
+    bool completes_message = false;
+  };
+
   bool IsRemotePacketCounterExpected(int counter);
   void TryWriteNextControl() ABSL_EXCLUSIVE_LOCKS_REQUIRED(executor_)
       ABSL_LOCKS_EXCLUDED(mutex_);
@@ -86,7 +96,9 @@ class BaseSocket {
       ABSL_LOCKS_EXCLUDED(mutex_);
   void OnWriteRequestWriteComplete(absl::Status status)
       ABSL_LOCKS_EXCLUDED(executor_);
-  void WritePacket(absl::StatusOr<Packet> packet);
+  void WritePacket(absl::StatusOr<Packet> packet, InFlightPacket in_flight)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void ClearMessageQueue() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   Mutex mutex_;
   // Messages and controls are in two separate queues to separate their control
@@ -96,7 +108,16 @@ class BaseSocket {
   std::deque<MessageWriteRequest> message_request_queue_
       ABSL_GUARDED_BY(mutex_);
   ControlPacketWriteRequest* current_control_ = nullptr;
+  // The message packets are being taken from. Messages ahead of it in
+  // `message_request_queue_` have been written completely and wait for their
+  // last packet to be reported as sent.
   MessageWriteRequest* current_message_ = nullptr;
+  int written_messages_ ABSL_GUARDED_BY(mutex_) = 0;
+  std::deque<InFlightPacket> in_flight_packets_ ABSL_GUARDED_BY(mutex_);
+  // Credit window: packets written but not yet reported as sent may not
+  // exceed this. Kept below the packet counter range, so that no two packets
+  // in flight carry the same counter.
+  int max_packets_in_flight_ = 1;
   SocketConnectionState state_ ABSL_GUARDED_BY(mutex_) =
       SocketConnectionState::kDisconnected;
   int max_packet_size_;
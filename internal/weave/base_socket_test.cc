@@ -47,6 +47,7 @@ class FakeConnection : public Connection {
   }
 
   int GetMaxPacketSize() const override { return max_packet_size_; }
+  int GetMaxPacketsInFlight() const override { return max_packets_in_flight_; }
   void Transmit(std::string packet) override {
     absl::MutexLock lock(&mutex_);
     packets_written_.push_back(packet);
@@ -73,6 +74,9 @@ class FakeConnection : public Connection {
   void SetInstantTransmit(bool instant_transmit) {
     instant_transmit_ = instant_transmit;
   }
+  void SetMaxPacketsInFlight(int max_packets_in_flight) {
+    max_packets_in_flight_ = max_packets_in_flight;
+  }
   void OnTransmitProxy(absl::Status status) {
     callback_.on_transmit_cb(status);
   }
@@ -82,6 +86,7 @@ class FakeConnection : public Connection {
 
  protected:
   int max_packet_size_;
+  int max_packets_in_flight_ = 1;
   ConnectionCallback callback_;
   absl::Mutex mutex_;
   std::vector<std::string> packets_written_ ABSL_GUARDED_BY(mutex_);
@@ -276,6 +281,56 @@ TEST_F(BaseSocketTest, TestWriteThreePackets) {
   EXPECT_TRUE(connection_.NoMorePackets());
 }
 
+TEST_F(BaseSocketTest, TestWriteWithCreditWindow) {
+  connection_.SetInstantTransmit(false);
+  connection_.SetMaxPacketsInFlight(2);
+  socket_.OnConnectedProxy(kMaxPacketSize);
+  nearby::Future<absl::Status> status =
+      socket_.Write(ByteArray("\x01\x02\x03\x04\x05\x06"));
+  // sleep for 10 ms to allow for packet population
+  absl::SleepFor(absl::Milliseconds(10));
+  // Two packets go out without waiting for the first one to be sent.
+  EXPECT_EQ(connection_.PollWrittenPacket(),
+            CreateDataPacket(0, true, false, ByteArray("\x01\x02")).GetBytes());
+  EXPECT_EQ(
+      connection_.PollWrittenPacket(),
+      CreateDataPacket(1, false, false, ByteArray("\x03\x04")).GetBytes());
+  EXPECT_TRUE(connection_.NoMorePackets());
+
+  connection_.OnTransmitProxy(absl::OkStatus());
+  absl::SleepFor(absl::Milliseconds(10));
+  EXPECT_EQ(connection_.PollWrittenPacket(),
+            CreateDataPacket(2, false, true, ByteArray("\x05\x06")).GetBytes());
+  EXPECT_FALSE(status.IsSet());
+
+  connection_.OnTransmitProxy(absl::OkStatus());
+  connection_.OnTransmitProxy(absl::OkStatus());
+  EXPECT_OK(status.Get().GetResult());
+  EXPECT_TRUE(connection_.NoMorePackets());
+}
+
+TEST_F(BaseSocketTest, TestCreditWindowSpansMessages) {
+  connection_.SetInstantTransmit(false);
+  connection_.SetMaxPacketsInFlight(3);
+  socket_.OnConnectedProxy(kMaxPacketSize);
+  nearby::Future<absl::Status> first = socket_.Write(ByteArray("\x01"));
+  nearby::Future<absl::Status> second = socket_.Write(ByteArray("\x02"));
+  // sleep for 10 ms to allow for packet population
+  absl::SleepFor(absl::Milliseconds(10));
+  EXPECT_EQ(connection_.PollWrittenPacket(),
+            CreateDataPacket(0, true, true, ByteArray("\x01")).GetBytes());
+  EXPECT_EQ(connection_.PollWrittenPacket(),
+            CreateDataPacket(1, true, true, ByteArray("\x02")).GetBytes());
+
+  connection_.OnTransmitProxy(absl::OkStatus());
+  EXPECT_OK(first.Get().GetResult());
+  absl::SleepFor(absl::Milliseconds(10));
+  EXPECT_FALSE(second.IsSet());
+
+  connection_.OnTransmitProxy(absl::OkStatus());
+  EXPECT_OK(second.Get().GetResult());
+}
+
 TEST_F(BaseSocketTest, TestWritePacketCounterRollover) {
   socket_.OnConnectedProxy(kMaxPacketSize);
   for (int i = 0; i <= Packet::kMaxPacketCounter; i++) {
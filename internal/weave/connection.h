@@ -36,6 +36,11 @@ class Connection {
   virtual ~Connection() = default;
   virtual void Initialize(ConnectionCallback callback) = 0;
   virtual int GetMaxPacketSize() const = 0;
+  // The number of packets that may be passed to Transmit() before the first
+  // of them is reported as sent through on_transmit_cb. Transports that queue
+  // writes, like GATT writes without response, can raise this to keep several
+  // packets in flight.
+  virtual int GetMaxPacketsInFlight() const { return 1; }
   virtual void Transmit(std::string packet) = 0;
   virtual void Close() = 0;
 };
@@ -42,12 +42,17 @@ constexpr int kConnectionRequestPacketHeaderLength = 6;
 
 Packet Packet::CreateDataPacket(bool is_first_packet, bool is_last_packet,
                                 ByteArray payload) {
+  return CreateDataPacket(is_first_packet, is_last_packet,
+                          payload.AsStringView());
+}
+
+Packet Packet::CreateDataPacket(bool is_first_packet, bool is_last_packet,
+                                absl::string_view payload) {
   int next_four_bits = ((is_first_packet ? kFirstPacketBit : 0) |
                         (is_last_packet ? kLastPacketBit : 0));
   Packet packet = Packet(ByteArray(kPacketHeaderLength + payload.size()));
   packet.SetHeader(/* is_control_packet = */ false, next_four_bits);
-  payload.AsStringView().copy(packet.bytes_.data() + kPacketHeaderLength,
-                              payload.size());
+  payload.copy(packet.bytes_.data() + kPacketHeaderLength, payload.size());
   return packet;
 }
 
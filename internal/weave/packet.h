@@ -15,11 +15,14 @@
 #ifndef THIRD_PARTY_NEARBY_INTERNAL_WEAVE_PACKET_H_
 #define THIRD_PARTY_NEARBY_INTERNAL_WEAVE_PACKET_H_
 
+#include <algorithm>
+#include <cstddef>
 #include <string>
 #include <utility>
 
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
 #include "internal/platform/byte_array.h"
 
 namespace nearby {
@@ -102,6 +105,9 @@ class Packet {
   }
   static Packet CreateDataPacket(bool is_first_packet, bool is_last_packet,
                                  ByteArray payload);
+  // Same as above, copying `payload` straight into the packet.
+  static Packet CreateDataPacket(bool is_first_packet, bool is_last_packet,
+                                 absl::string_view payload);
   static absl::StatusOr<Packet> CreateConnectionRequestPacket(
       int16_t min_protocol_version, int16_t max_protocol_version,
       int16_t max_packet_size, absl::string_view extra_data);
@@ -128,8 +134,20 @@ class Packet {
   bool IsDataPacket() const;
   int GetPacketCounter() const;
   ControlPacketType GetControlCommandNumber() const;
-  std::string GetPayload() const { return bytes_.substr(kPacketHeaderLength); }
+  // The returned view is only valid for as long as the packet is alive and
+  // unmodified.
+  absl::string_view GetPayload() const {
+    return absl::string_view(bytes_).substr(kPacketHeaderLength);
+  }
   std::string GetBytes() const { return bytes_; }
+  // Moves the payload out, leaving the packet empty. The header byte is
+  // dropped in place, so this does not allocate.
+  std::string TakePayload() && {
+    bytes_.erase(0, std::min<size_t>(kPacketHeaderLength, bytes_.size()));
+    return std::move(bytes_);
+  }
+  // Moves the raw packet data out, leaving the packet empty.
+  std::string TakeBytes() && { return std::move(bytes_); }
   absl::Status SetPacketCounter(int packetCounter);
   std::string ToString();
 
@@ -14,6 +14,8 @@
 
 #include "internal/weave/packetizer.h"
 
+#include <algorithm>
+#include <cstddef>
 #include <utility>
 
 #include "absl/status/status.h"
@@ -24,24 +26,35 @@
 namespace nearby {
 namespace weave {
 
-absl::Status Packetizer::AddPacket(Packet packet) {
+absl::Status Packetizer::AddPacket(Packet packet, size_t message_size_hint) {
   MutexLock lock(&mutex_);
   if (is_message_complete_) {
     return absl::InvalidArgumentError(
         "Call GetMessage() first to retrieve message before adding another "
         "packet.");
   }
-  if (pending_payloads_.empty() && !packet.IsFirstPacket()) {
+  if (!has_first_packet_ && !packet.IsFirstPacket()) {
     return absl::InvalidArgumentError(
         "First packet added must be marked as the first packet.");
   }
-  if (!pending_payloads_.empty() && packet.IsFirstPacket()) {
+  if (has_first_packet_ && packet.IsFirstPacket()) {
     return absl::InvalidArgumentError(
         "Packet marked as first packet cannot be added if there are existing "
         "packets.");
   }
-  absl::StrAppend(&pending_payloads_, packet.GetPayload());
-  if (packet.IsLastPacket()) {
+  bool is_last_packet = packet.IsLastPacket();
+  if (!has_first_packet_) {
+    has_first_packet_ = true;
+    pending_message_ = std::move(packet).TakePayload();
+    if (!is_last_packet) {
+      size_t hint =
+          message_size_hint > 0 ? message_size_hint : last_message_size_;
+      pending_message_.reserve(std::max(hint, pending_message_.size()));
+    }
+  } else {
+    pending_message_.append(packet.GetPayload());
+  }
+  if (is_last_packet) {
     is_message_complete_ = true;
   }
   return absl::OkStatus();
@@ -53,15 +66,18 @@ absl::StatusOr<ByteArray> Packetizer::TakeMessage() {
     return absl::UnavailableError(
         "Full message is not available, no last packet added yet.");
   }
-  ByteArray message = ByteArray(std::move(pending_payloads_));
-  pending_payloads_.clear();
+  last_message_size_ = pending_message_.size();
+  ByteArray message = ByteArray(std::move(pending_message_));
+  pending_message_.clear();
+  has_first_packet_ = false;
   is_message_complete_ = false;
   return message;
 }
 
 void Packetizer::Reset() {
   MutexLock lock(&mutex_);
-  pending_payloads_.clear();
+  pending_message_.clear();
+  has_first_packet_ = false;
   is_message_complete_ = false;
 }
 
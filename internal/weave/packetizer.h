@@ -15,6 +15,7 @@
 #ifndef THIRD_PARTY_NEARBY_INTERNAL_WEAVE_PACKETIZER_H_
 #define THIRD_PARTY_NEARBY_INTERNAL_WEAVE_PACKETIZER_H_
 
+#include <cstddef>
 #include <string>
 
 #include "absl/status/statusor.h"
@@ -26,15 +27,25 @@ namespace nearby {
 namespace weave {
 
 // Joins Weave packets to create messages.
+//
+// The first packet's buffer becomes the message buffer: its header byte is
+// dropped in place and later payloads are appended to it, so the finished
+// message is handed back without being copied again.
 class Packetizer {
  public:
   // Adds a Packet to an ongoing message, returning absl::OkStatus() on success.
   //
+  // `message_size_hint`, if non-zero on the first packet, is the expected size
+  // of the whole message, and is reserved up front so that appending the
+  // remaining packets does not reallocate. Without a hint, the size of the
+  // previous message is used, since messages on a socket tend to be similar.
+  //
   // Returns absl::InvalidArgumentError if the packet being added is
   // not marked as the first packet (if no prior packets have been joined) or if
   // the packet being joined is marked as the first packet, but there is already
   // a message being reconstructed.
-  absl::Status AddPacket(Packet packet) ABSL_LOCKS_EXCLUDED(mutex_);
+  absl::Status AddPacket(Packet packet, size_t message_size_hint = 0)
+      ABSL_LOCKS_EXCLUDED(mutex_);
 
   // Should be called after each call to AddPacket() to get the message if
   // available. This function will return absl::UnavailableError should the
@@ -47,8 +58,10 @@ class Packetizer {
 
  private:
   Mutex mutex_;
-  std::string pending_payloads_ ABSL_GUARDED_BY(mutex_);
+  std::string pending_message_ ABSL_GUARDED_BY(mutex_);
+  bool has_first_packet_ ABSL_GUARDED_BY(mutex_) = false;
   bool is_message_complete_ ABSL_GUARDED_BY(mutex_) = false;
+  size_t last_message_size_ ABSL_GUARDED_BY(mutex_) = 0;
 };
 }  // namespace weave
 }  // namespace nearby
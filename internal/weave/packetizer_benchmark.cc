@@ -0,0 +1,122 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks reassembling multi-kilobyte messages from Weave packets, as
+// BaseSocket does on receive. Besides throughput, reports the number of heap
+// allocations made per packet while the message is joined, which should be
+// zero once the message buffer has been reserved.
+//
+// Run with:
+//   bazel run -c opt //internal/weave:packetizer_benchmark
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "internal/platform/byte_array.h"
+#include "internal/weave/packet.h"
+#include "internal/weave/packetizer.h"
+
+namespace {
+
+std::atomic<std::int64_t> allocation_count{0};
+
+}  // namespace
+
+void* operator new(std::size_t size) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  if (size == 0) size = 1;
+  if (void* ptr = std::malloc(size)) return ptr;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+namespace nearby {
+namespace weave {
+namespace {
+
+// Splits `message` into data packets carrying at most `payload_size` bytes.
+std::vector<Packet> Packetize(const std::string& message, int payload_size) {
+  std::vector<Packet> packets;
+  for (size_t offset = 0; offset < message.size(); offset += payload_size) {
+    bool is_first_packet = offset == 0;
+    bool is_last_packet = offset + payload_size >= message.size();
+    packets.push_back(Packet::CreateDataPacket(
+        is_first_packet, is_last_packet,
+        absl::string_view(message).substr(offset, payload_size)));
+  }
+  return packets;
+}
+
+// Args: message size, packet payload size, pass the message size as a hint
+// (0/1).
+void BM_ReassembleMessage(benchmark::State& state) {
+  const int message_size = state.range(0);
+  const int payload_size = state.range(1);
+  const bool use_size_hint = state.range(2) != 0;
+  const std::string message(message_size, 'x');
+  Packetizer packetizer;
+  std::int64_t packet_count = 0;
+  std::int64_t allocations = 0;
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::vector<Packet> packets = Packetize(message, payload_size);
+    state.ResumeTiming();
+
+    std::int64_t start_allocations =
+        allocation_count.load(std::memory_order_relaxed);
+    for (Packet& packet : packets) {
+      if (!packetizer
+               .AddPacket(std::move(packet),
+                          use_size_hint ? message_size : 0)
+               .ok()) {
+        state.SkipWithError("Failed to add packet.");
+        return;
+      }
+    }
+    absl::StatusOr<ByteArray> reassembled = packetizer.TakeMessage();
+    allocations +=
+        allocation_count.load(std::memory_order_relaxed) - start_allocations;
+    if (!reassembled.ok() || reassembled->size() != message.size()) {
+      state.SkipWithError("Message was not reassembled.");
+      return;
+    }
+    packet_count += packets.size();
+    benchmark::DoNotOptimize(reassembled->data());
+  }
+
+  state.SetBytesProcessed(state.iterations() * message_size);
+  if (packet_count > 0) {
+    state.counters["allocs_per_packet"] =
+        static_cast<double>(allocations) / packet_count;
+  }
+}
+BENCHMARK(BM_ReassembleMessage)
+    ->ArgsProduct({{4 * 1024, 16 * 1024, 64 * 1024}, {20, 185, 512}, {0, 1}});
+
+}  // namespace
+}  // namespace weave
+}  // namespace nearby
@@ -14,6 +14,7 @@
 
 #include "internal/weave/packetizer.h"
 
+#include <string>
 #include <utility>
 
 #include "gmock/gmock.h"
@@ -116,6 +117,56 @@ TEST(PacketizerTest, TestAddTwoFirstPacketsFails) {
               StatusIs(absl::StatusCode::kInvalidArgument));
 }
 
+TEST(PacketizerTest, TestSinglePacketMessageIsNotCopied) {
+  std::string payload(1000, 'a');
+  Packet packet = Packet::CreateDataPacket(
+      /*is_first_packet=*/true, /*is_last_packet=*/true, payload);
+  // The header byte sits just before the payload in the packet's buffer.
+  const char* packet_data = packet.GetPayload().data() - 1;
+
+  Packetizer packetizer;
+  EXPECT_OK(packetizer.AddPacket(std::move(packet)));
+  absl::StatusOr<ByteArray> message = packetizer.TakeMessage();
+  ASSERT_OK(message);
+  EXPECT_EQ(message->string_data(), payload);
+  EXPECT_EQ(message->data(), packet_data);
+}
+
+TEST(PacketizerTest, TestAddPacketWithSizeHint) {
+  std::string first(100, 'a');
+  std::string second(100, 'b');
+  std::string third(50, 'c');
+
+  Packetizer packetizer;
+  EXPECT_OK(packetizer.AddPacket(
+      Packet::CreateDataPacket(/*is_first_packet=*/true,
+                               /*is_last_packet=*/false, first),
+      /*message_size_hint=*/250));
+  EXPECT_OK(packetizer.AddPacket(Packet::CreateDataPacket(
+      /*is_first_packet=*/false, /*is_last_packet=*/false, second)));
+  EXPECT_OK(packetizer.AddPacket(Packet::CreateDataPacket(
+      /*is_first_packet=*/false, /*is_last_packet=*/true, third)));
+  absl::StatusOr<ByteArray> message = packetizer.TakeMessage();
+  ASSERT_OK(message);
+  EXPECT_EQ(message->string_data(), first + second + third);
+}
+
+TEST(PacketizerTest, TestEmptyFirstPacketStartsMessage) {
+  Packetizer packetizer;
+  EXPECT_OK(packetizer.AddPacket(Packet::CreateDataPacket(
+      /*is_first_packet=*/true, /*is_last_packet=*/false, ByteArray())));
+  EXPECT_THAT(packetizer.AddPacket(Packet::CreateDataPacket(
+                  /*is_first_packet=*/true, /*is_last_packet=*/true,
+                  ByteArray("hello"))),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_OK(packetizer.AddPacket(Packet::CreateDataPacket(
+      /*is_first_packet=*/false, /*is_last_packet=*/true,
+      ByteArray("hello"))));
+  absl::StatusOr<ByteArray> message = packetizer.TakeMessage();
+  ASSERT_OK(message);
+  EXPECT_EQ(message->string_data(), "hello");
+}
+
 }  // namespace
 }  // namespace weave
 }  // namespace nearby
@@ -19,6 +19,7 @@
 #include <utility>
 
 #include "absl/status/status.h"
+#include "absl/strings/string_view.h"
 #include "internal/weave/base_socket.h"
 #include "internal/weave/socket_callback.h"
 #include "internal/weave/sockets/initial_data_provider.h"
@@ -115,8 +116,8 @@ void ClientSocket::OnReceiveControlPacket(Packet packet) {
   OnConnected(max_packet_size);
 
   if (packet.GetPayload().size() > kConnectionConfirmPacketMinLength) {
-    std::string remaining_data =
-        packet.GetPayload().substr(kConnectionConfirmPacketMinLength);
+    std::string remaining_data(
+        packet.GetPayload().substr(kConnectionConfirmPacketMinLength));
     GetSocketCallback().on_receive_cb(remaining_data);
   }
 }
@@ -0,0 +1,67 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "presence/implementation/advertisement_decode_cache.h"
+
+#include <cstdint>
+#include <string>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "internal/platform/implementation/system_clock.h"
+#include "presence/implementation/advertisement_decoder.h"
+
+namespace nearby {
+namespace presence {
+
+const absl::StatusOr<Advertisement>& AdvertisementDecodeCache::GetOrDecode(
+    absl::string_view advertisement, uint64_t generation,
+    AdvertisementDecoder& decoder) {
+  absl::Time now = SystemClock::ElapsedRealtime();
+  Key key(std::string(advertisement), generation);
+  auto it = entries_.find(key);
+  if (it != entries_.end()) {
+    if (it->second->expiration > now) {
+      lru_.splice(lru_.begin(), lru_, it->second);
+      return it->second->advertisement;
+    }
+    lru_.erase(it->second);
+    entries_.erase(it);
+  }
+  while (!lru_.empty() && lru_.size() >= static_cast<size_t>(capacity_)) {
+    entries_.erase(lru_.back().key);
+    lru_.pop_back();
+  }
+  lru_.push_front(Entry{.key = key,
+                        .advertisement =
+                            decoder.DecodeAdvertisement(advertisement),
+                        .expiration = now + ttl_});
+  entries_.emplace(std::move(key), lru_.begin());
+  return lru_.front().advertisement;
+}
+
+void AdvertisementDecodeCache::EraseGeneration(uint64_t generation) {
+  for (auto it = lru_.begin(); it != lru_.end();) {
+    if (it->key.second == generation) {
+      entries_.erase(it->key);
+      it = lru_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+}  // namespace presence
+}  // namespace nearby
@@ -0,0 +1,83 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_NEARBY_PRESENCE_IMPLEMENTATION_ADVERTISEMENT_DECODE_CACHE_H_
+#define THIRD_PARTY_NEARBY_PRESENCE_IMPLEMENTATION_ADVERTISEMENT_DECODE_CACHE_H_
+
+#include <cstdint>
+#include <list>
+#include <string>
+#include <utility>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "presence/implementation/advertisement_decoder.h"
+
+namespace nearby {
+namespace presence {
+
+// Remembers the results of decoding BLE advertisements, so that identical
+// advertisements seen again - by the same or another scan session - skip
+// parsing and LDT trial decryption.
+//
+// Results are keyed by the advertisement bytes and a credential set
+// generation. Callers must use a different generation whenever anything that
+// affects decoding changes, i.e. the credentials or the identity types being
+// scanned for. Failed decodes are cached as well, since they are the
+// expensive case: every credential was tried.
+//
+// Entries expire after `ttl`, and the least recently used entry is evicted
+// when the cache is full. Not thread-safe.
+class AdvertisementDecodeCache {
+ public:
+  static constexpr int kDefaultCapacity = 128;
+  static constexpr absl::Duration kDefaultTtl = absl::Seconds(10);
+
+  explicit AdvertisementDecodeCache(int capacity = kDefaultCapacity,
+                                    absl::Duration ttl = kDefaultTtl)
+      : capacity_(capacity), ttl_(ttl) {}
+
+  // Returns the result of decoding `advertisement` under credential set
+  // `generation`. On a miss, `decoder` decodes it and the result is cached.
+  // The reference is valid until the next call into the cache.
+  const absl::StatusOr<Advertisement>& GetOrDecode(
+      absl::string_view advertisement, uint64_t generation,
+      AdvertisementDecoder& decoder);
+
+  // Drops all results decoded under `generation`.
+  void EraseGeneration(uint64_t generation);
+
+  int Size() const { return entries_.size(); }
+
+ private:
+  using Key = std::pair<std::string, uint64_t>;
+  struct Entry {
+    Key key;
+    absl::StatusOr<Advertisement> advertisement;
+    absl::Time expiration;
+  };
+
+  int capacity_;
+  absl::Duration ttl_;
+  // Most recently used first.
+  std::list<Entry> lru_;
+  absl::flat_hash_map<Key, std::list<Entry>::iterator> entries_;
+};
+
+}  // namespace presence
+}  // namespace nearby
+
+#endif  // THIRD_PARTY_NEARBY_PRESENCE_IMPLEMENTATION_ADVERTISEMENT_DECODE_CACHE_H_
@@ -0,0 +1,129 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "presence/implementation/advertisement_decode_cache.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "absl/strings/escaping.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "internal/proto/credential.pb.h"
+#include "presence/implementation/advertisement_decoder.h"
+#include "presence/scan_request.h"
+
+namespace nearby {
+namespace presence {
+namespace {
+
+using ::nearby::internal::IdentityType;
+
+// Public identity, TX power and action.
+constexpr char kPublicAdvertisement[] = "000315FF260080";
+// Public identity and TX power.
+constexpr char kOtherPublicAdvertisement[] = "002041420337C1C2C31BEE";
+
+// Decodes public advertisements.
+AdvertisementDecoder PublicDecoder() {
+  return AdvertisementDecoder(
+      ScanRequest{.identity_types = {IdentityType::IDENTITY_TYPE_PUBLIC}});
+}
+
+// Rejects public advertisements.
+AdvertisementDecoder PrivateDecoder() {
+  return AdvertisementDecoder(
+      ScanRequest{.identity_types = {IdentityType::IDENTITY_TYPE_PRIVATE}});
+}
+
+TEST(AdvertisementDecodeCacheTest, HitSkipsDecoding) {
+  AdvertisementDecodeCache cache;
+  AdvertisementDecoder public_decoder = PublicDecoder();
+  AdvertisementDecoder private_decoder = PrivateDecoder();
+  std::string advertisement = absl::HexStringToBytes(kPublicAdvertisement);
+
+  ASSERT_TRUE(cache.GetOrDecode(advertisement, 1, public_decoder).ok());
+  // Would fail if it were decoded again.
+  EXPECT_TRUE(cache.GetOrDecode(advertisement, 1, private_decoder).ok());
+  EXPECT_EQ(cache.Size(), 1);
+}
+
+TEST(AdvertisementDecodeCacheTest, GenerationsAreCachedSeparately) {
+  AdvertisementDecodeCache cache;
+  AdvertisementDecoder public_decoder = PublicDecoder();
+  AdvertisementDecoder private_decoder = PrivateDecoder();
+  std::string advertisement = absl::HexStringToBytes(kPublicAdvertisement);
+
+  EXPECT_TRUE(cache.GetOrDecode(advertisement, 1, public_decoder).ok());
+  EXPECT_FALSE(cache.GetOrDecode(advertisement, 2, private_decoder).ok());
+  EXPECT_EQ(cache.Size(), 2);
+}
+
+TEST(AdvertisementDecodeCacheTest, FailuresAreCached) {
+  AdvertisementDecodeCache cache;
+  AdvertisementDecoder public_decoder = PublicDecoder();
+  AdvertisementDecoder private_decoder = PrivateDecoder();
+  std::string advertisement = absl::HexStringToBytes(kPublicAdvertisement);
+
+  EXPECT_FALSE(cache.GetOrDecode(advertisement, 1, private_decoder).ok());
+  EXPECT_FALSE(cache.GetOrDecode(advertisement, 1, public_decoder).ok());
+}
+
+TEST(AdvertisementDecodeCacheTest, LeastRecentlyUsedIsEvicted) {
+  AdvertisementDecodeCache cache(/*capacity=*/2);
+  AdvertisementDecoder public_decoder = PublicDecoder();
+  AdvertisementDecoder private_decoder = PrivateDecoder();
+  std::string advertisement = absl::HexStringToBytes(kPublicAdvertisement);
+  std::string other_advertisement =
+      absl::HexStringToBytes(kOtherPublicAdvertisement);
+
+  cache.GetOrDecode(advertisement, 1, public_decoder);
+  cache.GetOrDecode(other_advertisement, 1, public_decoder);
+  // Touch `advertisement`, so that `other_advertisement` is evicted next.
+  cache.GetOrDecode(advertisement, 1, public_decoder);
+  cache.GetOrDecode(advertisement, 2, public_decoder);
+
+  EXPECT_EQ(cache.Size(), 2);
+  EXPECT_TRUE(cache.GetOrDecode(advertisement, 1, private_decoder).ok());
+  EXPECT_FALSE(cache.GetOrDecode(other_advertisement, 1, private_decoder).ok());
+}
+
+TEST(AdvertisementDecodeCacheTest, EntriesExpire) {
+  AdvertisementDecodeCache cache(AdvertisementDecodeCache::kDefaultCapacity,
+                                 /*ttl=*/absl::Milliseconds(10));
+  AdvertisementDecoder public_decoder = PublicDecoder();
+  AdvertisementDecoder private_decoder = PrivateDecoder();
+  std::string advertisement = absl::HexStringToBytes(kPublicAdvertisement);
+
+  ASSERT_TRUE(cache.GetOrDecode(advertisement, 1, public_decoder).ok());
+  absl::SleepFor(absl::Milliseconds(20));
+
+  EXPECT_FALSE(cache.GetOrDecode(advertisement, 1, private_decoder).ok());
+}
+
+TEST(AdvertisementDecodeCacheTest, EraseGeneration) {
+  AdvertisementDecodeCache cache;
+  AdvertisementDecoder public_decoder = PublicDecoder();
+  std::string advertisement = absl::HexStringToBytes(kPublicAdvertisement);
+  cache.GetOrDecode(advertisement, 1, public_decoder);
+  cache.GetOrDecode(advertisement, 2, public_decoder);
+
+  cache.EraseGeneration(1);
+
+  EXPECT_EQ(cache.Size(), 1);
+}
+
+}  // namespace
+}  // namespace presence
+}  // namespace nearby
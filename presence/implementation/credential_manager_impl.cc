@@ -15,6 +15,7 @@
 #include "presence/implementation/credential_manager_impl.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <limits>
 #include <memory>
@@ -39,7 +40,6 @@
 #include "internal/crypto_cros/hkdf.h"
 #include "internal/crypto_cros/random.h"
 #endif
-#include "internal/platform/base64_utils.h"
 #include "internal/platform/future.h"
 #include "internal/platform/implementation/credential_callbacks.h"
 #include "internal/platform/implementation/crypto.h"
@@ -54,7 +54,6 @@
 namespace nearby {
 namespace presence {
 namespace {
-using ::nearby::Base64Utils;
 using ::nearby::Crypto;
 using ::nearby::Exception;
 using ::nearby::ExceptionOr;
@@ -63,9 +62,6 @@ using ::nearby::internal::IdentityType;
 using ::nearby::internal::LocalCredential;
 using ::nearby::internal::SharedCredential;
 
-// Key to retrieve local device's Private/Public Key Credentials from key store.
-constexpr char kPairedKeyAliasPrefix[] = "nearby_presence_paired_key_alias_";
-
 // The expected number of valid local credentials to be stored on local device.
 constexpr int kExpectedValidLocalCredtialSize = 6;
 // The expiration time in days for a credential.
@@ -91,32 +87,94 @@ void CredentialManagerImpl::GenerateCredentials(
     const std::vector<IdentityType>& identity_types,
     int credential_life_cycle_days, int contiguous_copy_of_credentials,
     GenerateCredentialsResultCallback credentials_generated_cb) {
+  // The credentials of each identity type are generated in the background.
+  // Once the last type is done, they are saved from the service controller
+  // thread, so the caller isn't held up by either.
+  struct PendingGeneration {
+    Mutex mutex;
+    std::string manager_app_id;
+    std::string account_name;
+    std::vector<CredentialPairs> credentials_per_identity_type
+        ABSL_GUARDED_BY(mutex);
+    int remaining ABSL_GUARDED_BY(mutex);
+    GenerateCredentialsResultCallback callback;
+  };
+  auto pending = std::make_shared<PendingGeneration>();
+  pending->manager_app_id = std::string(manager_app_id);
+  pending->account_name = metadata.account_name();
+  pending->callback = std::move(credentials_generated_cb);
+  {
+    MutexLock lock(&pending->mutex);
+    pending->credentials_per_identity_type.resize(identity_types.size());
+    pending->remaining = identity_types.size();
+  }
+  if (identity_types.empty()) {
+    RunOnServiceControllerThread(
+        "save-generated-credentials",
+        [this, pending]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(*executor_) {
+          SaveGeneratedCredentials(pending->manager_app_id,
+                                   pending->account_name, {},
+                                   std::move(pending->callback));
+        });
+    return;
+  }
+
+  absl::Time start_time = SystemClock::ElapsedRealtime();
+  absl::Duration gap = credential_life_cycle_days * absl::Hours(24);
+  for (size_t i = 0; i < identity_types.size(); i++) {
+    CreateLocalCredentialsAsync(
+        metadata, identity_types[i], start_time, gap,
+        contiguous_copy_of_credentials,
+        [this, pending, i](CredentialPairs credentials) {
+          std::vector<CredentialPairs> credentials_per_identity_type;
+          {
+            MutexLock lock(&pending->mutex);
+            pending->credentials_per_identity_type[i] = std::move(credentials);
+            if (--pending->remaining > 0) return;
+            credentials_per_identity_type =
+                std::move(pending->credentials_per_identity_type);
+          }
+          RunOnServiceControllerThread(
+              "save-generated-credentials",
+              [this, pending,
+               credentials_per_identity_type =
+                   std::move(credentials_per_identity_type)]() mutable
+              ABSL_EXCLUSIVE_LOCKS_REQUIRED(*executor_) {
+                SaveGeneratedCredentials(
+                    pending->manager_app_id, pending->account_name,
+                    std::move(credentials_per_identity_type),
+                    std::move(pending->callback));
+              });
+        });
+  }
+}
+
+void CredentialManagerImpl::SaveGeneratedCredentials(
+    absl::string_view manager_app_id, absl::string_view account_name,
+    std::vector<CredentialPairs> credentials_per_identity_type,
+    GenerateCredentialsResultCallback credentials_generated_cb) {
   std::vector<SharedCredential> public_credentials;
   std::vector<LocalCredential> private_credentials;
-
-  for (auto identity_type : identity_types) {
-    absl::Time start_time = SystemClock::ElapsedRealtime();
-    absl::Duration gap = credential_life_cycle_days * absl::Hours(24);
-    for (int index = 0; index < contiguous_copy_of_credentials; index++) {
-      auto public_private_credentials = CreateLocalCredential(
-          metadata, identity_type, start_time, start_time + gap);
+  for (auto& credentials : credentials_per_identity_type) {
+    for (auto& public_private_credentials : credentials) {
       if (public_private_credentials.second.identity_type() !=
           IdentityType::IDENTITY_TYPE_UNSPECIFIED) {
-        private_credentials.push_back(public_private_credentials.first);
-        public_credentials.push_back(public_private_credentials.second);
+        private_credentials.push_back(
+            std::move(public_private_credentials.first));
+        public_credentials.push_back(
+            std::move(public_private_credentials.second));
       }
-      start_time += gap;
     }
   }
 
   // Create credential_storage object and invoke SaveCredentials.
   credential_storage_ptr_->SaveCredentials(
-      manager_app_id, metadata.account_name(), private_credentials,
-      public_credentials, PublicCredentialType::kLocalPublicCredential,
+      manager_app_id, account_name, private_credentials, public_credentials,
+      PublicCredentialType::kLocalPublicCredential,
       SaveCredentialsResultCallback{
           .credentials_saved_cb =
               [this, manager_app_id = std::string(manager_app_id),
-               account_name = metadata.account_name(),
+               account_name = std::string(account_name),
                callback = std::move(credentials_generated_cb),
                public_credentials](absl::Status status) mutable {
                 if (!status.ok()) {
@@ -175,48 +233,134 @@ CredentialManagerImpl::CreateLocalCredential(const Metadata& metadata,
                                              IdentityType identity_type,
                                              absl::Time start_time,
                                              absl::Time end_time) {
+  KeyMaterial key_material = TakeKeyMaterial();
   LocalCredential private_credential;
   private_credential.set_start_time_millis(absl::ToUnixMillis(start_time));
   private_credential.set_end_time_millis(absl::ToUnixMillis(end_time));
   private_credential.set_identity_type(identity_type);
+  private_credential.set_key_seed(key_material.key_seed);
+  private_credential.set_secret_id(key_material.secret_id);
+  private_credential.mutable_connection_signing_key()->set_key(std::string(
+      key_material.private_key.begin(), key_material.private_key.end()));
+  private_credential.set_metadata_encryption_key_v0(
+      key_material.metadata_encryption_key);
+
+  return std::pair<LocalCredential, SharedCredential>(
+      private_credential,
+      CreatePublicCredential(private_credential, metadata,
+                             key_material.public_key));
+}
 
+void CredentialManagerImpl::CreateLocalCredentialsAsync(
+    const Metadata& metadata, IdentityType identity_type, absl::Time start_time,
+    absl::Duration life_cycle, int count,
+    CreateLocalCredentialsCallback callback) {
+  if (count <= 0) {
+    callback({});
+    return;
+  }
+  struct PendingCredentials {
+    Metadata metadata;
+    CredentialPairs credentials;
+    std::atomic<int> remaining;
+    CreateLocalCredentialsCallback callback;
+  };
+  auto pending = std::make_shared<PendingCredentials>();
+  pending->metadata = metadata;
+  pending->credentials.resize(count);
+  pending->remaining = count;
+  pending->callback = std::move(callback);
+  for (int i = 0; i < count; i++) {
+    credential_generation_executor_.Execute(
+        "create-credential",
+        [this, pending, identity_type, start_time, life_cycle, count, i]() {
+          absl::Time credential_start_time = start_time + i * life_cycle;
+          pending->credentials[i] = CreateLocalCredential(
+              pending->metadata, identity_type, credential_start_time,
+              credential_start_time + life_cycle);
+          if (pending->remaining.fetch_sub(1) > 1) return;
+          // Restock for the next batch.
+          PrecomputeKeyMaterial(count);
+          pending->callback(std::move(pending->credentials));
+        });
+  }
+}
+
+CredentialManagerImpl::CredentialPairs
+CredentialManagerImpl::CreateLocalCredentials(const Metadata& metadata,
+                                              IdentityType identity_type,
+                                              absl::Time start_time,
+                                              absl::Duration life_cycle,
+                                              int count) {
+  CredentialPairs credentials;
+  CountDownLatch latch(1);
+  CreateLocalCredentialsAsync(metadata, identity_type, start_time, life_cycle,
+                              count,
+                              [&credentials, latch](CredentialPairs result)
+                                  mutable {
+                                credentials = std::move(result);
+                                latch.CountDown();
+                              });
+  latch.Await();
+  return credentials;
+}
+
+void CredentialManagerImpl::PrecomputeKeyMaterial(int count) {
+  int missing;
+  {
+    MutexLock lock(&key_material_mutex_);
+    missing = count - pending_key_material_;
+    if (missing <= 0) return;
+    pending_key_material_ += missing;
+  }
+  for (int i = 0; i < missing; i++) {
+    credential_generation_executor_.Execute(
+        "precompute-key-material", [this]() {
+          KeyMaterial key_material = CreateKeyMaterial();
+          MutexLock lock(&key_material_mutex_);
+          precomputed_key_material_.push_back(std::move(key_material));
+        });
+  }
+}
+
+CredentialManagerImpl::KeyMaterial CredentialManagerImpl::CreateKeyMaterial() {
+  KeyMaterial key_material;
   // Creates an AES key to encrypt the whole broadcast.
-  std::string secret_key(kAuthenticityKeyByteSize, 0);
-  crypto::RandBytes(const_cast<std::string::value_type*>(secret_key.data()),
-                    secret_key.size());
-  private_credential.set_key_seed(secret_key);
+  key_material.key_seed.resize(kAuthenticityKeyByteSize);
+  crypto::RandBytes(key_material.key_seed.data(),
+                    key_material.key_seed.size());
 
   // Uses SHA-256 algorithm to generate the credential ID from the
   // authenticity key
-  auto secret_id = Crypto::Sha256(secret_key);
+  auto secret_id = Crypto::Sha256(key_material.key_seed);
   // Does not expect to fail here since Crypto::Sha256 should not return
   // empty ByteArray.
   CHECK(!secret_id.Empty()) << "Crypto::Sha256 failed!";
+  key_material.secret_id = std::string(secret_id.AsStringView());
 
-  private_credential.set_secret_id(std::string(secret_id.AsStringView()));
-
-  std::string alias = Base64Utils::Encode(secret_id);
-  auto prefixedAlias = kPairedKeyAliasPrefix + alias;
-
-  // Generate key pair. Store the private key in private credential.
+  // Generate key pair.
   auto key_pair = crypto::ECPrivateKey::Create();
-  std::vector<uint8_t> private_key;
-  key_pair->ExportPrivateKey(&private_key);
-  private_credential.mutable_connection_signing_key()->set_key(
-      std::string(private_key.begin(), private_key.end()));
-  // Create an AES key to encrypt the device metadata.
-  std::string metadata_key(kBaseMetadataSize, 0);
-  crypto::RandBytes(const_cast<std::string::value_type*>(metadata_key.data()),
-                    metadata_key.size());
-  private_credential.set_metadata_encryption_key_v0(metadata_key);
+  key_pair->ExportPrivateKey(&key_material.private_key);
+  key_pair->ExportPublicKey(&key_material.public_key);
 
-  // Generate the public credential
-  std::vector<uint8_t> public_key;
-  key_pair->ExportPublicKey(&public_key);
+  // Create an AES key to encrypt the device metadata.
+  key_material.metadata_encryption_key.resize(kBaseMetadataSize);
+  crypto::RandBytes(key_material.metadata_encryption_key.data(),
+                    key_material.metadata_encryption_key.size());
+  return key_material;
+}
 
-  return std::pair<LocalCredential, SharedCredential>(
-      private_credential,
-      CreatePublicCredential(private_credential, metadata, public_key));
+CredentialManagerImpl::KeyMaterial CredentialManagerImpl::TakeKeyMaterial() {
+  {
+    MutexLock lock(&key_material_mutex_);
+    if (!precomputed_key_material_.empty()) {
+      KeyMaterial key_material = std::move(precomputed_key_material_.front());
+      precomputed_key_material_.pop_front();
+      pending_key_material_--;
+      return key_material;
+    }
+  }
+  return CreateKeyMaterial();
 }
 
 SharedCredential CredentialManagerImpl::CreatePublicCredential(
@@ -625,6 +769,10 @@ void CredentialManagerImpl::CheckCredentialsAndRefillIfNeeded(
   // Otherwise, the long process of refill (another read, merge, then save)
   // would start.
   if (valid_credentials_count >= kExpectedValidLocalCredtialSize) {
+    // Refill is coming up as the credentials expire. Keep the expensive part
+    // of it done in the background ahead of time; this is a no-op while the
+    // stock is full.
+    PrecomputeKeyMaterial(kExpectedValidLocalCredtialSize);
     if (invoked_for_local) {
       callback_for_local_credentials.value().credentials_fetched_cb(
           valid_local_credentials);
@@ -638,16 +786,13 @@ void CredentialManagerImpl::CheckCredentialsAndRefillIfNeeded(
   std::vector<LocalCredential> newly_generated_local_credentials;
   std::vector<SharedCredential> newly_generated_shared_credentials;
   // Generate more credential pairs to refill the expired ones.
-  auto start_time = absl::FromUnixMillis(last_valid_end_time_millis);
-  auto gap = kCredentialLifeCycleDays * absl::Hours(24);
-  for (int i = 0; i < kExpectedValidLocalCredtialSize - valid_credentials_count;
-       i++) {
-    auto pair =
-        CreateLocalCredential(metadata_, credential_selector.identity_type,
-                              start_time, start_time + gap);
-    newly_generated_local_credentials.push_back(pair.first);
-    newly_generated_shared_credentials.push_back(pair.second);
-    start_time += gap;
+  for (auto& pair : CreateLocalCredentials(
+           metadata_, credential_selector.identity_type,
+           absl::FromUnixMillis(last_valid_end_time_millis),
+           kCredentialLifeCycleDays * absl::Hours(24),
+           kExpectedValidLocalCredtialSize - valid_credentials_count)) {
+    newly_generated_local_credentials.push_back(std::move(pair.first));
+    newly_generated_shared_credentials.push_back(std::move(pair.second));
   }
 
   // Already got the merged valid credential list for either local or shared.
@@ -16,6 +16,8 @@
 #define THIRD_PARTY_NEARBY_PRESENCE_IMPLEMENTATION_CREDENTIAL_MANAGER_IMPL_H_
 
 #include <atomic>
+#include <cstdint>
+#include <deque>
 #include <memory>
 #include <optional>
 #include <string>
@@ -24,6 +26,7 @@
 
 #include "absl/base/thread_annotations.h"
 #include "absl/container/flat_hash_map.h"
+#include "absl/functional/any_invocable.h"
 #include "absl/log/die_if_null.h"
 #include "absl/strings/string_view.h"
 #include "absl/time/time.h"
@@ -31,6 +34,8 @@
 #include "internal/platform/count_down_latch.h"
 #include "internal/platform/credential_storage_impl.h"
 #include "internal/platform/implementation/credential_callbacks.h"
+#include "internal/platform/multi_thread_executor.h"
+#include "internal/platform/mutex.h"
 #include "internal/platform/runnable.h"
 #include "internal/platform/single_thread_executor.h"
 #include "internal/proto/credential.pb.h"
@@ -57,6 +62,10 @@ class CredentialManagerImpl : public CredentialManager {
       : executor_(ABSL_DIE_IF_NULL(executor)),
         credential_storage_ptr_(std::move(credential_storage_ptr)) {}
 
+  ~CredentialManagerImpl() override {
+    credential_generation_executor_.Shutdown();
+  }
+
   // AES only supports key sizes of 16, 24 or 32 bytes.
   static constexpr int kAuthenticityKeyByteSize = 32;
 
@@ -66,6 +75,9 @@ class CredentialManagerImpl : public CredentialManager {
   // Modify this to 12 after use real AES.
   static constexpr int kAesGcmIVSize = 12;
 
+  // Number of worker threads generating credentials in parallel.
+  static constexpr int kCredentialGenerationParallelism = 4;
+
   void GenerateCredentials(
       const Metadata& metadata, absl::string_view manager_app_id,
       const std::vector<nearby::internal::IdentityType>& identity_types,
@@ -120,6 +132,33 @@ class CredentialManagerImpl : public CredentialManager {
   CreateLocalCredential(const Metadata& metadata, IdentityType identity_type,
                         absl::Time start_time, absl::Time end_time);
 
+  using CredentialPairs = std::vector<std::pair<
+      nearby::internal::LocalCredential, nearby::internal::SharedCredential>>;
+  using CreateLocalCredentialsCallback =
+      absl::AnyInvocable<void(CredentialPairs)>;
+
+  // Creates `count` contiguous credentials, each valid for `life_cycle`,
+  // starting at `start_time`. The credentials are created in parallel on the
+  // credential generation workers, and `callback` is called on one of them
+  // once all are ready.
+  void CreateLocalCredentialsAsync(const Metadata& metadata,
+                                   IdentityType identity_type,
+                                   absl::Time start_time,
+                                   absl::Duration life_cycle, int count,
+                                   CreateLocalCredentialsCallback callback);
+
+  // Blocking version of `CreateLocalCredentialsAsync`.
+  CredentialPairs CreateLocalCredentials(const Metadata& metadata,
+                                         IdentityType identity_type,
+                                         absl::Time start_time,
+                                         absl::Duration life_cycle, int count);
+
+  // Makes sure that key material for `count` credentials is, or will soon be,
+  // precomputed in the background. Credentials created later pick it up
+  // instead of generating keys themselves.
+  void PrecomputeKeyMaterial(int count)
+      ABSL_LOCKS_EXCLUDED(key_material_mutex_);
+
   nearby::internal::SharedCredential CreatePublicCredential(
       const nearby::internal::LocalCredential& private_credential,
       const Metadata& metadata, const std::vector<uint8_t>& public_key);
@@ -151,6 +190,21 @@ class CredentialManagerImpl : public CredentialManager {
   }
 
  private:
+  // The parts of a credential that don't depend on its validity period or on
+  // the device metadata. Generating them, the key pair in particular, is the
+  // expensive part of creating a credential.
+  struct KeyMaterial {
+    std::string key_seed;
+    std::string secret_id;
+    std::vector<uint8_t> private_key;
+    std::vector<uint8_t> public_key;
+    std::string metadata_encryption_key;
+  };
+
+  static KeyMaterial CreateKeyMaterial();
+  // Returns precomputed key material if there is any, otherwise generates it.
+  KeyMaterial TakeKeyMaterial() ABSL_LOCKS_EXCLUDED(key_material_mutex_);
+
   struct SubscriberKey {
     CredentialSelector credential_selector;
     PublicCredentialType public_credential_type;
@@ -187,6 +241,13 @@ class CredentialManagerImpl : public CredentialManager {
 
   bool WaitForLatch(absl::string_view method_name, CountDownLatch* latch);
 
+  // Saves credentials made by GenerateCredentials() and reports them.
+  void SaveGeneratedCredentials(
+      absl::string_view manager_app_id, absl::string_view account_name,
+      std::vector<CredentialPairs> credentials_per_identity_type,
+      GenerateCredentialsResultCallback credentials_generated_cb)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(*executor_);
+
   // The similar flow to check-expired-then-refill-if-needed is needed in both
   // GetLocalCredentials() and GetPublicCredentials(). The high level flow is:
   // check if there're expired creds from the result credentials list from
@@ -232,6 +293,13 @@ class CredentialManagerImpl : public CredentialManager {
   SingleThreadExecutor* executor_;
   std::unique_ptr<nearby::CredentialStorageImpl> credential_storage_ptr_;
   Metadata metadata_;
+  Mutex key_material_mutex_;
+  std::deque<KeyMaterial> precomputed_key_material_
+      ABSL_GUARDED_BY(key_material_mutex_);
+  // Key material that is precomputed or scheduled for precomputation.
+  int pending_key_material_ ABSL_GUARDED_BY(key_material_mutex_) = 0;
+  MultiThreadExecutor credential_generation_executor_{
+      kCredentialGenerationParallelism};
 };
 
 }  // namespace presence
@@ -24,6 +24,7 @@
 #include "gmock/gmock.h"
 #include "protobuf-matchers/protocol-buffer-matchers.h"
 #include "gtest/gtest.h"
+#include "absl/container/flat_hash_set.h"
 #include "absl/status/status.h"
 #include "absl/strings/escaping.h"
 #include "absl/strings/string_view.h"
@@ -124,14 +125,18 @@ class CredentialManagerImplTest : public ::testing::Test {
                         absl::string_view account_name,
                         IdentityType identity_type) {
     Metadata metadata = CreateTestMetadata(account_name);
+    CountDownLatch generated_latch(1);
 
     credential_manager_.GenerateCredentials(
         metadata, manager_app_id, {identity_type},
         /*credential_life_cycle_days=*/kExpectedPresenceCredentialValidDays,
         /*contigous_copy_of_credentials=*/1,
-        {[](absl::StatusOr<std::vector<SharedCredential>> credentials) {
+        {[generated_latch](absl::StatusOr<std::vector<SharedCredential>>
+                               credentials) mutable {
           EXPECT_OK(credentials);
+          generated_latch.CountDown();
         }});
+    generated_latch.Await();
   }
 
  protected:
@@ -190,6 +195,37 @@ TEST_F(CredentialManagerImplTest, CreateOneCredentialSuccessfully) {
   EXPECT_EQ(metadata.SerializeAsString(), decrypted_metadata);
 }
 
+TEST_F(CredentialManagerImplTest, CreateLocalCredentialsInParallel) {
+  Metadata metadata = CreateTestMetadata();
+  constexpr absl::Time kStartTime = absl::FromUnixSeconds(100000);
+  constexpr absl::Duration kLifeCycle = absl::Hours(24);
+  constexpr int kCount =
+      2 * CredentialManagerImpl::kCredentialGenerationParallelism;
+
+  auto credentials = credential_manager_.CreateLocalCredentials(
+      metadata, IDENTITY_TYPE_PRIVATE, kStartTime, kLifeCycle, kCount);
+
+  ASSERT_EQ(credentials.size(), kCount);
+  absl::flat_hash_set<std::string> secret_ids;
+  for (int i = 0; i < kCount; i++) {
+    const LocalCredential& private_credential = credentials[i].first;
+    const SharedCredential& public_credential = credentials[i].second;
+    EXPECT_EQ(private_credential.start_time_millis(),
+              absl::ToUnixMillis(kStartTime + i * kLifeCycle));
+    EXPECT_EQ(private_credential.end_time_millis(),
+              absl::ToUnixMillis(kStartTime + (i + 1) * kLifeCycle));
+    EXPECT_EQ(private_credential.secret_id(), public_credential.secret_id());
+    EXPECT_EQ(credential_manager_.DecryptMetadata(
+                  private_credential.metadata_encryption_key_v0(),
+                  public_credential.key_seed(),
+                  public_credential.encrypted_metadata_bytes_v0()),
+              metadata.SerializeAsString());
+    secret_ids.insert(private_credential.secret_id());
+  }
+  // Every credential got its own keys, precomputed or not.
+  EXPECT_EQ(secret_ids.size(), kCount);
+}
+
 TEST_F(CredentialManagerImplTest, GenerateCredentialsSuccessfully) {
   Metadata metadata = CreateTestMetadata();
   absl::StatusOr<std::vector<SharedCredential>> public_credentials;
@@ -197,13 +233,16 @@ TEST_F(CredentialManagerImplTest, GenerateCredentialsSuccessfully) {
   absl::Time previous_start_time;
   absl::Time previous_end_time;
 
+  CountDownLatch generated_latch(1);
   credential_manager_.GenerateCredentials(
       metadata, kManagerAppId, identityTypes,
       kExpectedPresenceCredentialValidDays, kExpectedPresenceCredentialListSize,
       {.credentials_generated_cb =
            [&](absl::StatusOr<std::vector<SharedCredential>> credentials) {
              public_credentials = std::move(credentials);
+             generated_latch.CountDown();
            }});
+  generated_latch.Await();
 
   EXPECT_OK(public_credentials);
   EXPECT_EQ(public_credentials->size(), kExpectedPresenceCredentialListSize);
@@ -325,18 +364,21 @@ TEST_F(CredentialManagerImplTest,
             callback.credentials_saved_cb(
                 absl::FailedPreconditionError("Expected failure"));
           }));
-  credential_manager_ =
-      CredentialManagerImpl(&executor_, std::move(credential_storage_ptr));
+  CredentialManagerImpl credential_manager(&executor_,
+                                           std::move(credential_storage_ptr));
   absl::StatusOr<std::vector<SharedCredential>> public_credentials;
   std::vector<IdentityType> identityTypes{IDENTITY_TYPE_PRIVATE};
 
-  credential_manager_.GenerateCredentials(
+  CountDownLatch generated_latch(1);
+  credential_manager.GenerateCredentials(
       metadata, kManagerAppId, identityTypes,
       kExpectedPresenceCredentialValidDays, kExpectedPresenceCredentialListSize,
       {.credentials_generated_cb =
            [&](absl::StatusOr<std::vector<SharedCredential>> credentials) {
              public_credentials = std::move(credentials);
+             generated_latch.CountDown();
            }});
+  generated_latch.Await();
   EXPECT_THAT(public_credentials,
               StatusIs(absl::StatusCode::kFailedPrecondition));
 }
@@ -450,13 +492,16 @@ TEST_F(CredentialManagerImplTest, GetCredentialsSuccessfully) {
   absl::StatusOr<std::vector<LocalCredential>> private_credentials;
   CredentialSelector credential_selector = BuildDefaultCredentialSelector();
 
+  CountDownLatch generated_latch(1);
   credential_manager_.GenerateCredentials(
       metadata, kManagerAppId, identity_types,
       kExpectedPresenceCredentialValidDays, kExpectedPresenceCredentialListSize,
       {.credentials_generated_cb =
            [&](absl::StatusOr<std::vector<SharedCredential>> credentials) {
              public_credentials = std::move(credentials);
+             generated_latch.CountDown();
            }});
+  generated_latch.Await();
   credential_manager_.GetLocalCredentials(
       credential_selector,
       {.credentials_fetched_cb =
@@ -483,13 +528,16 @@ TEST_F(CredentialManagerImplTest, PublicCredentialsFailEncryption) {
              absl::string_view metadata_string) { return ""; }));
   std::vector<IdentityType> identity_types{IDENTITY_TYPE_PRIVATE};
 
+  CountDownLatch generated_latch(1);
   credential_manager_ptr->GenerateCredentials(
       metadata, kManagerAppId, identity_types,
       kExpectedPresenceCredentialValidDays, 1,
       {.credentials_generated_cb =
            [&](absl::StatusOr<std::vector<SharedCredential>> credentials) {
              public_credentials = std::move(credentials);
+             generated_latch.CountDown();
            }});
+  generated_latch.Await();
 
   EXPECT_THAT(public_credentials, StatusIs(absl::StatusCode::kInvalidArgument));
 }
@@ -506,6 +554,7 @@ TEST_F(CredentialManagerImplTest, UpdateLocalCredential) {
   absl::StatusOr<std::vector<LocalCredential>> private_credentials;
   absl::StatusOr<std::vector<LocalCredential>> modified_private_credentials;
   CredentialSelector credential_selector = BuildDefaultCredentialSelector();
+  CountDownLatch generated_latch(1);
   credential_manager_.GenerateCredentials(
       metadata, kManagerAppId, identity_types,
       kExpectedPresenceCredentialValidDays, kExpectedPresenceCredentialListSize,
@@ -513,7 +562,9 @@ TEST_F(CredentialManagerImplTest, UpdateLocalCredential) {
            [&](absl::StatusOr<std::vector<nearby::internal::SharedCredential>>
                    credentials) {
              public_credentials = std::move(credentials);
+             generated_latch.CountDown();
            }});
+  generated_latch.Await();
   credential_manager_.GetLocalCredentials(
       credential_selector,
       {.credentials_fetched_cb =
@@ -586,13 +637,16 @@ TEST_F(CredentialManagerImplTest, RefillCredentailInGetLocalCredentials) {
   absl::StatusOr<std::vector<LocalCredential>> private_credentials;
   CredentialSelector credential_selector = BuildDefaultCredentialSelector();
 
+  CountDownLatch generated_latch(1);
   credential_manager_.GenerateCredentials(
       metadata, kManagerAppId, identity_types,
       kExpectedPresenceCredentialValidDays, 1,
       {.credentials_generated_cb =
            [&](absl::StatusOr<std::vector<SharedCredential>> credentials) {
              public_credentials = std::move(credentials);
+             generated_latch.CountDown();
            }});
+  generated_latch.Await();
 
   EXPECT_OK(public_credentials);
   EXPECT_EQ(public_credentials->size(), 1);
@@ -617,13 +671,16 @@ TEST_F(CredentialManagerImplTest, RefillCredentailInGetSharedCredentials) {
   absl::StatusOr<std::vector<SharedCredential>> refilled_public_credentials;
   CredentialSelector credential_selector = BuildDefaultCredentialSelector();
 
+  CountDownLatch generated_latch(1);
   credential_manager_.GenerateCredentials(
       metadata, kManagerAppId, identity_types,
       kExpectedPresenceCredentialValidDays, 1,
       {.credentials_generated_cb =
            [&](absl::StatusOr<std::vector<SharedCredential>> credentials) {
              public_credentials = std::move(credentials);
+             generated_latch.CountDown();
            }});
+  generated_latch.Await();
 
   EXPECT_OK(public_credentials);
   EXPECT_EQ(public_credentials->size(), 1);
@@ -650,13 +707,16 @@ TEST_F(CredentialManagerImplTest, RefillExpiredCredsInGetLocal) {
   absl::StatusOr<std::vector<LocalCredential>> private_credentials;
   CredentialSelector credential_selector = BuildDefaultCredentialSelector();
 
+  CountDownLatch generated_latch(1);
   credential_manager_.GenerateCredentials(
       metadata, kManagerAppId, identity_types,
       kExpectedPresenceCredentialValidDays, kExpectedPresenceCredentialListSize,
       {.credentials_generated_cb =
            [&](absl::StatusOr<std::vector<SharedCredential>> credentials) {
              public_credentials = std::move(credentials);
+             generated_latch.CountDown();
            }});
+  generated_latch.Await();
 
   ASSERT_OK(public_credentials);
   EXPECT_EQ(public_credentials->size(), kExpectedPresenceCredentialListSize);
@@ -21,7 +21,9 @@
 #include <utility>
 #include <vector>
 
+#include "absl/container/flat_hash_set.h"
 #include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
 #include "absl/types/variant.h"
 #include "internal/platform/implementation/crypto.h"
 #include "internal/platform/future.h"
@@ -42,6 +44,16 @@ using BleAdvertisementData = ::nearby::api::ble_v2::BleAdvertisementData;
 using BlePeripheral = ::nearby::api::ble_v2::BlePeripheral;
 using ScanningSession = ::nearby::api::ble_v2::BleMedium::ScanningSession;
 using ScanningCallback = ::nearby::api::ble_v2::BleMedium::ScanningCallback;
+
+void AppendCredentials(
+    std::string& out,
+    const std::vector<::nearby::internal::SharedCredential>& credentials) {
+  absl::StrAppend(&out, credentials.size(), ":");
+  for (const auto& credential : credentials) {
+    std::string serialized = credential.SerializeAsString();
+    absl::StrAppend(&out, serialized.size(), ":", serialized);
+  }
+}
 }  // namespace
 
 ScanSessionId ScanManager::StartScan(ScanRequest scan_request,
@@ -70,13 +82,20 @@ ScanSessionId ScanManager::StartScan(ScanRequest scan_request,
                               });
                     }};
             FetchCredentials(id, scan_request);
-            scan_sessions_.insert(
-                {id, ScanSessionState{
-                         .request = scan_request,
-                         .callback = std::move(scan_callback),
-                         .decoder = AdvertisementDecoder(scan_request),
-                         .scanning_session = mediums_->GetBle().StartScanning(
-                             scan_request, std::move(callback))}});
+            auto it =
+                scan_sessions_
+                    .insert({id, ScanSessionState{
+                                     .request = scan_request,
+                                     .callback = std::move(scan_callback),
+                                     .decoder =
+                                         AdvertisementDecoder(scan_request),
+                                     .scanning_session =
+                                         mediums_->GetBle().StartScanning(
+                                             scan_request,
+                                             std::move(callback))}})
+                    .first;
+            it->second.credential_generation =
+                GetCredentialGeneration(it->second);
           });
   return id;
 }
@@ -95,6 +114,7 @@ void ScanManager::StopScan(ScanSessionId id) {
           }
         }
         scan_sessions_.erase(it);
+        PruneCredentialGenerations();
       });
 }
 
@@ -106,7 +126,9 @@ void ScanManager::NotifyFoundBle(ScanSessionId id, BleAdvertisementData data,
   if (it == scan_sessions_.end()) {
     return;
   }
-  auto advert = it->second.decoder.DecodeAdvertisement(advertisement_data);
+  const absl::StatusOr<Advertisement>& advert = decode_cache_.GetOrDecode(
+      advertisement_data, it->second.credential_generation,
+      it->second.decoder);
   if (!advert.ok()) {
     // This advertisement is not relevant to the current element, skip.
     return;
@@ -177,6 +199,57 @@ void ScanManager::UpdateCredentials(ScanSessionId id,
   ScanSessionState& session = it->second;
   session.credentials[identity_type] = std::move(credentials);
   session.decoder = AdvertisementDecoder(session.request, &session.credentials);
+  session.credential_generation = GetCredentialGeneration(session);
+  PruneCredentialGenerations();
+}
+
+uint64_t ScanManager::GetCredentialGeneration(
+    const ScanSessionState& session) {
+  // Describes everything AdvertisementDecoder takes into account: the identity
+  // types it accepts, credentials from legacy scan filters and the fetched
+  // credentials, if any.
+  std::vector<IdentityType> identity_types = session.request.identity_types;
+  std::sort(identity_types.begin(), identity_types.end());
+  std::string description = absl::StrCat(identity_types.size(), ":");
+  for (IdentityType identity_type : identity_types) {
+    absl::StrAppend(&description, identity_type, ",");
+  }
+  for (const auto& scan_filter : session.request.scan_filters) {
+    if (absl::holds_alternative<LegacyPresenceScanFilter>(scan_filter)) {
+      AppendCredentials(description, absl::get<LegacyPresenceScanFilter>(
+                                         scan_filter)
+                                         .remote_public_credentials);
+    }
+  }
+  std::vector<IdentityType> fetched_types;
+  for (const auto& [identity_type, credentials] : session.credentials) {
+    fetched_types.push_back(identity_type);
+  }
+  std::sort(fetched_types.begin(), fetched_types.end());
+  for (IdentityType identity_type : fetched_types) {
+    absl::StrAppend(&description, identity_type, "=");
+    AppendCredentials(description, session.credentials.at(identity_type));
+  }
+  auto [it, inserted] = credential_generations_.emplace(
+      std::move(description), next_credential_generation_);
+  if (inserted) ++next_credential_generation_;
+  return it->second;
+}
+
+void ScanManager::PruneCredentialGenerations() {
+  absl::flat_hash_set<uint64_t> in_use;
+  for (const auto& [id, session] : scan_sessions_) {
+    in_use.insert(session.credential_generation);
+  }
+  for (auto it = credential_generations_.begin();
+       it != credential_generations_.end();) {
+    if (in_use.contains(it->second)) {
+      ++it;
+      continue;
+    }
+    decode_cache_.EraseGeneration(it->second);
+    credential_generations_.erase(it++);
+  }
 }
 
 int ScanManager::ScanningCallbacksLengthForTest() {
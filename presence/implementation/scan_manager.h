@@ -25,6 +25,7 @@
 #include "internal/platform/single_thread_executor.h"
 #include "internal/proto/credential.pb.h"
 #include "presence/data_types.h"
+#include "presence/implementation/advertisement_decode_cache.h"
 #include "presence/implementation/advertisement_decoder.h"
 #include "presence/implementation/credential_manager.h"
 #include "presence/implementation/mediums/mediums.h"
@@ -66,6 +67,9 @@ class ScanManager {
     absl::flat_hash_map<IdentityType, std::vector<SharedCredential>>
         credentials;
     AdvertisementDecoder decoder;
+    // Sessions decoding with the same identity types and credentials share a
+    // generation, and with it their entries in `decode_cache_`.
+    uint64_t credential_generation = 0;
     std::unique_ptr<ScanningSession> scanning_session;
   };
   void NotifyFoundBle(ScanSessionId id, BleAdvertisementData data,
@@ -76,6 +80,13 @@ class ScanManager {
   void UpdateCredentials(ScanSessionId id, IdentityType identity_type,
                          std::vector<SharedCredential> credentials)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(*executor_);
+  // Returns the credential set generation matching what `session` decodes
+  // with, allocating a new one for a credential set not seen before.
+  uint64_t GetCredentialGeneration(const ScanSessionState& session)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(*executor_);
+  // Forgets generations no longer used by any session, along with their
+  // cached advertisements.
+  void PruneCredentialGenerations() ABSL_EXCLUSIVE_LOCKS_REQUIRED(*executor_);
   void RunOnServiceControllerThread(absl::string_view name, Runnable runnable) {
     executor_->Execute(std::string(name), std::move(runnable));
   }
@@ -83,6 +94,11 @@ class ScanManager {
   CredentialManager* credential_manager_;
   absl::flat_hash_map<ScanSessionId, ScanSessionState> scan_sessions_
       ABSL_GUARDED_BY(*executor_);
+  AdvertisementDecodeCache decode_cache_ ABSL_GUARDED_BY(*executor_);
+  // Canonical description of a credential set -> its generation.
+  absl::flat_hash_map<std::string, uint64_t> credential_generations_
+      ABSL_GUARDED_BY(*executor_);
+  uint64_t next_credential_generation_ ABSL_GUARDED_BY(*executor_) = 1;
   SingleThreadExecutor* executor_;
 };
 